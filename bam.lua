@@ -234,7 +234,12 @@ function build(settings)
 	tools = {}
 	for i,v in ipairs(tools_src) do
 		toolname = PathFilename(PathBase(v))
-		tools[i] = Link(settings, toolname, Compile(settings, v), engine, zlib, pnglite)
+		if toolname == "demo_analyze" then
+			-- needs the game's snapshot items and collision
+			tools[i] = Link(settings, toolname, Compile(settings, v), engine, game_shared, zlib, pnglite)
+		else
+			tools[i] = Link(settings, toolname, Compile(settings, v), engine, zlib, pnglite)
+		end
 	end
 
 	-- build client, server, version server and master server
@@ -1,5 +1,9 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+	#define _GNU_SOURCE /* for pthread_setaffinity_np and pthread_setname_np */
+#endif
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdarg.h>
@@ -18,6 +22,7 @@
 	/* unix net includes */
 	#include <sys/stat.h>
 	#include <sys/types.h>
+	#include <sys/mman.h>
 	#include <sys/socket.h>
 	#include <sys/ioctl.h>
 	#include <errno.h>
@@ -25,12 +30,15 @@
 	#include <netinet/in.h>
 	#include <fcntl.h>
 	#include <pthread.h>
+	#include <semaphore.h>
+	#include <sched.h>
 	#include <arpa/inet.h>
 
 	#include <dirent.h>
 
 	#if defined(CONF_PLATFORM_MACOSX)
 		#include <Carbon/Carbon.h>
+		#include <dispatch/dispatch.h>
 	#endif
 
 #elif defined(CONF_FAMILY_WINDOWS)
@@ -41,6 +49,8 @@
 	#include <ws2tcpip.h>
 	#include <fcntl.h>
 	#include <direct.h>
+	#include <io.h>
+	#include <sys/stat.h>
 	#include <errno.h>
 #else
 	#error NOT IMPLEMENTED
@@ -59,6 +69,8 @@ static int num_loggers = 0;
 
 static NETSTATS network_stats = {0};
 static MEMSTATS memory_stats = {0};
+static MEMTAGSTATS memory_tag_stats[NUM_MEMTAGS] = {{0}};
+static const char *memory_tag_names[NUM_MEMTAGS] = { "other", "network", "snapshot", "map", "entity", "demo" };
 
 static NETSOCKET invalid_socket = {NETTYPE_INVALID, -1, -1};
 
@@ -147,6 +159,7 @@ typedef struct MEMHEADER
 	const char *filename;
 	int line;
 	int size;
+	int tag;
 	struct MEMHEADER *prev;
 	struct MEMHEADER *next;
 } MEMHEADER;
@@ -159,7 +172,20 @@ typedef struct MEMTAIL
 static struct MEMHEADER *first = 0;
 static const int MEM_GUARD_VAL = 0xbaadc0de;
 
-void *mem_alloc_debug(const char *filename, int line, unsigned size, unsigned alignment)
+/* the allocation list is shared by all threads, jobs allocate too */
+#if defined(CONF_FAMILY_UNIX)
+static pthread_mutex_t mem_lock = PTHREAD_MUTEX_INITIALIZER;
+static void mem_lock_wait() { pthread_mutex_lock(&mem_lock); }
+static void mem_lock_release() { pthread_mutex_unlock(&mem_lock); }
+#elif defined(CONF_FAMILY_WINDOWS)
+static volatile LONG mem_lock = 0;
+static void mem_lock_wait() { while(InterlockedCompareExchange(&mem_lock, 1, 0) != 0) Sleep(0); }
+static void mem_lock_release() { InterlockedExchange(&mem_lock, 0); }
+#else
+	#error not implemented on this platform
+#endif
+
+void *mem_alloc_debug(const char *filename, int line, unsigned size, unsigned alignment, int tag)
 {
 	/* TODO: fix alignment */
 	/* TODO: add debugging */
@@ -168,18 +194,28 @@ void *mem_alloc_debug(const char *filename, int line, unsigned size, unsigned al
 	header->size = size;
 	header->filename = filename;
 	header->line = line;
+	header->tag = tag >= 0 && tag < NUM_MEMTAGS ? tag : MEMTAG_OTHER;
 
+	tail->guard = MEM_GUARD_VAL;
+
+	mem_lock_wait();
 	memory_stats.allocated += header->size;
 	memory_stats.total_allocations++;
 	memory_stats.active_allocations++;
-
-	tail->guard = MEM_GUARD_VAL;
+	{
+		MEMTAGSTATS *tag_stats = &memory_tag_stats[header->tag];
+		tag_stats->allocated += header->size;
+		tag_stats->active_allocations++;
+		if(tag_stats->allocated > tag_stats->peak_allocated)
+			tag_stats->peak_allocated = tag_stats->allocated;
+	}
 
 	header->prev = (MEMHEADER *)0;
 	header->next = first;
 	if(first)
 		first->prev = header;
 	first = header;
+	mem_lock_release();
 
 	/*dbg_msg("mem", "++ %p", header+1); */
 	return header+1;
@@ -195,8 +231,11 @@ void mem_free(void *p)
 		if(tail->guard != MEM_GUARD_VAL)
 			dbg_msg("mem", "!! %p", p);
 		/* dbg_msg("mem", "-- %p", p); */
+		mem_lock_wait();
 		memory_stats.allocated -= header->size;
 		memory_stats.active_allocations--;
+		memory_tag_stats[header->tag].allocated -= header->size;
+		memory_tag_stats[header->tag].active_allocations--;
 
 		if(header->prev)
 			header->prev->next = header->next;
@@ -204,6 +243,7 @@ void mem_free(void *p)
 			first = header->next;
 		if(header->next)
 			header->next->prev = header->prev;
+		mem_lock_release();
 
 		free(header);
 	}
@@ -212,18 +252,21 @@ void mem_free(void *p)
 void mem_debug_dump(IOHANDLE file)
 {
 	char buf[1024];
-	MEMHEADER *header = first;
+	MEMHEADER *header;
 	if(!file)
 		file = io_open("memory.txt", IOFLAG_WRITE);
 
 	if(file)
 	{
+		mem_lock_wait();
+		header = first;
 		while(header)
 		{
 			str_format(buf, sizeof(buf), "%s(%d): %d\n", header->filename, header->line, header->size);
 			io_write(file, buf, strlen(buf));
 			header = header->next;
 		}
+		mem_lock_release();
 
 		io_close(file);
 	}
@@ -247,17 +290,21 @@ void mem_zero(void *block,unsigned size)
 
 int mem_check_imp()
 {
-	MEMHEADER *header = first;
+	MEMHEADER *header;
+	mem_lock_wait();
+	header = first;
 	while(header)
 	{
 		MEMTAIL *tail = (MEMTAIL *)(((char*)(header+1))+header->size);
 		if(tail->guard != MEM_GUARD_VAL)
 		{
 			dbg_msg("mem", "Memory check failed at %s(%d): %d", header->filename, header->line, header->size);
+			mem_lock_release();
 			return 0;
 		}
 		header = header->next;
 	}
+	mem_lock_release();
 
 	return 1;
 }
@@ -334,6 +381,23 @@ long int io_length(IOHANDLE io)
 	return length;
 }
 
+long int io_mtime(IOHANDLE io)
+{
+#if defined(CONF_FAMILY_UNIX)
+	struct stat sb;
+	if(fstat(fileno((FILE*)io), &sb) != 0)
+		return -1;
+	return (long int)sb.st_mtime;
+#elif defined(CONF_FAMILY_WINDOWS)
+	struct _stat64 sb;
+	if(_fstat64(_fileno((FILE*)io), &sb) != 0)
+		return -1;
+	return (long int)sb.st_mtime;
+#else
+	#error not implemented
+#endif
+}
+
 unsigned io_write(IOHANDLE io, const void *buffer, unsigned size)
 {
 	return fwrite(buffer, 1, size, (FILE*)io);
@@ -351,6 +415,52 @@ int io_flush(IOHANDLE io)
 	return 0;
 }
 
+void *io_map(IOHANDLE io, unsigned *size)
+{
+	long int length = io_length(io);
+	*size = 0;
+	if(length <= 0)
+		return 0;
+
+#if defined(CONF_FAMILY_UNIX)
+	{
+		void *data = mmap(0, (size_t)length, PROT_READ, MAP_PRIVATE, fileno((FILE*)io), 0);
+		if(data == MAP_FAILED)
+			return 0;
+		*size = (unsigned)length;
+		return data;
+	}
+#elif defined(CONF_FAMILY_WINDOWS)
+	{
+		void *data;
+		HANDLE mapping = CreateFileMapping((HANDLE)_get_osfhandle(_fileno((FILE*)io)), NULL, PAGE_READONLY, 0, 0, NULL);
+		if(!mapping)
+			return 0;
+		data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(mapping); /* the view keeps the mapping alive */
+		if(!data)
+			return 0;
+		*size = (unsigned)length;
+		return data;
+	}
+#else
+	#error not implemented
+#endif
+}
+
+void io_unmap(void *data, unsigned size)
+{
+	if(!data)
+		return;
+#if defined(CONF_FAMILY_UNIX)
+	munmap(data, size);
+#elif defined(CONF_FAMILY_WINDOWS)
+	UnmapViewOfFile(data);
+#else
+	#error not implemented
+#endif
+}
+
 void *thread_create(void (*threadfunc)(void *), void *u)
 {
 #if defined(CONF_FAMILY_UNIX)
@@ -418,6 +528,55 @@ void thread_detach(void *thread)
 #endif
 }
 
+void thread_set_name(const char *name)
+{
+#if defined(CONF_PLATFORM_LINUX)
+	char buf[16];
+	str_copy(buf, name, sizeof(buf));
+	pthread_setname_np(pthread_self(), buf);
+#elif defined(CONF_PLATFORM_MACOSX)
+	pthread_setname_np(name);
+#else
+	/* no way to name threads that works on all versions */
+	(void)name;
+#endif
+}
+
+int thread_set_affinity(int cpu)
+{
+	if(cpu < 0 || cpu >= cpu_count())
+		return -1;
+#if defined(CONF_PLATFORM_LINUX)
+	{
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0 ? 0 : -1;
+	}
+#elif defined(CONF_FAMILY_WINDOWS)
+	if(cpu >= (int)sizeof(DWORD_PTR)*8)
+		return -1;
+	return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1<<cpu) ? 0 : -1;
+#else
+	/* mac os x and the bsds only take hints */
+	return -1;
+#endif
+}
+
+int cpu_count()
+{
+#if defined(CONF_FAMILY_UNIX)
+	long num = sysconf(_SC_NPROCESSORS_ONLN);
+	return num > 0 ? (int)num : 1;
+#elif defined(CONF_FAMILY_WINDOWS)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+#else
+	#error not implemented
+#endif
+}
+
 
 
 
@@ -488,6 +647,200 @@ void lock_release(LOCK lock)
 #endif
 }
 
+#if defined(CONF_PLATFORM_MACOSX)
+SEMAPHORE semaphore_create() { return (SEMAPHORE)dispatch_semaphore_create(0); }
+void semaphore_destroy(SEMAPHORE sem) { dispatch_release((dispatch_semaphore_t)sem); }
+void semaphore_wait(SEMAPHORE sem) { dispatch_semaphore_wait((dispatch_semaphore_t)sem, DISPATCH_TIME_FOREVER); }
+void semaphore_signal(SEMAPHORE sem) { dispatch_semaphore_signal((dispatch_semaphore_t)sem); }
+#elif defined(CONF_FAMILY_UNIX)
+SEMAPHORE semaphore_create()
+{
+	sem_t *sem = (sem_t *)mem_alloc(sizeof(sem_t), 4);
+	sem_init(sem, 0, 0);
+	return (SEMAPHORE)sem;
+}
+
+void semaphore_destroy(SEMAPHORE sem)
+{
+	sem_destroy((sem_t *)sem);
+	mem_free(sem);
+}
+
+void semaphore_wait(SEMAPHORE sem)
+{
+	/* a signal handler may interrupt the wait */
+	while(sem_wait((sem_t *)sem) != 0 && errno == EINTR)
+		;
+}
+
+void semaphore_signal(SEMAPHORE sem) { sem_post((sem_t *)sem); }
+#elif defined(CONF_FAMILY_WINDOWS)
+SEMAPHORE semaphore_create() { return (SEMAPHORE)CreateSemaphore(NULL, 0, 0x7fffffff, NULL); }
+void semaphore_destroy(SEMAPHORE sem) { CloseHandle((HANDLE)sem); }
+void semaphore_wait(SEMAPHORE sem) { WaitForSingleObject((HANDLE)sem, INFINITE); }
+void semaphore_signal(SEMAPHORE sem) { ReleaseSemaphore((HANDLE)sem, 1, NULL); }
+#else
+	#error not implemented on this platform
+#endif
+
+#if defined(CONF_FAMILY_UNIX)
+CONDVAR condvar_create()
+{
+	pthread_cond_t *cond = (pthread_cond_t *)mem_alloc(sizeof(pthread_cond_t), 4);
+	pthread_cond_init(cond, 0x0);
+	return (CONDVAR)cond;
+}
+
+void condvar_destroy(CONDVAR cond)
+{
+	pthread_cond_destroy((pthread_cond_t *)cond);
+	mem_free(cond);
+}
+
+void condvar_wait(CONDVAR cond, LOCK lock) { pthread_cond_wait((pthread_cond_t *)cond, (LOCKINTERNAL *)lock); }
+void condvar_signal(CONDVAR cond) { pthread_cond_signal((pthread_cond_t *)cond); }
+void condvar_broadcast(CONDVAR cond) { pthread_cond_broadcast((pthread_cond_t *)cond); }
+#elif defined(CONF_FAMILY_WINDOWS)
+/* windows xp has no condition variables, so they are built on a semaphore.
+	a signal may wake a thread that started waiting after it, which is fine
+	as waiters have to check their condition again anyway */
+typedef struct
+{
+	volatile LONG waiters;
+	HANDLE sem;
+} CONDVARINTERNAL;
+
+CONDVAR condvar_create()
+{
+	CONDVARINTERNAL *cond = (CONDVARINTERNAL *)mem_alloc(sizeof(CONDVARINTERNAL), 4);
+	cond->waiters = 0;
+	cond->sem = CreateSemaphore(NULL, 0, 0x7fffffff, NULL);
+	return (CONDVAR)cond;
+}
+
+void condvar_destroy(CONDVAR cond)
+{
+	CloseHandle(((CONDVARINTERNAL *)cond)->sem);
+	mem_free(cond);
+}
+
+void condvar_wait(CONDVAR cond, LOCK lock)
+{
+	CONDVARINTERNAL *c = (CONDVARINTERNAL *)cond;
+	InterlockedIncrement(&c->waiters);
+	LeaveCriticalSection((LPCRITICAL_SECTION)lock);
+	WaitForSingleObject(c->sem, INFINITE);
+	EnterCriticalSection((LPCRITICAL_SECTION)lock);
+}
+
+void condvar_signal(CONDVAR cond)
+{
+	CONDVARINTERNAL *c = (CONDVARINTERNAL *)cond;
+	LONG waiters;
+	do
+	{
+		waiters = c->waiters;
+		if(waiters <= 0)
+			return;
+	}
+	while(InterlockedCompareExchange(&c->waiters, waiters-1, waiters) != waiters);
+	ReleaseSemaphore(c->sem, 1, NULL);
+}
+
+void condvar_broadcast(CONDVAR cond)
+{
+	CONDVARINTERNAL *c = (CONDVARINTERNAL *)cond;
+	LONG waiters = InterlockedExchange(&c->waiters, 0);
+	if(waiters > 0)
+		ReleaseSemaphore(c->sem, waiters, NULL);
+}
+#else
+	#error not implemented on this platform
+#endif
+
+#if defined(CONF_FAMILY_UNIX)
+TLSKEY tls_create()
+{
+	pthread_key_t *key = (pthread_key_t *)mem_alloc(sizeof(pthread_key_t), 4);
+	pthread_key_create(key, 0x0);
+	return (TLSKEY)key;
+}
+
+void tls_destroy(TLSKEY key)
+{
+	pthread_key_delete(*(pthread_key_t *)key);
+	mem_free(key);
+}
+
+void tls_set(TLSKEY key, void *value) { pthread_setspecific(*(pthread_key_t *)key, value); }
+void *tls_get(TLSKEY key) { return pthread_getspecific(*(pthread_key_t *)key); }
+#elif defined(CONF_FAMILY_WINDOWS)
+/* the slot index is stored in the handle itself */
+TLSKEY tls_create() { return (TLSKEY)(size_t)TlsAlloc(); }
+void tls_destroy(TLSKEY key) { TlsFree((DWORD)(size_t)key); }
+void tls_set(TLSKEY key, void *value) { TlsSetValue((DWORD)(size_t)key, value); }
+void *tls_get(TLSKEY key) { return TlsGetValue((DWORD)(size_t)key); }
+#else
+	#error not implemented on this platform
+#endif
+
+int atomic_inc(volatile int *value)
+{
+#if defined(CONF_FAMILY_WINDOWS)
+	return InterlockedIncrement((volatile LONG *)value);
+#elif defined(__GNUC__)
+	return __sync_add_and_fetch(value, 1);
+#else
+	#error not implemented on this platform
+#endif
+}
+
+int atomic_dec(volatile int *value)
+{
+#if defined(CONF_FAMILY_WINDOWS)
+	return InterlockedDecrement((volatile LONG *)value);
+#elif defined(__GNUC__)
+	return __sync_sub_and_fetch(value, 1);
+#else
+	#error not implemented on this platform
+#endif
+}
+
+int atomic_compare_swap(volatile int *value, int expected, int desired)
+{
+#if defined(CONF_FAMILY_WINDOWS)
+	return InterlockedCompareExchange((volatile LONG *)value, desired, expected);
+#elif defined(__GNUC__)
+	return __sync_val_compare_and_swap(value, expected, desired);
+#else
+	#error not implemented on this platform
+#endif
+}
+
+int atomic_exchange(volatile int *value, int desired)
+{
+#if defined(CONF_FAMILY_WINDOWS)
+	return InterlockedExchange((volatile LONG *)value, desired);
+#elif defined(__GNUC__)
+	/* __sync_lock_test_and_set is only an acquire barrier */
+	__sync_synchronize();
+	return __sync_lock_test_and_set(value, desired);
+#else
+	#error not implemented on this platform
+#endif
+}
+
+void sync_barrier()
+{
+#if defined(CONF_FAMILY_WINDOWS)
+	MemoryBarrier();
+#elif defined(__GNUC__)
+	__sync_synchronize();
+#else
+	#error not implemented on this platform
+#endif
+}
+
 /* -----  time ----- */
 int64 time_get()
 {
@@ -745,7 +1098,9 @@ int net_addr_from_str(NETADDR *addr, const char *string)
 				return -1;
 		}
 #else
-		if(inet_pton(AF_INET6, buf, &sa6) != 1)
+		mem_zero(&sa6, sizeof(sa6));
+		sa6.sin6_family = AF_INET6;
+		if(inet_pton(AF_INET6, buf, &sa6.sin6_addr) != 1)
 			return -1;
 #endif
 		sockaddr_to_netaddr((struct sockaddr *)&sa6, addr);
@@ -1713,6 +2068,20 @@ const MEMSTATS *mem_stats()
 	return &memory_stats;
 }
 
+const MEMTAGSTATS *mem_tag_stats(int tag)
+{
+	if(tag < 0 || tag >= NUM_MEMTAGS)
+		tag = MEMTAG_OTHER;
+	return &memory_tag_stats[tag];
+}
+
+const char *mem_tag_name(int tag)
+{
+	if(tag < 0 || tag >= NUM_MEMTAGS)
+		return "unknown";
+	return memory_tag_names[tag];
+}
+
 void net_stats(NETSTATS *stats_inout)
 {
 	*stats_inout = network_stats;
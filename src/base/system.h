@@ -64,6 +64,18 @@ void dbg_msg(const char *sys, const char *fmt, ...);
 
 /* Group: Memory */
 
+/* subsystems the allocations are accounted to */
+enum
+{
+	MEMTAG_OTHER=0,
+	MEMTAG_NETWORK,
+	MEMTAG_SNAPSHOT,
+	MEMTAG_MAP,
+	MEMTAG_ENTITY,
+	MEMTAG_DEMO,
+	NUM_MEMTAGS
+};
+
 /*
 	Function: mem_alloc
 		Allocates memory.
@@ -83,8 +95,20 @@ void dbg_msg(const char *sys, const char *fmt, ...);
 	See Also:
 		<mem_free>
 */
-void *mem_alloc_debug(const char *filename, int line, unsigned size, unsigned alignment);
-#define mem_alloc(s,a) mem_alloc_debug(__FILE__, __LINE__, (s), (a))
+void *mem_alloc_debug(const char *filename, int line, unsigned size, unsigned alignment, int tag);
+#define mem_alloc(s,a) mem_alloc_debug(__FILE__, __LINE__, (s), (a), MEMTAG_OTHER)
+
+/*
+	Function: mem_alloc_tagged
+		Allocates memory like <mem_alloc> and accounts it to a
+		subsystem, see <mem_tag_stats>.
+
+	Parameters:
+		size - Size of the needed block.
+		alignment - Alignment for the block.
+		tag - One of the MEMTAG_* values.
+*/
+#define mem_alloc_tagged(s,a,t) mem_alloc_debug(__FILE__, __LINE__, (s), (a), (t))
 
 /*
 	Function: mem_free
@@ -277,6 +301,18 @@ long int io_tell(IOHANDLE io);
 */
 long int io_length(IOHANDLE io);
 
+/*
+	Function: io_mtime
+		Gets the last modification time of the file.
+
+	Parameters:
+		io - Handle to the file.
+
+	Returns:
+		Returns the modification time in seconds since the epoch. -1L if an error occured.
+*/
+long int io_mtime(IOHANDLE io);
+
 /*
 	Function: io_close
 		Closes a file.
@@ -301,6 +337,36 @@ int io_close(IOHANDLE io);
 */
 int io_flush(IOHANDLE io);
 
+/*
+	Function: io_map
+		Maps the complete file read-only into memory.
+
+	Parameters:
+		io - Handle to the file.
+		size - Pointer that receives the size of the mapping.
+
+	Returns:
+		Returns a pointer to the mapped file contents or 0 on failure.
+
+	Remarks:
+		- The mapping stays valid after the file has been closed.
+		- Empty files can't be mapped.
+
+	See Also:
+		<io_unmap>
+*/
+void *io_map(IOHANDLE io, unsigned *size);
+
+/*
+	Function: io_unmap
+		Releases a mapping created by <io_map>.
+
+	Parameters:
+		data - Pointer returned by <io_map>.
+		size - Size of the mapping.
+*/
+void io_unmap(void *data, unsigned size);
+
 
 /*
 	Function: io_stdin
@@ -378,6 +444,36 @@ void thread_yield();
 */
 void thread_detach(void *thread);
 
+/*
+	Function: thread_set_name
+		Names the calling thread so debuggers and profilers can
+		tell it apart from the others.
+
+	Parameters:
+		name - Name of the thread, only the first 15 characters
+			are kept on some platforms.
+*/
+void thread_set_name(const char *name);
+
+/*
+	Function: thread_set_affinity
+		Pins the calling thread to one cpu.
+
+	Parameters:
+		cpu - Index of the cpu, from 0 to <cpu_count>-1.
+
+	Returns:
+		0 on success, -1 if the cpu doesn't exist or pinning
+		threads isn't supported on this platform.
+*/
+int thread_set_affinity(int cpu);
+
+/*
+	Function: cpu_count
+		Returns the number of cpus that are online, at least 1.
+*/
+int cpu_count();
+
 /* Group: Locks */
 typedef void* LOCK;
 
@@ -388,6 +484,122 @@ int lock_try(LOCK lock);
 void lock_wait(LOCK lock);
 void lock_release(LOCK lock);
 
+/* Group: Semaphores */
+typedef void* SEMAPHORE;
+
+/*
+	Function: semaphore_create
+		Creates a semaphore with a count of zero.
+*/
+SEMAPHORE semaphore_create();
+void semaphore_destroy(SEMAPHORE sem);
+
+/*
+	Function: semaphore_wait
+		Blocks until the count is above zero, then decrements it.
+*/
+void semaphore_wait(SEMAPHORE sem);
+
+/*
+	Function: semaphore_signal
+		Increments the count, waking up one waiting thread.
+*/
+void semaphore_signal(SEMAPHORE sem);
+
+/* Group: Condition variables */
+typedef void* CONDVAR;
+
+CONDVAR condvar_create();
+void condvar_destroy(CONDVAR cond);
+
+/*
+	Function: condvar_wait
+		Releases the lock, blocks until the condition variable is
+		signaled and takes the lock again before returning.
+
+	Parameters:
+		cond - Condition variable to wait on.
+		lock - Lock the calling thread holds.
+
+	Remarks:
+		The call may also return without a signal, so check on
+		what you wait for in a loop.
+*/
+void condvar_wait(CONDVAR cond, LOCK lock);
+
+/*
+	Function: condvar_signal
+		Wakes up one thread waiting on the condition variable.
+*/
+void condvar_signal(CONDVAR cond);
+
+/*
+	Function: condvar_broadcast
+		Wakes up all threads waiting on the condition variable.
+*/
+void condvar_broadcast(CONDVAR cond);
+
+/* Group: Thread local storage */
+typedef void* TLSKEY;
+
+/*
+	Function: tls_create
+		Creates a slot that holds one pointer per thread, it is
+		0 in every thread until set.
+*/
+TLSKEY tls_create();
+void tls_destroy(TLSKEY key);
+
+void tls_set(TLSKEY key, void *value);
+void *tls_get(TLSKEY key);
+
+/* Group: Atomics */
+
+/*
+	Function: atomic_inc
+		Increments a value shared between threads.
+
+	Returns:
+		The new value.
+*/
+int atomic_inc(volatile int *value);
+
+/*
+	Function: atomic_dec
+		Decrements a value shared between threads.
+
+	Returns:
+		The new value.
+*/
+int atomic_dec(volatile int *value);
+
+/*
+	Function: atomic_compare_swap
+		Sets a value shared between threads to desired if it is
+		still expected.
+
+	Returns:
+		The value before the call, the swap happened if it equals
+		expected.
+*/
+int atomic_compare_swap(volatile int *value, int expected, int desired);
+
+/*
+	Function: atomic_exchange
+		Sets a value shared between threads.
+
+	Returns:
+		The value before the call.
+*/
+int atomic_exchange(volatile int *value, int desired);
+
+/*
+	Function: sync_barrier
+		Makes sure all memory accesses before the call are done
+		before any after it.
+*/
+void sync_barrier();
+
 /* Group: Timer */
 #ifdef __GNUC__
 /* if compiled with -pedantic-errors it will complain about long
@@ -1166,6 +1378,29 @@ typedef struct
 
 const MEMSTATS *mem_stats();
 
+typedef struct
+{
+	int allocated;
+	int peak_allocated;
+	int active_allocations;
+} MEMTAGSTATS;
+
+/*
+	Function: mem_tag_stats
+		Returns the memory in use by one subsystem and the most
+		it ever used at once.
+
+	Parameters:
+		tag - One of the MEMTAG_* values.
+*/
+const MEMTAGSTATS *mem_tag_stats(int tag);
+
+/*
+	Function: mem_tag_name
+		Returns the name of a subsystem, like "network".
+*/
+const char *mem_tag_name(int tag);
+
 typedef struct
 {
 	int sent_packets;
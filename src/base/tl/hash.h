@@ -0,0 +1,300 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef BASE_TL_HASH_H
+#define BASE_TL_HASH_H
+
+#include <stddef.h>
+
+#include "base.h"
+#include "allocator.h"
+
+/*
+	Function: hash_mix
+		Spreads the bits of a value over the whole hash, so values
+		that only differ in their high bits end up in different slots.
+*/
+inline unsigned hash_mix(unsigned h)
+{
+	h ^= h >> 16;
+	h *= 0x7feb352du;
+	h ^= h >> 15;
+	h *= 0x846ca68bu;
+	h ^= h >> 16;
+	return h;
+}
+
+/*
+	Class: hash_traits
+		How a key is hashed and compared. Works for integers and for
+		pointers that are compared by address.
+*/
+template<class T>
+struct hash_traits
+{
+	static unsigned hash(const T &key) { return hash_mix((unsigned)(size_t)key); }
+	static bool equal(const T &a, const T &b) { return a == b; }
+};
+
+/*
+	Class: hash_traits<const char *>
+		Compares strings by content. The table only stores the pointer,
+		the string has to live as long as it is in the table.
+*/
+template<>
+struct hash_traits<const char *>
+{
+	static unsigned hash(const char *key) { return hash_mix(str_quickhash(key)); }
+	static bool equal(const char *a, const char *b) { return str_comp(a, b) == 0; }
+};
+
+/*
+	Class: hash_traits_nocase
+		Compares strings by content, ignoring the case like
+		<str_comp_nocase> does.
+*/
+struct hash_traits_nocase
+{
+	static unsigned hash(const char *key)
+	{
+		unsigned h = 5381;
+		for(; *key; key++)
+			h = ((h << 5) + h) + (unsigned char)str_uppercase(*key);
+		return hash_mix(h);
+	}
+	static bool equal(const char *a, const char *b) { return str_comp_nocase(a, b) == 0; }
+};
+
+/*
+	Class: hash_range
+		Visits the used slots of a hash table, in no particular order.
+
+	Concepts:
+		<concept_empty>
+		<concept_forwarditeration>
+*/
+template<class SLOT>
+class hash_range
+{
+public:
+	typedef SLOT type;
+
+	hash_range()
+	{
+		begin = 0x0;
+		end = 0x0;
+	}
+
+	hash_range(SLOT *b, SLOT *e)
+	{
+		begin = b;
+		end = e;
+		skip();
+	}
+
+	bool empty() const { return begin >= end; }
+	void pop_front() { assert(!empty()); begin++; skip(); }
+	SLOT& front() { assert(!empty()); return *begin; }
+
+protected:
+	void skip()
+	{
+		while(begin < end && !begin->used)
+			begin++;
+	}
+
+	SLOT *begin;
+	SLOT *end;
+};
+
+/*
+	Class: hash_table
+		Open addressing with linear probing, the base of <hash_map>
+		and <hash_set>. SLOT needs the members key, hash and used.
+
+	Remarks:
+		- The number of slots is a power of two and doubles once
+		  three quarters are used.
+		- Removing moves the following slots of the same run back
+		  instead of leaving tombstones, so lookups never slow down.
+		- New slots have to be unused when default constructed.
+		- Adding and removing items invalidates ranges and pointers
+		  into the table.
+*/
+template <class SLOT, class KEY, class TRAITS, class ALLOCATOR>
+class hash_table : protected ALLOCATOR
+{
+public:
+	typedef hash_range<SLOT> range;
+
+	hash_table()
+	{
+		slots = 0x0;
+		num_slots = 0;
+		num_elements = 0;
+	}
+
+	hash_table(const hash_table &other)
+	{
+		slots = 0x0;
+		num_slots = 0;
+		num_elements = 0;
+		*this = other;
+	}
+
+	~hash_table()
+	{
+		ALLOCATOR::free_array(slots);
+	}
+
+	hash_table &operator = (const hash_table &other)
+	{
+		if(this == &other)
+			return *this;
+		ALLOCATOR::free_array(slots);
+		slots = 0x0;
+		num_slots = other.num_slots;
+		num_elements = other.num_elements;
+		if(num_slots)
+		{
+			slots = ALLOCATOR::alloc_array(num_slots);
+			for(int i = 0; i < num_slots; i++)
+				slots[i] = other.slots[i];
+		}
+		return *this;
+	}
+
+	/*
+		Function: size
+	*/
+	int size() const { return num_elements; }
+
+	/*
+		Function: clear
+			Removes all items and frees the slots.
+	*/
+	void clear()
+	{
+		ALLOCATOR::free_array(slots);
+		slots = 0x0;
+		num_slots = 0;
+		num_elements = 0;
+	}
+
+	/*
+		Function: hint_size
+			Makes room for the number of items wanted, so adding
+			them doesn't need to grow the table.
+	*/
+	void hint_size(int hint)
+	{
+		int wanted = num_slots ? num_slots : 8;
+		while(wanted/4*3 < hint)
+			wanted *= 2;
+		if(wanted > num_slots)
+			rehash(wanted);
+	}
+
+	/*
+		Function: memusage
+			Returns how much memory the table is using
+	*/
+	int memusage() const
+	{
+		return sizeof(hash_table) + sizeof(SLOT)*num_slots;
+	}
+
+	/*
+		Function: all
+			Returns a range over all items.
+	*/
+	range all() { return range(slots, slots+num_slots); }
+
+protected:
+	int home(unsigned hash) const { return (int)(hash&(num_slots-1)); }
+
+	int find_slot(const KEY &key) const
+	{
+		if(!num_elements)
+			return -1;
+
+		unsigned hash = TRAITS::hash(key);
+		for(int i = home(hash); slots[i].used; i = (i+1)&(num_slots-1))
+		{
+			if(slots[i].hash == hash && TRAITS::equal(slots[i].key, key))
+				return i;
+		}
+		return -1;
+	}
+
+	// returns the slot of the key, new ones are marked as used with the key set
+	int insert_slot(const KEY &key, bool *pNew)
+	{
+		// grow first, so the index stays valid
+		if((num_elements+1)*4 > num_slots*3)
+			rehash(num_slots ? num_slots*2 : 8);
+
+		unsigned hash = TRAITS::hash(key);
+		int i = home(hash);
+		for(; slots[i].used; i = (i+1)&(num_slots-1))
+		{
+			if(slots[i].hash == hash && TRAITS::equal(slots[i].key, key))
+			{
+				*pNew = false;
+				return i;
+			}
+		}
+
+		slots[i].key = key;
+		slots[i].hash = hash;
+		slots[i].used = true;
+		num_elements++;
+		*pNew = true;
+		return i;
+	}
+
+	void remove_slot(int index)
+	{
+		// pull back the following items of the run that would not be found past the gap
+		int gap = index;
+		for(int i = (index+1)&(num_slots-1); slots[i].used; i = (i+1)&(num_slots-1))
+		{
+			int h = home(slots[i].hash);
+			bool movable = gap <= i ? (h <= gap || h > i) : (h <= gap && h > i);
+			if(movable)
+			{
+				slots[gap] = slots[i];
+				gap = i;
+			}
+		}
+		slots[gap] = SLOT();
+		num_elements--;
+	}
+
+	void rehash(int new_num_slots)
+	{
+		SLOT *old_slots = slots;
+		int old_num_slots = num_slots;
+
+		slots = ALLOCATOR::alloc_array(new_num_slots);
+		num_slots = new_num_slots;
+
+		// the hashes are kept, so the keys don't need to be hashed again
+		for(int i = 0; i < old_num_slots; i++)
+		{
+			if(!old_slots[i].used)
+				continue;
+			int j = home(old_slots[i].hash);
+			while(slots[j].used)
+				j = (j+1)&(num_slots-1);
+			slots[j] = old_slots[i];
+		}
+
+		ALLOCATOR::free_array(old_slots);
+	}
+
+	SLOT *slots;
+	int num_slots;
+	int num_elements;
+};
+
+#endif // TL_FILE_HASH_HPP
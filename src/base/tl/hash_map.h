@@ -0,0 +1,106 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef BASE_TL_HASH_MAP_H
+#define BASE_TL_HASH_MAP_H
+
+#include "hash.h"
+
+template <class KEY, class VALUE>
+struct hash_map_slot
+{
+	hash_map_slot() : key(), value(), hash(0), used(false) {}
+
+	KEY key;
+	VALUE value;
+	unsigned hash;
+	bool used;
+};
+
+/*
+	Class: hash_map
+		Maps keys to values, finding them takes constant time on average.
+
+	Remarks:
+		- See <hash_table> how the items are stored.
+		- A range over the map visits <hash_map_slot>s, use their key
+		  and value members.
+*/
+template <class KEY, class VALUE, class TRAITS = hash_traits<KEY>, class ALLOCATOR = allocator_default<hash_map_slot<KEY, VALUE> > >
+class hash_map : public hash_table<hash_map_slot<KEY, VALUE>, KEY, TRAITS, ALLOCATOR>
+{
+	typedef hash_table<hash_map_slot<KEY, VALUE>, KEY, TRAITS, ALLOCATOR> parent;
+
+public:
+	/*
+		Function: find
+			Returns the value of a key, 0 if the key isn't in the map.
+	*/
+	VALUE *find(const KEY &key)
+	{
+		int index = parent::find_slot(key);
+		return index < 0 ? 0x0 : &parent::slots[index].value;
+	}
+
+	const VALUE *find(const KEY &key) const
+	{
+		int index = parent::find_slot(key);
+		return index < 0 ? 0x0 : &parent::slots[index].value;
+	}
+
+	/*
+		Function: contains
+	*/
+	bool contains(const KEY &key) const
+	{
+		return parent::find_slot(key) >= 0;
+	}
+
+	/*
+		Function: set
+			Sets the value of a key, adding the key if it isn't in the
+			map yet. Returns the stored value.
+
+		Remarks:
+			- Invalidates ranges and pointers to values
+	*/
+	VALUE *set(const KEY &key, const VALUE &value)
+	{
+		bool added;
+		int index = parent::insert_slot(key, &added);
+		parent::slots[index].value = value;
+		return &parent::slots[index].value;
+	}
+
+	/*
+		Function: operator[]
+			Returns the value of a key, adding a default constructed
+			one if the key isn't in the map yet.
+
+		Remarks:
+			- Invalidates ranges and pointers to values
+	*/
+	VALUE &operator[] (const KEY &key)
+	{
+		bool added;
+		int index = parent::insert_slot(key, &added);
+		return parent::slots[index].value;
+	}
+
+	/*
+		Function: remove
+			Removes a key, returns false if it wasn't in the map.
+
+		Remarks:
+			- Invalidates ranges and pointers to values
+	*/
+	bool remove(const KEY &key)
+	{
+		int index = parent::find_slot(key);
+		if(index < 0)
+			return false;
+		parent::remove_slot(index);
+		return true;
+	}
+};
+
+#endif // TL_FILE_HASH_MAP_HPP
@@ -0,0 +1,72 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef BASE_TL_HASH_SET_H
+#define BASE_TL_HASH_SET_H
+
+#include "hash.h"
+
+template <class KEY>
+struct hash_set_slot
+{
+	hash_set_slot() : key(), hash(0), used(false) {}
+
+	KEY key;
+	unsigned hash;
+	bool used;
+};
+
+/*
+	Class: hash_set
+		Set of keys, checking for one takes constant time on average.
+
+	Remarks:
+		- See <hash_table> how the items are stored.
+		- A range over the set visits <hash_set_slot>s, use their key
+		  member.
+*/
+template <class KEY, class TRAITS = hash_traits<KEY>, class ALLOCATOR = allocator_default<hash_set_slot<KEY> > >
+class hash_set : public hash_table<hash_set_slot<KEY>, KEY, TRAITS, ALLOCATOR>
+{
+	typedef hash_table<hash_set_slot<KEY>, KEY, TRAITS, ALLOCATOR> parent;
+
+public:
+	/*
+		Function: contains
+	*/
+	bool contains(const KEY &key) const
+	{
+		return parent::find_slot(key) >= 0;
+	}
+
+	/*
+		Function: add
+			Adds a key, returns false if it was in the set already.
+
+		Remarks:
+			- Invalidates ranges
+	*/
+	bool add(const KEY &key)
+	{
+		bool added;
+		parent::insert_slot(key, &added);
+		return added;
+	}
+
+	/*
+		Function: remove
+			Removes a key, returns false if it wasn't in the set.
+
+		Remarks:
+			- Invalidates ranges
+	*/
+	bool remove(const KEY &key)
+	{
+		int index = parent::find_slot(key);
+		if(index < 0)
+			return false;
+		parent::remove_slot(index);
+		return true;
+	}
+};
+
+#endif // TL_FILE_HASH_SET_HPP
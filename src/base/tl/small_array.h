@@ -0,0 +1,306 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef BASE_TL_SMALL_ARRAY_H
+#define BASE_TL_SMALL_ARRAY_H
+
+#include "range.h"
+#include "allocator.h"
+
+
+/*
+	Class: small_array
+		Dynamic array that keeps up to N elements inside itself and only
+		allocates once it needs more, for lists that are short most of
+		the time.
+
+	Remarks:
+		- Same interface as <array>
+		- Grows 50% each time it needs to fit new items beyond N
+		- Never goes back to the inline storage once it allocated,
+		  use optimize() for that
+*/
+template <class T, int N, class ALLOCATOR = allocator_default<T> >
+class small_array : private ALLOCATOR
+{
+	void init()
+	{
+		list = inline_list;
+		list_size = N;
+		num_elements = 0;
+	}
+
+public:
+	typedef plain_range<T> range;
+
+	/*
+		Function: small_array constructor
+	*/
+	small_array()
+	{
+		init();
+	}
+
+	/*
+		Function: small_array copy constructor
+	*/
+	small_array(const small_array &other)
+	{
+		init();
+		*this = other;
+	}
+
+	/*
+		Function: small_array destructor
+	*/
+	~small_array()
+	{
+		if(list != inline_list)
+			ALLOCATOR::free_array(list);
+	}
+
+	/*
+		Function: clear
+			Removes all items, keeps the allocated space.
+	*/
+	void clear()
+	{
+		num_elements = 0;
+	}
+
+	/*
+		Function: size
+	*/
+	int size() const
+	{
+		return num_elements;
+	}
+
+	/*
+		Function: capacity
+			Returns how many items fit without allocating
+	*/
+	int capacity() const
+	{
+		return list_size;
+	}
+
+	/*
+		Function: remove_index_fast
+
+		Remarks:
+			- Invalidates ranges
+	*/
+	void remove_index_fast(int index)
+	{
+		list[index] = list[num_elements-1];
+		num_elements--;
+	}
+
+	/*
+		Function: remove_fast
+
+		Remarks:
+			- Invalidates ranges
+	*/
+	void remove_fast(const T& item)
+	{
+		for(int i = 0; i < size(); i++)
+			if(list[i] == item)
+			{
+				remove_index_fast(i);
+				return;
+			}
+	}
+
+	/*
+		Function: remove_index
+
+		Remarks:
+			- Invalidates ranges
+	*/
+	void remove_index(int index)
+	{
+		for(int i = index+1; i < num_elements; i++)
+			list[i-1] = list[i];
+		num_elements--;
+	}
+
+	/*
+		Function: remove
+
+		Remarks:
+			- Invalidates ranges
+	*/
+	bool remove(const T& item)
+	{
+		for(int i = 0; i < size(); i++)
+			if(list[i] == item)
+			{
+				remove_index(i);
+				return true;
+			}
+		return false;
+	}
+
+	/*
+		Function: add
+			Adds an item to the array.
+
+		Arguments:
+			item - Item to add.
+
+		Remarks:
+			- Invalidates ranges
+	*/
+	int add(const T& item)
+	{
+		if(num_elements == list_size)
+			alloc(list_size+list_size/2+1);
+		list[num_elements] = item;
+		return num_elements++;
+	}
+
+	/*
+		Function: operator[]
+	*/
+	T& operator[] (int index)
+	{
+		return list[index];
+	}
+
+	/*
+		Function: const operator[]
+	*/
+	const T& operator[] (int index) const
+	{
+		return list[index];
+	}
+
+	/*
+		Function: base_ptr
+	*/
+	T *base_ptr()
+	{
+		return list;
+	}
+
+	/*
+		Function: base_ptr
+	*/
+	const T *base_ptr() const
+	{
+		return list;
+	}
+
+	/*
+		Function: set_size
+			Resizes the array to the specified size.
+
+		Arguments:
+			new_size - The new size for the array.
+	*/
+	void set_size(int new_size)
+	{
+		if(list_size < new_size)
+			alloc(new_size);
+		num_elements = new_size;
+	}
+
+	/*
+		Function: hint_size
+			Allocates the number of elements wanted but
+			does not increase the list size.
+
+		Arguments:
+			hint - Size to allocate.
+
+		Remarks:
+			- Invalidates ranges
+	*/
+	void hint_size(int hint)
+	{
+		if(list_size < hint)
+			alloc(hint);
+	}
+
+	/*
+		Function: optimize
+			Removes unnessasary data, moves the items back into the
+			array itself if they fit. Returns how many bytes was earned.
+
+		Remarks:
+			- Invalidates ranges
+	*/
+	int optimize()
+	{
+		if(list == inline_list)
+			return 0;
+
+		int before = memusage();
+		if(num_elements <= N)
+		{
+			for(int i = 0; i < num_elements; i++)
+				inline_list[i] = list[i];
+			ALLOCATOR::free_array(list);
+			list = inline_list;
+			list_size = N;
+		}
+		else
+			alloc(num_elements);
+		return before - memusage();
+	}
+
+	/*
+		Function: memusage
+			Returns how much memory this array is using
+	*/
+	int memusage()
+	{
+		return sizeof(small_array) + (list != inline_list ? sizeof(T)*list_size : 0);
+	}
+
+	/*
+		Function: operator=(small_array)
+
+		Remarks:
+			- Invalidates ranges
+	*/
+	small_array &operator = (const small_array &other)
+	{
+		if(this == &other)
+			return *this;
+		set_size(other.size());
+		for(int i = 0; i < size(); i++)
+			(*this)[i] = other[i];
+		return *this;
+	}
+
+	/*
+		Function: all
+			Returns a range that contains the whole array.
+	*/
+	range all() { return range(list, list+num_elements); }
+
+protected:
+	void alloc(int new_len)
+	{
+		T *new_list = ALLOCATOR::alloc_array(new_len);
+		int end = num_elements < new_len ? num_elements : new_len;
+		for(int i = 0; i < end; i++)
+			new_list[i] = list[i];
+
+		if(list != inline_list)
+			ALLOCATOR::free_array(list);
+
+		list = new_list;
+		list_size = new_len;
+		num_elements = end;
+	}
+
+	T inline_list[N];
+	T *list;
+	int list_size;
+	int num_elements;
+};
+
+#endif // TL_FILE_SMALL_ARRAY_HPP
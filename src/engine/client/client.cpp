@@ -25,6 +25,7 @@
 
 #include <engine/shared/config.h>
 #include <engine/shared/compression.h>
+#include <engine/shared/crcindex.h>
 #include <engine/shared/datafile.h>
 #include <engine/shared/demo.h>
 #include <engine/shared/filecollection.h>
@@ -783,6 +784,9 @@ const char *CClient::LoadMap(const char *pName, const char *pFilename, unsigned
 		return aErrorMsg;
 	}
 
+	// decompress the layers and images in the background while the game loads the map
+	m_pMap->PrefetchData();
+
 	// stop demo recording if we loaded a new map
 	DemoRecorder_Stop();
 
@@ -1683,6 +1687,10 @@ void CClient::InitInterfaces()
 	m_pMasterServer = Kernel()->RequestInterface<IEngineMasterServer>();
 	m_pStorage = Kernel()->RequestInterface<IStorage>();
 
+	// remember map crcs between runs
+	m_CrcIndex.Init(m_pStorage);
+	CDataFileReader::SetCrcIndex(&m_CrcIndex);
+
 	//
 	m_ServerBrowser.SetBaseInfo(&m_NetClient, m_pGameClient->NetVersion());
 	m_Friends.Init();
@@ -1911,6 +1919,8 @@ void CClient::Run()
 
 	GameClient()->OnShutdown();
 	Disconnect();
+	CDataFileReader::SetCrcIndex(0);
+	m_CrcIndex.Save();
 
 	m_pGraphics->Shutdown();
 	m_pSound->Shutdown();
@@ -2017,6 +2027,7 @@ const char *CClient::DemoPlayer_Play(const char *pFilename, int StorageType)
 	// try to start playback
 	m_DemoPlayer.SetListner(this);
 
+	m_DemoPlayer.SetIndexCache(g_Config.m_ClDemoIndexCache != 0);
 	if(m_DemoPlayer.Load(Storage(), m_pConsole, pFilename, StorageType))
 		return "error loading demo";
 
@@ -2080,6 +2091,7 @@ void CClient::DemoRecorder_Start(const char *pFilename, bool WithTimestamp)
 		}
 		else
 			str_format(aFilename, sizeof(aFilename), "demos/%s.demo", pFilename);
+		m_DemoRecorder.SetKeyFrameInterval(g_Config.m_ClDemoKeyFrameInterval);
 		m_DemoRecorder.Start(Storage(), m_pConsole, aFilename, GameClient()->NetVersion(), m_aCurrentMap, m_CurrentMapCrc, "client");
 	}
 }
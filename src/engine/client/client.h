@@ -77,6 +77,7 @@ class CClient : public IClient, public CDemoPlayer::IListner
 	class CServerBrowser m_ServerBrowser;
 	class CFriends m_Friends;
 	class CMapChecker m_MapChecker;
+	class CCrcIndex m_CrcIndex;
 
 	char m_aServerAddressStr[256];
 
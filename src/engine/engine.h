@@ -26,7 +26,8 @@ public:
 	virtual void Init() = 0;
 	virtual void InitLogfile() = 0;
 	virtual void HostLookup(CHostLookup *pLookup, const char *pHostname, int Nettype) = 0;
-	virtual void AddJob(CJob *pJob, JOBFUNC pfnFunc, void *pData) = 0;
+	virtual void AddJob(CJob *pJob, JOBFUNC pfnFunc, void *pData, int Class=CJobPool::CLASS_CPU) = 0;
+	virtual void ParallelFor(int Begin, int End, int Grain, CJobPool::RANGEFUNC pfnFunc, void *pUser) = 0;
 };
 
 extern IEngine *CreateEngine(const char *pAppname);
@@ -26,7 +26,11 @@ public:
 	virtual bool Load(const char *pMapName) = 0;
 	virtual bool IsLoaded() = 0;
 	virtual void Unload() = 0;
+	virtual void SwapDataFile(class CDataFileReader *pDataFile) = 0; // takes over an opened file, hands back the old one
 	virtual unsigned Crc() = 0;
+	virtual unsigned FileSize() = 0;
+	virtual const unsigned char *FileData() = 0;
+	virtual void PrefetchData() = 0;
 };
 
 extern IEngineMap *CreateEngineMap();
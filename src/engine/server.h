@@ -44,11 +44,26 @@ public:
 		return SendMsg(&Packer, Flags, ClientID);
 	}
 
+	// packs the message once for all clients in the mask
+	virtual int SendMsgMask(CMsgPacker *pMsg, int Flags, int Mask) = 0;
+
+	template<class T>
+	int SendPackMsgMask(T *pMsg, int Flags, int Mask)
+	{
+		CMsgPacker Packer(pMsg->MsgID());
+		if(pMsg->Pack(&Packer))
+			return -1;
+		return SendMsgMask(&Packer, Flags, Mask);
+	}
+
 	virtual void SetClientName(int ClientID, char const *pName) = 0;
 	virtual void SetClientClan(int ClientID, char const *pClan) = 0;
 	virtual void SetClientCountry(int ClientID, int Country) = 0;
 	virtual void SetClientScore(int ClientID, int Score) = 0;
 
+	// call when something the server browser shows about a client changed
+	virtual void ExpireServerInfo() = 0;
+
 	virtual int SnapNewID() = 0;
 	virtual void SnapFreeID(int ID) = 0;
 	virtual void *SnapNewItem(int Type, int ID, int Size) = 0;
@@ -59,6 +74,8 @@ public:
 	virtual void Kick(int ClientID, const char *pReason) = 0;
 
 	virtual void DemoRecorder_HandleAutoStart() = 0;
+
+	virtual void PreloadMap(const char *pMapName) = 0;
 };
 
 class IGameServer : public IInterface
@@ -14,11 +14,14 @@
 
 #include <engine/shared/compression.h>
 #include <engine/shared/config.h>
+#include <engine/shared/crcindex.h>
 #include <engine/shared/datafile.h>
 #include <engine/shared/demo.h>
 #include <engine/shared/econ.h>
 #include <engine/shared/filecollection.h>
+#include <engine/shared/linereader.h>
 #include <engine/shared/mapchecker.h>
+#include <engine/shared/memheap.h>
 #include <engine/shared/network.h>
 #include <engine/shared/packer.h>
 #include <engine/shared/protocol.h>
@@ -166,10 +169,20 @@ void CServer::CClient::Reset()
 	m_LastAckedSnapshot = -1;
 	m_LastInputTick = -1;
 	m_SnapRate = CClient::SNAPRATE_INIT;
+	m_SnapInterval = 1;
+	m_SnapWindowStart = -1;
+	m_SnapWindowBytes = 0;
+	m_SnapVitalChunks = 0;
+	m_SnapResentChunks = 0;
+	m_SnapFallbacks = 0;
+	m_SnapLatency = 0;
+	m_SnapMinLatency = -1;
+	m_SnapGoodWindows = 0;
+	m_SnapBandwidth = 0;
 	m_Score = 0;
 }
 
-CServer::CServer() : m_DemoRecorder(&m_SnapshotDelta)
+CServer::CServer() : m_SnapArena(MEMTAG_SNAPSHOT), m_DemoRecorder(&m_SnapshotDelta)
 {
 	m_TickSpeed = SERVER_TICK_SPEED;
 
@@ -182,10 +195,14 @@ CServer::CServer() : m_DemoRecorder(&m_SnapshotDelta)
 	m_CurrentMapSize = 0;
 
 	m_MapReload = 0;
+	m_aPreloadMap[0] = 0;
+	m_aNextPreloadMap[0] = 0;
 
 	m_RconClientID = -1;
 	m_RconAuthLevel = AUTHED_ADMIN;
 
+	m_ServerInfoExpired = true;
+
 	Init();
 }
 
@@ -222,6 +239,7 @@ int CServer::TrySetClientName(int ClientID, const char *pName)
 
 	// set the client name
 	str_copy(m_aClients[ClientID].m_aName, pName, MAX_NAME_LENGTH);
+	ExpireServerInfo();
 	return 0;
 }
 
@@ -254,7 +272,11 @@ void CServer::SetClientClan(int ClientID, const char *pClan)
 	if(ClientID < 0 || ClientID >= MAX_CLIENTS || m_aClients[ClientID].m_State < CClient::STATE_READY || !pClan)
 		return;
 
+	if(str_comp(m_aClients[ClientID].m_aClan, pClan) == 0)
+		return;
+
 	str_copy(m_aClients[ClientID].m_aClan, pClan, MAX_CLAN_LENGTH);
+	ExpireServerInfo();
 }
 
 void CServer::SetClientCountry(int ClientID, int Country)
@@ -262,14 +284,29 @@ void CServer::SetClientCountry(int ClientID, int Country)
 	if(ClientID < 0 || ClientID >= MAX_CLIENTS || m_aClients[ClientID].m_State < CClient::STATE_READY)
 		return;
 
+	if(m_aClients[ClientID].m_Country == Country)
+		return;
+
 	m_aClients[ClientID].m_Country = Country;
+	ExpireServerInfo();
 }
 
 void CServer::SetClientScore(int ClientID, int Score)
 {
 	if(ClientID < 0 || ClientID >= MAX_CLIENTS || m_aClients[ClientID].m_State < CClient::STATE_READY)
 		return;
+
+	// the game sets it every tick
+	if(m_aClients[ClientID].m_Score == Score)
+		return;
+
 	m_aClients[ClientID].m_Score = Score;
+	ExpireServerInfo();
+}
+
+void CServer::ExpireServerInfo()
+{
+	m_ServerInfoExpired = true;
 }
 
 void CServer::Kick(int ClientID, const char *pReason)
@@ -395,68 +432,162 @@ int CServer::SendMsg(CMsgPacker *pMsg, int Flags, int ClientID)
 	return SendMsgEx(pMsg, Flags, ClientID, false);
 }
 
-int CServer::SendMsgEx(CMsgPacker *pMsg, int Flags, int ClientID, bool System)
+int CServer::SendMsgMask(CMsgPacker *pMsg, int Flags, int Mask)
+{
+	return SendMsgMaskEx(pMsg, Flags, Mask, false);
+}
+
+int CServer::PrepareMsg(CNetChunk *pPacket, CMsgPacker *pMsg, int Flags, bool System)
 {
-	CNetChunk Packet;
 	if(!pMsg)
 		return -1;
 
-	mem_zero(&Packet, sizeof(CNetChunk));
+	mem_zero(pPacket, sizeof(CNetChunk));
 
-	Packet.m_ClientID = ClientID;
-	Packet.m_pData = pMsg->Data();
-	Packet.m_DataSize = pMsg->Size();
+	pPacket->m_pData = pMsg->Data();
+	pPacket->m_DataSize = pMsg->Size();
 
 	// HACK: modify the message id in the packet and store the system flag
-	*((unsigned char*)Packet.m_pData) <<= 1;
+	*((unsigned char*)pPacket->m_pData) <<= 1;
 	if(System)
-		*((unsigned char*)Packet.m_pData) |= 1;
+		*((unsigned char*)pPacket->m_pData) |= 1;
 
 	if(Flags&MSGFLAG_VITAL)
-		Packet.m_Flags |= NETSENDFLAG_VITAL;
+		pPacket->m_Flags |= NETSENDFLAG_VITAL;
 	if(Flags&MSGFLAG_FLUSH)
-		Packet.m_Flags |= NETSENDFLAG_FLUSH;
+		pPacket->m_Flags |= NETSENDFLAG_FLUSH;
+	if(Flags&MSGFLAG_NODELAY)
+		pPacket->m_Flags |= NETSENDFLAG_NODELAY;
 
 	// write message to demo recorder
 	if(!(Flags&MSGFLAG_NORECORD))
 		m_DemoRecorder.RecordMessage(pMsg->Data(), pMsg->Size());
+	return 0;
+}
+
+int CServer::SendMsgEx(CMsgPacker *pMsg, int Flags, int ClientID, bool System)
+{
+	if(ClientID == -1)
+	{
+		// broadcast
+		int Mask = 0;
+		for(int i = 0; i < MAX_CLIENTS; i++)
+			if(m_aClients[i].m_State == CClient::STATE_INGAME)
+				Mask |= 1<<i;
+		return SendMsgMaskEx(pMsg, Flags, Mask, System);
+	}
+
+	CNetChunk Packet;
+	if(PrepareMsg(&Packet, pMsg, Flags, System) != 0)
+		return -1;
 
+	Packet.m_ClientID = ClientID;
 	if(!(Flags&MSGFLAG_NOSEND))
+		m_NetServer.Send(&Packet);
+	return 0;
+}
+
+int CServer::SendMsgMaskEx(CMsgPacker *pMsg, int Flags, int Mask, bool System)
+{
+	CNetChunk Packet;
+	if(PrepareMsg(&Packet, pMsg, Flags, System) != 0)
+		return -1;
+
+	// the message is packed once, the network keeps a single copy for all of them until acked
+	if(!(Flags&MSGFLAG_NOSEND) && Mask)
+		m_NetServer.SendMask(&Packet, Mask);
+	return 0;
+}
+
+void CServer::UpdateSnapRate(int ClientID)
+{
+	CClient *pClient = &m_aClients[ClientID];
+	int MinInterval = g_Config.m_SvHighBandwidth ? 1 : 2;
+	int MaxInterval = max(MinInterval, g_Config.m_SvSnapIntervalMax);
+	if(!g_Config.m_SvSnapAdaptive)
+	{
+		pClient->m_SnapInterval = MinInterval;
+		return;
+	}
+	pClient->m_SnapInterval = clamp(pClient->m_SnapInterval, MinInterval, MaxInterval);
+
+	const CNetConnection *pConnection = m_NetServer.ClientConnection(ClientID);
+	if(pClient->m_SnapWindowStart < 0 || pClient->m_SnapWindowStart > Tick())
+	{
+		pClient->m_SnapWindowStart = Tick();
+		pClient->m_SnapWindowBytes = 0;
+		pClient->m_SnapVitalChunks = pConnection->NumVitalChunks();
+		pClient->m_SnapResentChunks = pConnection->NumResentChunks();
+		pClient->m_SnapFallbacks = 0;
+		return;
+	}
+
+	// look at the connection once per second
+	int WindowTicks = Tick()-pClient->m_SnapWindowStart;
+	if(WindowTicks < SERVER_TICK_SPEED)
+		return;
+
+	int Rate = pClient->m_SnapWindowBytes*SERVER_TICK_SPEED/WindowTicks;
+	int NumVital = pConnection->NumVitalChunks()-pClient->m_SnapVitalChunks;
+	int NumResent = pConnection->NumResentChunks()-pClient->m_SnapResentChunks;
+	bool Lossy = NumResent > 0 && NumResent*100 >= max(NumVital, 1)*g_Config.m_SvSnapLossLimit;
+	bool Queued = pClient->m_SnapMinLatency >= 0 && pClient->m_SnapLatency-pClient->m_SnapMinLatency > g_Config.m_SvSnapQueueLimit;
+
+	if(Lossy || Queued || pClient->m_SnapFallbacks)
+	{
+		// a queue building up means the link is full, remember what it carried
+		if(Queued || pClient->m_SnapFallbacks)
+			pClient->m_SnapBandwidth = max(Rate*3/4, 1);
+		pClient->m_SnapInterval = min(pClient->m_SnapInterval+1, MaxInterval);
+		pClient->m_SnapGoodWindows = 0;
+	}
+	else if(++pClient->m_SnapGoodWindows >= 3 && pClient->m_SnapInterval > MinInterval)
 	{
-		if(ClientID == -1)
+		// speed up again if the next rate fits the estimate, and let the estimate grow
+		// slowly while the link stays fine so a link that got better is found again
+		int NextRate = Rate*pClient->m_SnapInterval/(pClient->m_SnapInterval-1);
+		if(!pClient->m_SnapBandwidth || NextRate <= pClient->m_SnapBandwidth)
 		{
-			// broadcast
-			int i;
-			for(i = 0; i < MAX_CLIENTS; i++)
-				if(m_aClients[i].m_State == CClient::STATE_INGAME)
-				{
-					Packet.m_ClientID = i;
-					m_NetServer.Send(&Packet);
-				}
+			pClient->m_SnapInterval--;
+			pClient->m_SnapGoodWindows = 0;
 		}
-		else
-			m_NetServer.Send(&Packet);
+		else if(pClient->m_SnapGoodWindows >= 5)
+			pClient->m_SnapBandwidth += pClient->m_SnapBandwidth/10+1;
 	}
-	return 0;
+
+	// the lowest latency drifts up slowly, in case the route got longer
+	if(pClient->m_SnapMinLatency >= 0)
+		pClient->m_SnapMinLatency++;
+
+	pClient->m_SnapWindowStart = Tick();
+	pClient->m_SnapWindowBytes = 0;
+	pClient->m_SnapVitalChunks = pConnection->NumVitalChunks();
+	pClient->m_SnapResentChunks = pConnection->NumResentChunks();
+	pClient->m_SnapFallbacks = 0;
 }
 
 void CServer::DoSnapshot()
 {
 	GameServer()->OnPreSnap();
 
-	// create snapshot for demo recording
-	if(m_DemoRecorder.IsRecording())
+	// the buffers are reused for every client, the arena keeps them off the stack
+	m_SnapArena.Reset();
+	char *pSnapData = (char *)m_SnapArena.Allocate(CSnapshot::MAX_SIZE);
+	char *pDeltaData = (char *)m_SnapArena.Allocate(CSnapshot::MAX_SIZE);
+	char *pCompData = (char *)m_SnapArena.Allocate(CSnapshot::MAX_SIZE);
+
+	// create snapshot for demo recording, unless the recorder has no room left for it
+	if((g_Config.m_SvHighBandwidth || (Tick()%2) == 0) && m_DemoRecorder.IsRecording() && m_DemoRecorder.ReserveSnapshot())
 	{
-		char aData[CSnapshot::MAX_SIZE];
 		int SnapshotSize;
 
 		// build snap and possibly add some messages
 		m_SnapshotBuilder.Init();
 		GameServer()->OnSnap(-1);
-		SnapshotSize = m_SnapshotBuilder.Finish(aData);
+		SnapshotSize = m_SnapshotBuilder.Finish(pSnapData);
 
 		// write snapshot
-		m_DemoRecorder.RecordSnapshot(Tick(), aData, SnapshotSize);
+		m_DemoRecorder.RecordSnapshot(Tick(), pSnapData, SnapshotSize);
 	}
 
 	// create snapshots for all clients
@@ -474,11 +605,13 @@ void CServer::DoSnapshot()
 		if(m_aClients[i].m_SnapRate == CClient::SNAPRATE_INIT && (Tick()%10) != 0)
 			continue;
 
+		// send as many snapshots as the connection of this client can take
+		UpdateSnapRate(i);
+		if(m_aClients[i].m_SnapRate == CClient::SNAPRATE_FULL && (Tick()%m_aClients[i].m_SnapInterval) != 0)
+			continue;
+
 		{
-			char aData[CSnapshot::MAX_SIZE];
-			CSnapshot *pData = (CSnapshot*)aData;	// Fix compiler warning for strict-aliasing
-			char aDeltaData[CSnapshot::MAX_SIZE];
-			char aCompData[CSnapshot::MAX_SIZE];
+			CSnapshot *pData = (CSnapshot*)pSnapData;
 			int SnapshotSize;
 			int Crc;
 			static CSnapshot EmptySnap;
@@ -512,13 +645,18 @@ void CServer::DoSnapshot()
 				else
 				{
 					// no acked package found, force client to recover rate
+					// and come back from it on the lowest rate
 					if(m_aClients[i].m_SnapRate == CClient::SNAPRATE_FULL)
+					{
 						m_aClients[i].m_SnapRate = CClient::SNAPRATE_RECOVER;
+						m_aClients[i].m_SnapInterval = g_Config.m_SvSnapIntervalMax;
+						m_aClients[i].m_SnapFallbacks++;
+					}
 				}
 			}
 
 			// create delta
-			DeltaSize = m_SnapshotDelta.CreateDelta(pDeltashot, pData, aDeltaData);
+			DeltaSize = m_SnapshotDelta.CreateDelta(pDeltashot, pData, pDeltaData);
 
 			if(DeltaSize)
 			{
@@ -527,8 +665,9 @@ void CServer::DoSnapshot()
 				const int MaxSize = MAX_SNAPSHOT_PACKSIZE;
 				int NumPackets;
 
-				SnapshotSize = CVariableInt::Compress(aDeltaData, DeltaSize, aCompData);
+				SnapshotSize = CVariableInt::Compress(pDeltaData, DeltaSize, pCompData);
 				NumPackets = (SnapshotSize+MaxSize-1)/MaxSize;
+				m_aClients[i].m_SnapWindowBytes += SnapshotSize;
 
 				for(int n = 0, Left = SnapshotSize; Left; n++)
 				{
@@ -542,7 +681,7 @@ void CServer::DoSnapshot()
 						Msg.AddInt(m_CurrentGameTick-DeltaTick);
 						Msg.AddInt(Crc);
 						Msg.AddInt(Chunk);
-						Msg.AddRaw(&aCompData[n*MaxSize], Chunk);
+						Msg.AddRaw(&pCompData[n*MaxSize], Chunk);
 						SendMsgEx(&Msg, MSGFLAG_FLUSH, i, true);
 					}
 					else
@@ -554,7 +693,7 @@ void CServer::DoSnapshot()
 						Msg.AddInt(n);
 						Msg.AddInt(Crc);
 						Msg.AddInt(Chunk);
-						Msg.AddRaw(&aCompData[n*MaxSize], Chunk);
+						Msg.AddRaw(&pCompData[n*MaxSize], Chunk);
 						SendMsgEx(&Msg, MSGFLAG_FLUSH, i, true);
 					}
 				}
@@ -584,6 +723,7 @@ int CServer::NewClientCallback(int ClientID, void *pUser)
 	pThis->m_aClients[ClientID].m_AuthTries = 0;
 	pThis->m_aClients[ClientID].m_pRconCmdToSend = 0;
 	pThis->m_aClients[ClientID].Reset();
+	pThis->ExpireServerInfo();
 	return 0;
 }
 
@@ -610,6 +750,7 @@ int CServer::DelClientCallback(int ClientID, const char *pReason, void *pUser)
 	pThis->m_aClients[ClientID].m_AuthTries = 0;
 	pThis->m_aClients[ClientID].m_pRconCmdToSend = 0;
 	pThis->m_aClients[ClientID].m_Snapshots.PurgeAll();
+	pThis->ExpireServerInfo();
 	return 0;
 }
 
@@ -753,7 +894,7 @@ void CServer::ProcessClientPacket(CNetChunk *pPacket)
 			Msg.AddInt(Chunk);
 			Msg.AddInt(ChunkSize);
 			Msg.AddRaw(&m_pCurrentMapData[Offset], ChunkSize);
-			SendMsgEx(&Msg, MSGFLAG_VITAL|MSGFLAG_FLUSH, ClientID, true);
+			SendMsgEx(&Msg, MSGFLAG_VITAL|MSGFLAG_FLUSH|MSGFLAG_NODELAY, ClientID, true);
 
 			if(g_Config.m_Debug)
 			{
@@ -775,6 +916,7 @@ void CServer::ProcessClientPacket(CNetChunk *pPacket)
 				Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "server", aBuf);
 				m_aClients[ClientID].m_State = CClient::STATE_READY;
 				GameServer()->OnClientConnected(ClientID);
+				ExpireServerInfo();
 				SendConnectionReady(ClientID);
 			}
 		}
@@ -798,6 +940,7 @@ void CServer::ProcessClientPacket(CNetChunk *pPacket)
 			CClient::CInput *pInput;
 			int64 TagTime;
 
+			int LastAckedSnapshot = m_aClients[ClientID].m_LastAckedSnapshot;
 			m_aClients[ClientID].m_LastAckedSnapshot = Unpacker.GetInt();
 			int IntendedTick = Unpacker.GetInt();
 			int Size = Unpacker.GetInt();
@@ -810,8 +953,18 @@ void CServer::ProcessClientPacket(CNetChunk *pPacket)
 				m_aClients[ClientID].m_SnapRate = CClient::SNAPRATE_FULL;
 
 			if(m_aClients[ClientID].m_Snapshots.Get(m_aClients[ClientID].m_LastAckedSnapshot, &TagTime, 0, 0) >= 0)
+			{
 				m_aClients[ClientID].m_Latency = (int)(((time_get()-TagTime)*1000)/time_freq());
 
+				// the same ack repeats until the next snapshot arrives, only fresh ones tell how long the way is
+				if(m_aClients[ClientID].m_LastAckedSnapshot > LastAckedSnapshot)
+				{
+					m_aClients[ClientID].m_SnapLatency = m_aClients[ClientID].m_Latency;
+					if(m_aClients[ClientID].m_SnapMinLatency < 0 || m_aClients[ClientID].m_SnapLatency < m_aClients[ClientID].m_SnapMinLatency)
+						m_aClients[ClientID].m_SnapMinLatency = m_aClients[ClientID].m_SnapLatency;
+				}
+			}
+
 			// add message to report the input timing
 			// skip packets that are old
 			if(IntendedTick > m_aClients[ClientID].m_LastInputTick)
@@ -869,7 +1022,9 @@ void CServer::ProcessClientPacket(CNetChunk *pPacket)
 			Unpacker.GetString(); // login name, not used
 			pPw = Unpacker.GetString(CUnpacker::SANITIZE_CC);
 
-			if(Unpacker.Error() == 0)
+			// guessing is throttled per address, the tries only count per connection
+			NETADDR PeerAddr = m_NetServer.ClientAddr(ClientID);
+			if(Unpacker.Error() == 0 && m_NetServer.RateLimitAllow(&PeerAddr, CNetRateLimit::TYPE_RCONAUTH))
 			{
 				if(g_Config.m_SvRconPassword[0] == 0 && g_Config.m_SvRconModPassword[0] == 0)
 				{
@@ -929,6 +1084,8 @@ void CServer::ProcessClientPacket(CNetChunk *pPacket)
 					SendRconLine(ClientID, "Wrong password.");
 				}
 			}
+			else if(Unpacker.Error() == 0)
+				SendRconLine(ClientID, "Too many login attempts, try again later.");
 		}
 		else if(Msg == NETMSG_PING)
 		{
@@ -965,10 +1122,9 @@ void CServer::ProcessClientPacket(CNetChunk *pPacket)
 	}
 }
 
-void CServer::SendServerInfo(NETADDR *pAddr, int Token)
+void CServer::CacheServerInfo()
 {
-	CNetChunk Packet;
-	CPacker p;
+	CPacker &p = m_ServerInfoBody;
 	char aBuf[128];
 
 	// count the players
@@ -986,10 +1142,6 @@ void CServer::SendServerInfo(NETADDR *pAddr, int Token)
 
 	p.Reset();
 
-	p.AddRaw(SERVERBROWSE_INFO, sizeof(SERVERBROWSE_INFO));
-	str_format(aBuf, sizeof(aBuf), "%d", Token);
-	p.AddString(aBuf, 6);
-
 	p.AddString(GameServer()->Version(), 32);
 	p.AddString(g_Config.m_SvName, 64);
 	p.AddString(GetMapName(), 32);
@@ -1021,6 +1173,24 @@ void CServer::SendServerInfo(NETADDR *pAddr, int Token)
 		}
 	}
 
+	m_ServerInfoExpired = false;
+}
+
+void CServer::SendServerInfo(NETADDR *pAddr, int Token)
+{
+	if(m_ServerInfoExpired)
+		CacheServerInfo();
+
+	// only the token differs between two replies
+	CPacker p;
+	char aBuf[16];
+	p.Reset();
+	p.AddRaw(SERVERBROWSE_INFO, sizeof(SERVERBROWSE_INFO));
+	str_format(aBuf, sizeof(aBuf), "%d", Token);
+	p.AddString(aBuf, 6);
+	p.AddRaw(m_ServerInfoBody.Data(), m_ServerInfoBody.Size());
+
+	CNetChunk Packet;
 	Packet.m_ClientID = -1;
 	Packet.m_Address = *pAddr;
 	Packet.m_Flags = NETSENDFLAG_CONNLESS;
@@ -1031,6 +1201,7 @@ void CServer::SendServerInfo(NETADDR *pAddr, int Token)
 
 void CServer::UpdateServerInfo()
 {
+	ExpireServerInfo();
 	for(int i = 0; i < MAX_CLIENTS; ++i)
 	{
 		if(m_aClients[i].m_State != CClient::STATE_EMPTY)
@@ -1041,11 +1212,10 @@ void CServer::UpdateServerInfo()
 	}
 }
 
-int CServer::BanAdd(NETADDR Addr, int Seconds, const char *pReason)
+int CServer::BanAdd(NETADDR Addr, int Seconds, const char *pReason, int Prefix)
 {
-	Addr.port = 0;
 	char aAddrStr[128];
-	net_addr_str(&Addr, aAddrStr, sizeof(aAddrStr));
+	CNetBanTable::FormatRange(&Addr, Prefix, aAddrStr, sizeof(aAddrStr));
 	char aBuf[256];
 	if(Seconds)
 		str_format(aBuf, sizeof(aBuf), "banned %s for %d minutes", aAddrStr, Seconds/60);
@@ -1053,12 +1223,64 @@ int CServer::BanAdd(NETADDR Addr, int Seconds, const char *pReason)
 		str_format(aBuf, sizeof(aBuf), "banned %s for life", aAddrStr);
 	Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
 
-	return m_NetServer.BanAdd(Addr, Seconds, pReason);
+	return m_NetServer.BanAdd(Addr, Seconds, pReason, Prefix);
+}
+
+int CServer::BanRemove(NETADDR Addr, int Prefix)
+{
+	return m_NetServer.BanRemove(Addr, Prefix);
 }
 
-int CServer::BanRemove(NETADDR Addr)
+void CServer::LoadBanFile(const char *pFilename)
 {
-	return m_NetServer.BanRemove(Addr);
+	IOHANDLE File = Storage()->OpenFile(pFilename, IOFLAG_READ, IStorage::TYPE_ALL);
+	if(!File)
+	{
+		char aBuf[256];
+		str_format(aBuf, sizeof(aBuf), "failed to open ban file '%s'", pFilename);
+		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
+		return;
+	}
+
+	// one ban per line: <address or range> [minutes] [reason], lines starting with # are comments
+	int NumLoaded = 0;
+	int NumInvalid = 0;
+	CLineReader LineReader;
+	LineReader.Init(File);
+	while(char *pLine = LineReader.Get())
+	{
+		pLine = str_skip_whitespaces(pLine);
+		if(!pLine[0] || pLine[0] == '#')
+			continue;
+
+		char *pRest = pLine;
+		while(*pRest && *pRest != ' ' && *pRest != '\t')
+			pRest++;
+		if(*pRest)
+			*pRest++ = 0;
+		pRest = str_skip_whitespaces(pRest);
+
+		int Minutes = 0;
+		if(*pRest >= '0' && *pRest <= '9')
+		{
+			Minutes = str_toint(pRest);
+			while(*pRest >= '0' && *pRest <= '9')
+				pRest++;
+			pRest = str_skip_whitespaces(pRest);
+		}
+
+		NETADDR Addr;
+		int Prefix;
+		if(CNetBanTable::ParseRange(pLine, &Addr, &Prefix) != 0 || m_NetServer.BanAdd(Addr, Minutes*60, pRest[0] ? pRest : "Blocklisted", Prefix) != 0)
+			NumInvalid++;
+		else
+			NumLoaded++;
+	}
+	io_close(File);
+
+	char aBuf[256];
+	str_format(aBuf, sizeof(aBuf), "loaded %d bans from '%s', %d invalid lines", NumLoaded, pFilename, NumInvalid);
+	Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", aBuf);
 }
 
 void CServer::GetIP(int ClientID, char *pBuffer, int BufferSize)
@@ -1111,25 +1333,100 @@ char *CServer::GetMapName()
 	return pMapShortName;
 }
 
+int CServer::PreloadMapThread(void *pUser)
+{
+	CServer *pThis = (CServer *)pUser;
+	char aBuf[512];
+	str_format(aBuf, sizeof(aBuf), "maps/%s.map", pThis->m_aPreloadMap);
+	return pThis->m_PreloadFile.Open(pThis->Storage(), aBuf, IStorage::TYPE_ALL) ? 0 : -1;
+}
+
+void CServer::PreloadMap(const char *pMapName)
+{
+	if(!pMapName[0])
+		return;
+
+	// the latest wish wins over one that is still waiting
+	if(str_comp(pMapName, m_aCurrentMap) == 0 || str_comp(pMapName, m_aPreloadMap) == 0)
+	{
+		m_aNextPreloadMap[0] = 0;
+		return;
+	}
+
+	// don't touch the reader while a job is still filling it, the tick loop starts this one after it
+	if(m_PreloadJob.Status() != CJob::STATE_DONE)
+	{
+		str_copy(m_aNextPreloadMap, pMapName, sizeof(m_aNextPreloadMap));
+		return;
+	}
+
+	m_aNextPreloadMap[0] = 0;
+	m_PreloadFile.Close();
+	str_copy(m_aPreloadMap, pMapName, sizeof(m_aPreloadMap));
+	m_pEngine->AddJob(&m_PreloadJob, PreloadMapThread, this, CJobPool::CLASS_IO);
+
+	char aBuf[256];
+	str_format(aBuf, sizeof(aBuf), "preloading map '%s'", pMapName);
+	Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "server", aBuf);
+}
+
 int CServer::LoadMap(const char *pMapName)
 {
-	//DATAFILE *df;
 	char aBuf[512];
 	str_format(aBuf, sizeof(aBuf), "maps/%s.map", pMapName);
 
-	/*df = datafile_load(buf);
-	if(!df)
-		return 0;*/
+	const char *pName = pMapName;
+	for(const char *pSrc = pMapName; *pSrc; ++pSrc)
+		if(*pSrc == '/' || *pSrc == '\\')
+			pName = pSrc+1;
 
-	// check for valid standard map
-	if(!m_MapChecker.ReadAndValidateMap(Storage(), aBuf, IStorage::TYPE_ALL))
+	// pick up the preloaded map, or open it now if it wasn't the one that got preloaded
+	m_PreloadJob.Wait();
+	bool Reopen = str_comp(m_aPreloadMap, pMapName) != 0 || !m_PreloadFile.IsOpen();
+	m_aPreloadMap[0] = 0;
+
+	const unsigned char *pMapData = 0;
+	for(int Try = 0; !pMapData; Try++)
 	{
-		Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "mapchecker", "invalid standard map");
-		return 0;
+		if(Reopen)
+		{
+			m_PreloadFile.Close();
+			if(!m_PreloadFile.Open(Storage(), aBuf, IStorage::TYPE_ALL))
+				return 0;
+		}
+
+		// check for valid standard map
+		if(!m_MapChecker.IsMapValid(pName, m_PreloadFile.Crc(), m_PreloadFile.FileSize()))
+		{
+			m_PreloadFile.Close();
+			Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "mapchecker", "invalid standard map");
+			return 0;
+		}
+
+		// downloads are served from a copy, the file may be overwritten while the map is
+		// running. the mapping is only good until then, so take the copy right away.
+		// a map that was updated on disk after it got preloaded is simply opened again
+		pMapData = m_PreloadFile.FileData();
+		if(!pMapData)
+		{
+			if(Try > 0)
+			{
+				m_PreloadFile.Close();
+				Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", "map file changed while it was loaded");
+				return 0;
+			}
+			Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "server", "map file changed since it was preloaded, reopening it");
+			Reopen = true;
+		}
 	}
+	mem_free(m_pCurrentMapData);
+	m_CurrentMapSize = (int)m_PreloadFile.FileSize();
+	m_pCurrentMapData = (unsigned char *)mem_alloc_tagged(m_CurrentMapSize, 1, MEMTAG_MAP);
+	mem_copy(m_pCurrentMapData, pMapData, m_CurrentMapSize);
 
-	if(!m_pMap->Load(aBuf))
-		return 0;
+	// the current map is only replaced once the new one is known to be good
+	m_pMap->SwapDataFile(&m_PreloadFile);
+	m_PreloadFile.Close();
 
 	// stop recording when we change map
 	m_DemoRecorder.Stop();
@@ -1145,17 +1442,6 @@ int CServer::LoadMap(const char *pMapName)
 
 	str_copy(m_aCurrentMap, pMapName, sizeof(m_aCurrentMap));
 	//map_set(df);
-
-	// load compelate map into memory for download
-	{
-		IOHANDLE File = Storage()->OpenFile(aBuf, IOFLAG_READ, IStorage::TYPE_ALL);
-		m_CurrentMapSize = (int)io_length(File);
-		if(m_pCurrentMapData)
-			mem_free(m_pCurrentMapData);
-		m_pCurrentMapData = (unsigned char *)mem_alloc(m_CurrentMapSize, 1);
-		io_read(File, m_pCurrentMapData, m_CurrentMapSize);
-		io_close(File);
-	}
 	return 1;
 }
 
@@ -1168,8 +1454,17 @@ int CServer::Run()
 {
 	m_pGameServer = Kernel()->RequestInterface<IGameServer>();
 	m_pMap = Kernel()->RequestInterface<IEngineMap>();
+	m_pEngine = Kernel()->RequestInterface<IEngine>();
 	m_pStorage = Kernel()->RequestInterface<IStorage>();
 
+	thread_set_name("server");
+	if(g_Config.m_SvCpu >= 0 && thread_set_affinity(g_Config.m_SvCpu) != 0)
+		dbg_msg("server", "couldn't pin the server thread to cpu %d, %d cpus online", g_Config.m_SvCpu, cpu_count());
+
+	// remember map crcs between runs
+	m_CrcIndex.Init(m_pStorage);
+	CDataFileReader::SetCrcIndex(&m_CrcIndex);
+
 	//
 	m_PrintCBIndex = Console()->RegisterPrintCallback(g_Config.m_ConsoleOutputLevel, SendRconLineAuthed, this);
 
@@ -1201,6 +1496,9 @@ int CServer::Run()
 	}
 
 	m_NetServer.SetCallbacks(NewClientCallback, DelClientCallback, this);
+	UpdateRateLimits();
+	if(g_Config.m_SvBanFile[0])
+		LoadBanFile(g_Config.m_SvBanFile);
 
 	m_Econ.Init(Console());
 
@@ -1296,10 +1594,21 @@ int CServer::Run()
 			// snap game
 			if(NewTicks)
 			{
-				if(g_Config.m_SvHighBandwidth || (m_CurrentGameTick%2) == 0)
-					DoSnapshot();
+				// every client has its own snapshot rate, see UpdateSnapRate
+				DoSnapshot();
 
 				UpdateClientRconCommands();
+
+				// send everything that was flushed during the tick
+				m_NetServer.Flush();
+			}
+
+			// start the preload that had to wait for the previous one
+			if(m_aNextPreloadMap[0] && m_PreloadJob.Status() == CJob::STATE_DONE)
+			{
+				char aNextMap[64];
+				str_copy(aNextMap, m_aNextPreloadMap, sizeof(aNextMap));
+				PreloadMap(aNextMap);
 			}
 
 			// master server stuff
@@ -1346,13 +1655,23 @@ int CServer::Run()
 	}
 
 	GameServer()->OnShutdown();
+	m_PreloadJob.Wait();
+	m_PreloadFile.Close();
 	m_pMap->Unload();
-
-	if(m_pCurrentMapData)
-		mem_free(m_pCurrentMapData);
+	CDataFileReader::SetCrcIndex(0);
+	m_CrcIndex.Save();
+	mem_free(m_pCurrentMapData);
+	m_pCurrentMapData = 0;
 	return 0;
 }
 
+void CServer::UpdateRateLimits()
+{
+	m_NetServer.SetRateLimit(CNetRateLimit::TYPE_INFO, g_Config.m_SvRateInfo);
+	m_NetServer.SetRateLimit(CNetRateLimit::TYPE_CONNECT, g_Config.m_SvRateConnect);
+	m_NetServer.SetRateLimit(CNetRateLimit::TYPE_RCONAUTH, g_Config.m_SvRateRconAuth);
+}
+
 void CServer::ConKick(IConsole::IResult *pResult, void *pUser)
 {
 	if(pResult->NumArguments() > 1)
@@ -1368,6 +1687,7 @@ void CServer::ConKick(IConsole::IResult *pResult, void *pUser)
 void CServer::ConBan(IConsole::IResult *pResult, void *pUser)
 {
 	NETADDR Addr;
+	int Prefix;
 	CServer *pServer = (CServer *)pUser;
 	const char *pStr = pResult->GetString(0);
 	int Minutes = 30;
@@ -1379,13 +1699,12 @@ void CServer::ConBan(IConsole::IResult *pResult, void *pUser)
 	if(pResult->NumArguments() > 2)
 		pReason = pResult->GetString(2);
 
-	if(net_addr_from_str(&Addr, pStr) == 0)
+	if(CNetBanTable::ParseRange(pStr, &Addr, &Prefix) == 0)
 	{
 		if(pServer->m_RconClientID >= 0 && pServer->m_RconClientID < MAX_CLIENTS && pServer->m_aClients[pServer->m_RconClientID].m_State != CClient::STATE_EMPTY)
 		{
 			NETADDR AddrCheck = pServer->m_NetServer.ClientAddr(pServer->m_RconClientID);
-			Addr.port = AddrCheck.port = 0;
-			if(net_addr_comp(&Addr, &AddrCheck) == 0)
+			if(CNetBanTable::Contains(&Addr, Prefix, &AddrCheck))
 			{
 				pServer->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", "you can't ban yourself");
 				return;
@@ -1397,15 +1716,15 @@ void CServer::ConBan(IConsole::IResult *pResult, void *pUser)
 					continue;
 
 				AddrCheck = pServer->m_NetServer.ClientAddr(i);
-				AddrCheck.port = 0;
-				if(net_addr_comp(&Addr, &AddrCheck) == 0 && pServer->m_aClients[i].m_Authed > pServer->m_RconAuthLevel)
+				if(pServer->m_aClients[i].m_State != CClient::STATE_EMPTY && CNetBanTable::Contains(&Addr, Prefix, &AddrCheck) &&
+					pServer->m_aClients[i].m_Authed > pServer->m_RconAuthLevel)
 				{
 					pServer->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", "ban command denied");
 					return;
 				}
 			}
 		}
-		pServer->BanAdd(Addr, Minutes*60, pReason);
+		pServer->BanAdd(Addr, Minutes*60, pReason, Prefix);
 	}
 	else if(StrAllnum(pStr))
 	{
@@ -1440,13 +1759,14 @@ void CServer::ConBan(IConsole::IResult *pResult, void *pUser)
 void CServer::ConUnban(IConsole::IResult *pResult, void *pUser)
 {
 	NETADDR Addr;
+	int Prefix;
 	CServer *pServer = (CServer *)pUser;
 	const char *pStr = pResult->GetString(0);
 
-	if(net_addr_from_str(&Addr, pStr) == 0 && !pServer->BanRemove(Addr))
+	if(CNetBanTable::ParseRange(pStr, &Addr, &Prefix) == 0 && !pServer->BanRemove(Addr, Prefix))
 	{
 		char aAddrStr[NETADDR_MAXSTRSIZE];
-		net_addr_str(&Addr, aAddrStr, sizeof(aAddrStr));
+		CNetBanTable::FormatRange(&Addr, Prefix, aAddrStr, sizeof(aAddrStr));
 
 		char aBuf[256];
 		str_format(aBuf, sizeof(aBuf), "unbanned %s", aAddrStr);
@@ -1458,10 +1778,10 @@ void CServer::ConUnban(IConsole::IResult *pResult, void *pUser)
 		CNetServer::CBanInfo Info;
 		if(BanIndex < 0 || !pServer->m_NetServer.BanGet(BanIndex, &Info))
 			pServer->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "server", "invalid ban index");
-		else if(!pServer->BanRemove(Info.m_Addr))
+		else if(!pServer->BanRemove(Info.m_Addr, Info.m_Prefix))
 		{
 			char aAddrStr[NETADDR_MAXSTRSIZE];
-			net_addr_str(&Info.m_Addr, aAddrStr, sizeof(aAddrStr));
+			CNetBanTable::FormatRange(&Info.m_Addr, Info.m_Prefix, aAddrStr, sizeof(aAddrStr));
 
 			char aBuf[256];
 			str_format(aBuf, sizeof(aBuf), "unbanned %s", aAddrStr);
@@ -1484,8 +1804,7 @@ void CServer::ConBans(IConsole::IResult *pResult, void *pUser)
 	{
 		CNetServer::CBanInfo Info;
 		pServer->m_NetServer.BanGet(i, &Info);
-		NETADDR Addr = Info.m_Addr;
-		net_addr_str(&Addr, aAddrStr, sizeof(aAddrStr));
+		CNetBanTable::FormatRange(&Info.m_Addr, Info.m_Prefix, aAddrStr, sizeof(aAddrStr));
 
 		if(Info.m_Expires == -1)
 		{
@@ -1502,6 +1821,39 @@ void CServer::ConBans(IConsole::IResult *pResult, void *pUser)
 	pServer->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "Server", aBuf);
 }
 
+void CServer::ConRateLimits(IConsole::IResult *pResult, void *pUser)
+{
+	static const char *s_apNames[CNetRateLimit::NUM_TYPES] = {"info", "connect", "rcon auth"};
+	static const int *s_apRates[CNetRateLimit::NUM_TYPES] = {&g_Config.m_SvRateInfo, &g_Config.m_SvRateConnect, &g_Config.m_SvRateRconAuth};
+	CServer* pServer = (CServer *)pUser;
+	const CNetRateLimit *pRateLimit = pServer->m_NetServer.RateLimit();
+
+	for(int i = 0; i < CNetRateLimit::NUM_TYPES; i++)
+	{
+		char aBuf[256];
+		str_format(aBuf, sizeof(aBuf), "%s: %d/s per ip, %u allowed, %u dropped", s_apNames[i], *s_apRates[i], pRateLimit->NumAllowed(i), pRateLimit->NumDropped(i));
+		pServer->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "Server", aBuf);
+	}
+}
+
+void CServer::ConMemory(IConsole::IResult *pResult, void *pUser)
+{
+	CServer* pServer = (CServer *)pUser;
+	char aBuf[256];
+
+	for(int i = 0; i < NUM_MEMTAGS; i++)
+	{
+		const MEMTAGSTATS *pStats = mem_tag_stats(i);
+		str_format(aBuf, sizeof(aBuf), "%s: %dk in %d allocations, peak %dk", mem_tag_name(i), pStats->allocated/1024,
+			pStats->active_allocations, pStats->peak_allocated/1024);
+		pServer->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "Server", aBuf);
+	}
+
+	str_format(aBuf, sizeof(aBuf), "total: %dk in %d allocations, snapshot buffers %dk", mem_stats()->allocated/1024,
+		mem_stats()->active_allocations, pServer->m_SnapArena.BlockSize()/1024);
+	pServer->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "Server", aBuf);
+}
+
 void CServer::ConStatus(IConsole::IResult *pResult, void *pUser)
 {
 	int i;
@@ -1517,8 +1869,8 @@ void CServer::ConStatus(IConsole::IResult *pResult, void *pUser)
 			Addr = pServer->m_NetServer.ClientAddr(i);
 			net_addr_str(&Addr, aAddrStr, sizeof(aAddrStr));
 			if(pServer->m_aClients[i].m_State == CClient::STATE_INGAME)
-				str_format(aBuf, sizeof(aBuf), "id=%d addr=%s name='%s' score=%d", i, aAddrStr,
-					pServer->m_aClients[i].m_aName, pServer->m_aClients[i].m_Score);
+				str_format(aBuf, sizeof(aBuf), "id=%d addr=%s name='%s' score=%d snaprate=%d", i, aAddrStr,
+					pServer->m_aClients[i].m_aName, pServer->m_aClients[i].m_Score, SERVER_TICK_SPEED/pServer->m_aClients[i].m_SnapInterval);
 			else
 				str_format(aBuf, sizeof(aBuf), "id=%d addr=%s connecting", i, aAddrStr);
 			pServer->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "Server", aBuf);
@@ -1540,6 +1892,7 @@ void CServer::DemoRecorder_HandleAutoStart()
 		char aDate[20];
 		str_timestamp(aDate, sizeof(aDate));
 		str_format(aFilename, sizeof(aFilename), "demos/%s_%s.demo", "auto/autorecord", aDate);
+		m_DemoRecorder.SetKeyFrameInterval(g_Config.m_SvDemoKeyFrameInterval);
 		m_DemoRecorder.Start(Storage(), m_pConsole, aFilename, GameServer()->NetVersion(), m_aCurrentMap, m_CurrentMapCrc, "server");
 		if(g_Config.m_SvAutoDemoMax)
 		{
@@ -1563,6 +1916,7 @@ void CServer::ConRecord(IConsole::IResult *pResult, void *pUser)
 		str_timestamp(aDate, sizeof(aDate));
 		str_format(aFilename, sizeof(aFilename), "demos/demo_%s.demo", aDate);
 	}
+	pServer->m_DemoRecorder.SetKeyFrameInterval(g_Config.m_SvDemoKeyFrameInterval);
 	pServer->m_DemoRecorder.Start(pServer->Storage(), pServer->Console(), aFilename, pServer->GameServer()->NetVersion(), pServer->m_aCurrentMap, pServer->m_CurrentMapCrc, "server");
 }
 
@@ -1590,6 +1944,13 @@ void CServer::ConchainMaxclientsperipUpdate(IConsole::IResult *pResult, void *pU
 		((CServer *)pUserData)->m_NetServer.SetMaxClientsPerIP(pResult->GetInteger(0));
 }
 
+void CServer::ConchainRatelimitUpdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData)
+{
+	pfnCallback(pResult, pCallbackUserData);
+	if(pResult->NumArguments())
+		((CServer *)pUserData)->UpdateRateLimits();
+}
+
 void CServer::ConchainModCommandUpdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData)
 {
 	if(pResult->NumArguments() == 2)
@@ -1634,10 +1995,12 @@ void CServer::RegisterCommands()
 	m_pConsole = Kernel()->RequestInterface<IConsole>();
 
 	Console()->Register("kick", "i?r", CFGFLAG_SERVER, ConKick, this, "Kick player with specified id for any reason");
-	Console()->Register("ban", "s?ir", CFGFLAG_SERVER|CFGFLAG_STORE, ConBan, this, "Ban player with ip/id for x minutes for any reason");
-	Console()->Register("unban", "s", CFGFLAG_SERVER|CFGFLAG_STORE, ConUnban, this, "Unban ip");
+	Console()->Register("ban", "s?ir", CFGFLAG_SERVER|CFGFLAG_STORE, ConBan, this, "Ban player with ip/ip range/id for x minutes for any reason");
+	Console()->Register("unban", "s", CFGFLAG_SERVER|CFGFLAG_STORE, ConUnban, this, "Unban ip/ip range");
 	Console()->Register("bans", "", CFGFLAG_SERVER|CFGFLAG_STORE, ConBans, this, "Show banlist");
 	Console()->Register("status", "", CFGFLAG_SERVER, ConStatus, this, "List players");
+	Console()->Register("ratelimits", "", CFGFLAG_SERVER, ConRateLimits, this, "Show how much traffic the rate limits let through and dropped");
+	Console()->Register("memory", "", CFGFLAG_SERVER, ConMemory, this, "Show the memory in use by each subsystem");
 	Console()->Register("shutdown", "", CFGFLAG_SERVER, ConShutdown, this, "Shut down");
 
 	Console()->Register("record", "?s", CFGFLAG_SERVER|CFGFLAG_STORE, ConRecord, this, "Record to a file");
@@ -1647,8 +2010,12 @@ void CServer::RegisterCommands()
 
 	Console()->Chain("sv_name", ConchainSpecialInfoupdate, this);
 	Console()->Chain("password", ConchainSpecialInfoupdate, this);
+	Console()->Chain("sv_spectator_slots", ConchainSpecialInfoupdate, this);
 
 	Console()->Chain("sv_max_clients_per_ip", ConchainMaxclientsperipUpdate, this);
+	Console()->Chain("sv_rate_info", ConchainRatelimitUpdate, this);
+	Console()->Chain("sv_rate_connect", ConchainRatelimitUpdate, this);
+	Console()->Chain("sv_rate_rcon_auth", ConchainRatelimitUpdate, this);
 	Console()->Chain("mod_command", ConchainModCommandUpdate, this);
 	Console()->Chain("console_output_level", ConchainConsoleOutputLevelUpdate, this);
 }
@@ -91,6 +91,18 @@ public:
 		int m_LastInputTick;
 		CSnapshotStorage m_Snapshots;
 
+		// adaptive snapshot rate, see UpdateSnapRate
+		int m_SnapInterval; // ticks between two snapshots
+		int m_SnapWindowStart; // tick the current measuring window started at
+		int m_SnapWindowBytes; // snapshot bytes sent in the window
+		int m_SnapVitalChunks; // connection counters at the start of the window
+		int m_SnapResentChunks;
+		int m_SnapFallbacks; // snapshots without an acked base in the window
+		int m_SnapLatency; // latency of the latest fresh snapshot ack
+		int m_SnapMinLatency; // lowest of those seen, the link without any queueing
+		int m_SnapGoodWindows; // windows in a row without loss or queueing
+		int m_SnapBandwidth; // bytes per second the link is estimated to carry, 0 while unknown
+
 		CInput m_LatestInput;
 		CInput m_aInputs[200]; // TODO: handle input better
 		int m_CurrentInput;
@@ -111,11 +123,13 @@ public:
 
 	CSnapshotDelta m_SnapshotDelta;
 	CSnapshotBuilder m_SnapshotBuilder;
+	CFrameArena m_SnapArena; // buffers of one DoSnapshot call
 	CSnapIDPool m_IDPool;
 	CNetServer m_NetServer;
 	CEcon m_Econ;
 
 	IEngineMap *m_pMap;
+	class IEngine *m_pEngine;
 
 	int64 m_GameStartTime;
 	//int m_CurrentGameTick;
@@ -136,6 +150,17 @@ public:
 	CDemoRecorder m_DemoRecorder;
 	CRegister m_Register;
 	CMapChecker m_MapChecker;
+	CCrcIndex m_CrcIndex;
+
+	// next map, opened and validated on the job pool
+	CJob m_PreloadJob;
+	CDataFileReader m_PreloadFile;
+	char m_aPreloadMap[64];
+	char m_aNextPreloadMap[64]; // the latest map asked for while a preload was running
+
+	// the info reply after its token, rebuilt only when something in it changed
+	CPacker m_ServerInfoBody;
+	bool m_ServerInfoExpired;
 
 	CServer();
 
@@ -145,6 +170,7 @@ public:
 	virtual void SetClientClan(int ClientID, char const *pClan);
 	virtual void SetClientCountry(int ClientID, int Country);
 	virtual void SetClientScore(int ClientID, int Score);
+	virtual void ExpireServerInfo();
 
 	void Kick(int ClientID, const char *pReason);
 
@@ -165,8 +191,12 @@ public:
 	bool ClientIngame(int ClientID);
 
 	virtual int SendMsg(CMsgPacker *pMsg, int Flags, int ClientID);
+	virtual int SendMsgMask(CMsgPacker *pMsg, int Flags, int Mask);
+	int PrepareMsg(CNetChunk *pPacket, CMsgPacker *pMsg, int Flags, bool System);
 	int SendMsgEx(CMsgPacker *pMsg, int Flags, int ClientID, bool System);
+	int SendMsgMaskEx(CMsgPacker *pMsg, int Flags, int Mask, bool System);
 
+	void UpdateSnapRate(int ClientID);
 	void DoSnapshot();
 
 	static int NewClientCallback(int ClientID, void *pUser);
@@ -183,17 +213,22 @@ public:
 
 	void ProcessClientPacket(CNetChunk *pPacket);
 
+	void CacheServerInfo();
 	void SendServerInfo(NETADDR *pAddr, int Token);
 	void UpdateServerInfo();
 
-	int BanAdd(NETADDR Addr, int Seconds, const char *pReason);
-	int BanRemove(NETADDR Addr);
+	int BanAdd(NETADDR Addr, int Seconds, const char *pReason, int Prefix=-1);
+	int BanRemove(NETADDR Addr, int Prefix=-1);
+	void LoadBanFile(const char *pFilename);
+	void UpdateRateLimits();
 
 	void GetIP(int ClientID, char *pBuffer, int BufferSize);
 	void PumpNetwork();
 
 	char *GetMapName();
 	int LoadMap(const char *pMapName);
+	static int PreloadMapThread(void *pUser);
+	virtual void PreloadMap(const char *pMapName);
 
 	void InitRegister(CNetServer *pNetServer, IEngineMasterServer *pMasterServer, IConsole *pConsole);
 	int Run();
@@ -202,6 +237,8 @@ public:
 	static void ConBan(IConsole::IResult *pResult, void *pUser);
 	static void ConUnban(IConsole::IResult *pResult, void *pUser);
 	static void ConBans(IConsole::IResult *pResult, void *pUser);
+	static void ConRateLimits(IConsole::IResult *pResult, void *pUser);
+	static void ConMemory(IConsole::IResult *pResult, void *pUser);
  	static void ConStatus(IConsole::IResult *pResult, void *pUser);
 	static void ConShutdown(IConsole::IResult *pResult, void *pUser);
 	static void ConRecord(IConsole::IResult *pResult, void *pUser);
@@ -209,6 +246,7 @@ public:
 	static void ConMapReload(IConsole::IResult *pResult, void *pUser);
 	static void ConchainSpecialInfoupdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData);
 	static void ConchainMaxclientsperipUpdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData);
+	static void ConchainRatelimitUpdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData);
 	static void ConchainModCommandUpdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData);
 	static void ConchainConsoleOutputLevelUpdate(IConsole::IResult *pResult, void *pUserData, IConsole::FCommandCallback pfnCallback, void *pCallbackUserData);
 
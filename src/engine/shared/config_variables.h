@@ -20,6 +20,8 @@ MACRO_CONFIG_INT(ClEditor, cl_editor, 0, 0, 1, CFGFLAG_CLIENT, "")
 
 MACRO_CONFIG_INT(ClAutoDemoRecord, cl_auto_demo_record, 0, 0, 1, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Automatically record demos")
 MACRO_CONFIG_INT(ClAutoDemoMax, cl_auto_demo_max, 10, 0, 1000, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Maximum number of automatically recorded demos (0 = no limit)")
+MACRO_CONFIG_INT(ClDemoKeyFrameInterval, cl_demo_keyframe_interval, 250, 10, 3000, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Ticks between keyframes in recorded demos, less makes seeking faster but demos larger")
+MACRO_CONFIG_INT(ClDemoIndexCache, cl_demo_index_cache, 1, 0, 1, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Remember the seek points of demos recorded without an index")
 MACRO_CONFIG_INT(ClAutoScreenshot, cl_auto_screenshot, 0, 0, 1, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Automatically take game over screenshot")
 MACRO_CONFIG_INT(ClAutoScreenshotMax, cl_auto_screenshot_max, 10, 0, 1000, CFGFLAG_SAVE|CFGFLAG_CLIENT, "Maximum number of automatically created screenshots (0 = no limit)")
 
@@ -80,14 +82,24 @@ MACRO_CONFIG_INT(SvExternalPort, sv_external_port, 0, 0, 0, CFGFLAG_SERVER, "Ext
 MACRO_CONFIG_STR(SvMap, sv_map, 128, "dm1", CFGFLAG_SERVER, "Map to use on the server")
 MACRO_CONFIG_INT(SvMaxClients, sv_max_clients, 8, 1, MAX_CLIENTS, CFGFLAG_SERVER, "Maximum number of clients that are allowed on a server")
 MACRO_CONFIG_INT(SvMaxClientsPerIP, sv_max_clients_per_ip, 4, 1, MAX_CLIENTS, CFGFLAG_SERVER, "Maximum number of clients with the same IP that can connect to the server")
+MACRO_CONFIG_INT(SvCpu, sv_cpu, -1, -1, 1023, CFGFLAG_SERVER, "Pin the server thread to this cpu, -1 lets the system move it")
 MACRO_CONFIG_INT(SvHighBandwidth, sv_high_bandwidth, 0, 0, 1, CFGFLAG_SERVER, "Use high bandwidth mode. Doubles the bandwidth required for the server. LAN use only")
+MACRO_CONFIG_INT(SvSnapAdaptive, sv_snap_adaptive, 1, 0, 1, CFGFLAG_SERVER, "Lower the snapshot rate of clients whose connection can't keep up")
+MACRO_CONFIG_INT(SvSnapIntervalMax, sv_snap_interval_max, 5, 2, 10, CFGFLAG_SERVER, "Most ticks between two snapshots for clients on a bad connection")
+MACRO_CONFIG_INT(SvSnapLossLimit, sv_snap_loss_limit, 5, 1, 100, CFGFLAG_SERVER, "Percentage of resent chunks that lowers the snapshot rate of a client")
+MACRO_CONFIG_INT(SvSnapQueueLimit, sv_snap_queue_limit, 100, 10, 1000, CFGFLAG_SERVER, "Milliseconds of latency above the lowest seen that lower the snapshot rate of a client")
+MACRO_CONFIG_INT(SvRateInfo, sv_rate_info, 10, 0, 1000, CFGFLAG_SERVER, "Connectionless packets, like server info requests, accepted per second from one IP (0 = no limit)")
+MACRO_CONFIG_INT(SvRateConnect, sv_rate_connect, 5, 0, 1000, CFGFLAG_SERVER, "Connection attempts accepted per second from one IP (0 = no limit)")
+MACRO_CONFIG_INT(SvRateRconAuth, sv_rate_rcon_auth, 1, 0, 1000, CFGFLAG_SERVER, "Remote console login attempts accepted per second from one IP (0 = no limit)")
 MACRO_CONFIG_INT(SvRegister, sv_register, 1, 0, 1, CFGFLAG_SERVER, "Register server with master server for public listing")
 MACRO_CONFIG_STR(SvRconPassword, sv_rcon_password, 32, "", CFGFLAG_SERVER, "Remote console password (full access)")
 MACRO_CONFIG_STR(SvRconModPassword, sv_rcon_mod_password, 32, "", CFGFLAG_SERVER, "Remote console password for moderators (limited access)")
 MACRO_CONFIG_INT(SvRconMaxTries, sv_rcon_max_tries, 3, 0, 100, CFGFLAG_SERVER, "Maximum number of tries for remote console authentication")
+MACRO_CONFIG_STR(SvBanFile, sv_ban_file, 128, "", CFGFLAG_SERVER, "File with address ranges to ban at startup, one '<ip[/prefix]> [minutes] [reason]' per line")
 MACRO_CONFIG_INT(SvRconBantime, sv_rcon_bantime, 5, 0, 1440, CFGFLAG_SERVER, "The time a client gets banned if remote console authentication fails. 0 makes it just use kick")
 MACRO_CONFIG_INT(SvAutoDemoRecord, sv_auto_demo_record, 0, 0, 1, CFGFLAG_SERVER, "Automatically record demos")
 MACRO_CONFIG_INT(SvAutoDemoMax, sv_auto_demo_max, 10, 0, 1000, CFGFLAG_SERVER, "Maximum number of automatically recorded demos (0 = no limit)")
+MACRO_CONFIG_INT(SvDemoKeyFrameInterval, sv_demo_keyframe_interval, 250, 10, 3000, CFGFLAG_SERVER, "Ticks between keyframes in recorded demos, less makes seeking faster but demos larger")
 
 MACRO_CONFIG_STR(EcBindaddr, ec_bindaddr, 128, "localhost", CFGFLAG_SERVER, "Address to bind the external console to. Anything but 'localhost' is dangerous")
 MACRO_CONFIG_INT(EcPort, ec_port, 0, 0, 0, CFGFLAG_SERVER, "Port to use for the external console")
@@ -0,0 +1,148 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <stdio.h>	// sscanf
+
+#include <engine/storage.h>
+
+#include "crcindex.h"
+#include "linereader.h"
+
+static const char *s_pIndexFile = "crcindex.txt";
+static const char *s_pIndexTmpFile = "crcindex.txt.tmp";
+
+CCrcIndex::CCrcIndex()
+{
+	m_pStorage = 0;
+	m_Lock = lock_create();
+	m_Dirty = false;
+	m_LastSave = 0;
+}
+
+CCrcIndex::~CCrcIndex()
+{
+	lock_destroy(m_Lock);
+}
+
+void CCrcIndex::Init(IStorage *pStorage)
+{
+	m_pStorage = pStorage;
+	m_lEntries.clear();
+	m_Dirty = false;
+	m_LastSave = time_get();
+
+	IOHANDLE File = m_pStorage->OpenFile(s_pIndexFile, IOFLAG_READ, IStorage::TYPE_SAVE);
+	if(!File)
+		return;
+
+	CLineReader LineReader;
+	LineReader.Init(File);
+	while(1)
+	{
+		const char *pLine = LineReader.Get();
+		if(!pLine)
+			break;
+
+		// parse line, the path takes the rest of it
+		CEntry Entry;
+		int PathStart = 0;
+		if(sscanf(pLine, "%x %u %ld %n", &Entry.m_Crc, &Entry.m_Size, &Entry.m_Mtime, &PathStart) == 3 && PathStart && pLine[PathStart])
+		{
+			str_copy(Entry.m_aPath, pLine+PathStart, sizeof(Entry.m_aPath));
+			m_lEntries.add_unsorted(Entry);
+		}
+	}
+	io_close(File);
+
+	m_lEntries.sort_range();
+}
+
+CCrcIndex::CEntry *CCrcIndex::Find(const char *pPath)
+{
+	CEntry Key;
+	str_copy(Key.m_aPath, pPath, sizeof(Key.m_aPath));
+	sorted_array<CEntry>::range r = partition_binary(m_lEntries.all(), Key);
+	if(r.empty() || str_comp(r.front().m_aPath, Key.m_aPath) != 0)
+		return 0;
+	return &r.front();
+}
+
+bool CCrcIndex::Lookup(const char *pPath, unsigned Size, long int Mtime, unsigned *pCrc)
+{
+	if(!m_pStorage || Mtime < 0)
+		return false;
+
+	lock_wait(m_Lock);
+	CEntry *pEntry = Find(pPath);
+	bool Found = pEntry && pEntry->m_Size == Size && pEntry->m_Mtime == Mtime;
+	if(Found)
+		*pCrc = pEntry->m_Crc;
+	lock_release(m_Lock);
+	return Found;
+}
+
+void CCrcIndex::Store(const char *pPath, unsigned Size, long int Mtime, unsigned Crc)
+{
+	if(!m_pStorage || Mtime < 0 || str_length(pPath) >= MAX_PATH_LENGTH)
+		return;
+
+	// the mtime has a resolution of a second, a file from the current second could still be
+	// rewritten with the same size and mtime. it gets hashed again next time instead
+	if(Mtime >= (long int)time_timestamp()-1)
+		return;
+
+	lock_wait(m_Lock);
+	CEntry *pEntry = Find(pPath);
+	if(!pEntry)
+	{
+		CEntry Entry;
+		str_copy(Entry.m_aPath, pPath, sizeof(Entry.m_aPath));
+		m_lEntries.add(Entry);
+		pEntry = Find(pPath);
+	}
+	pEntry->m_Size = Size;
+	pEntry->m_Mtime = Mtime;
+	pEntry->m_Crc = Crc;
+	m_Dirty = true;
+
+	// scans store lots of crcs in a row, so the file is only rewritten now and then
+	if(time_get() > m_LastSave+time_freq()*SAVE_INTERVAL)
+		Write();
+	lock_release(m_Lock);
+}
+
+void CCrcIndex::Save()
+{
+	if(!m_pStorage)
+		return;
+
+	lock_wait(m_Lock);
+	if(m_Dirty)
+		Write();
+	lock_release(m_Lock);
+}
+
+void CCrcIndex::Write()
+{
+	m_LastSave = time_get();
+
+	// write a new index next to the old one and swap it in, so a crash never leaves half an index behind
+	IOHANDLE File = m_pStorage->OpenFile(s_pIndexTmpFile, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+	if(!File)
+		return;
+
+	for(int i = 0; i < m_lEntries.size(); i++)
+	{
+		char aBuf[MAX_PATH_LENGTH+64];
+		str_format(aBuf, sizeof(aBuf), "%08x %u %ld %s\n", m_lEntries[i].m_Crc, m_lEntries[i].m_Size, m_lEntries[i].m_Mtime, m_lEntries[i].m_aPath);
+		io_write(File, aBuf, str_length(aBuf));
+	}
+	io_close(File);
+	m_Dirty = false;
+
+	if(!m_pStorage->RenameFile(s_pIndexTmpFile, s_pIndexFile, IStorage::TYPE_SAVE))
+	{
+		// rename doesn't replace existing files everywhere
+		m_pStorage->RemoveFile(s_pIndexFile, IStorage::TYPE_SAVE);
+		m_pStorage->RenameFile(s_pIndexTmpFile, s_pIndexFile, IStorage::TYPE_SAVE);
+	}
+}
@@ -0,0 +1,50 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef ENGINE_SHARED_CRCINDEX_H
+#define ENGINE_SHARED_CRCINDEX_H
+
+#include <base/system.h>
+#include <base/tl/sorted_array.h>
+
+// remembers file crcs between runs, an entry is only used while the file keeps its size and modification time
+class CCrcIndex
+{
+	enum
+	{
+		MAX_PATH_LENGTH=512,
+		SAVE_INTERVAL=60, // seconds, new entries are written at most this often unless saved explicitly
+	};
+
+	struct CEntry
+	{
+		char m_aPath[MAX_PATH_LENGTH];
+		unsigned m_Size;
+		long int m_Mtime;
+		unsigned m_Crc;
+
+		bool operator<(const CEntry &Other) const { return str_comp(m_aPath, Other.m_aPath) < 0; }
+	};
+
+	class IStorage *m_pStorage;
+	sorted_array<CEntry> m_lEntries;
+	LOCK m_Lock;
+	bool m_Dirty;
+	int64 m_LastSave;
+
+	CEntry *Find(const char *pPath);
+	void Write();
+
+public:
+	CCrcIndex();
+	~CCrcIndex();
+
+	void Init(class IStorage *pStorage);
+
+	bool Lookup(const char *pPath, unsigned Size, long int Mtime, unsigned *pCrc);
+	void Store(const char *pPath, unsigned Size, long int Mtime, unsigned Crc);
+
+	// writes the index if it has new entries, call after scans and on shutdown
+	void Save();
+};
+
+#endif
@@ -2,12 +2,16 @@
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
 #include <base/math.h>
 #include <base/system.h>
+#include <engine/engine.h>
 #include <engine/storage.h>
+#include "crcindex.h"
 #include "datafile.h"
 #include <zlib.h>
 
 static const int DEBUG=0;
 
+static CCrcIndex *s_pCrcIndex = 0;
+
 struct CDatafileItemType
 {
 	int m_Type;
@@ -57,57 +61,139 @@ struct CDatafileInfo
 
 struct CDatafile
 {
-	IOHANDLE m_File;
+	IOHANDLE m_File; // kept open to notice when the file is changed under the mapping
+	long int m_Mtime;
+	unsigned char *m_pFileData;
+	unsigned m_FileSize;
 	unsigned m_Crc;
 	CDatafileInfo m_Info;
 	CDatafileHeader m_Header;
 	int m_DataStartOffset;
 	char **m_ppDataPtrs;
+	struct CDatafileLoadJob *m_pLoadJobs;
 	char *m_pData;
 };
 
-bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int StorageType)
+struct CDatafileLoadJob
 {
-	dbg_msg("datafile", "loading. filename='%s'", pFilename);
+	CJob m_Job;
+	CDatafile *m_pDataFile;
+	int m_Index;
+	int m_DataSize;
+};
 
-	IOHANDLE File = pStorage->OpenFile(pFilename, IOFLAG_READ, StorageType);
-	if(!File)
+// reading a mapping whose file got truncated or overwritten crashes or returns other data,
+// so everything taken from the mapping after opening checks this first. it can't catch a
+// change that happens right after the check though, maps should be replaced by renaming
+static bool FileChanged(const CDatafile *pDataFile)
+{
+	return io_mtime(pDataFile->m_File) != pDataFile->m_Mtime;
+}
+
+static char *LoadData(CDatafile *pDataFile, int Index, int DataSize, int *pLoadedSize)
+{
+	if(FileChanged(pDataFile))
 	{
-		dbg_msg("datafile", "could not open '%s'", pFilename);
-		return false;
+		dbg_msg("datafile", "file changed on disk, can't load data index=%d", Index);
+		return 0;
 	}
 
+	// the data lives in the mapping, make sure it's actually there
+	unsigned Offset = pDataFile->m_DataStartOffset+pDataFile->m_Info.m_pDataOffsets[Index];
+	if(DataSize < 0 || pDataFile->m_Info.m_pDataOffsets[Index] < 0 || Offset+DataSize > pDataFile->m_FileSize)
+	{
+		dbg_msg("datafile", "data index=%d is out of bounds", Index);
+		return 0;
+	}
 
-	// take the CRC of the file and store it
-	unsigned Crc = 0;
+	if(pDataFile->m_Header.m_Version == 4)
 	{
-		enum
-		{
-			BUFFER_SIZE = 64*1024
-		};
+		// v4 has compressed data
+		unsigned long UncompressedSize = pDataFile->m_Info.m_pDataSizes[Index];
+		unsigned long s;
 
-		unsigned char aBuffer[BUFFER_SIZE];
+		dbg_msg("datafile", "loading data index=%d size=%d uncompressed=%d", Index, DataSize, UncompressedSize);
+		char *pData = (char *)mem_alloc_tagged(UncompressedSize, 1, MEMTAG_MAP);
 
-		while(1)
+		// decompress the data straight from the mapping
+		s = UncompressedSize;
+		int Result = uncompress((Bytef*)pData, &s, (const Bytef*)pDataFile->m_pFileData+Offset, DataSize); // ignore_convention
+		if(Result != Z_OK || s != UncompressedSize)
 		{
-			unsigned Bytes = io_read(File, aBuffer, BUFFER_SIZE);
-			if(Bytes <= 0)
-				break;
-			Crc = crc32(Crc, aBuffer, Bytes); // ignore_convention
+			// users rely on the size from the file, so a short buffer is as bad as a broken one
+			dbg_msg("datafile", "failed to uncompress data index=%d error=%d size=%d", Index, Result, (int)s);
+			mem_free(pData);
+			return 0;
 		}
+		*pLoadedSize = (int)s;
+		return pData;
+	}
+
+	// the data is copied out of the mapping, the file can change while the users still need it
+	dbg_msg("datafile", "loading data index=%d size=%d", Index, DataSize);
+	*pLoadedSize = DataSize;
+	char *pData = (char *)mem_alloc_tagged(DataSize, 1, MEMTAG_MAP);
+	mem_copy(pData, pDataFile->m_pFileData+Offset, DataSize);
+	return pData;
+}
+
+static int LoadDataJob(void *pUser)
+{
+	CDatafileLoadJob *pJob = (CDatafileLoadJob *)pUser;
+	int LoadedSize;
+	pJob->m_pDataFile->m_ppDataPtrs[pJob->m_Index] = LoadData(pJob->m_pDataFile, pJob->m_Index, pJob->m_DataSize, &LoadedSize);
+	return 0;
+}
+
+bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int StorageType)
+{
+	dbg_msg("datafile", "loading. filename='%s'", pFilename);
 
-		io_seek(File, 0, IOSEEK_START);
+	char aPath[512];
+	IOHANDLE File = pStorage->OpenFile(pFilename, IOFLAG_READ, StorageType, aPath, sizeof(aPath));
+	if(!File)
+	{
+		dbg_msg("datafile", "could not open '%s'", pFilename);
+		return false;
 	}
 
+	// map the whole file, the crc, the headers and the data are all taken from the mapping
+	unsigned FileSize = 0;
+	unsigned char *pFileData = (unsigned char *)io_map(File, &FileSize);
+	if(!pFileData)
+	{
+		dbg_msg("datafile", "could not map '%s'", pFilename);
+		io_close(File);
+		return false;
+	}
+
+	// take the CRC of the file and store it, unless the index already knows it
+	unsigned Crc;
+	long int Mtime = io_mtime(File);
+	if(!s_pCrcIndex || !s_pCrcIndex->Lookup(aPath, FileSize, Mtime, &Crc))
+	{
+		Crc = crc32(0, pFileData, FileSize); // ignore_convention
+		if(s_pCrcIndex)
+			s_pCrcIndex->Store(aPath, FileSize, Mtime, Crc);
+	}
 
 	// TODO: change this header
 	CDatafileHeader Header;
-	io_read(File, &Header, sizeof(Header));
+	if(FileSize < sizeof(Header))
+	{
+		io_unmap(pFileData, FileSize);
+		io_close(File);
+		dbg_msg("datafile", "file too small. size=%d", FileSize);
+		return false;
+	}
+	mem_copy(&Header, pFileData, sizeof(Header));
 	if(Header.m_aID[0] != 'A' || Header.m_aID[1] != 'T' || Header.m_aID[2] != 'A' || Header.m_aID[3] != 'D')
 	{
 		if(Header.m_aID[0] != 'D' || Header.m_aID[1] != 'A' || Header.m_aID[2] != 'T' || Header.m_aID[3] != 'A')
 		{
 			dbg_msg("datafile", "wrong signature. %x %x %x %x", Header.m_aID[0], Header.m_aID[1], Header.m_aID[2], Header.m_aID[3]);
+			io_unmap(pFileData, FileSize);
+			io_close(File);
 			return 0;
 		}
 	}
@@ -118,6 +204,8 @@ bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int
 	if(Header.m_Version != 3 && Header.m_Version != 4)
 	{
 		dbg_msg("datafile", "wrong version. version=%x", Header.m_Version);
+		io_unmap(pFileData, FileSize);
+		io_close(File);
 		return 0;
 	}
 
@@ -129,31 +217,35 @@ bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int
 		Size += Header.m_NumRawData*sizeof(int); // v4 has uncompressed data sizes aswell
 	Size += Header.m_ItemSize;
 
+	if(sizeof(CDatafileHeader)+Size > FileSize)
+	{
+		dbg_msg("datafile", "couldn't load the whole thing, wanted=%d got=%d", Size, FileSize-(unsigned)sizeof(CDatafileHeader));
+		io_unmap(pFileData, FileSize);
+		io_close(File);
+		return false;
+	}
+
 	unsigned AllocSize = Size;
 	AllocSize += sizeof(CDatafile); // add space for info structure
 	AllocSize += Header.m_NumRawData*sizeof(void*); // add space for data pointers
 
-	CDatafile *pTmpDataFile = (CDatafile*)mem_alloc(AllocSize, 1);
+	CDatafile *pTmpDataFile = (CDatafile*)mem_alloc_tagged(AllocSize, 1, MEMTAG_MAP);
 	pTmpDataFile->m_Header = Header;
 	pTmpDataFile->m_DataStartOffset = sizeof(CDatafileHeader) + Size;
 	pTmpDataFile->m_ppDataPtrs = (char**)(pTmpDataFile+1);
 	pTmpDataFile->m_pData = (char *)(pTmpDataFile+1)+Header.m_NumRawData*sizeof(char *);
 	pTmpDataFile->m_File = File;
+	pTmpDataFile->m_Mtime = Mtime;
+	pTmpDataFile->m_pFileData = pFileData;
+	pTmpDataFile->m_FileSize = FileSize;
 	pTmpDataFile->m_Crc = Crc;
+	pTmpDataFile->m_pLoadJobs = 0;
 
 	// clear the data pointers
 	mem_zero(pTmpDataFile->m_ppDataPtrs, Header.m_NumRawData*sizeof(void*));
 
-	// read types, offsets, sizes and item data
-	unsigned ReadSize = io_read(File, pTmpDataFile->m_pData, Size);
-	if(ReadSize != Size)
-	{
-		io_close(pTmpDataFile->m_File);
-		mem_free(pTmpDataFile);
-		pTmpDataFile = 0;
-		dbg_msg("datafile", "couldn't load the whole thing, wanted=%d got=%d", Size, ReadSize);
-		return false;
-	}
+	// copy types, offsets, sizes and item data, the data itself is loaded lazily
+	mem_copy(pTmpDataFile->m_pData, pFileData+sizeof(CDatafileHeader), Size);
 
 	Close();
 	m_pDataFile = pTmpDataFile;
@@ -165,7 +257,7 @@ bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int
 	//if(DEBUG)
 	{
 		dbg_msg("datafile", "allocsize=%d", AllocSize);
-		dbg_msg("datafile", "readsize=%d", ReadSize);
+		dbg_msg("datafile", "filesize=%d", FileSize);
 		dbg_msg("datafile", "swaplen=%d", Header.m_Swaplen);
 		dbg_msg("datafile", "item_size=%d", m_pDataFile->m_Header.m_ItemSize);
 	}
@@ -224,10 +316,24 @@ bool CDataFileReader::Open(class IStorage *pStorage, const char *pFilename, int
 
 bool CDataFileReader::GetCrcSize(class IStorage *pStorage, const char *pFilename, int StorageType, unsigned *pCrc, unsigned *pSize)
 {
-	IOHANDLE File = pStorage->OpenFile(pFilename, IOFLAG_READ, StorageType);
+	char aPath[512];
+	IOHANDLE File = pStorage->OpenFile(pFilename, IOFLAG_READ, StorageType, aPath, sizeof(aPath));
 	if(!File)
 		return false;
 
+	// the index saves reading the whole file
+	long int Mtime = io_mtime(File);
+	if(s_pCrcIndex)
+	{
+		unsigned Size = (unsigned)io_length(File);
+		if(s_pCrcIndex->Lookup(aPath, Size, Mtime, pCrc))
+		{
+			io_close(File);
+			*pSize = Size;
+			return true;
+		}
+	}
+
 	// get crc and size
 	unsigned Crc = 0;
 	unsigned Size = 0;
@@ -243,11 +349,19 @@ bool CDataFileReader::GetCrcSize(class IStorage *pStorage, const char *pFilename
 
 	io_close(File);
 
+	if(s_pCrcIndex)
+		s_pCrcIndex->Store(aPath, Size, Mtime, Crc);
+
 	*pCrc = Crc;
 	*pSize = Size;
 	return true;
 }
 
+void CDataFileReader::SetCrcIndex(CCrcIndex *pCrcIndex)
+{
+	s_pCrcIndex = pCrcIndex;
+}
+
 int CDataFileReader::NumData()
 {
 	if(!m_pDataFile) { return 0; }
@@ -264,61 +378,67 @@ int CDataFileReader::GetDataSize(int Index)
 	return m_pDataFile->m_Info.m_pDataOffsets[Index+1]-m_pDataFile->m_Info.m_pDataOffsets[Index];
 }
 
-void *CDataFileReader::GetDataImpl(int Index, int Swap)
+int CDataFileReader::GetUncompressedDataSize(int Index)
 {
 	if(!m_pDataFile) { return 0; }
 
-	// load it if needed
-	if(!m_pDataFile->m_ppDataPtrs[Index])
-	{
-		// fetch the data size
-		int DataSize = GetDataSize(Index);
-#if defined(CONF_ARCH_ENDIAN_BIG)
-		int SwapSize = DataSize;
-#endif
+	if(m_pDataFile->m_Header.m_Version == 4)
+		return m_pDataFile->m_Info.m_pDataSizes[Index];
+	return GetDataSize(Index);
+}
 
-		if(m_pDataFile->m_Header.m_Version == 4)
-		{
-			// v4 has compressed data
-			void *pTemp = (char *)mem_alloc(DataSize, 1);
-			unsigned long UncompressedSize = m_pDataFile->m_Info.m_pDataSizes[Index];
-			unsigned long s;
+void CDataFileReader::WaitForData(int Index)
+{
+	if(!m_pDataFile->m_pLoadJobs)
+		return;
+	m_pDataFile->m_pLoadJobs[Index].m_Job.Wait();
+}
 
-			dbg_msg("datafile", "loading data index=%d size=%d uncompressed=%d", Index, DataSize, UncompressedSize);
-			m_pDataFile->m_ppDataPtrs[Index] = (char *)mem_alloc(UncompressedSize, 1);
+void *CDataFileReader::GetDataImpl(int Index, int Swap)
+{
+	if(!m_pDataFile) { return 0; }
 
-			// read the compressed data
-			io_seek(m_pDataFile->m_File, m_pDataFile->m_DataStartOffset+m_pDataFile->m_Info.m_pDataOffsets[Index], IOSEEK_START);
-			io_read(m_pDataFile->m_File, pTemp, DataSize);
+	// the data might still be decompressed in the background
+	WaitForData(Index);
 
-			// decompress the data, TODO: check for errors
-			s = UncompressedSize;
-			uncompress((Bytef*)m_pDataFile->m_ppDataPtrs[Index], &s, (Bytef*)pTemp, DataSize); // ignore_convention
-#if defined(CONF_ARCH_ENDIAN_BIG)
-			SwapSize = s;
-#endif
-
-			// clean up the temporary buffers
-			mem_free(pTemp);
-		}
-		else
-		{
-			// load the data
-			dbg_msg("datafile", "loading data index=%d size=%d", Index, DataSize);
-			m_pDataFile->m_ppDataPtrs[Index] = (char *)mem_alloc(DataSize, 1);
-			io_seek(m_pDataFile->m_File, m_pDataFile->m_DataStartOffset+m_pDataFile->m_Info.m_pDataOffsets[Index], IOSEEK_START);
-			io_read(m_pDataFile->m_File, m_pDataFile->m_ppDataPtrs[Index], DataSize);
-		}
+	// load it if needed
+	if(!m_pDataFile->m_ppDataPtrs[Index])
+	{
+		int LoadedSize = 0;
+		m_pDataFile->m_ppDataPtrs[Index] = LoadData(m_pDataFile, Index, GetDataSize(Index), &LoadedSize);
 
 #if defined(CONF_ARCH_ENDIAN_BIG)
-		if(Swap && SwapSize)
-			swap_endian(m_pDataFile->m_ppDataPtrs[Index], sizeof(int), SwapSize/sizeof(int));
+		if(Swap && LoadedSize && m_pDataFile->m_ppDataPtrs[Index])
+			swap_endian(m_pDataFile->m_ppDataPtrs[Index], sizeof(int), LoadedSize/sizeof(int));
 #endif
 	}
 
 	return m_pDataFile->m_ppDataPtrs[Index];
 }
 
+void CDataFileReader::PrefetchData(IEngine *pEngine)
+{
+	// only compressed data is worth the trip to the job pool, the swapping on
+	// big endian machines depends on the access and can't be done ahead
+#if defined(CONF_ARCH_ENDIAN_LITTLE)
+	if(!m_pDataFile || !pEngine || m_pDataFile->m_pLoadJobs || m_pDataFile->m_Header.m_Version != 4)
+		return;
+
+	m_pDataFile->m_pLoadJobs = new CDatafileLoadJob[m_pDataFile->m_Header.m_NumRawData];
+	for(int i = 0; i < m_pDataFile->m_Header.m_NumRawData; i++)
+	{
+		if(m_pDataFile->m_ppDataPtrs[i])
+			continue;
+
+		CDatafileLoadJob *pJob = &m_pDataFile->m_pLoadJobs[i];
+		pJob->m_pDataFile = m_pDataFile;
+		pJob->m_Index = i;
+		pJob->m_DataSize = GetDataSize(i);
+		pEngine->AddJob(&pJob->m_Job, LoadDataJob, pJob);
+	}
+#endif
+}
+
 void *CDataFileReader::GetData(int Index)
 {
 	return GetDataImpl(Index, 0);
@@ -335,6 +455,7 @@ void CDataFileReader::UnloadData(int Index)
 		return;
 
 	//
+	WaitForData(Index);
 	mem_free(m_pDataFile->m_ppDataPtrs[Index]);
 	m_pDataFile->m_ppDataPtrs[Index] = 0x0;
 }
@@ -342,9 +463,10 @@ void CDataFileReader::UnloadData(int Index)
 int CDataFileReader::GetItemSize(int Index)
 {
 	if(!m_pDataFile) { return 0; }
+	// the offsets include the item header, only report the payload
 	if(Index == m_pDataFile->m_Header.m_NumItems-1)
-		return m_pDataFile->m_Header.m_ItemSize-m_pDataFile->m_Info.m_pItemOffsets[Index];
-	return m_pDataFile->m_Info.m_pItemOffsets[Index+1]-m_pDataFile->m_Info.m_pItemOffsets[Index];
+		return m_pDataFile->m_Header.m_ItemSize-m_pDataFile->m_Info.m_pItemOffsets[Index]-sizeof(CDatafileItem);
+	return m_pDataFile->m_Info.m_pItemOffsets[Index+1]-m_pDataFile->m_Info.m_pItemOffsets[Index]-sizeof(CDatafileItem);
 }
 
 void *CDataFileReader::GetItem(int Index, int *pType, int *pID)
@@ -408,8 +530,13 @@ bool CDataFileReader::Close()
 	// free the data that is loaded
 	int i;
 	for(i = 0; i < m_pDataFile->m_Header.m_NumRawData; i++)
+	{
+		WaitForData(i);
 		mem_free(m_pDataFile->m_ppDataPtrs[i]);
+	}
 
+	delete [] m_pDataFile->m_pLoadJobs;
+	io_unmap(m_pDataFile->m_pFileData, m_pDataFile->m_FileSize);
 	io_close(m_pDataFile->m_File);
 	mem_free(m_pDataFile);
 	m_pDataFile = 0;
@@ -422,6 +549,18 @@ unsigned CDataFileReader::Crc()
 	return m_pDataFile->m_Crc;
 }
 
+unsigned CDataFileReader::FileSize()
+{
+	if(!m_pDataFile) return 0;
+	return m_pDataFile->m_FileSize;
+}
+
+const unsigned char *CDataFileReader::FileData()
+{
+	if(!m_pDataFile || FileChanged(m_pDataFile)) return 0;
+	return m_pDataFile->m_pFileData;
+}
+
 
 CDataFileWriter::CDataFileWriter()
 {
@@ -504,25 +643,46 @@ int CDataFileWriter::AddData(int Size, void *pData)
 
 	dbg_assert(m_NumDatas < 1024, "too much data");
 
+	// keep a copy, compression happens in Finish
 	CDataInfo *pInfo = &m_pDatas[m_NumDatas];
-	unsigned long s = compressBound(Size);
+	pInfo->m_UncompressedSize = Size;
+	pInfo->m_CompressedSize = 0;
+	pInfo->m_pUncompressedData = mem_alloc(Size, 1);
+	mem_copy(pInfo->m_pUncompressedData, pData, Size);
+	pInfo->m_pCompressedData = 0;
+
+	m_NumDatas++;
+	return m_NumDatas-1;
+}
+
+int CDataFileWriter::CompressData(void *pUser)
+{
+	CDataInfo *pInfo = (CDataInfo *)pUser;
+	unsigned long s = compressBound(pInfo->m_UncompressedSize);
 	void *pCompData = mem_alloc(s, 1); // temporary buffer that we use during compression
 
-	int Result = compress((Bytef*)pCompData, &s, (Bytef*)pData, Size); // ignore_convention
+	int Result = compress((Bytef*)pCompData, &s, (Bytef*)pInfo->m_pUncompressedData, pInfo->m_UncompressedSize); // ignore_convention
 	if(Result != Z_OK)
 	{
 		dbg_msg("datafile", "compression error %d", Result);
 		dbg_assert(0, "zlib error");
 	}
 
-	pInfo->m_UncompressedSize = Size;
 	pInfo->m_CompressedSize = (int)s;
 	pInfo->m_pCompressedData = mem_alloc(pInfo->m_CompressedSize, 1);
 	mem_copy(pInfo->m_pCompressedData, pCompData, pInfo->m_CompressedSize);
 	mem_free(pCompData);
 
-	m_NumDatas++;
-	return m_NumDatas-1;
+	mem_free(pInfo->m_pUncompressedData);
+	pInfo->m_pUncompressedData = 0;
+	return 0;
+}
+
+void CDataFileWriter::CompressDataRange(void *pUser, int Begin, int End)
+{
+	CDataInfo *pDatas = (CDataInfo *)pUser;
+	for(int i = Begin; i < End; i++)
+		CompressData(&pDatas[i]);
 }
 
 int CDataFileWriter::AddDataSwapped(int Size, void *pData)
@@ -542,7 +702,7 @@ int CDataFileWriter::AddDataSwapped(int Size, void *pData)
 }
 
 
-int CDataFileWriter::Finish()
+int CDataFileWriter::Finish(class IEngine *pEngine)
 {
 	if(!m_File) return 1;
 
@@ -551,6 +711,15 @@ int CDataFileWriter::Finish()
 	int DataSize = 0;
 	CDatafileHeader Header;
 
+	// compress the data, each one on its own so the output doesn't depend on the order the jobs finish in
+	if(pEngine && m_NumDatas > 1)
+		pEngine->ParallelFor(0, m_NumDatas, 1, CompressDataRange, m_pDatas);
+	else
+	{
+		for(int i = 0; i < m_NumDatas; i++)
+			CompressData(&m_pDatas[i]);
+	}
+
 	// we should now write this file!
 	if(DEBUG)
 		dbg_msg("datafile", "writing");
@@ -8,6 +8,7 @@ class CDataFileReader
 {
 	struct CDatafile *m_pDataFile;
 	void *GetDataImpl(int Index, int Swap);
+	void WaitForData(int Index);
 public:
 	CDataFileReader() : m_pDataFile(0) {}
 	~CDataFileReader() { Close(); }
@@ -16,12 +17,17 @@ public:
 
 	bool Open(class IStorage *pStorage, const char *pFilename, int StorageType);
 	bool Close();
+	void Swap(CDataFileReader *pOther) { struct CDatafile *pTemp = m_pDataFile; m_pDataFile = pOther->m_pDataFile; pOther->m_pDataFile = pTemp; }
 
 	static bool GetCrcSize(class IStorage *pStorage, const char *pFilename, int StorageType, unsigned *pCrc, unsigned *pSize);
+	static void SetCrcIndex(class CCrcIndex *pCrcIndex); // crcs get taken from and added to this index
+
+	void PrefetchData(class IEngine *pEngine); // decompresses all data on the job pool
 
 	void *GetData(int Index);
 	void *GetDataSwapped(int Index); // makes sure that the data is 32bit LE ints when saved
 	int GetDataSize(int Index);
+	int GetUncompressedDataSize(int Index);
 	void UnloadData(int Index);
 	void *GetItem(int Index, int *pType, int *pID);
 	int GetItemSize(int Index);
@@ -32,6 +38,8 @@ public:
 	void Unload();
 
 	unsigned Crc();
+	unsigned FileSize();
+	const unsigned char *FileData(); // the raw file, valid until the file is closed, 0 if it changed on disk
 };
 
 // write access
@@ -41,6 +49,7 @@ class CDataFileWriter
 	{
 		int m_UncompressedSize;
 		int m_CompressedSize;
+		void *m_pUncompressedData;
 		void *m_pCompressedData;
 	};
 
@@ -76,6 +85,9 @@ class CDataFileWriter
 	CItemInfo *m_pItems;
 	CDataInfo *m_pDatas;
 
+	static int CompressData(void *pUser);
+	static void CompressDataRange(void *pUser, int Begin, int End);
+
 public:
 	CDataFileWriter();
 	~CDataFileWriter();
@@ -83,7 +95,7 @@ public:
 	int AddData(int Size, void *pData);
 	int AddDataSwapped(int Size, void *pData);
 	int AddItem(int Type, int ID, int Size, void *pData);
-	int Finish();
+	int Finish(class IEngine *pEngine = 0); // with an engine, data is compressed in parallel on its job pool
 };
 
 
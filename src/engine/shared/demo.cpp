@@ -15,13 +15,102 @@
 static const unsigned char gs_aHeaderMarker[7] = {'T', 'W', 'D', 'E', 'M', 'O', 0};
 static const unsigned char gs_ActVersion = 3;
 static const int gs_LengthOffset = 152;
+static const unsigned char gs_aIndexMarker[4] = {'T', 'W', 'I', 'X'};
+static const unsigned char gs_aIndexCacheMarker[4] = {'T', 'W', 'I', 'C'};
+
+/*
+	Tickmarker
+		7	= Always set
+		6	= Keyframe flag
+		0-5	= Delta tick
+
+	Normal
+		7 = Not set
+		5-6	= Type
+		0-4	= Size
+*/
+
+enum
+{
+	CHUNKTYPEFLAG_TICKMARKER = 0x80,
+	CHUNKTICKFLAG_KEYFRAME = 0x40, // only when tickmarker is set
+
+	CHUNKMASK_TICK = 0x3f,
+	CHUNKMASK_TYPE = 0x60,
+	CHUNKMASK_SIZE = 0x1f,
+
+	CHUNKTYPE_SNAPSHOT = 1,
+	CHUNKTYPE_MESSAGE = 2,
+	CHUNKTYPE_DELTA = 3,
+
+	CHUNKFLAG_BIGSIZE = 0x10
+};
+
+/*
+	Index
+		The keyframes are stored at the end of the demo in chunks of type 0 that
+		older players skip. Each chunk starts with a compressed empty payload, so
+		it decodes fine, followed by the raw keyframes (file position and tick).
+		The last chunk ends with a footer of fixed size:
+
+		4	= Marker
+		4	= Number of keyframes
+		4	= First tick
+		4	= Last tick
+		4	= File position of the first index chunk
+*/
+
+enum
+{
+	INDEX_ENTRY_SIZE = 8,
+	INDEX_FOOTER_SIZE = 20,
+	INDEX_MAX_ENTRIES_PER_CHUNK = 4096,
+	INDEX_CACHE_HEADER_SIZE = 28,
+};
+
+static void WriteIndexInt(unsigned char *pDst, int Value)
+{
+	pDst[0] = (Value>>24)&0xff;
+	pDst[1] = (Value>>16)&0xff;
+	pDst[2] = (Value>>8)&0xff;
+	pDst[3] = (Value)&0xff;
+}
+
+static int ReadIndexInt(const unsigned char *pSrc)
+{
+	return (pSrc[0]<<24) | (pSrc[1]<<16) | (pSrc[2]<<8) | pSrc[3];
+}
 
 
-CDemoRecorder::CDemoRecorder(class CSnapshotDelta *pSnapshotDelta)
+CDemoRecorder::CDemoRecorder(class CSnapshotDelta *pSnapshotDelta) : m_WriteArena(MEMTAG_DEMO)
 {
 	m_File = 0;
+	m_MapFile = 0;
 	m_LastTickMarker = -1;
+	m_KeyFrameInterval = SERVER_TICK_SPEED*5;
+	m_FirstQueuedTick = -1;
+	m_LastQueuedTick = -1;
 	m_pSnapshotDelta = pSnapshotDelta;
+	m_pThread = 0;
+	m_pRingMemory = 0;
+	m_Lock = lock_create();
+	m_Wakeup = semaphore_create();
+	mem_zero(&m_Stats, sizeof(m_Stats));
+}
+
+CDemoRecorder::~CDemoRecorder()
+{
+	// nothing gets finalized here, the console might already be gone
+	if(m_pThread)
+	{
+		m_Stopping = 1;
+		semaphore_signal(m_Wakeup);
+		thread_wait(m_pThread);
+		io_close(m_File);
+	}
+	mem_free(m_pRingMemory);
+	lock_destroy(m_Lock);
+	semaphore_destroy(m_Wakeup);
 }
 
 // Record
@@ -91,56 +180,111 @@ int CDemoRecorder::Start(class IStorage *pStorage, class IConsole *pConsole, con
 	str_timestamp(Header.m_aTimestamp, sizeof(Header.m_aTimestamp));
 	io_write(DemoFile, &Header, sizeof(Header));
 
-	// write map data
-	while(1)
-	{
-		unsigned char aChunk[1024*64];
-		int Bytes = io_read(MapFile, &aChunk, sizeof(aChunk));
-		if(Bytes <= 0)
-			break;
-		io_write(DemoFile, &aChunk, Bytes);
-	}
-	io_close(MapFile);
-
 	m_LastKeyFrame = -1;
 	m_LastTickMarker = -1;
 	m_FirstTick = -1;
+	m_lKeyFrames.clear();
+
+	m_pRingMemory = mem_alloc_tagged(RING_SIZE, sizeof(void*), MEMTAG_DEMO);
+	m_Ring.Init(m_pRingMemory, RING_SIZE);
+	m_QueuedBytes = 0;
+	m_Stopping = 0;
+	m_ForceKeyframe = false;
+	m_FirstQueuedTick = -1;
+	m_LastQueuedTick = -1;
+	m_LastSnapshotSize = 0;
+	mem_zero(&m_Stats, sizeof(m_Stats));
 
 	char aBuf[256];
 	str_format(aBuf, sizeof(aBuf), "Recording to '%s'", pFilename);
 	m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "demo_recorder", aBuf);
 	m_File = DemoFile;
 
+	// the map data gets copied by the writer thread too
+	m_MapFile = MapFile;
+	m_pThread = thread_create(WriterThread, this);
+
 	return 0;
 }
 
-/*
-	Tickmarker
-		7	= Always set
-		6	= Keyframe flag
-		0-5	= Delta tick
+bool CDemoRecorder::Queue(int Type, int Tick, int Keyframe, const void *pData, int Size)
+{
+	int ChunkSize = sizeof(CQueuedChunk)+Size;
 
-	Normal
-		7 = Not set
-		5-6	= Type
-		0-4	= Size
-*/
+	lock_wait(m_Lock);
+	CQueuedChunk *pChunk = 0;
+	if(Type == CHUNKTYPE_MESSAGE || m_QueuedBytes+ChunkSize <= RING_SIZE-MESSAGE_RESERVE)
+		pChunk = m_Ring.Allocate(ChunkSize);
+	if(pChunk)
+	{
+		pChunk->m_Type = Type;
+		pChunk->m_Tick = Tick;
+		pChunk->m_Keyframe = Keyframe;
+		pChunk->m_Size = Size;
+		mem_copy(pChunk+1, pData, Size);
+		m_QueuedBytes += ChunkSize;
+		if(m_QueuedBytes > m_Stats.m_PeakQueued)
+			m_Stats.m_PeakQueued = m_QueuedBytes;
+	}
+	lock_release(m_Lock);
+	if(pChunk)
+		semaphore_signal(m_Wakeup);
+	return pChunk != 0;
+}
 
-enum
+void CDemoRecorder::WriterThread(void *pUser)
 {
-	CHUNKTYPEFLAG_TICKMARKER = 0x80,
-	CHUNKTICKFLAG_KEYFRAME = 0x40, // only when tickmarker is set
+	CDemoRecorder *pSelf = (CDemoRecorder *)pUser;
 
-	CHUNKMASK_TICK = 0x3f,
-	CHUNKMASK_TYPE = 0x60,
-	CHUNKMASK_SIZE = 0x1f,
+	// write map data
+	while(1)
+	{
+		unsigned char aChunk[1024*64];
+		int Bytes = io_read(pSelf->m_MapFile, &aChunk, sizeof(aChunk));
+		if(Bytes <= 0)
+			break;
+		io_write(pSelf->m_File, &aChunk, Bytes);
+	}
+	io_close(pSelf->m_MapFile);
+	pSelf->m_MapFile = 0;
 
-	CHUNKTYPE_SNAPSHOT = 1,
-	CHUNKTYPE_MESSAGE = 2,
-	CHUNKTYPE_DELTA = 3,
+	// encode and write whatever gets queued, until the recording stops and the ring is drained
+	static const int s_BufferSize = sizeof(CQueuedChunk)+CSnapshot::MAX_SIZE;
+	CQueuedChunk *pChunk = (CQueuedChunk *)mem_alloc_tagged(s_BufferSize, 1, MEMTAG_DEMO);
+	while(1)
+	{
+		// every chunk and the stop request come with one signal, so the
+		// count is back to zero once the writer leaves
+		semaphore_wait(pSelf->m_Wakeup);
+
+		bool Found = false;
+		lock_wait(pSelf->m_Lock);
+		CQueuedChunk *pFirst = pSelf->m_Ring.First();
+		if(pFirst)
+		{
+			int ChunkSize = sizeof(CQueuedChunk)+pFirst->m_Size;
+			mem_copy(pChunk, pFirst, ChunkSize);
+			pSelf->m_Ring.PopFirst();
+			pSelf->m_QueuedBytes -= ChunkSize;
+			Found = true;
+		}
+		lock_release(pSelf->m_Lock);
 
-	CHUNKFLAG_BIGSIZE = 0x10
-};
+		if(!Found)
+		{
+			if(pSelf->m_Stopping)
+				break;
+			continue;
+		}
+
+		if(pChunk->m_Type == CHUNKTYPE_SNAPSHOT)
+			pSelf->WriteSnapshot(pChunk->m_Tick, pChunk->m_Keyframe, pChunk+1, pChunk->m_Size);
+		else
+			pSelf->Write(pChunk->m_Type, pChunk+1, pChunk->m_Size);
+		pSelf->m_WriteArena.Reset();
+	}
+	mem_free(pChunk);
+}
 
 void CDemoRecorder::WriteTickMarker(int Tick, int Keyframe)
 {
@@ -172,21 +316,28 @@ void CDemoRecorder::WriteTickMarker(int Tick, int Keyframe)
 
 void CDemoRecorder::Write(int Type, const void *pData, int Size)
 {
-	char aBuffer[64*1024];
-	char aBuffer2[64*1024];
-	unsigned char aChunk[3];
-
 	if(!m_File)
 		return;
 
+	const int BufferSize = 64*1024;
+	char *pBuffer = (char *)m_WriteArena.Allocate(BufferSize);
+	char *pBuffer2 = (char *)m_WriteArena.Allocate(BufferSize);
+
 	/* pad the data with 0 so we get an alignment of 4,
 	else the compression won't work and miss some bytes */
-	mem_copy(aBuffer2, pData, Size);
+	mem_copy(pBuffer2, pData, Size);
 	while(Size&3)
-		aBuffer2[Size++] = 0;
-	Size = CVariableInt::Compress(aBuffer2, Size, aBuffer); // buffer2 -> buffer
-	Size = CNetBase::Compress(aBuffer, Size, aBuffer2, sizeof(aBuffer2)); // buffer -> buffer2
+		pBuffer2[Size++] = 0;
+	Size = CVariableInt::Compress(pBuffer2, Size, pBuffer); // buffer2 -> buffer
+	Size = CNetBase::Compress(pBuffer, Size, pBuffer2, BufferSize); // buffer -> buffer2
+
+	WriteChunkHeader(Type, Size);
+	io_write(m_File, pBuffer2, Size);
+}
 
+void CDemoRecorder::WriteChunkHeader(int Type, int Size)
+{
+	unsigned char aChunk[3];
 
 	aChunk[0] = ((Type&0x3)<<5);
 	if(Size < 30)
@@ -210,14 +361,93 @@ void CDemoRecorder::Write(int Type, const void *pData, int Size)
 			io_write(m_File, aChunk, 3);
 		}
 	}
+}
 
-	io_write(m_File, aBuffer2, Size);
+void CDemoRecorder::WriteIndex()
+{
+	unsigned char aPrefix[16];
+	int PrefixSize = CNetBase::Compress(0, 0, aPrefix, sizeof(aPrefix));
+	unsigned char aBuf[16+INDEX_MAX_ENTRIES_PER_CHUNK*INDEX_ENTRY_SIZE+INDEX_FOOTER_SIZE];
+	long IndexOffset = io_tell(m_File);
+	int NumKeyFrames = m_lKeyFrames.size();
+
+	int Written = 0;
+	do
+	{
+		int Num = min(NumKeyFrames-Written, (int)INDEX_MAX_ENTRIES_PER_CHUNK);
+		int Size = PrefixSize;
+		mem_copy(aBuf, aPrefix, PrefixSize);
+		for(int i = Written; i < Written+Num; i++, Size += INDEX_ENTRY_SIZE)
+		{
+			WriteIndexInt(aBuf+Size, (int)m_lKeyFrames[i].m_Filepos);
+			WriteIndexInt(aBuf+Size+4, m_lKeyFrames[i].m_Tick);
+		}
+		Written += Num;
+
+		if(Written == NumKeyFrames)
+		{
+			mem_copy(aBuf+Size, gs_aIndexMarker, sizeof(gs_aIndexMarker));
+			WriteIndexInt(aBuf+Size+4, NumKeyFrames);
+			WriteIndexInt(aBuf+Size+8, m_FirstTick);
+			WriteIndexInt(aBuf+Size+12, m_LastTickMarker);
+			WriteIndexInt(aBuf+Size+16, (int)IndexOffset);
+			Size += INDEX_FOOTER_SIZE;
+		}
+
+		WriteChunkHeader(0, Size);
+		io_write(m_File, aBuf, Size);
+	}
+	while(Written < NumKeyFrames);
+}
+
+bool CDemoRecorder::ReserveSnapshot()
+{
+	if(!m_File)
+		return false;
+
+	// the ring has to fit a snapshot about as big as the last one, else it gets dropped
+	lock_wait(m_Lock);
+	bool Room = m_QueuedBytes+(int)sizeof(CQueuedChunk)+m_LastSnapshotSize*2 <= RING_SIZE-MESSAGE_RESERVE;
+	lock_release(m_Lock);
+	if(!Room)
+	{
+		m_Stats.m_NumDroppedSnapshots++;
+		m_ForceKeyframe = true;
+	}
+	return Room;
 }
 
 void CDemoRecorder::RecordSnapshot(int Tick, const void *pData, int Size)
 {
-	if(m_LastKeyFrame == -1 || (Tick-m_LastKeyFrame) > SERVER_TICK_SPEED*5)
+	if(!m_File)
+		return;
+
+	// after a drop the next snapshot is a keyframe, so playback and seeking pick up cleanly behind the gap
+	if(!Queue(CHUNKTYPE_SNAPSHOT, Tick, m_ForceKeyframe, pData, Size))
+	{
+		m_Stats.m_NumDroppedSnapshots++;
+		m_ForceKeyframe = true;
+		return;
+	}
+
+	m_Stats.m_NumSnapshots++;
+	m_ForceKeyframe = false;
+	m_LastSnapshotSize = Size;
+	m_LastQueuedTick = Tick;
+	if(m_FirstQueuedTick < 0)
+		m_FirstQueuedTick = Tick;
+}
+
+void CDemoRecorder::WriteSnapshot(int Tick, int Keyframe, const void *pData, int Size)
+{
+	if(Keyframe || m_LastKeyFrame == -1 || (Tick-m_LastKeyFrame) >= m_KeyFrameInterval)
 	{
+		// remember where it starts for the index
+		CKeyFrame KeyFrame;
+		KeyFrame.m_Filepos = io_tell(m_File);
+		KeyFrame.m_Tick = Tick;
+		m_lKeyFrames.add(KeyFrame);
+
 		// write full tickmarker
 		WriteTickMarker(Tick, 1);
 
@@ -230,17 +460,17 @@ void CDemoRecorder::RecordSnapshot(int Tick, const void *pData, int Size)
 	else
 	{
 		// create delta, prepend tick
-		char aDeltaData[CSnapshot::MAX_SIZE+sizeof(int)];
+		char *pDeltaData = (char *)m_WriteArena.Allocate(CSnapshot::MAX_SIZE+sizeof(int));
 		int DeltaSize;
 
 		// write tickmarker
 		WriteTickMarker(Tick, 0);
 
-		DeltaSize = m_pSnapshotDelta->CreateDelta((CSnapshot*)m_aLastSnapshotData, (CSnapshot*)pData, &aDeltaData);
+		DeltaSize = m_pSnapshotDelta->CreateDelta((CSnapshot*)m_aLastSnapshotData, (CSnapshot*)pData, pDeltaData);
 		if(DeltaSize)
 		{
 			// record delta
-			Write(CHUNKTYPE_DELTA, aDeltaData, DeltaSize);
+			Write(CHUNKTYPE_DELTA, pDeltaData, DeltaSize);
 			mem_copy(m_aLastSnapshotData, pData, Size);
 		}
 	}
@@ -248,7 +478,13 @@ void CDemoRecorder::RecordSnapshot(int Tick, const void *pData, int Size)
 
 void CDemoRecorder::RecordMessage(const void *pData, int Size)
 {
-	Write(CHUNKTYPE_MESSAGE, pData, Size);
+	if(!m_File)
+		return;
+
+	if(Queue(CHUNKTYPE_MESSAGE, m_LastQueuedTick, 0, pData, Size))
+		m_Stats.m_NumMessages++;
+	else
+		m_Stats.m_NumDroppedMessages++;
 }
 
 int CDemoRecorder::Stop()
@@ -256,6 +492,17 @@ int CDemoRecorder::Stop()
 	if(!m_File)
 		return -1;
 
+	// let the writer drain the ring
+	m_Stopping = 1;
+	semaphore_signal(m_Wakeup);
+	thread_wait(m_pThread);
+	m_pThread = 0;
+	mem_free(m_pRingMemory);
+	m_pRingMemory = 0;
+
+	// add the keyframe index so players don't have to scan the whole demo
+	WriteIndex();
+
 	// add the demo length to the header
 	io_seek(m_File, gs_LengthOffset, IOSEEK_START);
 	int DemoLength = Length();
@@ -270,6 +517,11 @@ int CDemoRecorder::Stop()
 	m_File = 0;
 	m_pConsole->Print(IConsole::OUTPUT_LEVEL_STANDARD, "demo_recorder", "Stopped recording");
 
+	char aBuf[256];
+	str_format(aBuf, sizeof(aBuf), "snapshots=%d dropped=%d messages=%d dropped=%d peak queue=%dk",
+		m_Stats.m_NumSnapshots, m_Stats.m_NumDroppedSnapshots, m_Stats.m_NumMessages, m_Stats.m_NumDroppedMessages, m_Stats.m_PeakQueued/1024);
+	m_pConsole->Print(m_Stats.m_NumDroppedSnapshots || m_Stats.m_NumDroppedMessages ? IConsole::OUTPUT_LEVEL_STANDARD : IConsole::OUTPUT_LEVEL_ADDINFO, "demo_recorder", aBuf);
+
 	return 0;
 }
 
@@ -279,9 +531,59 @@ CDemoPlayer::CDemoPlayer(class CSnapshotDelta *pSnapshotDelta)
 {
 	m_File = 0;
 	m_pKeyFrames = 0;
+	m_UseIndexCache = false;
 
 	m_pSnapshotDelta = pSnapshotDelta;
 	m_LastSnapshotDataSize = -1;
+	m_SeekTick = -1;
+
+	mem_zero(m_aSnapshotCache, sizeof(m_aSnapshotCache));
+	m_SnapshotCacheUse = 0;
+	ClearSnapshotCache();
+}
+
+CDemoPlayer::~CDemoPlayer()
+{
+	for(int i = 0; i < SNAPSHOT_CACHE_SIZE; i++)
+		mem_free(m_aSnapshotCache[i].m_pData);
+}
+
+CDemoPlayer::CCachedSnapshot *CDemoPlayer::FindCachedSnapshot(long Filepos)
+{
+	for(int i = 0; i < SNAPSHOT_CACHE_SIZE; i++)
+	{
+		if(m_aSnapshotCache[i].m_Filepos == Filepos)
+		{
+			m_aSnapshotCache[i].m_LastUse = ++m_SnapshotCacheUse;
+			return &m_aSnapshotCache[i];
+		}
+	}
+	return 0;
+}
+
+void CDemoPlayer::CacheSnapshot(long Filepos, const void *pData, int Size)
+{
+	// replace the least recently used one
+	CCachedSnapshot *pEntry = &m_aSnapshotCache[0];
+	for(int i = 1; i < SNAPSHOT_CACHE_SIZE; i++)
+		if(m_aSnapshotCache[i].m_LastUse < pEntry->m_LastUse)
+			pEntry = &m_aSnapshotCache[i];
+
+	if(!pEntry->m_pData)
+		pEntry->m_pData = (char *)mem_alloc_tagged(CSnapshot::MAX_SIZE, 1, MEMTAG_DEMO);
+	mem_copy(pEntry->m_pData, pData, Size);
+	pEntry->m_Filepos = Filepos;
+	pEntry->m_Size = Size;
+	pEntry->m_LastUse = ++m_SnapshotCacheUse;
+}
+
+void CDemoPlayer::ClearSnapshotCache()
+{
+	for(int i = 0; i < SNAPSHOT_CACHE_SIZE; i++)
+	{
+		m_aSnapshotCache[i].m_Filepos = -1;
+		m_aSnapshotCache[i].m_LastUse = 0;
+	}
 }
 
 void CDemoPlayer::SetListner(IListner *pListner)
@@ -395,7 +697,7 @@ void CDemoPlayer::ScanFile()
 	}
 
 	// copy all the frames to an array instead for fast access
-	m_pKeyFrames = (CKeyFrame*)mem_alloc(m_Info.m_SeekablePoints*sizeof(CKeyFrame), 1);
+	m_pKeyFrames = (CKeyFrame*)mem_alloc_tagged(m_Info.m_SeekablePoints*sizeof(CKeyFrame), 1, MEMTAG_DEMO);
 	for(pCurrentKey = pFirstKey, i = 0; pCurrentKey; pCurrentKey = pCurrentKey->m_pNext, i++)
 		m_pKeyFrames[i] = pCurrentKey->m_Frame;
 
@@ -403,11 +705,159 @@ void CDemoPlayer::ScanFile()
 	io_seek(m_File, StartPos, IOSEEK_START);
 }
 
+bool CDemoPlayer::ReadIndex()
+{
+	long StartPos = io_tell(m_File);
+	long FileSize = io_length(m_File);
+	unsigned char aFooter[INDEX_FOOTER_SIZE];
+
+	// the footer makes up the last bytes of the file
+	if(FileSize < StartPos+INDEX_FOOTER_SIZE || io_seek(m_File, FileSize-INDEX_FOOTER_SIZE, IOSEEK_START) != 0 ||
+		io_read(m_File, aFooter, sizeof(aFooter)) != sizeof(aFooter) || mem_comp(aFooter, gs_aIndexMarker, sizeof(gs_aIndexMarker)) != 0)
+	{
+		io_seek(m_File, StartPos, IOSEEK_START);
+		return false;
+	}
+
+	int NumKeyFrames = ReadIndexInt(aFooter+4);
+	int FirstTick = ReadIndexInt(aFooter+8);
+	int LastTick = ReadIndexInt(aFooter+12);
+	long IndexOffset = ReadIndexInt(aFooter+16);
+	if(NumKeyFrames < 0 || IndexOffset < StartPos || IndexOffset >= FileSize || NumKeyFrames > (FileSize-IndexOffset)/INDEX_ENTRY_SIZE)
+	{
+		io_seek(m_File, StartPos, IOSEEK_START);
+		return false;
+	}
+
+	unsigned char aPrefix[16];
+	int PrefixSize = CNetBase::Compress(0, 0, aPrefix, sizeof(aPrefix));
+	CKeyFrame *pKeyFrames = (CKeyFrame*)mem_alloc(max(NumKeyFrames, 1)*sizeof(CKeyFrame), 1);
+	unsigned char *pChunk = (unsigned char *)m_aCompressedData;
+	bool Valid = io_seek(m_File, IndexOffset, IOSEEK_START) == 0;
+	int Read = 0;
+
+	// the chunks are split the same way the recorder did it
+	while(Valid)
+	{
+		int Num = min(NumKeyFrames-Read, (int)INDEX_MAX_ENTRIES_PER_CHUNK);
+		bool Last = Read+Num == NumKeyFrames;
+		int ChunkType, ChunkSize, ChunkTick = 0;
+		if(ReadChunkHeader(&ChunkType, &ChunkSize, &ChunkTick) || ChunkType != 0 ||
+			ChunkSize != PrefixSize+Num*INDEX_ENTRY_SIZE+(Last ? INDEX_FOOTER_SIZE : 0) ||
+			io_read(m_File, pChunk, ChunkSize) != (unsigned)ChunkSize || mem_comp(pChunk, aPrefix, PrefixSize) != 0)
+		{
+			Valid = false;
+			break;
+		}
+
+		for(int i = 0; i < Num; i++, Read++)
+		{
+			const unsigned char *pEntry = pChunk+PrefixSize+i*INDEX_ENTRY_SIZE;
+			pKeyFrames[Read].m_Filepos = ReadIndexInt(pEntry);
+			pKeyFrames[Read].m_Tick = ReadIndexInt(pEntry+4);
+			if(pKeyFrames[Read].m_Filepos < StartPos || pKeyFrames[Read].m_Filepos >= IndexOffset ||
+				(Read > 0 && (pKeyFrames[Read].m_Filepos <= pKeyFrames[Read-1].m_Filepos || pKeyFrames[Read].m_Tick < pKeyFrames[Read-1].m_Tick)))
+				Valid = false;
+		}
+
+		if(Last)
+			break;
+	}
+
+	io_seek(m_File, StartPos, IOSEEK_START);
+	if(!Valid)
+	{
+		mem_free(pKeyFrames);
+		return false;
+	}
+
+	m_pKeyFrames = pKeyFrames;
+	m_Info.m_SeekablePoints = NumKeyFrames;
+	m_Info.m_Info.m_FirstTick = FirstTick;
+	m_Info.m_Info.m_LastTick = LastTick;
+	return true;
+}
+
+bool CDemoPlayer::ReadIndexCache(IStorage *pStorage, const char *pCacheFilename, unsigned DemoSize, long int DemoMtime)
+{
+	IOHANDLE File = pStorage->OpenFile(pCacheFilename, IOFLAG_READ, IStorage::TYPE_SAVE);
+	if(!File)
+		return false;
+
+	// only use it while the demo is unchanged
+	unsigned char aHeader[INDEX_CACHE_HEADER_SIZE];
+	char aFilename[256];
+	bool Valid = io_read(File, aHeader, sizeof(aHeader)) == sizeof(aHeader) && mem_comp(aHeader, gs_aIndexCacheMarker, sizeof(gs_aIndexCacheMarker)) == 0 &&
+		(unsigned)ReadIndexInt(aHeader+4) == DemoSize && ReadIndexInt(aHeader+8) == (int)(DemoMtime>>16>>16) && ReadIndexInt(aHeader+12) == (int)DemoMtime &&
+		io_read(File, aFilename, sizeof(aFilename)) == sizeof(aFilename) && mem_comp(aFilename, m_aFilename, sizeof(aFilename)) == 0;
+
+	int NumKeyFrames = Valid ? ReadIndexInt(aHeader+16) : -1;
+	if(NumKeyFrames < 0 || NumKeyFrames > (int)(DemoSize/2))
+	{
+		io_close(File);
+		return false;
+	}
+
+	CKeyFrame *pKeyFrames = (CKeyFrame*)mem_alloc(max(NumKeyFrames, 1)*sizeof(CKeyFrame), 1);
+	for(int i = 0; i < NumKeyFrames && Valid; i++)
+	{
+		unsigned char aEntry[INDEX_ENTRY_SIZE];
+		Valid = io_read(File, aEntry, sizeof(aEntry)) == sizeof(aEntry);
+		pKeyFrames[i].m_Filepos = ReadIndexInt(aEntry);
+		pKeyFrames[i].m_Tick = ReadIndexInt(aEntry+4);
+		if(pKeyFrames[i].m_Filepos < 0 || pKeyFrames[i].m_Filepos >= (long)DemoSize)
+			Valid = false;
+	}
+	io_close(File);
+
+	if(!Valid)
+	{
+		mem_free(pKeyFrames);
+		return false;
+	}
+
+	m_pKeyFrames = pKeyFrames;
+	m_Info.m_SeekablePoints = NumKeyFrames;
+	m_Info.m_Info.m_FirstTick = ReadIndexInt(aHeader+20);
+	m_Info.m_Info.m_LastTick = ReadIndexInt(aHeader+24);
+	return true;
+}
+
+void CDemoPlayer::WriteIndexCache(IStorage *pStorage, const char *pCacheFilename, unsigned DemoSize, long int DemoMtime)
+{
+	if(DemoMtime < 0)
+		return;
+
+	IOHANDLE File = pStorage->OpenFile(pCacheFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+	if(!File)
+		return;
+
+	unsigned char aHeader[INDEX_CACHE_HEADER_SIZE];
+	char aFilename[256];
+	mem_copy(aHeader, gs_aIndexCacheMarker, sizeof(gs_aIndexCacheMarker));
+	WriteIndexInt(aHeader+4, DemoSize);
+	WriteIndexInt(aHeader+8, (int)(DemoMtime>>16>>16));
+	WriteIndexInt(aHeader+12, (int)DemoMtime);
+	WriteIndexInt(aHeader+16, m_Info.m_SeekablePoints);
+	WriteIndexInt(aHeader+20, m_Info.m_Info.m_FirstTick);
+	WriteIndexInt(aHeader+24, m_Info.m_Info.m_LastTick);
+	mem_zero(aFilename, sizeof(aFilename));
+	str_copy(aFilename, m_aFilename, sizeof(aFilename));
+	io_write(File, aHeader, sizeof(aHeader));
+	io_write(File, aFilename, sizeof(aFilename));
+
+	for(int i = 0; i < m_Info.m_SeekablePoints; i++)
+	{
+		unsigned char aEntry[INDEX_ENTRY_SIZE];
+		WriteIndexInt(aEntry, (int)m_pKeyFrames[i].m_Filepos);
+		WriteIndexInt(aEntry+4, m_pKeyFrames[i].m_Tick);
+		io_write(File, aEntry, sizeof(aEntry));
+	}
+	io_close(File);
+}
+
 void CDemoPlayer::DoTick()
 {
-	static char aCompresseddata[CSnapshot::MAX_SIZE];
-	static char aDecompressed[CSnapshot::MAX_SIZE];
-	static char aData[CSnapshot::MAX_SIZE];
 	int ChunkType, ChunkTick, ChunkSize;
 	int DataSize = 0;
 	int GotSnapshot = 0;
@@ -417,6 +867,9 @@ void CDemoPlayer::DoTick()
 	m_Info.m_Info.m_CurrentTick = m_Info.m_NextTick;
 	ChunkTick = m_Info.m_Info.m_CurrentTick;
 
+	// while seeking only the ticks we end up at are passed on
+	IListner *pListner = m_Info.m_Info.m_CurrentTick >= m_SeekTick ? m_pListner : 0;
+
 	while(1)
 	{
 		if(ReadChunkHeader(&ChunkType, &ChunkSize, &ChunkTick))
@@ -433,10 +886,25 @@ void CDemoPlayer::DoTick()
 			break;
 		}
 
+		// messages nobody gets to see don't need to be decoded
+		if(!pListner && ChunkType == CHUNKTYPE_MESSAGE)
+		{
+			io_skip(m_File, ChunkSize);
+			continue;
+		}
+
 		// read the chunk
-		if(ChunkSize)
+		long ChunkPos = io_tell(m_File);
+		CCachedSnapshot *pCached = ChunkType == CHUNKTYPE_SNAPSHOT ? FindCachedSnapshot(ChunkPos) : 0;
+		if(pCached)
 		{
-			if(io_read(m_File, aCompresseddata, ChunkSize) != (unsigned)ChunkSize)
+			io_skip(m_File, ChunkSize);
+			DataSize = pCached->m_Size;
+			mem_copy(m_aData, pCached->m_pData, DataSize);
+		}
+		else if(ChunkSize)
+		{
+			if(io_read(m_File, m_aCompressedData, ChunkSize) != (unsigned)ChunkSize)
 			{
 				// stop on error or eof
 				m_pConsole->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "demo_player", "error reading chunk");
@@ -444,7 +912,7 @@ void CDemoPlayer::DoTick()
 				break;
 			}
 
-			DataSize = CNetBase::Decompress(aCompresseddata, ChunkSize, aDecompressed, sizeof(aDecompressed));
+			DataSize = CNetBase::Decompress(m_aCompressedData, ChunkSize, m_aDecompressedData, sizeof(m_aDecompressedData));
 			if(DataSize < 0)
 			{
 				// stop on error or eof
@@ -453,7 +921,7 @@ void CDemoPlayer::DoTick()
 				break;
 			}
 
-			DataSize = CVariableInt::Decompress(aDecompressed, DataSize, aData);
+			DataSize = CVariableInt::Decompress(m_aDecompressedData, DataSize, m_aData);
 
 			if(DataSize < 0)
 			{
@@ -461,24 +929,25 @@ void CDemoPlayer::DoTick()
 				Stop();
 				break;
 			}
+
+			if(ChunkType == CHUNKTYPE_SNAPSHOT)
+				CacheSnapshot(ChunkPos, m_aData, DataSize);
 		}
 
 		if(ChunkType == CHUNKTYPE_DELTA)
 		{
 			// process delta snapshot
-			static char aNewsnap[CSnapshot::MAX_SIZE];
-
 			GotSnapshot = 1;
 
-			DataSize = m_pSnapshotDelta->UnpackDelta((CSnapshot*)m_aLastSnapshotData, (CSnapshot*)aNewsnap, aData, DataSize);
+			DataSize = m_pSnapshotDelta->UnpackDelta((CSnapshot*)m_aLastSnapshotData, (CSnapshot*)m_aNewSnapshotData, m_aData, DataSize);
 
 			if(DataSize >= 0)
 			{
-				if(m_pListner)
-					m_pListner->OnDemoPlayerSnapshot(aNewsnap, DataSize);
+				if(pListner)
+					pListner->OnDemoPlayerSnapshot(m_aNewSnapshotData, DataSize);
 
 				m_LastSnapshotDataSize = DataSize;
-				mem_copy(m_aLastSnapshotData, aNewsnap, DataSize);
+				mem_copy(m_aLastSnapshotData, m_aNewSnapshotData, DataSize);
 			}
 			else
 			{
@@ -493,17 +962,17 @@ void CDemoPlayer::DoTick()
 			GotSnapshot = 1;
 
 			m_LastSnapshotDataSize = DataSize;
-			mem_copy(m_aLastSnapshotData, aData, DataSize);
-			if(m_pListner)
-				m_pListner->OnDemoPlayerSnapshot(aData, DataSize);
+			mem_copy(m_aLastSnapshotData, m_aData, DataSize);
+			if(pListner)
+				pListner->OnDemoPlayerSnapshot(m_aData, DataSize);
 		}
 		else
 		{
 			// if there were no snapshots in this tick, replay the last one
-			if(!GotSnapshot && m_pListner && m_LastSnapshotDataSize != -1)
+			if(!GotSnapshot && pListner && m_LastSnapshotDataSize != -1)
 			{
 				GotSnapshot = 1;
-				m_pListner->OnDemoPlayerSnapshot(m_aLastSnapshotData, m_LastSnapshotDataSize);
+				pListner->OnDemoPlayerSnapshot(m_aLastSnapshotData, m_LastSnapshotDataSize);
 			}
 
 			// check the remaining types
@@ -514,8 +983,8 @@ void CDemoPlayer::DoTick()
 			}
 			else if(ChunkType == CHUNKTYPE_MESSAGE)
 			{
-				if(m_pListner)
-					m_pListner->OnDemoPlayerMessage(aData, DataSize);
+				if(pListner)
+					pListner->OnDemoPlayerMessage(m_aData, DataSize);
 			}
 		}
 	}
@@ -549,7 +1018,10 @@ int CDemoPlayer::Load(class IStorage *pStorage, class IConsole *pConsole, const
 	}
 
 	// store the filename
+	mem_zero(m_aFilename, sizeof(m_aFilename));
 	str_copy(m_aFilename, pFilename, sizeof(m_aFilename));
+	unsigned DemoSize = io_length(m_File);
+	long int DemoMtime = io_mtime(m_File);
 
 	// clear the playback info
 	mem_zero(&m_Info, sizeof(m_Info));
@@ -561,6 +1033,8 @@ int CDemoPlayer::Load(class IStorage *pStorage, class IConsole *pConsole, const
 	m_Info.m_Info.m_Speed = 1;
 
 	m_LastSnapshotDataSize = -1;
+	m_SeekTick = -1;
+	ClearSnapshotCache();
 
 	// read the header
 	io_read(m_File, &m_Info.m_Header, sizeof(m_Info.m_Header));
@@ -623,8 +1097,18 @@ int CDemoPlayer::Load(class IStorage *pStorage, class IConsole *pConsole, const
 	}
 
 
-	// scan the file for interessting points
-	ScanFile();
+	// demos recorded with an index don't need to be scanned for interessting points
+	if(!ReadIndex())
+	{
+		char aCacheFilename[128];
+		str_format(aCacheFilename, sizeof(aCacheFilename), "demoindex/%08x.idx", str_quickhash(pFilename));
+		if(!m_UseIndexCache || DemoMtime < 0 || !ReadIndexCache(pStorage, aCacheFilename, DemoSize, DemoMtime))
+		{
+			ScanFile();
+			if(m_UseIndexCache)
+				WriteIndexCache(pStorage, aCacheFilename, DemoSize, DemoMtime);
+		}
+	}
 
 	// ready for playback
 	return 0;
@@ -652,26 +1136,24 @@ int CDemoPlayer::Play()
 
 int CDemoPlayer::SetPos(float Percent)
 {
-	int Keyframe;
 	int WantedTick;
-	if(!m_File)
+	if(!m_File || m_Info.m_SeekablePoints <= 0 || Percent < 0.0f || Percent > 1.0f)
 		return -1;
 
 	// -5 because we have to have a current tick and previous tick when we do the playback
 	WantedTick = m_Info.m_Info.m_FirstTick + (int)((m_Info.m_Info.m_LastTick-m_Info.m_Info.m_FirstTick)*Percent) - 5;
 
-	Keyframe = (int)(m_Info.m_SeekablePoints*Percent);
-
-	if(Keyframe < 0 || Keyframe >= m_Info.m_SeekablePoints)
-		return -1;
-
-	// get correct key frame
-	if(m_pKeyFrames[Keyframe].m_Tick < WantedTick)
-		while(Keyframe < m_Info.m_SeekablePoints-1 && m_pKeyFrames[Keyframe].m_Tick < WantedTick)
-			Keyframe++;
-
-	while(Keyframe && m_pKeyFrames[Keyframe].m_Tick > WantedTick)
-		Keyframe--;
+	// get the last key frame before the wanted tick
+	int Keyframe = 0;
+	int Last = m_Info.m_SeekablePoints-1;
+	while(Keyframe < Last)
+	{
+		int Mid = (Keyframe+Last+1)/2;
+		if(m_pKeyFrames[Mid].m_Tick <= WantedTick)
+			Keyframe = Mid;
+		else
+			Last = Mid-1;
+	}
 
 	// seek to the correct keyframe
 	io_seek(m_File, m_pKeyFrames[Keyframe].m_Filepos, IOSEEK_START);
@@ -681,9 +1163,11 @@ int CDemoPlayer::SetPos(float Percent)
 	m_Info.m_Info.m_CurrentTick = -1;
 	m_Info.m_PreviousTick = -1;
 
-	// playback everything until we hit our tick
-	while(m_Info.m_PreviousTick < WantedTick)
+	// playback everything until we hit our tick, without passing on the ticks in between
+	m_SeekTick = WantedTick;
+	while(m_Info.m_PreviousTick < WantedTick && IsPlaying())
 		DoTick();
+	m_SeekTick = -1;
 
 	Play();
 
@@ -3,35 +3,99 @@
 #ifndef ENGINE_SHARED_DEMO_H
 #define ENGINE_SHARED_DEMO_H
 
+#include <base/tl/array.h>
+
 #include <engine/demo.h>
 #include <engine/shared/protocol.h>
 
+#include "memheap.h"
+#include "ringbuffer.h"
 #include "snapshot.h"
 
 class CDemoRecorder : public IDemoRecorder
 {
+public:
+	struct CStats
+	{
+		int m_NumSnapshots;
+		int m_NumDroppedSnapshots;
+		int m_NumMessages;
+		int m_NumDroppedMessages;
+		int m_PeakQueued; // bytes
+	};
+
+private:
+	enum
+	{
+		RING_SIZE=2*1024*1024,
+		MESSAGE_RESERVE=64*1024, // snapshots can't take the last bit, so messages still fit when the disk falls behind
+	};
+
+	// raw snapshot or message, followed by its data
+	struct CQueuedChunk
+	{
+		int m_Type;
+		int m_Tick;
+		int m_Keyframe;
+		int m_Size;
+	};
+
+	struct CKeyFrame
+	{
+		long m_Filepos;
+		int m_Tick;
+	};
+
 	class IConsole *m_pConsole;
 	IOHANDLE m_File;
+	IOHANDLE m_MapFile;
 	int m_LastTickMarker;
 	int m_LastKeyFrame;
+	int m_KeyFrameInterval;
 	int m_FirstTick;
 	unsigned char m_aLastSnapshotData[CSnapshot::MAX_SIZE];
 	class CSnapshotDelta *m_pSnapshotDelta;
+	CFrameArena m_WriteArena; // buffers of the writer thread, reset after each chunk
+	array<CKeyFrame> m_lKeyFrames; // written as index at the end of the demo
+
+	// the writer thread encodes and writes everything that is queued in the ring
+	void *m_pThread;
+	LOCK m_Lock;
+	SEMAPHORE m_Wakeup; // signaled once per queued chunk and once when stopping
+	void *m_pRingMemory; // only allocated while recording
+	TRingBuffer<CQueuedChunk> m_Ring;
+	int m_QueuedBytes;
+	volatile int m_Stopping;
+	bool m_ForceKeyframe;
+	int m_LastQueuedTick;
+	int m_FirstQueuedTick;
+	int m_LastSnapshotSize;
+	CStats m_Stats;
+
+	bool Queue(int Type, int Tick, int Keyframe, const void *pData, int Size);
+	static void WriterThread(void *pUser);
 
 	void WriteTickMarker(int Tick, int Keyframe);
 	void Write(int Type, const void *pData, int Size);
+	void WriteChunkHeader(int Type, int Size);
+	void WriteSnapshot(int Tick, int Keyframe, const void *pData, int Size);
+	void WriteIndex();
 public:
 	CDemoRecorder(class CSnapshotDelta *pSnapshotDelta);
+	~CDemoRecorder();
 
 	int Start(class IStorage *pStorage, class IConsole *pConsole, const char *pFilename, const char *pNetversion, const char *pMap, unsigned MapCrc, const char *pType);
 	int Stop();
 
+	void SetKeyFrameInterval(int Ticks) { m_KeyFrameInterval = Ticks > 0 ? Ticks : 1; } // takes effect with the next Start
+	bool ReserveSnapshot();
 	void RecordSnapshot(int Tick, const void *pData, int Size);
 	void RecordMessage(const void *pData, int Size);
 
 	bool IsRecording() const { return m_File != 0; }
+	const CStats *Stats() const { return &m_Stats; }
 
-	int Length() const { return (m_LastTickMarker - m_FirstTick)/SERVER_TICK_SPEED; }
+	int Length() const { return (m_LastQueuedTick - m_FirstQueuedTick)/SERVER_TICK_SPEED; }
 };
 
 class CDemoPlayer : public IDemoPlayer
@@ -80,27 +144,58 @@ private:
 		CKeyFrameSearch *m_pNext;
 	};
 
+	// decoded keyframe snapshots, so scrubbing back and forth doesn't decode them again
+	enum
+	{
+		SNAPSHOT_CACHE_SIZE=8,
+	};
+
+	struct CCachedSnapshot
+	{
+		long m_Filepos;
+		int m_Size;
+		unsigned m_LastUse;
+		char *m_pData;
+	};
+
 	class IConsole *m_pConsole;
 	IOHANDLE m_File;
 	char m_aFilename[256];
 	CKeyFrame *m_pKeyFrames;
+	bool m_UseIndexCache;
 
 	CPlaybackInfo m_Info;
 	int m_DemoType;
 	unsigned char m_aLastSnapshotData[CSnapshot::MAX_SIZE];
 	int m_LastSnapshotDataSize;
 	class CSnapshotDelta *m_pSnapshotDelta;
-
+	int m_SeekTick;
+
+	// decoding buffers, per player so several demos can be played on different threads
+	char m_aCompressedData[CSnapshot::MAX_SIZE];
+	char m_aDecompressedData[CSnapshot::MAX_SIZE];
+	char m_aData[CSnapshot::MAX_SIZE];
+	char m_aNewSnapshotData[CSnapshot::MAX_SIZE];
+	CCachedSnapshot m_aSnapshotCache[SNAPSHOT_CACHE_SIZE];
+	unsigned m_SnapshotCacheUse;
+
+	CCachedSnapshot *FindCachedSnapshot(long Filepos);
+	void CacheSnapshot(long Filepos, const void *pData, int Size);
+	void ClearSnapshotCache();
 	int ReadChunkHeader(int *pType, int *pSize, int *pTick);
 	void DoTick();
 	void ScanFile();
-	int NextFrame();
+	bool ReadIndex();
+	bool ReadIndexCache(class IStorage *pStorage, const char *pCacheFilename, unsigned DemoSize, long int DemoMtime);
+	void WriteIndexCache(class IStorage *pStorage, const char *pCacheFilename, unsigned DemoSize, long int DemoMtime);
 
 public:
 
 	CDemoPlayer(class CSnapshotDelta *m_pSnapshotDelta);
+	~CDemoPlayer();
 
 	void SetListner(IListner *pListner);
+	void SetIndexCache(bool UseIndexCache) { m_UseIndexCache = UseIndexCache; } // keep the scanned index of demos that have none
 
 	int Load(class IStorage *pStorage, class IConsole *pConsole, const char *pFilename, int StorageType);
 	int Play();
@@ -109,6 +204,7 @@ public:
 	int Stop();
 	void SetSpeed(float Speed);
 	int SetPos(float Precent);
+	int NextFrame(); // decodes the next tick right away, for tools that don't play in real time
 	const CInfo *BaseInfo() const { return &m_Info.m_Info; }
 	void GetDemoName(char *pBuffer, int BufferSize) const;
 	bool GetDemoInfo(class IStorage *pStorage, const char *pFilename, int StorageType, CDemoHeader *pDemoHeader) const;
@@ -1,6 +1,7 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
 
+#include <base/math.h>
 #include <base/system.h>
 
 #include <engine/console.h>
@@ -74,7 +75,9 @@ public:
 		net_init();
 		CNetBase::Init();
 
-		m_JobPool.Init(1);
+		// map data is decompressed on the pool, so give it a few workers. the thread
+		// waiting on the jobs helps out, so it doesn't get a cpu of its own
+		m_JobPool.Init(clamp(cpu_count()-1, 1, 4));
 
 		m_Logging = false;
 	}
@@ -102,14 +105,19 @@ public:
 	{
 		str_copy(pLookup->m_aHostname, pHostname, sizeof(pLookup->m_aHostname));
 		pLookup->m_Nettype = Nettype;
-		AddJob(&pLookup->m_Job, HostLookupThread, pLookup);
+		AddJob(&pLookup->m_Job, HostLookupThread, pLookup, CJobPool::CLASS_IO);
 	}
 
-	void AddJob(CJob *pJob, JOBFUNC pfnFunc, void *pData)
+	void AddJob(CJob *pJob, JOBFUNC pfnFunc, void *pData, int Class)
 	{
 		if(g_Config.m_Debug)
 			dbg_msg("engine", "job added");
-		m_JobPool.Add(pJob, pfnFunc, pData);
+		m_JobPool.Add(pJob, pfnFunc, pData, Class);
+	}
+
+	void ParallelFor(int Begin, int End, int Grain, CJobPool::RANGEFUNC pfnFunc, void *pUser)
+	{
+		m_JobPool.ParallelFor(Begin, End, Grain, pfnFunc, pUser);
 	}
 };
 
@@ -1,75 +1,303 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
 #include <base/system.h>
 #include "jobs.h"
 
+void CJob::Wait()
+{
+	if(m_pPool)
+		m_pPool->Wait(this);
+}
+
+bool CJob::Cancel()
+{
+	return m_pPool ? m_pPool->Cancel(this) : false;
+}
+
 CJobPool::CJobPool()
 {
 	// empty the pool
-	m_Lock = lock_create();
-	m_pFirstJob = 0;
-	m_pLastJob = 0;
+	for(int i = 0; i < MAX_WORKERS+1; i++)
+	{
+		m_aQueues[i].m_Lock = lock_create();
+		m_aQueues[i].m_pFirst = 0;
+		m_aQueues[i].m_pLast = 0;
+	}
+	m_NumWorkers = 0;
+	m_NextQueue = 0;
+	m_CurrentWorker = tls_create();
+
+	m_CpuJobs = semaphore_create();
+	m_IoJobs = semaphore_create();
+
+	m_DoneLock = lock_create();
+	m_DoneSignal = semaphore_create();
+	m_NumWaiters = 0;
 }
 
-void CJobPool::WorkerThread(void *pUser)
+void CJobPool::Push(int Queue, CJob *pJob)
 {
-	CJobPool *pPool = (CJobPool *)pUser;
+	CQueue *pQueue = &m_aQueues[Queue];
+	lock_wait(pQueue->m_Lock);
 
-	while(1)
+	// add job to queue
+	pJob->m_Queue = Queue;
+	pJob->m_pPrev = pQueue->m_pLast;
+	pJob->m_pNext = 0;
+	if(pQueue->m_pLast)
+		pQueue->m_pLast->m_pNext = pJob;
+	pQueue->m_pLast = pJob;
+	if(!pQueue->m_pFirst)
+		pQueue->m_pFirst = pJob;
+
+	lock_release(pQueue->m_Lock);
+}
+
+CJob *CJobPool::Pop(int Queue, bool Newest)
+{
+	CQueue *pQueue = &m_aQueues[Queue];
+	if(!pQueue->m_pFirst)
+		return 0;
+
+	lock_wait(pQueue->m_Lock);
+	CJob *pJob = Newest ? pQueue->m_pLast : pQueue->m_pFirst;
+	if(pJob)
 	{
-		CJob *pJob = 0;
+		if(pJob->m_pPrev)
+			pJob->m_pPrev->m_pNext = pJob->m_pNext;
+		else
+			pQueue->m_pFirst = pJob->m_pNext;
+		if(pJob->m_pNext)
+			pJob->m_pNext->m_pPrev = pJob->m_pPrev;
+		else
+			pQueue->m_pLast = pJob->m_pPrev;
+		pJob->m_Queue = -1;
+	}
+	lock_release(pQueue->m_Lock);
+	return pJob;
+}
 
-		// fetch job from queue
-		lock_wait(pPool->m_Lock);
-		if(pPool->m_pFirstJob)
+CJob *CJobPool::FindJob(int OwnQueue)
+{
+	if(OwnQueue >= 0)
+	{
+		CJob *pJob = Pop(OwnQueue, true);
+		if(pJob)
+			return pJob;
+	}
+
+	// steal from the others, starting after the own queue so not everyone robs the same one
+	for(int i = 1; i <= m_NumWorkers; i++)
+	{
+		CJob *pJob = Pop((max(OwnQueue, 0)+i)%m_NumWorkers, false);
+		if(pJob)
+			return pJob;
+	}
+	return 0;
+}
+
+void CJobPool::RunJob(CJob *pJob)
+{
+	pJob->m_Status = CJob::STATE_RUNNING;
+	Finish(pJob, pJob->m_pfnFunc(pJob->m_pFuncData));
+}
+
+void CJobPool::Finish(CJob *pJob, int Result)
+{
+	// the owner may free the job as soon as it sees it done, so it isn't touched after that
+	lock_wait(m_DoneLock);
+	pJob->m_Result = Result;
+	sync_barrier();
+	pJob->m_Status = CJob::STATE_DONE;
+	int NumWaiters = m_NumWaiters;
+	m_NumWaiters = 0;
+	lock_release(m_DoneLock);
+
+	// the waiters check on their own job again
+	for(int i = 0; i < NumWaiters; i++)
+		semaphore_signal(m_DoneSignal);
+}
+
+void CJobPool::Wait(CJob *pJob)
+{
+	while(pJob->m_Status != CJob::STATE_DONE)
+	{
+		// help out instead of idling
+		CJob *pOther = FindJob(-1);
+		if(pOther)
 		{
-			pJob = pPool->m_pFirstJob;
-			pPool->m_pFirstJob = pPool->m_pFirstJob->m_pNext;
-			if(pPool->m_pFirstJob)
-				pPool->m_pFirstJob->m_pPrev = 0;
-			else
-				pPool->m_pLastJob = 0;
+			RunJob(pOther);
+			continue;
 		}
-		lock_release(pPool->m_Lock);
 
-		// do the job if we have one
-		if(pJob)
+		lock_wait(m_DoneLock);
+		if(pJob->m_Status == CJob::STATE_DONE)
 		{
-			pJob->m_Status = CJob::STATE_RUNNING;
-			pJob->m_Result = pJob->m_pfnFunc(pJob->m_pFuncData);
-			pJob->m_Status = CJob::STATE_DONE;
+			lock_release(m_DoneLock);
+			break;
 		}
-		else
-			thread_sleep(10);
+		m_NumWaiters++;
+		lock_release(m_DoneLock);
+		semaphore_wait(m_DoneSignal);
 	}
 
+	// what the job wrote has to be visible before the caller goes on using it
+	sync_barrier();
+}
+
+bool CJobPool::Cancel(CJob *pJob)
+{
+	int Queue = pJob->m_Queue;
+	if(Queue < 0)
+		return false;
+
+	// a job never moves to another queue, so if it isn't in this one anymore a thread has it
+	CQueue *pQueue = &m_aQueues[Queue];
+	lock_wait(pQueue->m_Lock);
+	if(pJob->m_Queue != Queue)
+	{
+		lock_release(pQueue->m_Lock);
+		return false;
+	}
+
+	if(pJob->m_pPrev)
+		pJob->m_pPrev->m_pNext = pJob->m_pNext;
+	else
+		pQueue->m_pFirst = pJob->m_pNext;
+	if(pJob->m_pNext)
+		pJob->m_pNext->m_pPrev = pJob->m_pPrev;
+	else
+		pQueue->m_pLast = pJob->m_pPrev;
+	pJob->m_Queue = -1;
+	lock_release(pQueue->m_Lock);
+
+	Finish(pJob, -1);
+	return true;
+}
+
+void CJobPool::WorkerThread(void *pUser)
+{
+	CWorker *pWorker = (CWorker *)pUser;
+	CJobPool *pPool = pWorker->m_pPool;
+	tls_set(pPool->m_CurrentWorker, pWorker);
+	thread_set_name("job worker");
+
+	while(1)
+	{
+		// sleep until there is something to do, a waiting thread might take the job first though
+		semaphore_wait(pPool->m_CpuJobs);
+
+		CJob *pJob = pPool->FindJob(pWorker->m_Index);
+		if(pJob)
+			pPool->RunJob(pJob);
+	}
+}
+
+void CJobPool::IoThread(void *pUser)
+{
+	CJobPool *pPool = (CJobPool *)pUser;
+	thread_set_name("job io");
+
+	while(1)
+	{
+		semaphore_wait(pPool->m_IoJobs);
+
+		CJob *pJob = pPool->Pop(QUEUE_IO, false);
+		if(pJob)
+			pPool->RunJob(pJob);
+	}
 }
 
 int CJobPool::Init(int NumThreads)
 {
 	// start threads
-	for(int i = 0; i < NumThreads; i++)
-		thread_create(WorkerThread, this);
+	m_NumWorkers = clamp(NumThreads, 1, (int)MAX_WORKERS);
+	for(int i = 0; i < m_NumWorkers; i++)
+	{
+		m_aWorkers[i].m_pPool = this;
+		m_aWorkers[i].m_Index = i;
+		thread_create(WorkerThread, &m_aWorkers[i]);
+	}
+	for(int i = 0; i < NUM_IO_THREADS; i++)
+		thread_create(IoThread, this);
 	return 0;
 }
 
-int CJobPool::Add(CJob *pJob, JOBFUNC pfnFunc, void *pData)
+int CJobPool::Add(CJob *pJob, JOBFUNC pfnFunc, void *pData, int Class)
 {
 	mem_zero(pJob, sizeof(CJob));
+	pJob->m_pPool = this;
+	pJob->m_Queue = -1;
 	pJob->m_pfnFunc = pfnFunc;
 	pJob->m_pFuncData = pData;
 
-	lock_wait(m_Lock);
+	// without threads the job is done right away
+	if(!m_NumWorkers)
+	{
+		RunJob(pJob);
+		return 0;
+	}
 
-	// add job to queue
-	pJob->m_pPrev = m_pLastJob;
-	if(m_pLastJob)
-		m_pLastJob->m_pNext = pJob;
-	m_pLastJob = pJob;
-	if(!m_pFirstJob)
-		m_pFirstJob = pJob;
-
-	lock_release(m_Lock);
+	if(Class == CLASS_IO)
+	{
+		Push(QUEUE_IO, pJob);
+		semaphore_signal(m_IoJobs);
+	}
+	else
+	{
+		// jobs added by a worker stay with it, the data they need is likely still in its cache
+		CWorker *pWorker = (CWorker *)tls_get(m_CurrentWorker);
+		Push(pWorker ? pWorker->m_Index : (unsigned)atomic_inc(&m_NextQueue)%m_NumWorkers, pJob);
+		semaphore_signal(m_CpuJobs);
+	}
+	return 0;
+}
+
+struct CJobRange
+{
+	CJobPool::RANGEFUNC m_pfnFunc;
+	void *m_pUser;
+	int m_Begin;
+	int m_End;
+};
+
+static int RangeJob(void *pData)
+{
+	CJobRange *pRange = (CJobRange *)pData;
+	pRange->m_pfnFunc(pRange->m_pUser, pRange->m_Begin, pRange->m_End);
 	return 0;
 }
 
+void CJobPool::ParallelFor(int Begin, int End, int Grain, RANGEFUNC pfnFunc, void *pUser)
+{
+	int Num = End-Begin;
+	if(Num <= 0)
+		return;
+
+	// a few ranges per thread even out ranges that take longer than others
+	int NumRanges = (Num+max(Grain, 1)-1)/max(Grain, 1);
+	NumRanges = min(NumRanges, min((m_NumWorkers+1)*4, (int)MAX_PARALLEL_JOBS));
+	if(NumRanges <= 1)
+	{
+		pfnFunc(pUser, Begin, End);
+		return;
+	}
+
+	CJobRange aRanges[MAX_PARALLEL_JOBS];
+	CJob aJobs[MAX_PARALLEL_JOBS];
+	for(int i = 0; i < NumRanges; i++)
+	{
+		aRanges[i].m_pfnFunc = pfnFunc;
+		aRanges[i].m_pUser = pUser;
+		aRanges[i].m_Begin = Begin+(int)((int64)Num*i/NumRanges);
+		aRanges[i].m_End = Begin+(int)((int64)Num*(i+1)/NumRanges);
+	}
+
+	// the calling thread takes the first range itself
+	for(int i = 1; i < NumRanges; i++)
+		Add(&aJobs[i], RangeJob, &aRanges[i]);
+	RangeJob(&aRanges[0]);
+	for(int i = 1; i < NumRanges; i++)
+		aJobs[i].Wait();
+}
@@ -2,6 +2,8 @@
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
 #ifndef ENGINE_SHARED_JOBS_H
 #define ENGINE_SHARED_JOBS_H
+#include <base/system.h>
+
 typedef int (*JOBFUNC)(void *pData);
 
 class CJobPool;
@@ -11,6 +13,7 @@ class CJob
 	friend class CJobPool;
 
 	CJobPool *m_pPool;
+	volatile int m_Queue; // the queue the job waits in, -1 once a thread took it
 	CJob *m_pPrev;
 	CJob *m_pNext;
 
@@ -22,6 +25,8 @@ class CJob
 public:
 	CJob()
 	{
+		m_pPool = 0;
+		m_Queue = -1;
 		m_Status = STATE_DONE;
 		m_pFuncData = 0;
 	}
@@ -35,20 +40,88 @@ public:
 
 	int Status() const { return m_Status; }
 	int Result() const {return m_Result; }
+
+	// blocks until the job is done, runs other jobs of the pool in the meantime
+	void Wait();
+
+	// takes the job out of the pool if no thread started it yet, its result is -1 then
+	bool Cancel();
 };
 
 class CJobPool
 {
-	LOCK m_Lock;
-	CJob *m_pFirstJob;
-	CJob *m_pLastJob;
+public:
+	enum
+	{
+		CLASS_CPU=0, // computations, run by the workers and by threads waiting on a job
+		CLASS_IO, // work that blocks, like reading files or looking up hosts
+
+		MAX_WORKERS=32,
+		NUM_IO_THREADS=2,
+		MAX_PARALLEL_JOBS=64,
+	};
+
+	typedef void (*RANGEFUNC)(void *pUser, int Begin, int End);
+
+private:
+	friend class CJob;
+
+	// each worker takes the newest job of its own queue, idle ones steal the oldest from the others
+	struct CQueue
+	{
+		LOCK m_Lock;
+		CJob *m_pFirst;
+		CJob *m_pLast;
+	};
+
+	struct CWorker
+	{
+		CJobPool *m_pPool;
+		int m_Index;
+	};
+
+	enum
+	{
+		QUEUE_IO=MAX_WORKERS, // the io jobs share one queue, first come first served
+	};
+
+	CQueue m_aQueues[MAX_WORKERS+1];
+	CWorker m_aWorkers[MAX_WORKERS];
+	int m_NumWorkers;
+	volatile int m_NextQueue;
+	TLSKEY m_CurrentWorker; // the worker of the calling thread, 0 for other threads
+
+	// count the queued jobs of each class, idle threads sleep on them
+	SEMAPHORE m_CpuJobs;
+	SEMAPHORE m_IoJobs;
+
+	// threads waiting for a job to finish
+	LOCK m_DoneLock;
+	SEMAPHORE m_DoneSignal;
+	int m_NumWaiters;
+
+	void Push(int Queue, CJob *pJob);
+	CJob *Pop(int Queue, bool Newest);
+	CJob *FindJob(int OwnQueue);
+	void RunJob(CJob *pJob);
+	void Finish(CJob *pJob, int Result);
+
+	void Wait(CJob *pJob);
+	bool Cancel(CJob *pJob);
 
 	static void WorkerThread(void *pUser);
+	static void IoThread(void *pUser);
 
 public:
 	CJobPool();
 
 	int Init(int NumThreads);
-	int Add(CJob *pJob, JOBFUNC pfnFunc, void *pData);
+	int Add(CJob *pJob, JOBFUNC pfnFunc, void *pData, int Class=CLASS_CPU);
+
+	// splits [Begin, End) into ranges of at least Grain items and runs them on the
+	// workers and the calling thread, returns once all are done
+	void ParallelFor(int Begin, int End, int Grain, RANGEFUNC pfnFunc, void *pUser);
+
+	int NumWorkers() const { return m_NumWorkers; }
 };
 #endif
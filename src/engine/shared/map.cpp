@@ -1,6 +1,7 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
 #include <base/system.h>
+#include <engine/engine.h>
 #include <engine/map.h>
 #include <engine/storage.h>
 #include "datafile.h"
@@ -32,6 +33,11 @@ public:
 		return m_DataFile.Open(pStorage, pMapName, IStorage::TYPE_ALL);
 	}
 
+	virtual void SwapDataFile(CDataFileReader *pDataFile)
+	{
+		m_DataFile.Swap(pDataFile);
+	}
+
 	virtual bool IsLoaded()
 	{
 		return m_DataFile.IsOpen();
@@ -41,6 +47,21 @@ public:
 	{
 		return m_DataFile.Crc();
 	}
+
+	virtual unsigned FileSize()
+	{
+		return m_DataFile.FileSize();
+	}
+
+	virtual const unsigned char *FileData()
+	{
+		return m_DataFile.FileData();
+	}
+
+	virtual void PrefetchData()
+	{
+		m_DataFile.PrefetchData(Kernel()->RequestInterface<IEngine>());
+	}
 };
 
 extern IEngineMap *CreateEngineMap() { return new CMap; }
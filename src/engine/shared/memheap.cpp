@@ -95,3 +95,61 @@ void *CHeap::Allocate(unsigned Size)
 
 	return pMem;
 }
+
+
+CFrameArena::CFrameArena(int Tag)
+{
+	m_Tag = Tag;
+	m_pBlock = 0x0;
+	m_BlockSize = 0;
+	m_Used = 0;
+	m_pOverflow = 0x0;
+	m_FrameBytes = 0;
+	m_PeakFrameBytes = 0;
+}
+
+CFrameArena::~CFrameArena()
+{
+	Reset();
+	mem_free(m_pBlock);
+}
+
+void *CFrameArena::Allocate(unsigned Size)
+{
+	Size = (Size+ALIGNMENT-1)&~(ALIGNMENT-1);
+	m_FrameBytes += Size;
+	if(m_FrameBytes > m_PeakFrameBytes)
+		m_PeakFrameBytes = m_FrameBytes;
+
+	if(m_Used+Size <= m_BlockSize)
+	{
+		void *pMem = m_pBlock+m_Used;
+		m_Used += Size;
+		return pMem;
+	}
+
+	// doesn't fit, the block grows on the next reset
+	COverflow *pOverflow = (COverflow *)mem_alloc_tagged(ALIGNMENT+Size, ALIGNMENT, m_Tag);
+	pOverflow->m_pNext = m_pOverflow;
+	m_pOverflow = pOverflow;
+	return (char *)pOverflow+ALIGNMENT;
+}
+
+void CFrameArena::Reset()
+{
+	while(m_pOverflow)
+	{
+		COverflow *pNext = m_pOverflow->m_pNext;
+		mem_free(m_pOverflow);
+		m_pOverflow = pNext;
+	}
+
+	if(m_PeakFrameBytes > m_BlockSize)
+	{
+		mem_free(m_pBlock);
+		m_BlockSize = m_PeakFrameBytes;
+		m_pBlock = (char *)mem_alloc_tagged(m_BlockSize, ALIGNMENT, m_Tag);
+	}
+	m_Used = 0;
+	m_FrameBytes = 0;
+}
@@ -31,4 +31,38 @@ public:
 	void Reset();
 	void *Allocate(unsigned Size);
 };
+
+// memory for temporaries that only live until the next Reset, like the buffers of one tick.
+// the block is kept between resets and grows to what the largest frame needed, so after
+// the first frames allocating is just moving a pointer. only one thread may use an arena
+class CFrameArena
+{
+	struct COverflow
+	{
+		COverflow *m_pNext;
+	};
+
+	enum
+	{
+		ALIGNMENT=16,
+	};
+
+	int m_Tag;
+	char *m_pBlock;
+	unsigned m_BlockSize;
+	unsigned m_Used;
+	COverflow *m_pOverflow; // allocations that didn't fit in the block this frame
+	unsigned m_FrameBytes;
+	unsigned m_PeakFrameBytes;
+
+public:
+	CFrameArena(int Tag);
+	~CFrameArena();
+
+	void *Allocate(unsigned Size);
+	void Reset();
+
+	unsigned BlockSize() const { return m_BlockSize; }
+	unsigned PeakFrameBytes() const { return m_PeakFrameBytes; }
+};
 #endif
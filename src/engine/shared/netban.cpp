@@ -0,0 +1,357 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/system.h>
+
+#include "netban.h"
+
+static int AddrBit(const NETADDR *pAddr, int Bit)
+{
+	return (pAddr->ip[Bit>>3]>>(7-(Bit&7)))&1;
+}
+
+static int RootNode(const NETADDR *pAddr)
+{
+	return pAddr->type == NETTYPE_IPV4 ? 1 : 2;
+}
+
+static void NormalizeRange(const NETADDR *pAddr, int Prefix, NETADDR *pOut)
+{
+	// only the banned bits are kept, so equal ranges compare equal
+	mem_zero(pOut, sizeof(NETADDR));
+	pOut->type = pAddr->type;
+	for(int i = 0; i < Prefix; i++)
+		pOut->ip[i>>3] |= AddrBit(pAddr, i)<<(7-(i&7));
+}
+
+void CNetBanTable::Init()
+{
+	m_lNodes.clear();
+	m_lFreeNodes.clear();
+	m_lBans.clear();
+	m_lFreeBans.clear();
+	m_lExpiryHeap.clear();
+	m_NumBans = 0;
+	m_GetIndex = -1;
+	m_GetBan = 0;
+
+	for(int i = 0; i < 3; i++)
+		NewNode();
+	CBan Unused;
+	mem_zero(&Unused, sizeof(Unused));
+	m_lBans.add(Unused);
+}
+
+int CNetBanTable::NewNode()
+{
+	CNode Node;
+	Node.m_aChildren[0] = Node.m_aChildren[1] = 0;
+	Node.m_Ban = 0;
+
+	if(m_lFreeNodes.size())
+	{
+		int Index = m_lFreeNodes[m_lFreeNodes.size()-1];
+		m_lFreeNodes.remove_index_fast(m_lFreeNodes.size()-1);
+		m_lNodes[Index] = Node;
+		return Index;
+	}
+	return m_lNodes.add(Node);
+}
+
+int CNetBanTable::FindNode(const NETADDR *pAddr, int Prefix) const
+{
+	int Node = RootNode(pAddr);
+	for(int i = 0; i < Prefix && Node; i++)
+		Node = m_lNodes[Node].m_aChildren[AddrBit(pAddr, i)];
+	return Node;
+}
+
+void CNetBanTable::HeapSwap(int a, int b)
+{
+	int Temp = m_lExpiryHeap[a];
+	m_lExpiryHeap[a] = m_lExpiryHeap[b];
+	m_lExpiryHeap[b] = Temp;
+	m_lBans[m_lExpiryHeap[a]].m_HeapIndex = a;
+	m_lBans[m_lExpiryHeap[b]].m_HeapIndex = b;
+}
+
+void CNetBanTable::HeapUp(int Index)
+{
+	while(Index > 0)
+	{
+		int Parent = (Index-1)/2;
+		if(m_lBans[m_lExpiryHeap[Parent]].m_Info.m_Expires <= m_lBans[m_lExpiryHeap[Index]].m_Info.m_Expires)
+			break;
+		HeapSwap(Index, Parent);
+		Index = Parent;
+	}
+}
+
+void CNetBanTable::HeapDown(int Index)
+{
+	while(1)
+	{
+		int Smallest = Index;
+		for(int Child = Index*2+1; Child <= Index*2+2 && Child < m_lExpiryHeap.size(); Child++)
+			if(m_lBans[m_lExpiryHeap[Child]].m_Info.m_Expires < m_lBans[m_lExpiryHeap[Smallest]].m_Info.m_Expires)
+				Smallest = Child;
+		if(Smallest == Index)
+			break;
+		HeapSwap(Index, Smallest);
+		Index = Smallest;
+	}
+}
+
+void CNetBanTable::HeapInsert(int Ban)
+{
+	m_lBans[Ban].m_HeapIndex = m_lExpiryHeap.add(Ban);
+	HeapUp(m_lBans[Ban].m_HeapIndex);
+}
+
+void CNetBanTable::HeapRemove(int Ban)
+{
+	int Index = m_lBans[Ban].m_HeapIndex;
+	if(Index < 0)
+		return;
+
+	int Last = m_lExpiryHeap.size()-1;
+	if(Index != Last)
+		HeapSwap(Index, Last);
+	m_lExpiryHeap.remove_index_fast(Last);
+	m_lBans[Ban].m_HeapIndex = -1;
+
+	// the ban that took its place can belong either further up or down
+	if(Index < m_lExpiryHeap.size())
+	{
+		HeapUp(Index);
+		HeapDown(Index);
+	}
+}
+
+int CNetBanTable::Add(const NETADDR *pAddr, int Prefix, int Expires, const char *pReason)
+{
+	if(pAddr->type != NETTYPE_IPV4 && pAddr->type != NETTYPE_IPV6)
+		return -1;
+	if(Prefix < 0 || Prefix > MaxPrefix(pAddr))
+		Prefix = MaxPrefix(pAddr);
+
+	NETADDR Addr;
+	NormalizeRange(pAddr, Prefix, &Addr);
+
+	// walk down the trie and add what is missing on the way
+	int Node = RootNode(&Addr);
+	for(int i = 0; i < Prefix; i++)
+	{
+		int Bit = AddrBit(&Addr, i);
+		int Child = m_lNodes[Node].m_aChildren[Bit];
+		if(!Child)
+		{
+			Child = NewNode();
+			m_lNodes[Node].m_aChildren[Bit] = Child;
+		}
+		Node = Child;
+	}
+
+	int Ban = m_lNodes[Node].m_Ban;
+	if(Ban)
+	{
+		// adjust the ban
+		HeapRemove(Ban);
+	}
+	else
+	{
+		if(m_lFreeBans.size())
+		{
+			Ban = m_lFreeBans[m_lFreeBans.size()-1];
+			m_lFreeBans.remove_index_fast(m_lFreeBans.size()-1);
+		}
+		else
+		{
+			CBan NewBan;
+			mem_zero(&NewBan, sizeof(NewBan));
+			Ban = m_lBans.add(NewBan);
+		}
+
+		m_lNodes[Node].m_Ban = Ban;
+		m_lBans[Ban].m_Node = Node;
+		m_lBans[Ban].m_HeapIndex = -1;
+		m_lBans[Ban].m_Info.m_Addr = Addr;
+		m_lBans[Ban].m_Info.m_Prefix = Prefix;
+		m_NumBans++;
+		m_GetIndex = -1;
+	}
+
+	m_lBans[Ban].m_Info.m_Expires = Expires;
+	str_copy(m_lBans[Ban].m_Info.m_Reason, pReason, sizeof(m_lBans[Ban].m_Info.m_Reason));
+	if(Expires > -1)
+		HeapInsert(Ban);
+	return 0;
+}
+
+void CNetBanTable::RemoveBan(int Ban)
+{
+	const NETADDR *pAddr = &m_lBans[Ban].m_Info.m_Addr;
+	int Prefix = m_lBans[Ban].m_Info.m_Prefix;
+
+	int aPath[128+1];
+	aPath[0] = RootNode(pAddr);
+	for(int i = 0; i < Prefix; i++)
+		aPath[i+1] = m_lNodes[aPath[i]].m_aChildren[AddrBit(pAddr, i)];
+	m_lNodes[aPath[Prefix]].m_Ban = 0;
+
+	// give back the nodes that don't lead to any ban anymore, the roots stay
+	for(int i = Prefix; i > 0; i--)
+	{
+		const CNode *pNode = &m_lNodes[aPath[i]];
+		if(pNode->m_Ban || pNode->m_aChildren[0] || pNode->m_aChildren[1])
+			break;
+		m_lNodes[aPath[i-1]].m_aChildren[AddrBit(pAddr, i-1)] = 0;
+		m_lFreeNodes.add(aPath[i]);
+	}
+
+	HeapRemove(Ban);
+	m_lBans[Ban].m_Node = 0;
+	m_lFreeBans.add(Ban);
+	m_NumBans--;
+	m_GetIndex = -1;
+}
+
+int CNetBanTable::Remove(const NETADDR *pAddr, int Prefix)
+{
+	if(pAddr->type != NETTYPE_IPV4 && pAddr->type != NETTYPE_IPV6)
+		return -1;
+	if(Prefix < 0 || Prefix > MaxPrefix(pAddr))
+		Prefix = MaxPrefix(pAddr);
+
+	NETADDR Addr;
+	NormalizeRange(pAddr, Prefix, &Addr);
+	int Node = FindNode(&Addr, Prefix);
+	if(!Node || !m_lNodes[Node].m_Ban)
+		return -1;
+
+	RemoveBan(m_lNodes[Node].m_Ban);
+	return 0;
+}
+
+const CNetBanTable::CBanInfo *CNetBanTable::Find(const NETADDR *pAddr) const
+{
+	if(pAddr->type != NETTYPE_IPV4 && pAddr->type != NETTYPE_IPV6)
+		return 0;
+
+	// the first ban on the way down covers the address
+	int Node = RootNode(pAddr);
+	for(int i = 0; ; i++)
+	{
+		if(m_lNodes[Node].m_Ban)
+			return &m_lBans[m_lNodes[Node].m_Ban].m_Info;
+		if(i == MaxPrefix(pAddr))
+			return 0;
+		Node = m_lNodes[Node].m_aChildren[AddrBit(pAddr, i)];
+		if(!Node)
+			return 0;
+	}
+}
+
+bool CNetBanTable::PopExpired(int Now, CBanInfo *pInfo)
+{
+	if(!m_lExpiryHeap.size() || m_lBans[m_lExpiryHeap[0]].m_Info.m_Expires >= Now)
+		return false;
+
+	*pInfo = m_lBans[m_lExpiryHeap[0]].m_Info;
+	RemoveBan(m_lExpiryHeap[0]);
+	return true;
+}
+
+bool CNetBanTable::Get(int Index, CBanInfo *pInfo) const
+{
+	int Current = -1;
+	int Ban = 1;
+	if(m_GetIndex >= 0 && m_GetIndex <= Index)
+	{
+		Current = m_GetIndex-1;
+		Ban = m_GetBan;
+	}
+
+	for(; Ban < m_lBans.size(); Ban++)
+	{
+		if(!m_lBans[Ban].m_Node || ++Current != Index)
+			continue;
+
+		*pInfo = m_lBans[Ban].m_Info;
+		m_GetIndex = Index;
+		m_GetBan = Ban;
+		return true;
+	}
+	return false;
+}
+
+bool CNetBanTable::Contains(const NETADDR *pRange, int Prefix, const NETADDR *pAddr)
+{
+	if(pRange->type != pAddr->type)
+		return false;
+	if(Prefix < 0 || Prefix > MaxPrefix(pRange))
+		Prefix = MaxPrefix(pRange);
+
+	int Bytes = Prefix/8;
+	if(mem_comp(pRange->ip, pAddr->ip, Bytes) != 0)
+		return false;
+	int Mask = (0xff<<(8-Prefix%8))&0xff;
+	return Prefix%8 == 0 || (pRange->ip[Bytes]&Mask) == (pAddr->ip[Bytes]&Mask);
+}
+
+int CNetBanTable::ParseRange(const char *pStr, NETADDR *pAddr, int *pPrefix)
+{
+	char aBuf[128];
+	str_copy(aBuf, pStr, sizeof(aBuf));
+
+	*pPrefix = -1;
+	for(char *p = aBuf; *p; p++)
+	{
+		if(*p != '/')
+			continue;
+
+		*p++ = 0;
+		if(!*p)
+			return -1;
+		for(const char *pDigit = p; *pDigit; pDigit++)
+			if(*pDigit < '0' || *pDigit > '9')
+				return -1;
+		*pPrefix = str_toint(p);
+		break;
+	}
+
+	// bare ipv6 addresses are common in block lists, the address parser wants them in brackets
+	int NumColons = 0;
+	for(const char *p = aBuf; *p; p++)
+		if(*p == ':')
+			NumColons++;
+	if(NumColons > 1 && aBuf[0] != '[')
+	{
+		char aAddr[128];
+		str_format(aAddr, sizeof(aAddr), "[%s]", aBuf);
+		str_copy(aBuf, aAddr, sizeof(aBuf));
+	}
+
+	if(net_addr_from_str(pAddr, aBuf) != 0 || (pAddr->type != NETTYPE_IPV4 && pAddr->type != NETTYPE_IPV6))
+		return -1;
+	pAddr->port = 0;
+
+	if(*pPrefix > MaxPrefix(pAddr))
+		return -1;
+	if(*pPrefix < 0)
+		*pPrefix = MaxPrefix(pAddr);
+	return 0;
+}
+
+void CNetBanTable::FormatRange(const NETADDR *pAddr, int Prefix, char *pBuffer, int BufferSize)
+{
+	NETADDR Addr;
+	if(Prefix < 0 || Prefix > MaxPrefix(pAddr))
+		Prefix = MaxPrefix(pAddr);
+	NormalizeRange(pAddr, Prefix, &Addr);
+	char aAddrStr[NETADDR_MAXSTRSIZE];
+	net_addr_str(&Addr, aAddrStr, sizeof(aAddrStr));
+	if(Prefix == MaxPrefix(pAddr))
+		str_copy(pBuffer, aAddrStr, BufferSize);
+	else
+		str_format(pBuffer, BufferSize, "%s/%d", aAddrStr, Prefix);
+}
@@ -0,0 +1,82 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#ifndef ENGINE_SHARED_NETBAN_H
+#define ENGINE_SHARED_NETBAN_H
+
+#include <base/system.h>
+#include <base/tl/array.h>
+
+// bans on single addresses and whole ranges. the ranges are kept in a binary trie per address
+// family, so finding the ban of an address takes at most one step per address bit. bans that
+// run out are kept in a heap ordered by their expiry time
+class CNetBanTable
+{
+public:
+	struct CBanInfo
+	{
+		NETADDR m_Addr;
+		int m_Prefix; // leading bits of the address that are banned
+		int m_Expires; // -1 for life
+		char m_Reason[128];
+	};
+
+private:
+	struct CNode
+	{
+		int m_aChildren[2]; // 0 for none
+		int m_Ban; // 0 for none
+	};
+
+	struct CBan
+	{
+		CBanInfo m_Info;
+		int m_Node; // 0 if the slot is free
+		int m_HeapIndex; // -1 if it doesn't expire
+	};
+
+	// index 0 of nodes and bans is never used, nodes 1 and 2 are the roots for ipv4 and ipv6
+	array<CNode> m_lNodes;
+	array<int> m_lFreeNodes;
+	array<CBan> m_lBans;
+	array<int> m_lFreeBans;
+	array<int> m_lExpiryHeap;
+	int m_NumBans;
+
+	// where the last Get ended, so listing all bans in order stays linear
+	mutable int m_GetIndex;
+	mutable int m_GetBan;
+
+	int NewNode();
+	int FindNode(const NETADDR *pAddr, int Prefix) const;
+
+	void HeapSwap(int a, int b);
+	void HeapUp(int Index);
+	void HeapDown(int Index);
+	void HeapInsert(int Ban);
+	void HeapRemove(int Ban);
+
+	void RemoveBan(int Ban);
+
+public:
+	void Init();
+
+	// a negative prefix bans the whole address
+	int Add(const NETADDR *pAddr, int Prefix, int Expires, const char *pReason);
+	int Remove(const NETADDR *pAddr, int Prefix);
+	const CBanInfo *Find(const NETADDR *pAddr) const;
+
+	// removes one ban that ran out before Now, returns false when there is none
+	bool PopExpired(int Now, CBanInfo *pInfo);
+
+	int Num() const { return m_NumBans; }
+	bool Get(int Index, CBanInfo *pInfo) const; // caution, slow
+
+	static int MaxPrefix(const NETADDR *pAddr) { return pAddr->type == NETTYPE_IPV4 ? 32 : 128; }
+	static bool Contains(const NETADDR *pRange, int Prefix, const NETADDR *pAddr);
+
+	// "1.2.3.0/24", "[2001:db8::]/32", "2001:db8::/32" or a plain address
+	static int ParseRange(const char *pStr, NETADDR *pAddr, int *pPrefix);
+	static void FormatRange(const NETADDR *pAddr, int Prefix, char *pBuffer, int BufferSize);
+};
+
+#endif
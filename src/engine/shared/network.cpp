@@ -67,7 +67,10 @@ int CNetRecvUnpacker::FetchChunk(CNetChunk *pChunk)
 			{
 				// old packet that we already got
 				if(CNetBase::IsSeqInBackroom(Header.m_Sequence, m_pConnection->m_Ack))
+				{
+					m_pConnection->m_NumDuplicateBytes += Header.m_Size;
 					continue;
+				}
 
 				// out of sequence, request resend
 				if(g_Config.m_Debug)
@@ -5,6 +5,7 @@
 
 #include "ringbuffer.h"
 #include "huffman.h"
+#include "netban.h"
 
 /*
 
@@ -30,6 +31,7 @@ enum
 	NETSENDFLAG_VITAL=1,
 	NETSENDFLAG_CONNLESS=2,
 	NETSENDFLAG_FLUSH=4,
+	NETSENDFLAG_NODELAY=8,
 
 	NETSTATE_OFFLINE=0,
 	NETSTATE_CONNECTING,
@@ -73,9 +75,8 @@ enum
 	NET_CTRLMSG_ACCEPT=3,
 	NET_CTRLMSG_CLOSE=4,
 
-	NET_SERVER_MAXBANS=1024,
-
 	NET_CONN_BUFFERSIZE=1024*32,
+	NET_CONN_RESEND_BUDGET=NET_MAX_PAYLOAD*4, // most bytes resent at once, the rest waits for the next update
 
 	NET_ENUM_TERMINATOR
 };
@@ -106,14 +107,33 @@ public:
 	unsigned char *Unpack(unsigned char *pData);
 };
 
+// payload of a chunk that goes to several connections, it is packed once and freed
+// when the last connection got it acked
+class CNetSharedData
+{
+	int m_RefCount;
+	int m_DataSize;
+
+public:
+	static CNetSharedData *Create(const void *pData, int DataSize);
+
+	void Retain() { m_RefCount++; }
+	void Release();
+
+	int Size() const { return m_DataSize; }
+	const unsigned char *Data() const { return (const unsigned char *)(this+1); }
+};
+
 class CNetChunkResend
 {
 public:
 	int m_Flags;
 	int m_DataSize;
-	unsigned char *m_pData;
+	const unsigned char *m_pData;
+	CNetSharedData *m_pShared; // owner of m_pData if the chunk is not stored inline
 
 	int m_Sequence;
+	int m_NumResends;
 	int64 m_LastSendTime;
 	int64 m_FirstSendTime;
 };
@@ -142,8 +162,10 @@ private:
 
 	int m_Token;
 	int m_RemoteClosed;
+	bool m_FlushPending;
 
 	TStaticRingBuffer<CNetChunkResend, NET_CONN_BUFFERSIZE> m_Buffer;
+	int m_NumUnsent; // vital chunks at the end of m_Buffer that wait for the next flush
 
 	int64 m_LastUpdateTime;
 	int64 m_LastRecvTime;
@@ -157,16 +179,28 @@ private:
 	NETSOCKET m_Socket;
 	NETSTATS m_Stats;
 
+	// round trip estimate from acked chunks, 0 until there is one
+	int64 m_SmoothedRtt;
+	int64 m_RttVariance;
+
+	// counters for rate control, they only ever grow while connected
+	int m_NumVitalChunks;
+	int m_NumResentChunks;
+	int m_NumResentBytes;
+	int m_NumDuplicateBytes;
+
 	//
 	void Reset();
 	void ResetStats();
 	void SetError(const char *pString);
 	void AckChunks(int Ack);
+	void ClearBuffer();
 
-	int QueueChunkEx(int Flags, int DataSize, const void *pData, int Sequence);
+	int QueueChunkEx(int Flags, int DataSize, const void *pData, int Sequence, CNetSharedData *pShared=0);
 	void SendControl(int ControlMsg, const void *pExtra, int ExtraSize);
-	void ResendChunk(CNetChunkResend *pResend);
-	void Resend();
+	int64 ResendTimeout(const CNetChunkResend *pResend) const;
+	int ResendChunk(CNetChunkResend *pResend);
+	void Resend(int64 MinAge);
 
 public:
 	void Init(NETSOCKET Socket);
@@ -176,8 +210,13 @@ public:
 	int Update();
 	int Flush();
 
+	// lets chunks queued until the next FlushPending go out in the same packet
+	void SetFlushPending() { m_FlushPending = true; }
+	int FlushPending();
+
 	int Feed(CNetPacketConstruct *pPacket, NETADDR *pAddr);
 	int QueueChunk(int Flags, int DataSize, const void *pData);
+	int QueueSharedChunk(int Flags, CNetSharedData *pShared);
 
 	const char *ErrorString();
 	void SignalResend();
@@ -191,6 +230,12 @@ public:
 	int64 LastRecvTime() const { return m_LastRecvTime; }
 
 	int AckSequence() const { return m_Ack; }
+
+	int NumVitalChunks() const { return m_NumVitalChunks; }
+	int NumResentChunks() const { return m_NumResentChunks; }
+	int NumResentBytes() const { return m_NumResentBytes; }
+	int NumDuplicateBytes() const { return m_NumDuplicateBytes; }
+	int Rtt() const { return (int)(m_SmoothedRtt*1000/time_freq()); }
 };
 
 class CConsoleNetConnection
@@ -241,36 +286,55 @@ public:
 	int FetchChunk(CNetChunk *pChunk);
 };
 
-// server side
-class CNetServer
+// per address token buckets for traffic from outside the connections, checked before the
+// packet gets parsed. colliding addresses replace each other, which only makes it more lenient.
+// a bucket is kept as the time it will be full again, so refilling it costs nothing
+class CNetRateLimit
 {
 public:
-	struct CBanInfo
+	enum
 	{
-		NETADDR m_Addr;
-		int m_Expires;
-		char m_Reason[128];
+		TYPE_INFO=0,
+		TYPE_CONNECT,
+		TYPE_RCONAUTH,
+		NUM_TYPES,
+
+		TABLE_SIZE=1024,
+		BURST_SECONDS=2, // how much an idle address can send at once
 	};
 
 private:
-	struct CSlot
+	struct CEntry
 	{
-	public:
-		CNetConnection m_Connection;
+		NETADDR m_Addr;
+		int64 m_aFullTime[NUM_TYPES];
 	};
 
-	struct CBan
-	{
-	public:
-		CBanInfo m_Info;
+	CEntry m_aEntries[TABLE_SIZE];
+	int m_aRates[NUM_TYPES]; // per second, 0 for no limit
+	unsigned m_aNumAllowed[NUM_TYPES];
+	unsigned m_aNumDropped[NUM_TYPES];
 
-		// hash list
-		CBan *m_pHashNext;
-		CBan *m_pHashPrev;
+public:
+	void Init();
+	void SetRate(int Type, int Rate);
+	bool Allow(const NETADDR *pAddr, int Type);
+
+	unsigned NumAllowed(int Type) const { return m_aNumAllowed[Type]; }
+	unsigned NumDropped(int Type) const { return m_aNumDropped[Type]; }
+};
+
+// server side
+class CNetServer
+{
+public:
+	typedef CNetBanTable::CBanInfo CBanInfo;
 
-		// used or free list
-		CBan *m_pNext;
-		CBan *m_pPrev;
+private:
+	struct CSlot
+	{
+	public:
+		CNetConnection m_Connection;
 	};
 
 
@@ -279,18 +343,14 @@ private:
 	int m_MaxClients;
 	int m_MaxClientsPerIP;
 
-	CBan *m_aBans[256];
-	CBan m_BanPool[NET_SERVER_MAXBANS];
-	CBan *m_BanPool_FirstFree;
-	CBan *m_BanPool_FirstUsed;
+	CNetBanTable m_BanTable;
 
 	NETFUNC_NEWCLIENT m_pfnNewClient;
 	NETFUNC_DELCLIENT m_pfnDelClient;
 	void *m_UserPtr;
 
 	CNetRecvUnpacker m_RecvUnpacker;
-
-	void BanRemoveByObject(CBan *pBan);
+	CNetRateLimit m_RateLimit;
 
 public:
 	int SetCallbacks(NETFUNC_NEWCLIENT pfnNewClient, NETFUNC_DELCLIENT pfnDelClient, void *pUser);
@@ -302,19 +362,27 @@ public:
 	//
 	int Recv(CNetChunk *pChunk);
 	int Send(CNetChunk *pChunk);
+	int SendMask(CNetChunk *pChunk, int Mask); // one chunk to every client in the mask, vital data is shared between them
 	int Update();
+	void Flush(); // sends what was flushed since the last call, unless it was sent with NETSENDFLAG_NODELAY
 
 	//
 	int Drop(int ClientID, const char *pReason);
 
-	// banning
-	int BanAdd(NETADDR Addr, int Seconds, const char *pReason);
-	int BanRemove(NETADDR Addr);
-	int BanNum(); // caution, slow
+	// banning, a negative prefix bans just the address
+	int BanAdd(NETADDR Addr, int Seconds, const char *pReason, int Prefix=-1);
+	int BanRemove(NETADDR Addr, int Prefix=-1);
+	int BanNum() { return m_BanTable.Num(); }
 	int BanGet(int Index, CBanInfo *pInfo); // caution, slow
 
+	// rate limiting
+	void SetRateLimit(int Type, int Rate) { m_RateLimit.SetRate(Type, Rate); }
+	bool RateLimitAllow(const NETADDR *pAddr, int Type) { return m_RateLimit.Allow(pAddr, Type); }
+	const CNetRateLimit *RateLimit() const { return &m_RateLimit; }
+
 	// status requests
 	NETADDR ClientAddr(int ClientID) const { return m_aSlots[ClientID].m_Connection.PeerAddress(); }
+	const CNetConnection *ClientConnection(int ClientID) const { return &m_aSlots[ClientID].m_Connection; }
 	NETSOCKET Socket() const { return m_Socket; }
 	int NetType() { return m_Socket.type; }
 	int MaxClients() const { return m_MaxClients; }
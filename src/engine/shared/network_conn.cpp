@@ -1,9 +1,26 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
 #include <base/system.h>
 #include "config.h"
 #include "network.h"
 
+CNetSharedData *CNetSharedData::Create(const void *pData, int DataSize)
+{
+	// the creator holds the first reference
+	CNetSharedData *pShared = (CNetSharedData *)mem_alloc_tagged(sizeof(CNetSharedData)+DataSize, 1, MEMTAG_NETWORK);
+	pShared->m_RefCount = 1;
+	pShared->m_DataSize = DataSize;
+	mem_copy(pShared+1, pData, DataSize);
+	return pShared;
+}
+
+void CNetSharedData::Release()
+{
+	if(--m_RefCount == 0)
+		mem_free(this);
+}
+
 void CNetConnection::ResetStats()
 {
 	mem_zero(&m_Stats, sizeof(m_Stats));
@@ -14,6 +31,7 @@ void CNetConnection::Reset()
 	m_Sequence = 0;
 	m_Ack = 0;
 	m_RemoteClosed = 0;
+	m_FlushPending = false;
 
 	m_State = NET_CONNSTATE_OFFLINE;
 	m_LastSendTime = 0;
@@ -21,8 +39,14 @@ void CNetConnection::Reset()
 	m_LastUpdateTime = 0;
 	m_Token = -1;
 	mem_zero(&m_PeerAddr, sizeof(m_PeerAddr));
+	m_SmoothedRtt = 0;
+	m_RttVariance = 0;
+	m_NumVitalChunks = 0;
+	m_NumResentChunks = 0;
+	m_NumResentBytes = 0;
+	m_NumDuplicateBytes = 0;
 
-	m_Buffer.Init();
+	ClearBuffer();
 
 	mem_zero(&m_Construct, sizeof(m_Construct));
 }
@@ -39,6 +63,8 @@ void CNetConnection::SetError(const char *pString)
 
 void CNetConnection::Init(NETSOCKET Socket)
 {
+	// the owner might have zeroed us, so there is nothing to release yet
+	m_Buffer.Init();
 	Reset();
 	ResetStats();
 
@@ -46,8 +72,19 @@ void CNetConnection::Init(NETSOCKET Socket)
 	mem_zero(m_ErrorString, sizeof(m_ErrorString));
 }
 
+void CNetConnection::ClearBuffer()
+{
+	for(CNetChunkResend *pResend = m_Buffer.First(); pResend; pResend = m_Buffer.Next(pResend))
+		if(pResend->m_pShared)
+			pResend->m_pShared->Release();
+	m_Buffer.Init();
+	m_NumUnsent = 0;
+}
+
 void CNetConnection::AckChunks(int Ack)
 {
+	int64 Now = time_get();
+	int64 Rtt = 0;
 	while(1)
 	{
 		CNetChunkResend *pResend = m_Buffer.First();
@@ -55,10 +92,32 @@ void CNetConnection::AckChunks(int Ack)
 			break;
 
 		if(CNetBase::IsSeqInBackroom(pResend->m_Sequence, Ack))
+		{
+			// only chunks that were sent once tell how long the round trip is
+			if(!pResend->m_NumResends)
+				Rtt = Now-pResend->m_FirstSendTime;
+			if(pResend->m_pShared)
+				pResend->m_pShared->Release();
 			m_Buffer.PopFirst();
+		}
 		else
 			break;
 	}
+
+	if(Rtt > 0)
+	{
+		if(!m_SmoothedRtt)
+		{
+			m_SmoothedRtt = Rtt;
+			m_RttVariance = Rtt/2;
+		}
+		else
+		{
+			int64 Delta = m_SmoothedRtt > Rtt ? m_SmoothedRtt-Rtt : Rtt-m_SmoothedRtt;
+			m_RttVariance = (3*m_RttVariance+Delta)/4;
+			m_SmoothedRtt = (7*m_SmoothedRtt+Rtt)/8;
+		}
+	}
 }
 
 void CNetConnection::SignalResend()
@@ -76,15 +135,30 @@ int CNetConnection::Flush()
 	m_Construct.m_Ack = m_Ack;
 	CNetBase::SendPacket(m_Socket, &m_PeerAddr, &m_Construct);
 
-	// update send times
+	// update send times, the chunks only count as sent now and not when they were queued,
+	// the round trip estimate would include the time they waited for the flush otherwise
 	m_LastSendTime = time_get();
+	for(CNetChunkResend *pResend = m_Buffer.Last(); pResend && m_NumUnsent > 0; pResend = m_Buffer.Prev(pResend), m_NumUnsent--)
+	{
+		pResend->m_FirstSendTime = m_LastSendTime;
+		pResend->m_LastSendTime = m_LastSendTime;
+	}
+	m_NumUnsent = 0;
 
 	// clear construct so we can start building a new package
 	mem_zero(&m_Construct, sizeof(m_Construct));
+	m_FlushPending = false;
 	return NumChunks;
 }
 
-int CNetConnection::QueueChunkEx(int Flags, int DataSize, const void *pData, int Sequence)
+int CNetConnection::FlushPending()
+{
+	if(!m_FlushPending)
+		return 0;
+	return Flush();
+}
+
+int CNetConnection::QueueChunkEx(int Flags, int DataSize, const void *pData, int Sequence, CNetSharedData *pShared)
 {
 	unsigned char *pChunkData;
 
@@ -110,17 +184,30 @@ int CNetConnection::QueueChunkEx(int Flags, int DataSize, const void *pData, int
 
 	if(Flags&NET_CHUNKFLAG_VITAL && !(Flags&NET_CHUNKFLAG_RESEND))
 	{
-		// save packet if we need to resend
-		CNetChunkResend *pResend = m_Buffer.Allocate(sizeof(CNetChunkResend)+DataSize);
+		// save packet if we need to resend, shared data is referenced instead of copied
+		CNetChunkResend *pResend = m_Buffer.Allocate(sizeof(CNetChunkResend)+(pShared ? 0 : DataSize));
 		if(pResend)
 		{
+			m_NumVitalChunks++;
+			m_NumUnsent++;
 			pResend->m_Sequence = Sequence;
+			pResend->m_NumResends = 0;
 			pResend->m_Flags = Flags;
 			pResend->m_DataSize = DataSize;
-			pResend->m_pData = (unsigned char *)(pResend+1);
+			pResend->m_pShared = pShared;
 			pResend->m_FirstSendTime = time_get();
 			pResend->m_LastSendTime = pResend->m_FirstSendTime;
-			mem_copy(pResend->m_pData, pData, DataSize);
+			if(pShared)
+			{
+				pShared->Retain();
+				pResend->m_pData = pShared->Data();
+			}
+			else
+			{
+				unsigned char *pCopy = (unsigned char *)(pResend+1);
+				mem_copy(pCopy, pData, DataSize);
+				pResend->m_pData = pCopy;
+			}
 		}
 		else
 		{
@@ -140,6 +227,13 @@ int CNetConnection::QueueChunk(int Flags, int DataSize, const void *pData)
 	return QueueChunkEx(Flags, DataSize, pData, m_Sequence);
 }
 
+int CNetConnection::QueueSharedChunk(int Flags, CNetSharedData *pShared)
+{
+	if(Flags&NET_CHUNKFLAG_VITAL)
+		m_Sequence = (m_Sequence+1)%NET_MAX_SEQUENCE;
+	return QueueChunkEx(Flags, pShared->Size(), pShared->Data(), m_Sequence, (Flags&NET_CHUNKFLAG_VITAL) ? pShared : 0);
+}
+
 void CNetConnection::SendControl(int ControlMsg, const void *pExtra, int ExtraSize)
 {
 	// send the control message
@@ -147,16 +241,38 @@ void CNetConnection::SendControl(int ControlMsg, const void *pExtra, int ExtraSi
 	CNetBase::SendControlMsg(m_Socket, &m_PeerAddr, m_Ack, ControlMsg, pExtra, ExtraSize);
 }
 
-void CNetConnection::ResendChunk(CNetChunkResend *pResend)
+int64 CNetConnection::ResendTimeout(const CNetChunkResend *pResend) const
+{
+	// a second until the round trip is known, then a bit more than it takes, doubled for every
+	// time the chunk got lost already
+	int64 Timeout = time_freq();
+	if(m_SmoothedRtt)
+		Timeout = clamp(m_SmoothedRtt+4*m_RttVariance, time_freq()/10, time_freq());
+	return min(Timeout<<min(pResend->m_NumResends, 3), time_freq());
+}
+
+int CNetConnection::ResendChunk(CNetChunkResend *pResend)
 {
 	QueueChunkEx(pResend->m_Flags|NET_CHUNKFLAG_RESEND, pResend->m_DataSize, pResend->m_pData, pResend->m_Sequence);
 	pResend->m_LastSendTime = time_get();
+	pResend->m_NumResends++;
+	m_NumResentChunks++;
+	m_NumResentBytes += pResend->m_DataSize;
+	return pResend->m_DataSize;
 }
 
-void CNetConnection::Resend()
+void CNetConnection::Resend(int64 MinAge)
 {
-	for(CNetChunkResend *pResend = m_Buffer.First(); pResend; pResend = m_Buffer.Next(pResend))
-		ResendChunk(pResend);
+	// the other side misses something, resend what had the time to arrive, but not all at once
+	int64 Now = time_get();
+	int Budget = NET_CONN_RESEND_BUDGET;
+	for(CNetChunkResend *pResend = m_Buffer.First(); pResend && Budget > 0; pResend = m_Buffer.Next(pResend))
+	{
+		if(Now-pResend->m_LastSendTime >= MinAge)
+			Budget -= ResendChunk(pResend);
+	}
+	if(Budget != NET_CONN_RESEND_BUDGET)
+		SetFlushPending();
 }
 
 int CNetConnection::Connect(NETADDR *pAddr)
@@ -178,6 +294,10 @@ void CNetConnection::Disconnect(const char *pReason)
 	if(State() == NET_CONNSTATE_OFFLINE)
 		return;
 
+	if(g_Config.m_Debug)
+		dbg_msg("conn", "closed. vital=%d resent=%d (%d bytes) duplicates=%d bytes rtt=%dms",
+			m_NumVitalChunks, m_NumResentChunks, m_NumResentBytes, m_NumDuplicateBytes, Rtt());
+
 	if(m_RemoteClosed == 0)
 	{
 		if(pReason)
@@ -197,10 +317,6 @@ int CNetConnection::Feed(CNetPacketConstruct *pPacket, NETADDR *pAddr)
 {
 	int64 Now = time_get();
 
-	// check if resend is requested
-	if(pPacket->m_Flags&NET_PACKETFLAG_RESEND)
-		Resend();
-
 	//
 	if(pPacket->m_Flags&NET_PACKETFLAG_CONTROL)
 	{
@@ -283,6 +399,10 @@ int CNetConnection::Feed(CNetPacketConstruct *pPacket, NETADDR *pAddr)
 		AckChunks(pPacket->m_Ack);
 	}
 
+	// check if resend is requested, after the ack so nothing acked goes out again
+	if(pPacket->m_Flags&NET_PACKETFLAG_RESEND)
+		Resend(m_SmoothedRtt);
+
 	return 1;
 }
 
@@ -315,9 +435,15 @@ int CNetConnection::Update()
 		}
 		else
 		{
-			// resend packet if we havn't got it acked in 1 second
-			if(Now-pResend->m_LastSendTime > time_freq())
-				ResendChunk(pResend);
+			// resend the chunks that weren't acked in time, but not all at once
+			int Budget = NET_CONN_RESEND_BUDGET;
+			for(; pResend && Budget > 0; pResend = m_Buffer.Next(pResend))
+			{
+				if(Now-pResend->m_LastSendTime > ResendTimeout(pResend))
+					Budget -= ResendChunk(pResend);
+			}
+			if(Budget != NET_CONN_RESEND_BUDGET)
+				SetFlushPending();
 		}
 	}
 
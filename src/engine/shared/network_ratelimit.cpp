@@ -0,0 +1,54 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+#include <base/system.h>
+#include "network.h"
+
+void CNetRateLimit::Init()
+{
+	mem_zero(this, sizeof(*this));
+}
+
+void CNetRateLimit::SetRate(int Type, int Rate)
+{
+	m_aRates[Type] = max(Rate, 0);
+}
+
+bool CNetRateLimit::Allow(const NETADDR *pAddr, int Type)
+{
+	if(!m_aRates[Type])
+	{
+		m_aNumAllowed[Type]++;
+		return true;
+	}
+
+	// all ports of an address share the buckets
+	NETADDR Addr = *pAddr;
+	Addr.port = 0;
+
+	unsigned Hash = 2166136261u;
+	for(int i = 0; i < 16; i++)
+		Hash = (Hash^Addr.ip[i])*16777619u;
+	CEntry *pEntry = &m_aEntries[Hash%TABLE_SIZE];
+	if(net_addr_comp(&pEntry->m_Addr, &Addr) != 0)
+	{
+		// new address, start with full buckets
+		mem_zero(pEntry, sizeof(*pEntry));
+		pEntry->m_Addr = Addr;
+	}
+
+	// every packet moves the time the bucket is full again by one interval, it may be
+	// at most the burst ahead of now
+	int64 Now = time_get();
+	int64 Interval = time_freq()/m_aRates[Type];
+	int64 FullTime = max(pEntry->m_aFullTime[Type], Now)+Interval;
+	if(FullTime-Now > Interval*BURST_SECONDS*m_aRates[Type])
+	{
+		m_aNumDropped[Type]++;
+		return false;
+	}
+
+	pEntry->m_aFullTime[Type] = FullTime;
+	m_aNumAllowed[Type]++;
+	return true;
+}
@@ -3,29 +3,6 @@
 #include <base/system.h>
 #include "network.h"
 
-#define MACRO_LIST_LINK_FIRST(Object, First, Prev, Next) \
-	{ if(First) First->Prev = Object; \
-	Object->Prev = (struct CBan *)0; \
-	Object->Next = First; \
-	First = Object; }
-
-#define MACRO_LIST_LINK_AFTER(Object, After, Prev, Next) \
-	{ Object->Prev = After; \
-	Object->Next = After->Next; \
-	After->Next = Object; \
-	if(Object->Next) \
-		Object->Next->Prev = Object; \
-	}
-
-#define MACRO_LIST_UNLINK(Object, First, Prev, Next) \
-	{ if(Object->Next) Object->Next->Prev = Object->Prev; \
-	if(Object->Prev) Object->Prev->Next = Object->Next; \
-	else First = Object->Next; \
-	Object->Next = 0; Object->Prev = 0; }
-
-#define MACRO_LIST_FIND(Start, Next, Expression) \
-	{ while(Start && !(Expression)) Start = Start->Next; }
-
 bool CNetServer::Open(NETADDR BindAddr, int MaxClients, int MaxClientsPerIP, int Flags)
 {
 	// zero out the whole structure
@@ -48,16 +25,8 @@ bool CNetServer::Open(NETADDR BindAddr, int MaxClients, int MaxClientsPerIP, int
 	for(int i = 0; i < NET_MAX_CLIENTS; i++)
 		m_aSlots[i].m_Connection.Init(m_Socket);
 
-	// setup all pointers for bans
-	for(int i = 1; i < NET_SERVER_MAXBANS-1; i++)
-	{
-		m_BanPool[i].m_pNext = &m_BanPool[i+1];
-		m_BanPool[i].m_pPrev = &m_BanPool[i-1];
-	}
-
-	m_BanPool[0].m_pNext = &m_BanPool[1];
-	m_BanPool[NET_SERVER_MAXBANS-1].m_pPrev = &m_BanPool[NET_SERVER_MAXBANS-2];
-	m_BanPool_FirstFree = &m_BanPool[0];
+	m_BanTable.Init();
+	m_RateLimit.Init();
 
 	return true;
 }
@@ -96,130 +65,32 @@ int CNetServer::Drop(int ClientID, const char *pReason)
 
 int CNetServer::BanGet(int Index, CBanInfo *pInfo)
 {
-	CBan *pBan;
-	for(pBan = m_BanPool_FirstUsed; pBan && Index; pBan = pBan->m_pNext, Index--)
-		{}
-
-	if(!pBan)
-		return 0;
-	*pInfo = pBan->m_Info;
-	return 1;
+	return m_BanTable.Get(Index, pInfo) ? 1 : 0;
 }
 
-int CNetServer::BanNum()
+int CNetServer::BanRemove(NETADDR Addr, int Prefix)
 {
-	int Count = 0;
-	CBan *pBan;
-	for(pBan = m_BanPool_FirstUsed; pBan; pBan = pBan->m_pNext)
-		Count++;
-	return Count;
-}
+	if(m_BanTable.Remove(&Addr, Prefix) != 0)
+		return -1;
 
-void CNetServer::BanRemoveByObject(CBan *pBan)
-{
-	int IpHash = (pBan->m_Info.m_Addr.ip[0]+pBan->m_Info.m_Addr.ip[1]+pBan->m_Info.m_Addr.ip[2]+pBan->m_Info.m_Addr.ip[3]+
-					pBan->m_Info.m_Addr.ip[4]+pBan->m_Info.m_Addr.ip[5]+pBan->m_Info.m_Addr.ip[6]+pBan->m_Info.m_Addr.ip[7]+
-					pBan->m_Info.m_Addr.ip[8]+pBan->m_Info.m_Addr.ip[9]+pBan->m_Info.m_Addr.ip[10]+pBan->m_Info.m_Addr.ip[11]+
-					pBan->m_Info.m_Addr.ip[12]+pBan->m_Info.m_Addr.ip[13]+pBan->m_Info.m_Addr.ip[14]+pBan->m_Info.m_Addr.ip[15])&0xff;
 	char aAddrStr[NETADDR_MAXSTRSIZE];
-	net_addr_str(&pBan->m_Info.m_Addr, aAddrStr, sizeof(aAddrStr));
+	CNetBanTable::FormatRange(&Addr, Prefix, aAddrStr, sizeof(aAddrStr));
 	dbg_msg("netserver", "removing ban on %s", aAddrStr);
-	MACRO_LIST_UNLINK(pBan, m_BanPool_FirstUsed, m_pPrev, m_pNext);
-	MACRO_LIST_UNLINK(pBan, m_aBans[IpHash], m_pHashPrev, m_pHashNext);
-	MACRO_LIST_LINK_FIRST(pBan, m_BanPool_FirstFree, m_pPrev, m_pNext);
-}
-
-int CNetServer::BanRemove(NETADDR Addr)
-{
-	int IpHash = (Addr.ip[0]+Addr.ip[1]+Addr.ip[2]+Addr.ip[3]+Addr.ip[4]+Addr.ip[5]+Addr.ip[6]+Addr.ip[7]+
-					Addr.ip[8]+Addr.ip[9]+Addr.ip[10]+Addr.ip[11]+Addr.ip[12]+Addr.ip[13]+Addr.ip[14]+Addr.ip[15])&0xff;
-	CBan *pBan = m_aBans[IpHash];
-
-	MACRO_LIST_FIND(pBan, m_pHashNext, net_addr_comp(&pBan->m_Info.m_Addr, &Addr) == 0);
-
-	if(pBan)
-	{
-		BanRemoveByObject(pBan);
-		return 0;
-	}
-
-	return -1;
+	return 0;
 }
 
-int CNetServer::BanAdd(NETADDR Addr, int Seconds, const char *pReason)
+int CNetServer::BanAdd(NETADDR Addr, int Seconds, const char *pReason, int Prefix)
 {
-	int IpHash = (Addr.ip[0]+Addr.ip[1]+Addr.ip[2]+Addr.ip[3]+Addr.ip[4]+Addr.ip[5]+Addr.ip[6]+Addr.ip[7]+
-					Addr.ip[8]+Addr.ip[9]+Addr.ip[10]+Addr.ip[11]+Addr.ip[12]+Addr.ip[13]+Addr.ip[14]+Addr.ip[15])&0xff;
 	int Stamp = -1;
-	CBan *pBan;
-
-	// remove the port
-	Addr.port = 0;
-
 	if(Seconds)
 		Stamp = time_timestamp() + Seconds;
 
-	// search to see if it already exists
-	pBan = m_aBans[IpHash];
-	MACRO_LIST_FIND(pBan, m_pHashNext, net_addr_comp(&pBan->m_Info.m_Addr, &Addr) == 0);
-	if(pBan)
-	{
-		// adjust the ban
-		pBan->m_Info.m_Expires = Stamp;
-		return 0;
-	}
-
-	if(!m_BanPool_FirstFree)
+	if(m_BanTable.Add(&Addr, Prefix, Stamp, pReason) != 0)
 		return -1;
 
-	// fetch and clear the new ban
-	pBan = m_BanPool_FirstFree;
-	MACRO_LIST_UNLINK(pBan, m_BanPool_FirstFree, m_pPrev, m_pNext);
-
-	// setup the ban info
-	pBan->m_Info.m_Expires = Stamp;
-	pBan->m_Info.m_Addr = Addr;
-	str_copy(pBan->m_Info.m_Reason, pReason, sizeof(pBan->m_Info.m_Reason));
-
-	// add it to the ban hash
-	MACRO_LIST_LINK_FIRST(pBan, m_aBans[IpHash], m_pHashPrev, m_pHashNext);
-
-	// insert it into the used list
-	{
-		if(m_BanPool_FirstUsed)
-		{
-			CBan *pInsertAfter = m_BanPool_FirstUsed;
-			MACRO_LIST_FIND(pInsertAfter, m_pNext, Stamp < pInsertAfter->m_Info.m_Expires);
-
-			if(pInsertAfter)
-				pInsertAfter = pInsertAfter->m_pPrev;
-			else
-			{
-				// add to last
-				pInsertAfter = m_BanPool_FirstUsed;
-				while(pInsertAfter->m_pNext)
-					pInsertAfter = pInsertAfter->m_pNext;
-			}
-
-			if(pInsertAfter)
-			{
-				MACRO_LIST_LINK_AFTER(pBan, pInsertAfter, m_pPrev, m_pNext);
-			}
-			else
-			{
-				MACRO_LIST_LINK_FIRST(pBan, m_BanPool_FirstUsed, m_pPrev, m_pNext);
-			}
-		}
-		else
-		{
-			MACRO_LIST_LINK_FIRST(pBan, m_BanPool_FirstUsed, m_pPrev, m_pNext);
-		}
-	}
-
 	// drop banned clients
 	{
 		char Buf[128];
-		NETADDR BanAddr;
 
 		if(Stamp > -1)
 		{
@@ -234,10 +105,8 @@ int CNetServer::BanAdd(NETADDR Addr, int Seconds, const char *pReason)
 
 		for(int i = 0; i < MaxClients(); i++)
 		{
-			BanAddr = m_aSlots[i].m_Connection.PeerAddress();
-			BanAddr.port = 0;
-
-			if(net_addr_comp(&Addr, &BanAddr) == 0)
+			NETADDR PeerAddr = m_aSlots[i].m_Connection.PeerAddress();
+			if(m_aSlots[i].m_Connection.State() != NET_CONNSTATE_OFFLINE && CNetBanTable::Contains(&Addr, Prefix, &PeerAddr))
 				Drop(i, Buf);
 		}
 	}
@@ -255,15 +124,23 @@ int CNetServer::Update()
 	}
 
 	// remove expired bans
-	while(m_BanPool_FirstUsed && m_BanPool_FirstUsed->m_Info.m_Expires > -1 && m_BanPool_FirstUsed->m_Info.m_Expires < Now)
+	CBanInfo Expired;
+	while(m_BanTable.PopExpired(Now, &Expired))
 	{
-		CBan *pBan = m_BanPool_FirstUsed;
-		BanRemoveByObject(pBan);
+		char aAddrStr[NETADDR_MAXSTRSIZE];
+		CNetBanTable::FormatRange(&Expired.m_Addr, Expired.m_Prefix, aAddrStr, sizeof(aAddrStr));
+		dbg_msg("netserver", "removing ban on %s", aAddrStr);
 	}
 
 	return 0;
 }
 
+void CNetServer::Flush()
+{
+	for(int i = 0; i < MaxClients(); i++)
+		m_aSlots[i].m_Connection.FlushPending();
+}
+
 /*
 	TODO: chopp up this function into smaller working parts
 */
@@ -286,37 +163,40 @@ int CNetServer::Recv(CNetChunk *pChunk)
 		if(Bytes <= 0)
 			break;
 
+		// drop floods of info requests and connects from the raw header, before spending anything on them.
+		// compressed control packets count as connects, they can't be told apart without decompressing
+		int PacketFlags = m_RecvUnpacker.m_aBuffer[0]>>4;
+		int RateType = -1;
+		if(PacketFlags&NET_PACKETFLAG_CONNLESS)
+			RateType = CNetRateLimit::TYPE_INFO;
+		else if(PacketFlags&NET_PACKETFLAG_CONTROL && (PacketFlags&NET_PACKETFLAG_COMPRESSION ||
+			(Bytes > NET_PACKETHEADERSIZE && m_RecvUnpacker.m_aBuffer[NET_PACKETHEADERSIZE] == NET_CTRLMSG_CONNECT)))
+			RateType = CNetRateLimit::TYPE_CONNECT;
+		if(RateType != -1 && !m_RateLimit.Allow(&Addr, RateType))
+			continue;
+
 		if(CNetBase::UnpackPacket(m_RecvUnpacker.m_aBuffer, Bytes, &m_RecvUnpacker.m_Data) == 0)
 		{
-			CBan *pBan = 0;
-			NETADDR BanAddr = Addr;
-			int IpHash = (BanAddr.ip[0]+BanAddr.ip[1]+BanAddr.ip[2]+BanAddr.ip[3]+BanAddr.ip[4]+BanAddr.ip[5]+BanAddr.ip[6]+BanAddr.ip[7]+
-							BanAddr.ip[8]+BanAddr.ip[9]+BanAddr.ip[10]+BanAddr.ip[11]+BanAddr.ip[12]+BanAddr.ip[13]+BanAddr.ip[14]+BanAddr.ip[15])&0xff;
 			int Found = 0;
-			BanAddr.port = 0;
 
 			// search a ban
-			for(pBan = m_aBans[IpHash]; pBan; pBan = pBan->m_pHashNext)
-			{
-				if(net_addr_comp(&pBan->m_Info.m_Addr, &BanAddr) == 0)
-					break;
-			}
+			const CBanInfo *pBan = m_BanTable.Find(&Addr);
 
 			// check if we just should drop the packet
 			if(pBan)
 			{
 				// banned, reply with a message
 				char BanStr[128];
-				if(pBan->m_Info.m_Expires > -1)
+				if(pBan->m_Expires > -1)
 				{
-					int Mins = ((pBan->m_Info.m_Expires - Now)+59)/60;
+					int Mins = ((pBan->m_Expires - Now)+59)/60;
 					if(Mins <= 1)
-						str_format(BanStr, sizeof(BanStr), "Banned for 1 minute (%s)", pBan->m_Info.m_Reason);
+						str_format(BanStr, sizeof(BanStr), "Banned for 1 minute (%s)", pBan->m_Reason);
 					else
-						str_format(BanStr, sizeof(BanStr), "Banned for %d minutes (%s)", Mins, pBan->m_Info.m_Reason);
+						str_format(BanStr, sizeof(BanStr), "Banned for %d minutes (%s)", Mins, pBan->m_Reason);
 				}
 				else
-					str_format(BanStr, sizeof(BanStr), "Banned for life (%s)", pBan->m_Info.m_Reason);
+					str_format(BanStr, sizeof(BanStr), "Banned for life (%s)", pBan->m_Reason);
 				CNetBase::SendControlMsg(m_Socket, &Addr, 0, NET_CTRLMSG_CLOSE, BanStr, str_length(BanStr)+1);
 				continue;
 			}
@@ -440,8 +320,11 @@ int CNetServer::Send(CNetChunk *pChunk)
 
 		if(m_aSlots[pChunk->m_ClientID].m_Connection.QueueChunk(Flags, pChunk->m_DataSize, pChunk->m_pData) == 0)
 		{
-			if(pChunk->m_Flags&NETSENDFLAG_FLUSH)
+			// flushes wait for the end of the tick, so everything sent until then shares packets
+			if(pChunk->m_Flags&NETSENDFLAG_NODELAY)
 				m_aSlots[pChunk->m_ClientID].m_Connection.Flush();
+			else if(pChunk->m_Flags&NETSENDFLAG_FLUSH)
+				m_aSlots[pChunk->m_ClientID].m_Connection.SetFlushPending();
 		}
 		else
 		{
@@ -451,6 +334,50 @@ int CNetServer::Send(CNetChunk *pChunk)
 	return 0;
 }
 
+int CNetServer::SendMask(CNetChunk *pChunk, int Mask)
+{
+	if(pChunk->m_DataSize >= NET_MAX_PAYLOAD)
+	{
+		dbg_msg("netserver", "packet payload too big. %d. dropping packet", pChunk->m_DataSize);
+		return -1;
+	}
+
+	int Flags = 0;
+	if(pChunk->m_Flags&NETSENDFLAG_VITAL)
+		Flags = NET_CHUNKFLAG_VITAL;
+
+	// vital chunks stay around until acked, let all connections keep the same copy
+	CNetSharedData *pShared = 0;
+	if(Flags&NET_CHUNKFLAG_VITAL)
+		pShared = CNetSharedData::Create(pChunk->m_pData, pChunk->m_DataSize);
+
+	for(int i = 0; i < MaxClients(); i++)
+	{
+		if(!(Mask&(1<<i)) || m_aSlots[i].m_Connection.State() == NET_CONNSTATE_OFFLINE)
+			continue;
+
+		int Result;
+		if(pShared)
+			Result = m_aSlots[i].m_Connection.QueueSharedChunk(Flags, pShared);
+		else
+			Result = m_aSlots[i].m_Connection.QueueChunk(Flags, pChunk->m_DataSize, pChunk->m_pData);
+
+		if(Result == 0)
+		{
+			if(pChunk->m_Flags&NETSENDFLAG_NODELAY)
+				m_aSlots[i].m_Connection.Flush();
+			else if(pChunk->m_Flags&NETSENDFLAG_FLUSH)
+				m_aSlots[i].m_Connection.SetFlushPending();
+		}
+		else
+			Drop(i, "Error sending data");
+	}
+
+	if(pShared)
+		pShared->Release();
+	return 0;
+}
+
 void CNetServer::SetMaxClientsPerIP(int Max)
 {
 	// clamp
@@ -91,7 +91,8 @@ enum
 	MSGFLAG_FLUSH=2,
 	MSGFLAG_NORECORD=4,
 	MSGFLAG_RECORD=8,
-	MSGFLAG_NOSEND=16
+	MSGFLAG_NOSEND=16,
+	MSGFLAG_NODELAY=32 // the server flushes at the end of the tick, this flushes right away
 };
 
 #endif
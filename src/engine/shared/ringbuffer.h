@@ -65,4 +65,20 @@ public:
 	T *Last() { return (T*)CRingBufferBase::Last(); }
 };
 
+// same as TStaticRingBuffer, but on memory the user allocates and frees
+template<typename T, int TFLAGS=0>
+class TRingBuffer : public CRingBufferBase
+{
+public:
+	void Init(void *pMemory, int Size) { CRingBufferBase::Init(pMemory, Size, TFLAGS); }
+
+	T *Allocate(int Size) { return (T*)CRingBufferBase::Allocate(Size); }
+	int PopFirst() { return CRingBufferBase::PopFirst(); }
+
+	T *Prev(T *pCurrent) { return (T*)CRingBufferBase::Prev(pCurrent); }
+	T *Next(T *pCurrent) { return (T*)CRingBufferBase::Next(pCurrent); }
+	T *First() { return (T*)CRingBufferBase::First(); }
+	T *Last() { return (T*)CRingBufferBase::Last(); }
+};
+
 #endif
@@ -38,12 +38,16 @@ void CMapImages::OnMapLoad()
 		{
 			char Buf[256];
 			char *pName = (char *)pMap->GetData(pImg->m_ImageName);
+			if(!pName)
+				continue;
 			str_format(Buf, sizeof(Buf), "mapres/%s.png", pName);
 			m_aTextures[i] = Graphics()->LoadTexture(Buf, IStorage::TYPE_ALL, CImageInfo::FORMAT_AUTO, 0);
 		}
 		else
 		{
 			void *pData = pMap->GetData(pImg->m_ImageData);
+			if(!pData)
+				continue;
 			m_aTextures[i] = Graphics()->LoadTextureRaw(pImg->m_Width, pImg->m_Height, CImageInfo::FORMAT_RGBA, pData, CImageInfo::FORMAT_RGBA, 0);
 			pMap->UnloadData(pImg->m_ImageData);
 		}
@@ -51,7 +51,7 @@ void CSounds::OnInit()
 	{
 		g_UserData.m_pGameClient = m_pClient;
 		g_UserData.m_Render = false;
-		m_pClient->Engine()->AddJob(&m_SoundJob, LoadSoundsThread, &g_UserData);
+		m_pClient->Engine()->AddJob(&m_SoundJob, LoadSoundsThread, &g_UserData, CJobPool::CLASS_IO);
 		m_WaitForSoundJob = true;
 	}
 	else
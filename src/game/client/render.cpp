@@ -312,6 +312,8 @@ void CRenderTools::RenderTilemapGenerateSkip(class CLayers *pLayers)
 			{
 				CMapItemLayerTilemap *pTmap = (CMapItemLayerTilemap *)pLayer;
 				CTile *pTiles = (CTile *)pLayers->Map()->GetData(pTmap->m_Data);
+				if(!pTiles)
+					continue;
 				for(int y = 0; y < pTmap->m_Height; y++)
 				{
 					for(int x = 1; x < pTmap->m_Width; x++)
@@ -15,11 +15,17 @@
 CCollision::CCollision()
 {
 	m_pTiles = 0;
+	m_pEmptyTiles = 0;
 	m_Width = 0;
 	m_Height = 0;
 	m_pLayers = 0;
 }
 
+CCollision::~CCollision()
+{
+	delete [] m_pEmptyTiles;
+}
+
 void CCollision::Init(class CLayers *pLayers)
 {
 	m_pLayers = pLayers;
@@ -27,6 +33,17 @@ void CCollision::Init(class CLayers *pLayers)
 	m_Height = m_pLayers->GameLayer()->m_Height;
 	m_pTiles = static_cast<CTile *>(m_pLayers->Map()->GetData(m_pLayers->GameLayer()->m_Data));
 
+	delete [] m_pEmptyTiles;
+	m_pEmptyTiles = 0;
+	if(!m_pTiles)
+	{
+		// broken map data, go on with an empty game layer instead of crashing
+		dbg_msg("collision", "failed to load the game layer");
+		m_pEmptyTiles = new CTile[m_Width*m_Height];
+		mem_zero(m_pEmptyTiles, m_Width*m_Height*sizeof(CTile));
+		m_pTiles = m_pEmptyTiles;
+	}
+
 	// race
 	mem_zero(aLen, sizeof(aLen));
 	mem_zero(aTele, sizeof(aTele));
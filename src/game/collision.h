@@ -8,6 +8,7 @@
 class CCollision
 {
 	class CTile *m_pTiles;
+	class CTile *m_pEmptyTiles; // stands in for a game layer that can't be loaded
 	int m_Width;
 	int m_Height;
 	class CLayers *m_pLayers;
@@ -29,6 +30,7 @@ public:
 	};
 
 	CCollision();
+	~CCollision();
 	void Init(class CLayers *pLayers);
 	bool CheckPoint(float x, float y) { return IsTileSolid(round(x), round(y)); }
 	bool CheckPoint(vec2 Pos) { return CheckPoint(Pos.x, Pos.y); }
@@ -367,7 +367,7 @@ int CEditorMap::Save(class IStorage *pStorage, const char *pFileName)
 	df.AddItem(MAPITEMTYPE_ENVPOINTS, 0, TotalSize, pPoints);
 
 	// finish the data file
-	df.Finish();
+	df.Finish(m_pEditor->Engine());
 	m_pEditor->Console()->Print(IConsole::OUTPUT_LEVEL_ADDINFO, "editor", "saving done");
 
 	// send rcon.. if we can
@@ -397,6 +397,9 @@ int CEditorMap::Load(class IStorage *pStorage, const char *pFileName, int Storag
 	if(!DataFile.Open(pStorage, pFileName, StorageType))
 		return 0;
 
+	// images and layers are read one after another below, get them decompressed in parallel
+	DataFile.PrefetchData(m_pEditor->Engine());
+
 	Clean();
 
 	// check version
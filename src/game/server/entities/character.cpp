@@ -39,7 +39,7 @@ CInputCount CountInput(int Prev, int Cur)
 }
 
 
-MACRO_ALLOC_POOL_ID_IMPL(CCharacter, MAX_CLIENTS)
+MACRO_ALLOC_POOL_IMPL(CCharacter)
 
 // Character, "physical" player's part
 CCharacter::CCharacter(CGameWorld *pWorld)
@@ -84,6 +84,7 @@ bool CCharacter::Spawn(CPlayer *pPlayer, vec2 Pos)
 
 	m_ReckoningTick = 0;
 	mem_zero(&m_SendCore, sizeof(m_SendCore));
+	m_LowRateTick = 0;
 	mem_zero(&m_ReckoningCore, sizeof(m_ReckoningCore));
 
 	GameServer()->m_World.InsertEntity(this);
@@ -108,7 +109,7 @@ void CCharacter::SetWeapon(int W)
 	m_LastWeapon = m_ActiveWeapon;
 	m_QueuedWeapon = -1;
 	m_ActiveWeapon = W;
-	GameServer()->CreateSound(m_Pos, SOUND_WEAPON_SWITCH);
+	GameServer()->CreateSound(m_Pos, SOUND_WEAPON_SWITCH, GameServer()->TeamMask(m_pPlayer->GetCID()));
 
 	if(m_ActiveWeapon < 0 || m_ActiveWeapon >= NUM_WEAPONS)
 		m_ActiveWeapon = 0;
@@ -287,7 +288,7 @@ void CCharacter::FireWeapon()
 	{
 		// 125ms is a magical limit of how fast a human can click
 		m_ReloadTimer = 125 * Server()->TickSpeed() / 1000;
-		GameServer()->CreateSound(m_Pos, SOUND_WEAPON_NOAMMO);
+		GameServer()->CreateSound(m_Pos, SOUND_WEAPON_NOAMMO, GameServer()->TeamMask(m_pPlayer->GetCID()));
 		return;
 	}
 
@@ -330,9 +331,9 @@ void CCharacter::FireWeapon()
 				if(!GameServer()->m_pController->IsHPRace())
 				{
 					if(length(pTarget->m_Pos-ProjStartPos) > 0.0f)
-						GameServer()->CreateHammerHit(pTarget->m_Pos-normalize(pTarget->m_Pos-ProjStartPos)*m_ProximityRadius*0.5f);
+						GameServer()->CreateHammerHit(pTarget->m_Pos-normalize(pTarget->m_Pos-ProjStartPos)*m_ProximityRadius*0.5f, GameServer()->TeamMask(m_pPlayer->GetCID()));
 					else
-						GameServer()->CreateHammerHit(ProjStartPos);
+						GameServer()->CreateHammerHit(ProjStartPos, GameServer()->TeamMask(m_pPlayer->GetCID()));
 				}
 				else if(m_pPlayer->GetPartner())
 				{
@@ -384,7 +385,7 @@ void CCharacter::FireWeapon()
 
 			Server()->SendMsg(&Msg, 0, m_pPlayer->GetCID());
 
-			GameServer()->CreateSound(m_Pos, SOUND_GUN_FIRE);
+			GameServer()->CreateSound(m_Pos, SOUND_GUN_FIRE, GameServer()->TeamMask(m_pPlayer->GetCID()));
 		} break;
 
 		case WEAPON_SHOTGUN:
@@ -418,7 +419,7 @@ void CCharacter::FireWeapon()
 
 			Server()->SendMsg(&Msg, 0,m_pPlayer->GetCID());
 
-			GameServer()->CreateSound(m_Pos, SOUND_SHOTGUN_FIRE);
+			GameServer()->CreateSound(m_Pos, SOUND_SHOTGUN_FIRE, GameServer()->TeamMask(m_pPlayer->GetCID()));
 		} break;
 
 		case WEAPON_GRENADE:
@@ -440,13 +441,13 @@ void CCharacter::FireWeapon()
 				Msg.AddInt(((int *)&p)[i]);
 			Server()->SendMsg(&Msg, 0, m_pPlayer->GetCID());
 
-			GameServer()->CreateSound(m_Pos, SOUND_GRENADE_FIRE);
+			GameServer()->CreateSound(m_Pos, SOUND_GRENADE_FIRE, GameServer()->TeamMask(m_pPlayer->GetCID()));
 		} break;
 
 		case WEAPON_RIFLE:
 		{
 			new CLaser(GameWorld(), m_Pos, Direction, GameServer()->Tuning()->m_LaserReach, m_pPlayer->GetCID());
-			GameServer()->CreateSound(m_Pos, SOUND_RIFLE_FIRE);
+			GameServer()->CreateSound(m_Pos, SOUND_RIFLE_FIRE, GameServer()->TeamMask(m_pPlayer->GetCID()));
 		} break;
 
 		case WEAPON_NINJA:
@@ -458,7 +459,7 @@ void CCharacter::FireWeapon()
 			m_Ninja.m_CurrentMoveTime = g_pData->m_Weapons.m_Ninja.m_Movetime * Server()->TickSpeed() / 1000;
 			m_Ninja.m_OldVelAmount = length(m_Core.m_Vel);
 
-			GameServer()->CreateSound(m_Pos, SOUND_NINJA_FIRE);
+			GameServer()->CreateSound(m_Pos, SOUND_NINJA_FIRE, GameServer()->TeamMask(m_pPlayer->GetCID()));
 		} break;
 
 	}
@@ -533,7 +534,7 @@ void CCharacter::GiveNinja()
 		m_LastWeapon = m_ActiveWeapon;
 	m_ActiveWeapon = WEAPON_NINJA;
 
-	GameServer()->CreateSound(m_Pos, SOUND_PICKUP_NINJA);
+	GameServer()->CreateSound(m_Pos, SOUND_PICKUP_NINJA, GameServer()->TeamMask(m_pPlayer->GetCID()));
 }
 
 void CCharacter::SetEmote(int Emote, int Tick)
@@ -1075,7 +1076,7 @@ void CCharacter::Die(int Killer, int Weapon)
 	Server()->SendPackMsg(&Msg, MSGFLAG_VITAL, -1);
 
 	// a nice sound
-	GameServer()->CreateSound(m_Pos, SOUND_PLAYER_DIE);
+	GameServer()->CreateSound(m_Pos, SOUND_PLAYER_DIE, GameServer()->TeamMask(m_pPlayer->GetCID()));
 
 	// this is for auto respawn after 3 secs
 	m_pPlayer->m_DieTick = Server()->Tick();
@@ -1083,7 +1084,7 @@ void CCharacter::Die(int Killer, int Weapon)
 	m_Alive = false;
 	GameServer()->m_World.RemoveEntity(this);
 	GameServer()->m_World.m_Core.m_apCharacters[m_pPlayer->GetCID()] = 0;
-	GameServer()->CreateDeath(m_Pos, m_pPlayer->GetCID());
+	GameServer()->CreateDeath(m_Pos, m_pPlayer->GetCID(), GameServer()->TeamMask(m_pPlayer->GetCID()));
 }
 
 bool CCharacter::TakeDamage(vec2 Force, int Dmg, int From, int Weapon)
@@ -1108,12 +1109,12 @@ bool CCharacter::TakeDamage(vec2 Force, int Dmg, int From, int Weapon)
 	if(Server()->Tick() < m_DamageTakenTick+25)
 	{
 		// make sure that the damage indicators doesn't group together
-		GameServer()->CreateDamageInd(m_Pos, m_DamageTaken*0.25f, Dmg);
+		GameServer()->CreateDamageInd(m_Pos, m_DamageTaken*0.25f, Dmg, GameServer()->TeamMask(m_pPlayer->GetCID()));
 	}
 	else
 	{
 		m_DamageTaken = 0;
-		GameServer()->CreateDamageInd(m_Pos, 0, Dmg);
+		GameServer()->CreateDamageInd(m_Pos, 0, Dmg, GameServer()->TeamMask(m_pPlayer->GetCID()));
 	}
 
 	if(Dmg)
@@ -1175,9 +1176,9 @@ bool CCharacter::TakeDamage(vec2 Force, int Dmg, int From, int Weapon)
 	}
 
 	if (Dmg > 2)
-		GameServer()->CreateSound(m_Pos, SOUND_PLAYER_PAIN_LONG);
+		GameServer()->CreateSound(m_Pos, SOUND_PLAYER_PAIN_LONG, GameServer()->TeamMask(m_pPlayer->GetCID()));
 	else
-		GameServer()->CreateSound(m_Pos, SOUND_PLAYER_PAIN_SHORT);
+		GameServer()->CreateSound(m_Pos, SOUND_PLAYER_PAIN_SHORT, GameServer()->TeamMask(m_pPlayer->GetCID()));
 
 	m_EmoteType = EMOTE_PAIN;
 	m_EmoteStop = Server()->Tick() + 500 * Server()->TickSpeed() / 1000;
@@ -1190,8 +1191,8 @@ void CCharacter::Snap(int SnappingClient)
 	if(NetworkClipped(SnappingClient))
 		return;
  	
-	if(GameServer()->m_apPlayers[SnappingClient] && GameServer()->m_apPlayers[SnappingClient]->GetPartner()
-		&& SnappingClient != m_pPlayer->GetCID() && m_pPlayer->GetCID() != GameServer()->m_apPlayers[SnappingClient]->GetPartner()->GetCID())
+	int Policy = GameServer()->SnapPolicy(SnappingClient, m_pPlayer->GetCID());
+	if(Policy == CGameContext::SNAP_HIDDEN)
 		return;
 
 	CNetObj_Character *pCharacter = static_cast<CNetObj_Character *>(Server()->SnapNewItem(NETOBJTYPE_CHARACTER, m_pPlayer->GetCID(), sizeof(CNetObj_Character)));
@@ -1199,7 +1200,33 @@ void CCharacter::Snap(int SnappingClient)
 		return;
 
 	// write down the m_Core
-	if(!m_ReckoningTick || GameServer()->m_World.m_Paused)
+	if(Policy == CGameContext::SNAP_REDUCED_RATE && !GameServer()->m_World.m_Paused)
+	{
+		// other teams only get a fresh core every few ticks, the client reckons the rest
+		if(!m_LowRateTick || m_LowRateTick+g_Config.m_SvHPRaceSnapInterval <= Server()->Tick())
+		{
+			m_LowRateTick = Server()->Tick();
+			m_Core.Write(&m_LowRateCore);
+			m_LowRateCore.m_Tick = m_LowRateTick;
+		}
+		mem_copy(pCharacter, &m_LowRateCore, sizeof(m_LowRateCore));
+	}
+	else if(Policy == CGameContext::SNAP_REDUCED_PRECISION)
+	{
+		// coarse values without reckoning, so most of them stay the same between snapshots and delta away
+		pCharacter->m_Tick = 0;
+		m_Core.Write(pCharacter);
+		pCharacter->m_X &= ~3;
+		pCharacter->m_Y &= ~3;
+		pCharacter->m_VelX &= ~255;
+		pCharacter->m_VelY &= ~255;
+		pCharacter->m_Angle &= ~31;
+		pCharacter->m_HookX &= ~3;
+		pCharacter->m_HookY &= ~3;
+		pCharacter->m_HookDx &= ~31;
+		pCharacter->m_HookDy &= ~31;
+	}
+	else if(!m_ReckoningTick || GameServer()->m_World.m_Paused)
 	{
 		// no dead reckoning when paused because the client doesn't know
 		// how far to perform the reckoning
@@ -25,7 +25,7 @@ enum
 
 class CCharacter : public CEntity
 {
-	MACRO_ALLOC_POOL_ID()
+	MACRO_ALLOC_POOL()
 
 public:
 	//character's size
@@ -150,6 +150,10 @@ private:
 	CCharacterCore m_SendCore; // core that we should send
 	CCharacterCore m_ReckoningCore; // the dead reckoning core
 
+	// core sent to other hp-race teams with a reduced rate
+	int m_LowRateTick;
+	CNetObj_CharacterCore m_LowRateCore;
+
 };
 
 #endif
@@ -4,6 +4,99 @@
 #include "entity.h"
 #include "gamecontext.h"
 
+//////////////////////////////////////////////////
+// Entity pool
+//////////////////////////////////////////////////
+CEntityPool *CEntityPool::ms_pFirstPool = 0;
+
+CEntityPool::CEntityPool(const char *pName, unsigned Size)
+{
+	m_pName = pName;
+	m_Size = Size;
+	m_ObjectSize = (max(Size, (unsigned)sizeof(CFreeObject))+ALIGNMENT-1)&~(ALIGNMENT-1);
+	m_pSlabs = 0;
+	m_pFree = 0;
+	m_NumSlabs = 0;
+	m_NumUsed = 0;
+	m_PeakUsed = 0;
+	m_NumAllocs = 0;
+
+	// the pools are static objects, this runs before main
+	m_pNextPool = ms_pFirstPool;
+	ms_pFirstPool = this;
+}
+
+void CEntityPool::NewSlab()
+{
+	// the objects follow the slab header, in order so the first one is handed out first
+	CSlab *pSlab = (CSlab *)mem_alloc_tagged(ALIGNMENT+OBJECTS_PER_SLAB*m_ObjectSize, ALIGNMENT, MEMTAG_ENTITY);
+	pSlab->m_pNext = m_pSlabs;
+	m_pSlabs = pSlab;
+	m_NumSlabs++;
+
+	char *pObjects = (char *)pSlab+ALIGNMENT;
+	for(int i = OBJECTS_PER_SLAB-1; i >= 0; i--)
+	{
+		CFreeObject *pObject = (CFreeObject *)(pObjects+i*m_ObjectSize);
+		Poison(pObject, m_ObjectSize);
+		pObject->m_pNext = m_pFree;
+		m_pFree = pObject;
+	}
+}
+
+void *CEntityPool::Alloc(unsigned Size)
+{
+	dbg_assert(Size == m_Size, "size error");
+	if(!m_pFree)
+		NewSlab();
+
+	CFreeObject *pObject = m_pFree;
+	m_pFree = pObject->m_pNext;
+
+#ifdef CONF_DEBUG
+	if(!IsPoisoned(pObject+1, m_ObjectSize-sizeof(CFreeObject)))
+		dbg_msg("pool", "freed %s at %p was written to", m_pName, pObject);
+#endif
+
+	m_NumUsed++;
+	m_NumAllocs++;
+	if(m_NumUsed > m_PeakUsed)
+		m_PeakUsed = m_NumUsed;
+
+	mem_zero(pObject, m_Size);
+	return pObject;
+}
+
+void CEntityPool::Free(void *p)
+{
+	if(!p)
+		return;
+
+	Poison(p, m_ObjectSize);
+	CFreeObject *pObject = (CFreeObject *)p;
+	pObject->m_pNext = m_pFree;
+	m_pFree = pObject;
+	m_NumUsed--;
+}
+
+void CEntityPool::Poison(void *p, unsigned Size)
+{
+#ifdef CONF_DEBUG
+	unsigned char *pBytes = (unsigned char *)p;
+	for(unsigned i = 0; i < Size; i++)
+		pBytes[i] = POISON;
+#endif
+}
+
+bool CEntityPool::IsPoisoned(const void *p, unsigned Size)
+{
+	const unsigned char *pBytes = (const unsigned char *)p;
+	for(unsigned i = 0; i < Size; i++)
+		if(pBytes[i] != POISON)
+			return false;
+	return true;
+}
+
 //////////////////////////////////////////////////
 // Entity
 //////////////////////////////////////////////////
@@ -20,6 +113,9 @@ CEntity::CEntity(CGameWorld *pGameWorld, int ObjType)
 
 	m_pPrevTypeEntity = 0;
 	m_pNextTypeEntity = 0;
+	m_pPrevGridEntity = 0;
+	m_pNextGridEntity = 0;
+	m_GridCell = -1;
 }
 
 CEntity::~CEntity()
@@ -11,7 +11,7 @@
 	public: \
 	void *operator new(size_t Size) \
 	{ \
-		void *p = mem_alloc(Size, 1); \
+		void *p = mem_alloc_tagged(Size, 1, MEMTAG_ENTITY); \
 		/*dbg_msg("", "++ %p %d", p, size);*/ \
 		mem_zero(p, Size); \
 		return p; \
@@ -23,6 +23,77 @@
 	} \
 	private:
 
+// hands out the objects of one entity type from slabs, allocating and freeing is taking the
+// first object of a free list or putting it back. slabs are kept once allocated, so a type
+// holds on to the memory of its peak. debug builds fill freed objects with a pattern and
+// complain when something wrote to them before they are used again
+class CEntityPool
+{
+	enum
+	{
+		OBJECTS_PER_SLAB=64,
+		ALIGNMENT=16,
+		POISON=0xdd,
+	};
+
+	struct CSlab
+	{
+		CSlab *m_pNext;
+	};
+
+	struct CFreeObject
+	{
+		CFreeObject *m_pNext;
+	};
+
+	const char *m_pName;
+	unsigned m_Size;
+	unsigned m_ObjectSize;
+	CSlab *m_pSlabs;
+	CFreeObject *m_pFree;
+
+	int m_NumSlabs;
+	int m_NumUsed;
+	int m_PeakUsed;
+	int m_NumAllocs;
+
+	CEntityPool *m_pNextPool;
+	static CEntityPool *ms_pFirstPool;
+
+	void NewSlab();
+
+public:
+	CEntityPool(const char *pName, unsigned Size);
+
+	void *Alloc(unsigned Size);
+	void Free(void *p);
+
+	const char *Name() const { return m_pName; }
+	int NumUsed() const { return m_NumUsed; }
+	int PeakUsed() const { return m_PeakUsed; }
+	int NumAllocs() const { return m_NumAllocs; }
+	int NumSlabs() const { return m_NumSlabs; }
+	int SlabBytes() const { return m_NumSlabs*(ALIGNMENT+OBJECTS_PER_SLAB*m_ObjectSize); }
+
+	// fills freed memory with a pattern in debug builds, does nothing otherwise
+	static void Poison(void *p, unsigned Size);
+	static bool IsPoisoned(const void *p, unsigned Size);
+
+	static CEntityPool *First() { return ms_pFirstPool; }
+	CEntityPool *Next() const { return m_pNextPool; }
+};
+
+#define MACRO_ALLOC_POOL() \
+	public: \
+	void *operator new(size_t Size); \
+	void operator delete(void *p); \
+	private:
+
+#define MACRO_ALLOC_POOL_IMPL(POOLTYPE) \
+	static CEntityPool ms_Pool##POOLTYPE(#POOLTYPE, sizeof(POOLTYPE)); \
+	void *POOLTYPE::operator new(size_t Size) { return ms_Pool##POOLTYPE.Alloc(Size); } \
+	void POOLTYPE::operator delete(void *p) { ms_Pool##POOLTYPE.Free(p); }
+
 #define MACRO_ALLOC_POOL_ID() \
 	public: \
 	void *operator new(size_t Size, int id); \
@@ -47,7 +118,7 @@
 		dbg_assert(ms_PoolUsed##POOLTYPE[id], "not used"); \
 		/*dbg_msg("pool", "-- %s %d", #POOLTYPE, id);*/ \
 		ms_PoolUsed##POOLTYPE[id] = 0; \
-		mem_zero(ms_PoolData##POOLTYPE[id], sizeof(POOLTYPE)); \
+		CEntityPool::Poison(ms_PoolData##POOLTYPE[id], sizeof(POOLTYPE)); \
 	}
 
 /*
@@ -62,6 +133,11 @@ class CEntity
 	CEntity *m_pPrevTypeEntity;
 	CEntity *m_pNextTypeEntity;
 
+	// the grid cell the entity is listed in, -1 if none
+	CEntity *m_pPrevGridEntity;
+	CEntity *m_pNextGridEntity;
+	int m_GridCell;
+
 	class CGameWorld *m_pGameWorld;
 protected:
 	bool m_MarkedForDestroy;
@@ -9,7 +9,28 @@
 CEventHandler::CEventHandler()
 {
 	m_pGameServer = 0;
+	m_pEvents = 0;
+	m_MaxEvents = 0;
+	m_pData = 0;
+	m_DataSize = 0;
+	m_pRegionFirst = 0;
+	m_pRegionLast = 0;
+	m_RegionsWidth = 0;
+	m_RegionsHeight = 0;
+	m_NumDropped = 0;
+	m_NumCulled = 0;
+	m_SnappedTick = -1;
 	Clear();
+	for(int i = 0; i < MAX_CLIENTS+1; i++)
+		m_aLastSnapTick[i] = -1;
+}
+
+CEventHandler::~CEventHandler()
+{
+	mem_free(m_pEvents);
+	mem_free(m_pData);
+	mem_free(m_pRegionFirst);
+	mem_free(m_pRegionLast);
 }
 
 void CEventHandler::SetGameServer(CGameContext *pGameServer)
@@ -17,18 +38,118 @@ void CEventHandler::SetGameServer(CGameContext *pGameServer)
 	m_pGameServer = pGameServer;
 }
 
+void CEventHandler::InitRegions(int Width, int Height)
+{
+	mem_free(m_pRegionFirst);
+	mem_free(m_pRegionLast);
+
+	m_RegionsWidth = max(Width*32/REGION_SIZE+1, 1);
+	m_RegionsHeight = max(Height*32/REGION_SIZE+1, 1);
+	int NumRegions = m_RegionsWidth*m_RegionsHeight;
+	m_pRegionFirst = (int *)mem_alloc_tagged(NumRegions*sizeof(int), sizeof(int), MEMTAG_ENTITY);
+	m_pRegionLast = (int *)mem_alloc_tagged(NumRegions*sizeof(int), sizeof(int), MEMTAG_ENTITY);
+	Relink();
+}
+
+void CEventHandler::RegionCoords(float X, float Y, int *pX, int *pY) const
+{
+	*pX = (int)clamp(X/REGION_SIZE, 0.0f, (float)(m_RegionsWidth-1));
+	*pY = (int)clamp(Y/REGION_SIZE, 0.0f, (float)(m_RegionsHeight-1));
+}
+
+void CEventHandler::Relink()
+{
+	m_NumSorted = 0;
+	if(!m_pRegionFirst)
+		return;
+
+	for(int i = 0; i < m_RegionsWidth*m_RegionsHeight; i++)
+	{
+		m_pRegionFirst[i] = -1;
+		m_pRegionLast[i] = -1;
+	}
+}
+
+void CEventHandler::SortNew()
+{
+	if(!m_pRegionFirst)
+		InitRegions(0, 0);
+
+	// the position is only known once the creator filled in the event
+	for(; m_NumSorted < m_NumEvents; m_NumSorted++)
+	{
+		CEvent *pEvent = &m_pEvents[m_NumSorted];
+		CNetEvent_Common *pData = (CNetEvent_Common *)&m_pData[pEvent->m_Offset];
+		int x, y;
+		RegionCoords((float)pData->m_X, (float)pData->m_Y, &x, &y);
+		pEvent->m_Region = y*m_RegionsWidth+x;
+		pEvent->m_NextInRegion = -1;
+
+		if(m_pRegionLast[pEvent->m_Region] >= 0)
+			m_pEvents[m_pRegionLast[pEvent->m_Region]].m_NextInRegion = m_NumSorted;
+		else
+			m_pRegionFirst[pEvent->m_Region] = m_NumSorted;
+		m_pRegionLast[pEvent->m_Region] = m_NumSorted;
+	}
+}
+
+bool CEventHandler::Grow(int NumEvents, int DataSize)
+{
+	if(NumEvents > MAX_EVENTS || DataSize > MAX_EVENTS*EVENT_DATASIZE)
+		return false;
+
+	int MaxEvents = max(m_MaxEvents, (int)MIN_EVENTS);
+	while(MaxEvents < NumEvents)
+		MaxEvents *= 2;
+	MaxEvents = min(MaxEvents, (int)MAX_EVENTS);
+	if(MaxEvents != m_MaxEvents)
+	{
+		CEvent *pEvents = (CEvent *)mem_alloc_tagged(MaxEvents*sizeof(CEvent), sizeof(int), MEMTAG_ENTITY);
+		if(m_NumEvents)
+			mem_copy(pEvents, m_pEvents, m_NumEvents*sizeof(CEvent));
+		mem_free(m_pEvents);
+		m_pEvents = pEvents;
+		m_MaxEvents = MaxEvents;
+	}
+
+	int NewDataSize = max(m_DataSize, MIN_EVENTS*EVENT_DATASIZE);
+	while(NewDataSize < DataSize)
+		NewDataSize *= 2;
+	NewDataSize = min(NewDataSize, MAX_EVENTS*EVENT_DATASIZE);
+	if(NewDataSize != m_DataSize)
+	{
+		char *pData = (char *)mem_alloc_tagged(NewDataSize, sizeof(int), MEMTAG_ENTITY);
+		if(m_CurrentOffset)
+			mem_copy(pData, m_pData, m_CurrentOffset);
+		mem_free(m_pData);
+		m_pData = pData;
+		m_DataSize = NewDataSize;
+	}
+	return true;
+}
+
 void *CEventHandler::Create(int Type, int Size, int Mask)
 {
-	if(m_NumEvents == MAX_EVENTS)
-		return 0;
-	if(m_CurrentOffset+Size >= MAX_DATASIZE)
-		return 0;
+	if(m_NumEvents == m_MaxEvents || m_CurrentOffset+Size > m_DataSize)
+	{
+		if(!Grow(m_NumEvents+1, m_CurrentOffset+Size))
+		{
+			m_NumDropped++;
+			return 0;
+		}
+	}
 
-	void *p = &m_aData[m_CurrentOffset];
-	m_aOffsets[m_NumEvents] = m_CurrentOffset;
-	m_aTypes[m_NumEvents] = Type;
-	m_aSizes[m_NumEvents] = Size;
-	m_aClientMasks[m_NumEvents] = Mask;
+	void *p = &m_pData[m_CurrentOffset];
+	CEvent *pEvent = &m_pEvents[m_NumEvents];
+	pEvent->m_Offset = m_CurrentOffset;
+	pEvent->m_Type = Type;
+	pEvent->m_Size = Size;
+	pEvent->m_ClientMask = Mask;
+	pEvent->m_Tick = GameServer()->Server()->Tick();
+	if(pEvent->m_Tick == m_SnappedTick)
+		pEvent->m_Tick++;
+	pEvent->m_Region = -1;
+	pEvent->m_NextInRegion = -1;
 	m_CurrentOffset += Size;
 	m_NumEvents++;
 	return p;
@@ -38,21 +159,100 @@ void CEventHandler::Clear()
 {
 	m_NumEvents = 0;
 	m_CurrentOffset = 0;
+	Relink();
 }
 
-void CEventHandler::Snap(int SnappingClient)
+void CEventHandler::Purge()
 {
+	// drop what every client and the demo recorder got already, and what is too old to matter
+	int Tick = GameServer()->Server()->Tick();
+	m_SnappedTick = Tick;
+
+	int PurgeTick = Tick;
+	if(m_aLastSnapTick[0] >= Tick-MAX_AGE)
+		PurgeTick = min(PurgeTick, m_aLastSnapTick[0]);
+	for(int i = 0; i < MAX_CLIENTS; i++)
+		if(GameServer()->Server()->ClientIngame(i))
+			PurgeTick = min(PurgeTick, m_aLastSnapTick[i+1]);
+	PurgeTick = max(PurgeTick, Tick-MAX_AGE);
+
+	// the events are in tick order, so the ones to drop are at the front
+	int First = 0;
+	while(First < m_NumEvents && m_pEvents[First].m_Tick <= PurgeTick)
+		First++;
+	if(!First)
+		return;
+
+	int Offset = First < m_NumEvents ? m_pEvents[First].m_Offset : m_CurrentOffset;
+	mem_move(m_pData, &m_pData[Offset], m_CurrentOffset-Offset);
+	mem_move(m_pEvents, &m_pEvents[First], (m_NumEvents-First)*sizeof(CEvent));
+	m_NumEvents -= First;
+	m_CurrentOffset -= Offset;
 	for(int i = 0; i < m_NumEvents; i++)
+		m_pEvents[i].m_Offset -= Offset;
+	Relink();
+}
+
+void CEventHandler::Snap(int SnappingClient)
+{
+	// only send what happend since this client's last snapshot
+	int Tick = GameServer()->Server()->Tick();
+	int LastSnapTick = m_aLastSnapTick[SnappingClient+1] <= Tick ? m_aLastSnapTick[SnappingClient+1] : -1;
+	m_aLastSnapTick[SnappingClient+1] = Tick;
+
+	int FirstNew = m_NumEvents;
+	while(FirstNew > 0 && m_pEvents[FirstNew-1].m_Tick > LastSnapTick)
+		FirstNew--;
+	if(FirstNew == m_NumEvents)
+		return;
+
+	if(SnappingClient == -1)
 	{
-		if(SnappingClient == -1 || CmaskIsSet(m_aClientMasks[i], SnappingClient))
+		for(int i = FirstNew; i < m_NumEvents; i++)
 		{
-			CNetEvent_Common *ev = (CNetEvent_Common *)&m_aData[m_aOffsets[i]];
-			if(SnappingClient == -1 || distance(GameServer()->m_apPlayers[SnappingClient]->m_ViewPos, vec2(ev->m_X, ev->m_Y)) < 1500.0f)
-			{
-				void *d = GameServer()->Server()->SnapNewItem(m_aTypes[i], i, m_aSizes[i]);
-				if(d)
-					mem_copy(d, &m_aData[m_aOffsets[i]], m_aSizes[i]);
-			}
+			void *d = GameServer()->Server()->SnapNewItem(m_pEvents[i].m_Type, i, m_pEvents[i].m_Size);
+			if(d)
+				mem_copy(d, &m_pData[m_pEvents[i].m_Offset], m_pEvents[i].m_Size);
 		}
+		return;
 	}
+
+	// only look at the regions around the view
+	SortNew();
+	vec2 ViewPos = GameServer()->m_apPlayers[SnappingClient]->m_ViewPos;
+	int x0, y0, x1, y1;
+	RegionCoords(ViewPos.x-VIEW_DISTANCE, ViewPos.y-VIEW_DISTANCE, &x0, &y0);
+	RegionCoords(ViewPos.x+VIEW_DISTANCE, ViewPos.y+VIEW_DISTANCE, &x1, &y1);
+
+	int NumVisited = 0;
+	for(int y = y0; y <= y1; y++)
+		for(int x = x0; x <= x1; x++)
+			for(int i = m_pRegionFirst[y*m_RegionsWidth+x]; i >= 0; i = m_pEvents[i].m_NextInRegion)
+			{
+				CEvent *pEvent = &m_pEvents[i];
+				if(pEvent->m_Tick <= LastSnapTick)
+					continue;
+
+				if(!CmaskIsSet(pEvent->m_ClientMask, SnappingClient))
+					continue;
+				NumVisited++;
+
+				CNetEvent_Common *ev = (CNetEvent_Common *)&m_pData[pEvent->m_Offset];
+				if(distance(ViewPos, vec2(ev->m_X, ev->m_Y)) < VIEW_DISTANCE)
+				{
+					void *d = GameServer()->Server()->SnapNewItem(pEvent->m_Type, i, pEvent->m_Size);
+					if(d)
+						mem_copy(d, ev, pEvent->m_Size);
+				}
+				else
+					m_NumCulled++;
+			}
+
+	// the new events for this client in the regions that were skipped, the ones
+	// that are not meant for it don't count as culled
+	int NumForClient = 0;
+	for(int i = FirstNew; i < m_NumEvents; i++)
+		if(CmaskIsSet(m_pEvents[i].m_ClientMask, SnappingClient))
+			NumForClient++;
+	m_NumCulled += NumForClient-NumVisited;
 }
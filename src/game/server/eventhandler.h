@@ -3,30 +3,111 @@
 #ifndef GAME_SERVER_EVENTHANDLER_H
 #define GAME_SERVER_EVENTHANDLER_H
 
+#include <engine/shared/protocol.h>
+
 //
 class CEventHandler
 {
-	static const int MAX_EVENTS = 128;
-	static const int MAX_DATASIZE = 128*64;
+	enum
+	{
+		MIN_EVENTS=512,
+		MAX_EVENTS=8192, // snapshot item ids are 16 bit, events use their index
+		EVENT_DATASIZE=64, // room reserved per event
+
+		VIEW_DISTANCE=1500, // clients only get events this close to their view
+		REGION_SIZE=1024, // world units, 32 tiles
+	};
+
+	// clients can be on a reduced snapshot rate, so events are kept until
+	// everyone had a snapshot since, but never longer than this many ticks
+	static const int MAX_AGE = 10;
+
+	struct CEvent
+	{
+		int m_Type;
+		int m_Offset;
+		int m_Size;
+		int m_ClientMask;
+		int m_Tick;
+		int m_Region;
+		int m_NextInRegion; // -1 for the last event of the region
+	};
 
-	int m_aTypes[MAX_EVENTS]; // TODO: remove some of these arrays
-	int m_aOffsets[MAX_EVENTS];
-	int m_aSizes[MAX_EVENTS];
-	int m_aClientMasks[MAX_EVENTS];
-	char m_aData[MAX_DATASIZE];
+	// both grow when a tick has more events than they fit, events are in tick order
+	CEvent *m_pEvents;
+	int m_MaxEvents;
+	char *m_pData;
+	int m_DataSize;
+
+	// the events of each region of the map in the order they were created,
+	// positions outside of the map count to the border regions
+	int *m_pRegionFirst;
+	int *m_pRegionLast;
+	int m_RegionsWidth;
+	int m_RegionsHeight;
+
+	int m_aLastSnapTick[MAX_CLIENTS+1]; // the demo recorder is at 0, clients follow
+
+	// events are stamped with the tick of the first snapshot they can be in, those
+	// created after the snapshots of a tick (e.g. by network messages) belong to the next one
+	int m_SnappedTick;
 
 	class CGameContext *m_pGameServer;
 
 	int m_CurrentOffset;
 	int m_NumEvents;
+	int m_NumSorted; // the events after these are not in their region yet
+
+	int64 m_NumDropped;
+	int64 m_NumCulled;
+
+	void RegionCoords(float X, float Y, int *pX, int *pY) const;
+	void Relink();
+	void SortNew();
+	bool Grow(int NumEvents, int DataSize);
 public:
 	CGameContext *GameServer() const { return m_pGameServer; }
 	void SetGameServer(CGameContext *pGameServer);
 
 	CEventHandler();
+	~CEventHandler();
+
+	/*
+		Function: InitRegions
+			Sizes the regions the events are sorted into.
+
+		Arguments:
+			Width - Width of the map in tiles.
+			Height - Height of the map in tiles.
+	*/
+	void InitRegions(int Width, int Height);
+
+	/*
+		Function: Create
+			Adds an event, its data has to start with CNetEvent_Common.
+
+		Returns:
+			Memory for the event data, only valid until the next call.
+			NULL if the event was dropped.
+	*/
 	void *Create(int Type, int Size, int Mask = -1);
 	void Clear();
+
+	/*
+		Function: Purge
+			Drops the events everyone got already, called once the
+			snapshots of the current tick are done.
+	*/
+	void Purge();
 	void Snap(int SnappingClient);
+
+	int NumEvents() const { return m_NumEvents; }
+	int MaxEvents() const { return m_MaxEvents; }
+	int DataSize() const { return m_DataSize; }
+
+	// events that did not fit and events kept from clients because they were too far away
+	int64 NumDropped() const { return m_NumDropped; }
+	int64 NumCulled() const { return m_NumCulled; }
 };
 
 #endif
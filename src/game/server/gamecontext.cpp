@@ -9,6 +9,8 @@
 #include <game/version.h>
 #include <game/collision.h>
 #include <game/gamecore.h>
+#include "entities/pickup.h"
+#include "entities/projectile.h"
 #include "gamemodes/dm.h"
 #include "gamemodes/tdm.h"
 #include "gamemodes/ctf.h"
@@ -86,7 +88,7 @@ class CCharacter *CGameContext::GetPlayerChar(int ClientID)
 	return m_apPlayers[ClientID]->GetCharacter();
 }
 
-void CGameContext::CreateDamageInd(vec2 Pos, float Angle, int Amount)
+void CGameContext::CreateDamageInd(vec2 Pos, float Angle, int Amount, int Mask)
 {
 	float a = 3 * 3.14159f / 2 + Angle;
 	//float a = get_angle(dir);
@@ -95,7 +97,7 @@ void CGameContext::CreateDamageInd(vec2 Pos, float Angle, int Amount)
 	for(int i = 0; i < Amount; i++)
 	{
 		float f = mix(s, e, float(i+1)/float(Amount+2));
-		CNetEvent_DamageInd *pEvent = (CNetEvent_DamageInd *)m_Events.Create(NETEVENTTYPE_DAMAGEIND, sizeof(CNetEvent_DamageInd));
+		CNetEvent_DamageInd *pEvent = (CNetEvent_DamageInd *)m_Events.Create(NETEVENTTYPE_DAMAGEIND, sizeof(CNetEvent_DamageInd), Mask);
 		if(pEvent)
 		{
 			pEvent->m_X = (int)Pos.x;
@@ -105,10 +107,10 @@ void CGameContext::CreateDamageInd(vec2 Pos, float Angle, int Amount)
 	}
 }
 
-void CGameContext::CreateHammerHit(vec2 Pos)
+void CGameContext::CreateHammerHit(vec2 Pos, int Mask)
 {
 	// create the event
-	CNetEvent_HammerHit *pEvent = (CNetEvent_HammerHit *)m_Events.Create(NETEVENTTYPE_HAMMERHIT, sizeof(CNetEvent_HammerHit));
+	CNetEvent_HammerHit *pEvent = (CNetEvent_HammerHit *)m_Events.Create(NETEVENTTYPE_HAMMERHIT, sizeof(CNetEvent_HammerHit), Mask);
 	if(pEvent)
 	{
 		pEvent->m_X = (int)Pos.x;
@@ -117,10 +119,10 @@ void CGameContext::CreateHammerHit(vec2 Pos)
 }
 
 
-void CGameContext::CreateExplosion(vec2 Pos, int Owner, int Weapon, bool NoDamage)
+void CGameContext::CreateExplosion(vec2 Pos, int Owner, int Weapon, bool NoDamage, int Mask)
 {
 	// create the event
-	CNetEvent_Explosion *pEvent = (CNetEvent_Explosion *)m_Events.Create(NETEVENTTYPE_EXPLOSION, sizeof(CNetEvent_Explosion));
+	CNetEvent_Explosion *pEvent = (CNetEvent_Explosion *)m_Events.Create(NETEVENTTYPE_EXPLOSION, sizeof(CNetEvent_Explosion), Mask);
 	if(pEvent)
 	{
 		pEvent->m_X = (int)Pos.x;
@@ -161,10 +163,10 @@ void create_smoke(vec2 Pos)
 	}
 }*/
 
-void CGameContext::CreatePlayerSpawn(vec2 Pos)
+void CGameContext::CreatePlayerSpawn(vec2 Pos, int Mask)
 {
 	// create the event
-	CNetEvent_Spawn *ev = (CNetEvent_Spawn *)m_Events.Create(NETEVENTTYPE_SPAWN, sizeof(CNetEvent_Spawn));
+	CNetEvent_Spawn *ev = (CNetEvent_Spawn *)m_Events.Create(NETEVENTTYPE_SPAWN, sizeof(CNetEvent_Spawn), Mask);
 	if(ev)
 	{
 		ev->m_X = (int)Pos.x;
@@ -172,10 +174,10 @@ void CGameContext::CreatePlayerSpawn(vec2 Pos)
 	}
 }
 
-void CGameContext::CreateDeath(vec2 Pos, int ClientID)
+void CGameContext::CreateDeath(vec2 Pos, int ClientID, int Mask)
 {
 	// create the event
-	CNetEvent_Death *pEvent = (CNetEvent_Death *)m_Events.Create(NETEVENTTYPE_DEATH, sizeof(CNetEvent_Death));
+	CNetEvent_Death *pEvent = (CNetEvent_Death *)m_Events.Create(NETEVENTTYPE_DEATH, sizeof(CNetEvent_Death), Mask);
 	if(pEvent)
 	{
 		pEvent->m_X = (int)Pos.x;
@@ -210,6 +212,32 @@ void CGameContext::CreateSoundGlobal(int Sound, int Target)
 }
 
 
+int CGameContext::SnapPolicy(int SnappingClient, int ClientID)
+{
+	// demos, the own team and everything outside hp-race are always sent in full
+	if(SnappingClient == -1 || ClientID < 0 || SnappingClient == ClientID || !m_pController->IsHPRace())
+		return SNAP_FULL;
+
+	CPlayer *pPartner = m_apPlayers[SnappingClient] ? m_apPlayers[SnappingClient]->GetPartner() : 0;
+	if(!pPartner || pPartner->GetCID() == ClientID)
+		return SNAP_FULL;
+
+	return g_Config.m_SvHPRaceSnapOthers;
+}
+
+int CGameContext::TeamMask(int ClientID)
+{
+	if(!m_pController->IsHPRace())
+		return CmaskAll();
+
+	// events of other teams are dropped only where their characters are hidden too
+	int Mask = 0;
+	for(int i = 0; i < MAX_CLIENTS; i++)
+		if(m_apPlayers[i] && SnapPolicy(i, ClientID) != SNAP_HIDDEN)
+			Mask |= CmaskOne(i);
+	return Mask;
+}
+
 void CGameContext::SendChatTarget(int To, const char *pText, int From, int Team)
 {
 	CNetMsg_Sv_Chat Msg;
@@ -244,15 +272,14 @@ void CGameContext::SendChat(int ChatterClientID, int Team, const char *pText)
 		Msg.m_ClientID = ChatterClientID;
 		Msg.m_pMessage = pText;
 
-		// pack one for the recording only
-		Server()->SendPackMsg(&Msg, MSGFLAG_VITAL|MSGFLAG_NOSEND, -1);
-
-		// send to the clients
+		// pack it once for the recording and all team members
+		int Mask = 0;
 		for(int i = 0; i < MAX_CLIENTS; i++)
 		{
 			if(m_apPlayers[i] && m_apPlayers[i]->GetTeam() == Team)
-				Server()->SendPackMsg(&Msg, MSGFLAG_VITAL|MSGFLAG_NORECORD, i);
+				Mask |= CmaskOne(i);
 		}
+		Server()->SendPackMsgMask(&Msg, MSGFLAG_VITAL, Mask);
 	}
 }
 
@@ -304,6 +331,31 @@ void CGameContext::StartVote(const char *pDesc, const char *pCommand, const char
 	str_copy(m_aVoteReason, pReason, sizeof(m_aVoteReason));
 	SendVoteSet(-1);
 	m_VoteUpdate = true;
+
+	// map votes are likely to pass, get the map ready in the background
+	const char *pMap = 0;
+	if(str_comp_num(pCommand, "sv_map ", 7) == 0)
+		pMap = pCommand+7;
+	else if(str_comp_num(pCommand, "change_map ", 11) == 0)
+		pMap = pCommand+11;
+	if(pMap)
+	{
+		char aMap[128];
+		str_copy(aMap, pMap, sizeof(aMap));
+		char *pName = str_skip_whitespaces(aMap);
+		bool Quoted = *pName == '"';
+		if(Quoted)
+			pName++;
+		for(char *pEnd = pName; *pEnd; pEnd++)
+		{
+			if(*pEnd == '"' || *pEnd == ';' || (!Quoted && str_isspace(*pEnd)))
+			{
+				*pEnd = 0;
+				break;
+			}
+		}
+		Server()->PreloadMap(pName);
+	}
 }
 
 
@@ -1244,6 +1296,62 @@ void CGameContext::ConTuneDump(IConsole::IResult *pResult, void *pUserData)
 	}
 }
 
+void CGameContext::ConEntityPools(IConsole::IResult *pResult, void *pUserData)
+{
+	CGameContext *pSelf = (CGameContext *)pUserData;
+	char aBuf[256];
+	for(CEntityPool *pPool = CEntityPool::First(); pPool; pPool = pPool->Next())
+	{
+		str_format(aBuf, sizeof(aBuf), "%s: %d in use, peak %d, %d allocated, %d slabs %dk", pPool->Name(), pPool->NumUsed(),
+			pPool->PeakUsed(), pPool->NumAllocs(), pPool->NumSlabs(), pPool->SlabBytes()/1024);
+		pSelf->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "pool", aBuf);
+	}
+}
+
+void CGameContext::ConEvents(IConsole::IResult *pResult, void *pUserData)
+{
+	CGameContext *pSelf = (CGameContext *)pUserData;
+	char aBuf[256];
+	str_format(aBuf, sizeof(aBuf), "%d buffered, room for %d events %dk data, %lld dropped, %lld culled", pSelf->m_Events.NumEvents(),
+		pSelf->m_Events.MaxEvents(), pSelf->m_Events.DataSize()/1024, (long long)pSelf->m_Events.NumDropped(), (long long)pSelf->m_Events.NumCulled());
+	pSelf->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "events", aBuf);
+}
+
+#ifdef CONF_DEBUG
+void CGameContext::ConGridCheck(IConsole::IResult *pResult, void *pUserData)
+{
+	CGameContext *pSelf = (CGameContext *)pUserData;
+	int NumSpawn = pResult->NumArguments() > 0 ? clamp(pResult->GetInteger(0), 0, 1000) : 0;
+	int NumQueries = pResult->NumArguments() > 1 ? clamp(pResult->GetInteger(1), 1, 20000) : 10000;
+
+	// scatter pickups and projectiles over the map for the queries to find, they are gone before the next tick
+	CEntity **ppSpawned = (CEntity **)mem_alloc(max(NumSpawn*2, 1)*sizeof(CEntity *), sizeof(void*));
+	vec2 MapSize = vec2(pSelf->m_Collision.GetWidth()*32.0f, pSelf->m_Collision.GetHeight()*32.0f);
+	for(int i = 0; i < NumSpawn; i++)
+	{
+		CPickup *pPickup = new CPickup(&pSelf->m_World, POWERUP_HEALTH);
+		pPickup->m_Pos = vec2(frandom()*MapSize.x, frandom()*MapSize.y);
+		ppSpawned[i*2] = pPickup;
+		vec2 Pos = vec2(frandom()*MapSize.x, frandom()*MapSize.y);
+		ppSpawned[i*2+1] = new CProjectile(&pSelf->m_World, WEAPON_GUN, -1, Pos, normalize(vec2(frandom()-0.5f, frandom()-0.5f)),
+			pSelf->Server()->TickSpeed(), 1, false, 0, -1, WEAPON_GUN);
+	}
+
+	int NumMismatches = pSelf->m_World.CheckGrid(NumQueries);
+
+	for(int i = 0; i < NumSpawn*2; i++)
+	{
+		pSelf->m_World.RemoveEntity(ppSpawned[i]);
+		ppSpawned[i]->Destroy();
+	}
+	mem_free(ppSpawned);
+
+	char aBuf[256];
+	str_format(aBuf, sizeof(aBuf), "%d queries per kind and type, %d mismatches", NumQueries, NumMismatches);
+	pSelf->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "grid", aBuf);
+}
+#endif
+
 void CGameContext::ConChangeMap(IConsole::IResult *pResult, void *pUserData)
 {
 	CGameContext *pSelf = (CGameContext *)pUserData;
@@ -1605,9 +1713,11 @@ void CGameContext::ConchainSpecialMotdupdate(IConsole::IResult *pResult, void *p
 		CNetMsg_Sv_Motd Msg;
 		Msg.m_pMessage = g_Config.m_SvMotd;
 		CGameContext *pSelf = (CGameContext *)pUserData;
+		int Mask = 0;
 		for(int i = 0; i < MAX_CLIENTS; ++i)
 			if(pSelf->m_apPlayers[i])
-				pSelf->Server()->SendPackMsg(&Msg, MSGFLAG_VITAL, i);
+				Mask |= CmaskOne(i);
+		pSelf->Server()->SendPackMsgMask(&Msg, MSGFLAG_VITAL, Mask);
 	}
 }
 
@@ -1619,6 +1729,11 @@ void CGameContext::OnConsoleInit()
 	Console()->Register("tune", "si", CFGFLAG_SERVER, ConTuneParam, this, "Tune variable to value");
 	Console()->Register("tune_reset", "", CFGFLAG_SERVER, ConTuneReset, this, "Reset tuning");
 	Console()->Register("tune_dump", "", CFGFLAG_SERVER, ConTuneDump, this, "Dump tuning");
+	Console()->Register("entity_pools", "", CFGFLAG_SERVER, ConEntityPools, this, "Show how many entities of each type are allocated");
+	Console()->Register("events", "", CFGFLAG_SERVER, ConEvents, this, "Show the event buffer usage and how many events were dropped or culled");
+#ifdef CONF_DEBUG
+	Console()->Register("grid_check", "?i?i", CFGFLAG_SERVER, ConGridCheck, this, "Spawn pickups and projectiles, then time the entity grid against the type lists and compare their results");
+#endif
 
 	Console()->Register("change_map", "?r", CFGFLAG_SERVER|CFGFLAG_STORE, ConChangeMap, this, "Change map");
 	Console()->Register("restart", "?i", CFGFLAG_SERVER|CFGFLAG_STORE, ConRestart, this, "Restart in x seconds");
@@ -1656,6 +1771,8 @@ void CGameContext::OnInit(/*class IKernel *pKernel*/)
 
 	m_Layers.Init(Kernel());
 	m_Collision.Init(&m_Layers);
+	m_World.InitGrid(m_Collision.GetWidth(), m_Collision.GetHeight());
+	m_Events.InitRegions(m_Collision.GetWidth(), m_Collision.GetHeight());
 
 	// reset everything here
 	//world = new GAMEWORLD;
@@ -1692,7 +1809,7 @@ void CGameContext::OnInit(/*class IKernel *pKernel*/)
 	num_spawn_points[2] = 0;
 	*/
 
-	for(int y = 0; y < pTileMap->m_Height; y++)
+	for(int y = 0; pTiles && y < pTileMap->m_Height; y++)
 	{
 		for(int x = 0; x < pTileMap->m_Width; x++)
 		{
@@ -1741,7 +1858,7 @@ void CGameContext::OnSnap(int ClientID)
 void CGameContext::OnPreSnap() {}
 void CGameContext::OnPostSnap()
 {
-	m_Events.Clear();
+	m_Events.Purge();
 }
 
 bool CGameContext::IsClientReady(int ClientID)
@@ -48,6 +48,11 @@ class CGameContext : public IGameServer
 	static void ConTuneParam(IConsole::IResult *pResult, void *pUserData);
 	static void ConTuneReset(IConsole::IResult *pResult, void *pUserData);
 	static void ConTuneDump(IConsole::IResult *pResult, void *pUserData);
+	static void ConEntityPools(IConsole::IResult *pResult, void *pUserData);
+	static void ConEvents(IConsole::IResult *pResult, void *pUserData);
+#ifdef CONF_DEBUG
+	static void ConGridCheck(IConsole::IResult *pResult, void *pUserData);
+#endif
 	static void ConChangeMap(IConsole::IResult *pResult, void *pUserData);
 	static void ConRestart(IConsole::IResult *pResult, void *pUserData);
 	static void ConBroadcast(IConsole::IResult *pResult, void *pUserData);
@@ -116,14 +121,24 @@ public:
 	CVoteOptionServer *m_pVoteOptionLast;
 
 	// helper functions
-	void CreateDamageInd(vec2 Pos, float AngleMod, int Amount);
-	void CreateExplosion(vec2 Pos, int Owner, int Weapon, bool NoDamage);
-	void CreateHammerHit(vec2 Pos);
-	void CreatePlayerSpawn(vec2 Pos);
-	void CreateDeath(vec2 Pos, int Who);
+	void CreateDamageInd(vec2 Pos, float AngleMod, int Amount, int Mask=-1);
+	void CreateExplosion(vec2 Pos, int Owner, int Weapon, bool NoDamage, int Mask=-1);
+	void CreateHammerHit(vec2 Pos, int Mask=-1);
+	void CreatePlayerSpawn(vec2 Pos, int Mask=-1);
+	void CreateDeath(vec2 Pos, int Who, int Mask=-1);
 	void CreateSound(vec2 Pos, int Sound, int Mask=-1);
 	void CreateSoundGlobal(int Sound, int Target=-1);
 
+	// hp-race interest management, how the objects of ClientID are snapped to SnappingClient
+	enum
+	{
+		SNAP_FULL=0,
+		SNAP_REDUCED_RATE,
+		SNAP_REDUCED_PRECISION,
+		SNAP_HIDDEN,
+	};
+	int SnapPolicy(int SnappingClient, int ClientID);
+	int TeamMask(int ClientID);
 
 	enum
 	{
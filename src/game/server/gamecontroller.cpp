@@ -224,11 +224,17 @@ void IGameController::StartRound()
 	char aBuf[256];
 	str_format(aBuf, sizeof(aBuf), "start round type='%s' teamplay='%d'", m_pGameType, m_GameFlags&GAMEFLAG_TEAMS);
 	GameServer()->Console()->Print(IConsole::OUTPUT_LEVEL_DEBUG, "game", aBuf);
+
+	// get the next map of the rotation ready in the background, but only once the end
+	// of this round is going to rotate. a map wish was already preloaded by ChangeMap
+	if(!m_aMapWish[0] && m_RoundCount >= g_Config.m_SvRoundsPerMap-1 && GetNextMap(aBuf, sizeof(aBuf)))
+		Server()->PreloadMap(aBuf);
 }
 
 void IGameController::ChangeMap(const char *pToMap)
 {
 	str_copy(m_aMapWish, pToMap, sizeof(m_aMapWish));
+	Server()->PreloadMap(m_aMapWish);
 	EndRound();
 }
 
@@ -251,6 +257,23 @@ void IGameController::CycleMap()
 		return;
 
 	// handle maprotation
+	char aBuf[512];
+	if(!GetNextMap(aBuf, sizeof(aBuf)))
+		return;
+
+	m_RoundCount = 0;
+
+	char aBufMsg[256];
+	str_format(aBufMsg, sizeof(aBufMsg), "rotating map to %s", aBuf);
+	GameServer()->Console()->Print(IConsole::OUTPUT_LEVEL_DEBUG, "game", aBufMsg);
+	str_copy(g_Config.m_SvMap, aBuf, sizeof(g_Config.m_SvMap));
+}
+
+bool IGameController::GetNextMap(char *pNextMapName, int BufferSize)
+{
+	if(!str_length(g_Config.m_SvMaprotation))
+		return false;
+
 	const char *pMapRotation = g_Config.m_SvMaprotation;
 	const char *pCurrentMap = g_Config.m_SvMap;
 
@@ -296,12 +319,8 @@ void IGameController::CycleMap()
 	while(IsSeparator(aBuf[i]))
 		i++;
 
-	m_RoundCount = 0;
-
-	char aBufMsg[256];
-	str_format(aBufMsg, sizeof(aBufMsg), "rotating map to %s", &aBuf[i]);
-	GameServer()->Console()->Print(IConsole::OUTPUT_LEVEL_DEBUG, "game", aBuf);
-	str_copy(g_Config.m_SvMap, &aBuf[i], sizeof(g_Config.m_SvMap));
+	str_copy(pNextMapName, &aBuf[i], BufferSize);
+	return pNextMapName[0] != 0;
 }
 
 void IGameController::PostReset()
@@ -424,8 +443,8 @@ void IGameController::Tick()
 		if(Server()->Tick() > m_GameOverTick+Server()->TickSpeed()*10)
 		{
 			CycleMap();
-			StartRound();
 			m_RoundCount++;
+			StartRound();
 		}
 	}
 
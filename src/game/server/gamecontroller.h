@@ -42,6 +42,7 @@ protected:
 	bool EvaluateSpawn(class CPlayer *pP, vec2 *pPos);
 
 	void CycleMap();
+	bool GetNextMap(char *pNextMapName, int BufferSize);
 	void ResetGame();
 
 	char m_aMapWish[128];
@@ -15,8 +15,16 @@ CGameWorld::CGameWorld()
 
 	m_Paused = false;
 	m_ResetRequested = false;
+	m_pNextTraverseEntity = 0;
 	for(int i = 0; i < NUM_ENTTYPES; i++)
+	{
 		m_apFirstEntityTypes[i] = 0;
+		m_aMaxProximityRadius[i] = 0.0f;
+	}
+
+	m_ppGrid = 0;
+	m_GridWidth = 0;
+	m_GridHeight = 0;
 }
 
 CGameWorld::~CGameWorld()
@@ -25,6 +33,7 @@ CGameWorld::~CGameWorld()
 	for(int i = 0; i < NUM_ENTTYPES; i++)
 		while(m_apFirstEntityTypes[i])
 			delete m_apFirstEntityTypes[i];
+	mem_free(m_ppGrid);
 }
 
 void CGameWorld::SetGameServer(CGameContext *pGameServer)
@@ -38,13 +47,124 @@ CEntity *CGameWorld::FindFirst(int Type)
 	return Type < 0 || Type >= NUM_ENTTYPES ? 0 : m_apFirstEntityTypes[Type];
 }
 
+void CGameWorld::InitGrid(int Width, int Height)
+{
+	// take the entities out of the old grid
+	for(int i = 0; i < NUM_ENTTYPES; i++)
+		for(CEntity *pEnt = m_apFirstEntityTypes[i]; pEnt; pEnt = pEnt->m_pNextTypeEntity)
+		{
+			pEnt->m_pPrevGridEntity = 0;
+			pEnt->m_pNextGridEntity = 0;
+			pEnt->m_GridCell = -1;
+		}
+	mem_free(m_ppGrid);
+
+	m_GridWidth = max(Width*32/GRID_CELL_SIZE+1, 1);
+	m_GridHeight = max(Height*32/GRID_CELL_SIZE+1, 1);
+	int Size = NUM_ENTTYPES*m_GridWidth*m_GridHeight*sizeof(CEntity *);
+	m_ppGrid = (CEntity **)mem_alloc_tagged(Size, sizeof(void*), MEMTAG_ENTITY);
+	mem_zero(m_ppGrid, Size);
+
+	for(int i = 0; i < NUM_ENTTYPES; i++)
+		for(CEntity *pEnt = m_apFirstEntityTypes[i]; pEnt; pEnt = pEnt->m_pNextTypeEntity)
+			GridInsert(pEnt);
+}
+
+int CGameWorld::GridCell(vec2 Pos) const
+{
+	int x = (int)clamp(Pos.x/GRID_CELL_SIZE, 0.0f, (float)(m_GridWidth-1));
+	int y = (int)clamp(Pos.y/GRID_CELL_SIZE, 0.0f, (float)(m_GridHeight-1));
+	return y*m_GridWidth+x;
+}
+
+void CGameWorld::GridCellRange(vec2 Min, vec2 Max, int *pX0, int *pY0, int *pX1, int *pY1) const
+{
+	*pX0 = (int)clamp(Min.x/GRID_CELL_SIZE, 0.0f, (float)(m_GridWidth-1));
+	*pY0 = (int)clamp(Min.y/GRID_CELL_SIZE, 0.0f, (float)(m_GridHeight-1));
+	*pX1 = (int)clamp(Max.x/GRID_CELL_SIZE, 0.0f, (float)(m_GridWidth-1));
+	*pY1 = (int)clamp(Max.y/GRID_CELL_SIZE, 0.0f, (float)(m_GridHeight-1));
+}
+
+void CGameWorld::GridInsert(CEntity *pEnt)
+{
+	int Cell = GridCell(pEnt->m_Pos);
+	CEntity **ppFirst = &m_ppGrid[pEnt->m_ObjType*m_GridWidth*m_GridHeight+Cell];
+	if(*ppFirst)
+		(*ppFirst)->m_pPrevGridEntity = pEnt;
+	pEnt->m_pNextGridEntity = *ppFirst;
+	pEnt->m_pPrevGridEntity = 0;
+	pEnt->m_GridCell = Cell;
+	*ppFirst = pEnt;
+
+	if(pEnt->m_ProximityRadius > m_aMaxProximityRadius[pEnt->m_ObjType])
+		m_aMaxProximityRadius[pEnt->m_ObjType] = pEnt->m_ProximityRadius;
+}
+
+void CGameWorld::GridRemove(CEntity *pEnt)
+{
+	if(pEnt->m_GridCell < 0)
+		return;
+
+	if(pEnt->m_pPrevGridEntity)
+		pEnt->m_pPrevGridEntity->m_pNextGridEntity = pEnt->m_pNextGridEntity;
+	else
+		m_ppGrid[pEnt->m_ObjType*m_GridWidth*m_GridHeight+pEnt->m_GridCell] = pEnt->m_pNextGridEntity;
+	if(pEnt->m_pNextGridEntity)
+		pEnt->m_pNextGridEntity->m_pPrevGridEntity = pEnt->m_pPrevGridEntity;
+
+	pEnt->m_pPrevGridEntity = 0;
+	pEnt->m_pNextGridEntity = 0;
+	pEnt->m_GridCell = -1;
+}
+
+void CGameWorld::UpdateGrid()
+{
+	// entities change their positions themselves, so move the ones that left their cell
+	for(int i = 0; i < NUM_ENTTYPES; i++)
+		for(CEntity *pEnt = m_apFirstEntityTypes[i]; pEnt; pEnt = pEnt->m_pNextTypeEntity)
+		{
+			if(GridCell(pEnt->m_Pos) != pEnt->m_GridCell || pEnt->m_ProximityRadius > m_aMaxProximityRadius[i])
+			{
+				GridRemove(pEnt);
+				GridInsert(pEnt);
+			}
+		}
+}
+
 int CGameWorld::FindEntities(vec2 Pos, float Radius, CEntity **ppEnts, int Max, int Type)
 {
-	if(Type < 0 || Type >= NUM_ENTTYPES)
+	if(Type < 0 || Type >= NUM_ENTTYPES || !m_ppGrid)
 		return 0;
 
+	float Reach = Radius+m_aMaxProximityRadius[Type];
+	int x0, y0, x1, y1;
+	GridCellRange(Pos-vec2(Reach, Reach), Pos+vec2(Reach, Reach), &x0, &y0, &x1, &y1);
+	CEntity **ppCells = &m_ppGrid[Type*m_GridWidth*m_GridHeight];
+
 	int Num = 0;
-	for(CEntity *pEnt = m_apFirstEntityTypes[Type];	pEnt; pEnt = pEnt->m_pNextTypeEntity)
+	for(int y = y0; y <= y1; y++)
+		for(int x = x0; x <= x1; x++)
+			for(CEntity *pEnt = ppCells[y*m_GridWidth+x]; pEnt; pEnt = pEnt->m_pNextGridEntity)
+			{
+				if(distance(pEnt->m_Pos, Pos) < Radius+pEnt->m_ProximityRadius)
+				{
+					if(ppEnts)
+						ppEnts[Num] = pEnt;
+					Num++;
+					if(Num == Max)
+						return Num;
+				}
+			}
+
+	return Num;
+}
+
+#ifdef CONF_DEBUG
+// the walks over the type lists the grid replaced, CheckGrid compares against them
+static int FindEntitiesListed(CGameWorld *pWorld, vec2 Pos, float Radius, CEntity **ppEnts, int Max, int Type)
+{
+	int Num = 0;
+	for(CEntity *pEnt = pWorld->FindFirst(Type); pEnt; pEnt = pEnt->TypeNext())
 	{
 		if(distance(pEnt->m_Pos, Pos) < Radius+pEnt->m_ProximityRadius)
 		{
@@ -55,10 +175,157 @@ int CGameWorld::FindEntities(vec2 Pos, float Radius, CEntity **ppEnts, int Max,
 				break;
 		}
 	}
-
 	return Num;
 }
 
+static CEntity *IntersectEntityListed(CGameWorld *pWorld, vec2 Pos0, vec2 Pos1, float Radius, vec2 &NewPos, int Type)
+{
+	float ClosestLen = distance(Pos0, Pos1) * 100.0f;
+	CEntity *pClosest = 0;
+	for(CEntity *p = pWorld->FindFirst(Type); p; p = p->TypeNext())
+	{
+		vec2 IntersectPos = closest_point_on_line(Pos0, Pos1, p->m_Pos);
+		float Len = distance(p->m_Pos, IntersectPos);
+		if(Len < p->m_ProximityRadius+Radius)
+		{
+			Len = distance(Pos0, IntersectPos);
+			if(Len < ClosestLen)
+			{
+				NewPos = IntersectPos;
+				ClosestLen = Len;
+				pClosest = p;
+			}
+		}
+	}
+	return pClosest;
+}
+
+static CEntity *ClosestEntityListed(CGameWorld *pWorld, vec2 Pos, float Radius, int Type)
+{
+	float ClosestRange = Radius*2;
+	CEntity *pClosest = 0;
+	for(CEntity *p = pWorld->FindFirst(Type); p; p = p->TypeNext())
+	{
+		float Len = distance(Pos, p->m_Pos);
+		if(Len < p->m_ProximityRadius+Radius && Len < ClosestRange)
+		{
+			ClosestRange = Len;
+			pClosest = p;
+		}
+	}
+	return pClosest;
+}
+
+// the same entities in any order give the same signature
+static unsigned FoundSignature(CEntity **ppEnts, int Num)
+{
+	unsigned Signature = Num;
+	for(int i = 0; i < Num; i++)
+	{
+		unsigned h = (unsigned)(size_t)ppEnts[i];
+		h ^= h>>15;
+		h *= 0x2c1b3c6d;
+		Signature += h^(h>>12);
+	}
+	return Signature;
+}
+
+int CGameWorld::CheckGrid(int NumQueries)
+{
+	enum
+	{
+		MAX_FOUND=1024,
+		MAX_QUERY_RADIUS=400,
+		MAX_QUERY_LENGTH=800,
+	};
+	static const char *s_apTypeNames[NUM_ENTTYPES] = {"projectiles", "lasers", "pickups", "flags", "characters"};
+
+	// catch up with positions that were set since the last tick
+	if(!m_ppGrid)
+		InitGrid(0, 0);
+	UpdateGrid();
+
+	vec2 *pPos0 = (vec2 *)mem_alloc(NumQueries*sizeof(vec2), sizeof(float));
+	vec2 *pPos1 = (vec2 *)mem_alloc(NumQueries*sizeof(vec2), sizeof(float));
+	float *pRadius = (float *)mem_alloc(NumQueries*sizeof(float), sizeof(float));
+	unsigned *pSignatures = (unsigned *)mem_alloc(NumQueries*sizeof(unsigned), sizeof(unsigned));
+	CEntity **ppHits = (CEntity **)mem_alloc(NumQueries*sizeof(CEntity *), sizeof(void*));
+	vec2 *pHitPos = (vec2 *)mem_alloc(NumQueries*sizeof(vec2), sizeof(float));
+	CEntity *apFound[MAX_FOUND];
+
+	float Width = (float)m_GridWidth*GRID_CELL_SIZE;
+	float Height = (float)m_GridHeight*GRID_CELL_SIZE;
+	float ToNs = 1000000000.0f/time_freq()/max(NumQueries, 1);
+	int NumMismatches = 0;
+	for(int Type = 0; Type < NUM_ENTTYPES; Type++)
+	{
+		int NumEntities = 0;
+		for(CEntity *pEnt = m_apFirstEntityTypes[Type]; pEnt; pEnt = pEnt->m_pNextTypeEntity)
+			NumEntities++;
+
+		for(int i = 0; i < NumQueries; i++)
+		{
+			pPos0[i] = vec2(frandom()*Width, frandom()*Height);
+			pPos1[i] = pPos0[i]+vec2(frandom()-0.5f, frandom()-0.5f)*(float)MAX_QUERY_LENGTH;
+			pRadius[i] = frandom()*MAX_QUERY_RADIUS;
+		}
+		int Mismatches = 0;
+
+		// find, the grid pass keeps what it found and the list pass compares
+		int64 Start = time_get();
+		for(int i = 0; i < NumQueries; i++)
+			pSignatures[i] = FoundSignature(apFound, FindEntities(pPos0[i], pRadius[i], apFound, MAX_FOUND, Type));
+		int64 GridFind = time_get()-Start;
+		Start = time_get();
+		for(int i = 0; i < NumQueries; i++)
+			if(FoundSignature(apFound, FindEntitiesListed(this, pPos0[i], pRadius[i], apFound, MAX_FOUND, Type)) != pSignatures[i])
+				Mismatches++;
+		int64 ListFind = time_get()-Start;
+
+		// intersect, entities that touch the line at the same point tie and the walk order picks one, so only the point counts
+		Start = time_get();
+		for(int i = 0; i < NumQueries; i++)
+			ppHits[i] = IntersectEntity(pPos0[i], pPos1[i], pRadius[i], pHitPos[i], Type);
+		int64 GridIntersect = time_get()-Start;
+		Start = time_get();
+		for(int i = 0; i < NumQueries; i++)
+		{
+			vec2 HitPos;
+			CEntity *pHit = IntersectEntityListed(this, pPos0[i], pPos1[i], pRadius[i], HitPos, Type);
+			if(!pHit != !ppHits[i] || (pHit && (HitPos.x != pHitPos[i].x || HitPos.y != pHitPos[i].y)))
+				Mismatches++;
+		}
+		int64 ListIntersect = time_get()-Start;
+
+		// closest, only the characters have that query, ties again only compare the distance
+		if(Type == ENTTYPE_CHARACTER)
+		{
+			for(int i = 0; i < NumQueries; i++)
+			{
+				CEntity *pGrid = ClosestCharacter(pPos0[i], pRadius[i], 0);
+				CEntity *pListed = ClosestEntityListed(this, pPos0[i], pRadius[i], Type);
+				if(!pGrid != !pListed || (pGrid && distance(pPos0[i], pGrid->m_Pos) != distance(pPos0[i], pListed->m_Pos)))
+					Mismatches++;
+			}
+		}
+
+		char aBuf[256];
+		str_format(aBuf, sizeof(aBuf), "%s: %d, find %.0f/%.0fns, intersect %.0f/%.0fns (grid/list), %d mismatches",
+			s_apTypeNames[Type], NumEntities, GridFind*ToNs, ListFind*ToNs, GridIntersect*ToNs, ListIntersect*ToNs, Mismatches);
+		GameServer()->Console()->Print(IConsole::OUTPUT_LEVEL_STANDARD, "grid", aBuf);
+		NumMismatches += Mismatches;
+	}
+
+	mem_free(pPos0);
+	mem_free(pPos1);
+	mem_free(pRadius);
+	mem_free(pSignatures);
+	mem_free(ppHits);
+	mem_free(pHitPos);
+	return NumMismatches;
+}
+#endif
+
 void CGameWorld::InsertEntity(CEntity *pEnt)
 {
 #ifdef CONF_DEBUG
@@ -72,6 +339,10 @@ void CGameWorld::InsertEntity(CEntity *pEnt)
 	pEnt->m_pNextTypeEntity = m_apFirstEntityTypes[pEnt->m_ObjType];
 	pEnt->m_pPrevTypeEntity = 0x0;
 	m_apFirstEntityTypes[pEnt->m_ObjType] = pEnt;
+
+	if(!m_ppGrid)
+		InitGrid(0, 0);
+	GridInsert(pEnt);
 }
 
 void CGameWorld::DestroyEntity(CEntity *pEnt)
@@ -99,6 +370,8 @@ void CGameWorld::RemoveEntity(CEntity *pEnt)
 
 	pEnt->m_pNextTypeEntity = 0;
 	pEnt->m_pPrevTypeEntity = 0;
+
+	GridRemove(pEnt);
 }
 
 //
@@ -152,6 +425,9 @@ void CGameWorld::Tick()
 	if(m_ResetRequested)
 		Reset();
 
+	// catch up with what moved since the last tick, like carried flags and new pickups
+	UpdateGrid();
+
 	if(!m_Paused)
 	{
 		if(GameServer()->m_pController->IsForceBalanced())
@@ -165,6 +441,9 @@ void CGameWorld::Tick()
 				pEnt = m_pNextTraverseEntity;
 			}
 
+		// the characters move in TickDefered
+		UpdateGrid();
+
 		for(int i = 0; i < NUM_ENTTYPES; i++)
 			for(CEntity *pEnt = m_apFirstEntityTypes[i]; pEnt; )
 			{
@@ -175,62 +454,87 @@ void CGameWorld::Tick()
 	}
 
 	RemoveEntities();
+	UpdateGrid();
 }
 
 
-// TODO: should be more general
-CCharacter *CGameWorld::IntersectCharacter(vec2 Pos0, vec2 Pos1, float Radius, vec2& NewPos, CEntity *pNotThis)
+CEntity *CGameWorld::IntersectEntity(vec2 Pos0, vec2 Pos1, float Radius, vec2& NewPos, int Type, CEntity *pNotThis)
 {
-	// Find other players
-	float ClosestLen = distance(Pos0, Pos1) * 100.0f;
-	CCharacter *pClosest = 0;
-
-	CCharacter *p = (CCharacter *)FindFirst(ENTTYPE_CHARACTER);
-	for(; p; p = (CCharacter *)p->TypeNext())
- 	{
-		if(p == pNotThis)
-			continue;
+	if(Type < 0 || Type >= NUM_ENTTYPES || !m_ppGrid)
+		return 0;
 
-		vec2 IntersectPos = closest_point_on_line(Pos0, Pos1, p->m_Pos);
-		float Len = distance(p->m_Pos, IntersectPos);
-		if(Len < p->m_ProximityRadius+Radius)
-		{
-			Len = distance(Pos0, IntersectPos);
-			if(Len < ClosestLen)
+	float ClosestLen = distance(Pos0, Pos1) * 100.0f;
+	CEntity *pClosest = 0;
+
+	// only the cells around the line can hold entities touching it
+	float Reach = Radius+m_aMaxProximityRadius[Type];
+	vec2 Min(min(Pos0.x, Pos1.x)-Reach, min(Pos0.y, Pos1.y)-Reach);
+	vec2 Max(max(Pos0.x, Pos1.x)+Reach, max(Pos0.y, Pos1.y)+Reach);
+	int x0, y0, x1, y1;
+	GridCellRange(Min, Max, &x0, &y0, &x1, &y1);
+	CEntity **ppCells = &m_ppGrid[Type*m_GridWidth*m_GridHeight];
+
+	for(int y = y0; y <= y1; y++)
+		for(int x = x0; x <= x1; x++)
+			for(CEntity *p = ppCells[y*m_GridWidth+x]; p; p = p->m_pNextGridEntity)
 			{
-				NewPos = IntersectPos;
-				ClosestLen = Len;
-				pClosest = p;
+				if(p == pNotThis)
+					continue;
+
+				vec2 IntersectPos = closest_point_on_line(Pos0, Pos1, p->m_Pos);
+				float Len = distance(p->m_Pos, IntersectPos);
+				if(Len < p->m_ProximityRadius+Radius)
+				{
+					Len = distance(Pos0, IntersectPos);
+					if(Len < ClosestLen)
+					{
+						NewPos = IntersectPos;
+						ClosestLen = Len;
+						pClosest = p;
+					}
+				}
 			}
-		}
-	}
 
 	return pClosest;
 }
 
+CCharacter *CGameWorld::IntersectCharacter(vec2 Pos0, vec2 Pos1, float Radius, vec2& NewPos, CEntity *pNotThis)
+{
+	return (CCharacter *)IntersectEntity(Pos0, Pos1, Radius, NewPos, ENTTYPE_CHARACTER, pNotThis);
+}
+
 
 CCharacter *CGameWorld::ClosestCharacter(vec2 Pos, float Radius, CEntity *pNotThis)
 {
+	if(!m_ppGrid)
+		return 0;
+
 	// Find other players
 	float ClosestRange = Radius*2;
 	CCharacter *pClosest = 0;
 
-	CCharacter *p = (CCharacter *)GameServer()->m_World.FindFirst(ENTTYPE_CHARACTER);
-	for(; p; p = (CCharacter *)p->TypeNext())
- 	{
-		if(p == pNotThis)
-			continue;
+	float Reach = Radius+m_aMaxProximityRadius[ENTTYPE_CHARACTER];
+	int x0, y0, x1, y1;
+	GridCellRange(Pos-vec2(Reach, Reach), Pos+vec2(Reach, Reach), &x0, &y0, &x1, &y1);
+	CEntity **ppCells = &m_ppGrid[ENTTYPE_CHARACTER*m_GridWidth*m_GridHeight];
 
-		float Len = distance(Pos, p->m_Pos);
-		if(Len < p->m_ProximityRadius+Radius)
-		{
-			if(Len < ClosestRange)
+	for(int y = y0; y <= y1; y++)
+		for(int x = x0; x <= x1; x++)
+			for(CEntity *p = ppCells[y*m_GridWidth+x]; p; p = p->m_pNextGridEntity)
 			{
-				ClosestRange = Len;
-				pClosest = p;
+				if(p == pNotThis)
+					continue;
+
+				float Len = distance(Pos, p->m_Pos);
+				if(Len < p->m_ProximityRadius+Radius)
+				{
+					if(Len < ClosestRange)
+					{
+						ClosestRange = Len;
+						pClosest = (CCharacter *)p;
+					}
+				}
 			}
-		}
-	}
 
 	return pClosest;
 }
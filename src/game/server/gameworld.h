@@ -27,12 +27,30 @@ public:
 	};
 
 private:
+	enum
+	{
+		GRID_CELL_SIZE=256, // world units, 8 tiles
+	};
+
 	void Reset();
 	void RemoveEntities();
 
 	CEntity *m_pNextTraverseEntity;
 	CEntity *m_apFirstEntityTypes[NUM_ENTTYPES];
 
+	// entities are also listed in the cell of the grid their position is in, one grid per
+	// type. positions outside of the map count to the border cells
+	CEntity **m_ppGrid;
+	int m_GridWidth;
+	int m_GridHeight;
+	float m_aMaxProximityRadius[NUM_ENTTYPES]; // how far an entity reaches out of its cell
+
+	int GridCell(vec2 Pos) const;
+	void GridCellRange(vec2 Min, vec2 Max, int *pX0, int *pY0, int *pX1, int *pY1) const;
+	void GridInsert(CEntity *pEnt);
+	void GridRemove(CEntity *pEnt);
+	void UpdateGrid();
+
 	class CGameContext *m_pGameServer;
 	class IServer *m_pServer;
 
@@ -49,6 +67,31 @@ public:
 
 	void SetGameServer(CGameContext *pGameServer);
 
+	/*
+		Function: InitGrid
+			Sizes the grid that speeds up finding entities by position.
+
+		Arguments:
+			Width - Width of the map in tiles.
+			Height - Height of the map in tiles.
+	*/
+	void InitGrid(int Width, int Height);
+
+#ifdef CONF_DEBUG
+	/*
+		Function: CheckGrid
+			Runs random queries through the grid and through the type
+			lists, prints how long both took and where they disagree.
+
+		Arguments:
+			NumQueries - Number of queries of each kind and type.
+
+		Returns:
+			Number of queries with different results.
+	*/
+	int CheckGrid(int NumQueries);
+#endif
+
 	CEntity *FindFirst(int Type);
 
 	/*
@@ -84,6 +127,24 @@ public:
 	*/
 	class CCharacter *IntersectCharacter(vec2 Pos0, vec2 Pos1, float Radius, vec2 &NewPos, class CEntity *pNotThis = 0);
 
+	/*
+		Function: IntersectEntity
+			Finds the entity of a type that intersects the line closest
+			to its start.
+
+		Arguments:
+			Pos0 - Start position
+			Pos1 - End position
+			Radius - How far from the line the entity is allowed to be.
+			NewPos - Intersection position
+			Type - Type of the entities to check.
+			pNotThis - Entity to ignore intersecting with
+
+		Returns:
+			Returns a pointer to the closest hit or NULL of there is no intersection.
+	*/
+	CEntity *IntersectEntity(vec2 Pos0, vec2 Pos1, float Radius, vec2 &NewPos, int Type, CEntity *pNotThis = 0);
+
 	/*
 		Function: closest_CCharacter
 			Finds the closest CCharacter to a specific point.
@@ -256,6 +256,7 @@ void CPlayer::SetTeam(int Team)
 
 	m_Team = Team;
 	m_LastActionTick = Server()->Tick();
+	Server()->ExpireServerInfo();
 	// we got to wait 0.5 secs before respawning
 	m_RespawnTick = Server()->Tick()+Server()->TickSpeed()/2;
 	str_format(aBuf, sizeof(aBuf), "team_join player='%d:%s' m_Team=%d", m_ClientID, Server()->ClientName(m_ClientID), m_Team);
@@ -292,9 +293,9 @@ void CPlayer::TryRespawn()
 	}
 
 	m_Spawning = false;
-	m_pCharacter = new(m_ClientID) CCharacter(&GameServer()->m_World);
+	m_pCharacter = new CCharacter(&GameServer()->m_World);
 	m_pCharacter->Spawn(this, SpawnPos);
-	GameServer()->CreatePlayerSpawn(SpawnPos);
+	GameServer()->CreatePlayerSpawn(SpawnPos, GameServer()->TeamMask(m_ClientID));
 }
 
 CPlayer *CPlayer::GetPartner()
@@ -104,5 +104,7 @@ MACRO_CONFIG_INT(SvJumperAdd, sv_jumper_add, 0, -100, 100, CFGFLAG_SERVER, "Jump
 MACRO_CONFIG_INT(SvScoreIP, sv_score_ip, 1, 0, 1, CFGFLAG_SERVER, "")
 MACRO_CONFIG_INT(SvCheckpointSave, sv_checkpoint_save, 0, 0, 1, CFGFLAG_SERVER, "")
 MACRO_CONFIG_INT(SvHammerPower, sv_hammer_power, 1, 1, 500, CFGFLAG_SERVER, "Hammer's power")
+MACRO_CONFIG_INT(SvHPRaceSnapOthers, sv_hprace_snap_others, 3, 0, 3, CFGFLAG_SERVER, "How other hp-race teams are sent to a player with a partner (0=full, 1=reduced rate, 2=reduced precision, 3=hidden)")
+MACRO_CONFIG_INT(SvHPRaceSnapInterval, sv_hprace_snap_interval, 10, 2, 50, CFGFLAG_SERVER, "Ticks between updates of other hp-race teams with reduced rate")
 
 #endif
@@ -1,5 +1,6 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
 #include <base/system.h>
 #include <engine/shared/network.h>
 #include <engine/shared/config.h>
@@ -12,10 +13,119 @@
 enum {
 	MTU = 1400,
 	MAX_SERVERS_PER_PACKET=75,
-	MAX_PACKETS=16,
+	MAX_PACKETS=256,
 	MAX_SERVERS=MAX_SERVERS_PER_PACKET*MAX_PACKETS,
 	MAX_BANS=128,
-	EXPIRE_TIME = 90
+	MAX_LIST_REQUESTS=256,
+	LIST_BURST=16, // list packets sent to one requester per loop
+	EXPIRE_TIME = 90,
+	HASH_SIZE = 1<<15 // buckets of the address indices, a power of two
+};
+
+// hands out the entries of one of the tables below and keeps the used ones in a list,
+// entries stay where they are, so they can be referred to by index
+class CEntryList
+{
+	int m_aPrev[MAX_SERVERS];
+	int m_aNext[MAX_SERVERS];
+	int m_aFree[MAX_SERVERS];
+	int m_NumFree;
+	int m_First;
+	int m_Last;
+
+public:
+	void Init()
+	{
+		for(int i = 0; i < MAX_SERVERS; i++)
+			m_aFree[i] = MAX_SERVERS-1-i;
+		m_NumFree = MAX_SERVERS;
+		m_First = m_Last = -1;
+	}
+
+	// the new entry is not in the list yet, -1 when the table is full
+	int New() { return m_NumFree ? m_aFree[--m_NumFree] : -1; }
+	void Free(int Entry) { Unlink(Entry); m_aFree[m_NumFree++] = Entry; }
+
+	void PushFront(int Entry)
+	{
+		m_aPrev[Entry] = -1;
+		m_aNext[Entry] = m_First;
+		if(m_First != -1)
+			m_aPrev[m_First] = Entry;
+		else
+			m_Last = Entry;
+		m_First = Entry;
+	}
+
+	void PushBack(int Entry)
+	{
+		m_aPrev[Entry] = m_Last;
+		m_aNext[Entry] = -1;
+		if(m_Last != -1)
+			m_aNext[m_Last] = Entry;
+		else
+			m_First = Entry;
+		m_Last = Entry;
+	}
+
+	void Unlink(int Entry)
+	{
+		if(m_aPrev[Entry] != -1)
+			m_aNext[m_aPrev[Entry]] = m_aNext[Entry];
+		else
+			m_First = m_aNext[Entry];
+		if(m_aNext[Entry] != -1)
+			m_aPrev[m_aNext[Entry]] = m_aPrev[Entry];
+		else
+			m_Last = m_aPrev[Entry];
+	}
+
+	int First() const { return m_First; }
+	int Num() const { return MAX_SERVERS-m_NumFree; }
+};
+
+// chained hash from an address to its entry in one of the tables below
+class CAddrIndex
+{
+	int m_aBuckets[HASH_SIZE];
+	int m_aNext[MAX_SERVERS];
+
+public:
+	static unsigned Hash(const NETADDR *pAddr, bool Port)
+	{
+		unsigned Hash = 2166136261u;
+		for(int i = 0; i < 16; i++)
+			Hash = (Hash^pAddr->ip[i])*16777619u;
+		if(Port)
+		{
+			Hash = (Hash^(pAddr->port&0xff))*16777619u;
+			Hash = (Hash^(pAddr->port>>8))*16777619u;
+		}
+		return Hash&(HASH_SIZE-1);
+	}
+
+	void Init()
+	{
+		for(int i = 0; i < HASH_SIZE; i++)
+			m_aBuckets[i] = -1;
+	}
+
+	void Add(unsigned Hash, int Entry)
+	{
+		m_aNext[Entry] = m_aBuckets[Hash];
+		m_aBuckets[Hash] = Entry;
+	}
+
+	void Remove(unsigned Hash, int Entry)
+	{
+		int *pLink = &m_aBuckets[Hash];
+		while(*pLink != Entry)
+			pLink = &m_aNext[*pLink];
+		*pLink = m_aNext[Entry];
+	}
+
+	int First(unsigned Hash) const { return m_aBuckets[Hash]; }
+	int Next(int Entry) const { return m_aNext[Entry]; }
 };
 
 struct CCheckServer
@@ -27,19 +137,30 @@ struct CCheckServer
 	int64 m_TryTime;
 };
 
+// the list is ordered by try time, the index is by ip only as the response
+// can come from either port
 static CCheckServer m_aCheckServers[MAX_SERVERS];
-static int m_NumCheckServers = 0;
+static CEntryList m_CheckServerList;
+static CAddrIndex m_CheckServerIndex;
 
 struct CServerEntry
 {
 	enum ServerType m_Type;
 	NETADDR m_Address;
 	int64 m_Expire;
+	int m_Slot; // position in the list packets of its type
 };
 
+// the list is ordered by expiry, the index is by address
 static CServerEntry m_aServers[MAX_SERVERS];
+static CEntryList m_ServerList;
+static CAddrIndex m_ServerIndex;
 static int m_NumServers = 0;
 
+// servers of each type in the order of their slots
+static int m_aaSlotServers[2][MAX_SERVERS];
+static int m_aNumSlots[2] = {0};
+
 struct CPacketData
 {
 	int m_Size;
@@ -77,6 +198,24 @@ static CCountPacketData m_CountData;
 static CCountPacketData m_CountDataLegacy;
 
 
+// lists that are still being sent, a large list going out at once overflows the
+// receive buffer of the requester
+struct CListRequest
+{
+	NETADDR m_Address;
+	int m_Type;
+	int m_NextPacket;
+};
+
+static CListRequest m_aListRequests[MAX_LIST_REQUESTS];
+static int m_NumListRequests = 0;
+
+// removing a server moves the last one of its type into the free slot, a list that is
+// only partly sent would miss that server or get it twice. purges wait until the lists
+// in flight are done, new requests are held back meanwhile
+static bool m_PurgeWaiting = false;
+
+
 struct CBanEntry
 {
 	NETADDR m_Address;
@@ -91,86 +230,143 @@ static CNetClient m_NetOp; // main
 
 IConsole *m_pConsole;
 
-void BuildPackets()
+void InitPackets()
 {
-	CServerEntry *pCurrent = &m_aServers[0];
-	int ServersLeft = m_NumServers;
-	m_NumPackets = 0;
-	m_NumPacketsLegacy = 0;
-	int PacketIndex = 0;
-	int PacketIndexLegacy = 0;
-	while(ServersLeft-- && (m_NumPackets + m_NumPacketsLegacy) < MAX_PACKETS)
+	for(int i = 0; i < MAX_PACKETS; i++)
 	{
-		if(pCurrent->m_Type == SERVERTYPE_NORMAL)
-		{
-			if(PacketIndex % MAX_SERVERS_PER_PACKET == 0)
-			{
-				PacketIndex = 0;
-				m_NumPackets++;
-			}
-
-			// copy header
-			mem_copy(m_aPackets[m_NumPackets-1].m_Data.m_aHeader, SERVERBROWSE_LIST, sizeof(SERVERBROWSE_LIST));
-
-			// copy server addresses
-			if(pCurrent->m_Address.type == NETTYPE_IPV6)
-			{
-				mem_copy(m_aPackets[m_NumPackets-1].m_Data.m_aServers[PacketIndex].m_aIp, pCurrent->m_Address.ip,
-					sizeof(m_aPackets[m_NumPackets-1].m_Data.m_aServers[PacketIndex].m_aIp));
-			}
-			else
-			{
-				static char IPV4Mapping[] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF };
-
-				mem_copy(m_aPackets[m_NumPackets-1].m_Data.m_aServers[PacketIndex].m_aIp, IPV4Mapping, sizeof(IPV4Mapping));
-				m_aPackets[m_NumPackets-1].m_Data.m_aServers[PacketIndex].m_aIp[12] = pCurrent->m_Address.ip[0];
-				m_aPackets[m_NumPackets-1].m_Data.m_aServers[PacketIndex].m_aIp[13] = pCurrent->m_Address.ip[1];
-				m_aPackets[m_NumPackets-1].m_Data.m_aServers[PacketIndex].m_aIp[14] = pCurrent->m_Address.ip[2];
-				m_aPackets[m_NumPackets-1].m_Data.m_aServers[PacketIndex].m_aIp[15] = pCurrent->m_Address.ip[3];
-			}
-
-			m_aPackets[m_NumPackets-1].m_Data.m_aServers[PacketIndex].m_aPort[0] = (pCurrent->m_Address.port>>8)&0xff;
-			m_aPackets[m_NumPackets-1].m_Data.m_aServers[PacketIndex].m_aPort[1] = pCurrent->m_Address.port&0xff;
+		mem_copy(m_aPackets[i].m_Data.m_aHeader, SERVERBROWSE_LIST, sizeof(SERVERBROWSE_LIST));
+		mem_copy(m_aPacketsLegacy[i].m_Data.m_aHeader, SERVERBROWSE_LIST_LEGACY, sizeof(SERVERBROWSE_LIST_LEGACY));
+	}
+}
 
-			PacketIndex++;
+// the list packets are kept up to date as servers come and go, only the slot that
+// changed and the size of the last packet are touched
+void WriteSlot(int Type, int Slot)
+{
+	const NETADDR *pAddr = &m_aServers[m_aaSlotServers[Type][Slot]].m_Address;
+	int Packet = Slot/MAX_SERVERS_PER_PACKET;
+	int Index = Slot%MAX_SERVERS_PER_PACKET;
 
-			m_aPackets[m_NumPackets-1].m_Size = sizeof(SERVERBROWSE_LIST) + sizeof(CMastersrvAddr)*PacketIndex;
+	if(Type == SERVERTYPE_NORMAL)
+	{
+		CMastersrvAddr *pEntry = &m_aPackets[Packet].m_Data.m_aServers[Index];
 
-			pCurrent++;
+		// copy server addresses
+		if(pAddr->type == NETTYPE_IPV6)
+		{
+			mem_copy(pEntry->m_aIp, pAddr->ip, sizeof(pEntry->m_aIp));
 		}
-		else if(pCurrent->m_Type == SERVERTYPE_LEGACY)
+		else
 		{
-			if(PacketIndexLegacy % MAX_SERVERS_PER_PACKET == 0)
-			{
-				PacketIndexLegacy = 0;
-				m_NumPacketsLegacy++;
-			}
+			static char IPV4Mapping[] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF };
 
-			// copy header
-			mem_copy(m_aPacketsLegacy[m_NumPacketsLegacy-1].m_Data.m_aHeader, SERVERBROWSE_LIST_LEGACY, sizeof(SERVERBROWSE_LIST_LEGACY));
+			mem_copy(pEntry->m_aIp, IPV4Mapping, sizeof(IPV4Mapping));
+			pEntry->m_aIp[12] = pAddr->ip[0];
+			pEntry->m_aIp[13] = pAddr->ip[1];
+			pEntry->m_aIp[14] = pAddr->ip[2];
+			pEntry->m_aIp[15] = pAddr->ip[3];
+		}
 
-			// copy server addresses
-			mem_copy(m_aPacketsLegacy[m_NumPacketsLegacy-1].m_Data.m_aServers[PacketIndexLegacy].m_aIp, pCurrent->m_Address.ip,
-				sizeof(m_aPacketsLegacy[m_NumPacketsLegacy-1].m_Data.m_aServers[PacketIndexLegacy].m_aIp));
-			// 0.5 has the port in little endian on the network
-			m_aPacketsLegacy[m_NumPacketsLegacy-1].m_Data.m_aServers[PacketIndexLegacy].m_aPort[0] = pCurrent->m_Address.port&0xff;
-			m_aPacketsLegacy[m_NumPacketsLegacy-1].m_Data.m_aServers[PacketIndexLegacy].m_aPort[1] = (pCurrent->m_Address.port>>8)&0xff;
+		pEntry->m_aPort[0] = (pAddr->port>>8)&0xff;
+		pEntry->m_aPort[1] = pAddr->port&0xff;
+	}
+	else
+	{
+		CMastersrvAddrLegacy *pEntry = &m_aPacketsLegacy[Packet].m_Data.m_aServers[Index];
 
-			PacketIndexLegacy++;
+		// copy server addresses
+		mem_copy(pEntry->m_aIp, pAddr->ip, sizeof(pEntry->m_aIp));
+		// 0.5 has the port in little endian on the network
+		pEntry->m_aPort[0] = pAddr->port&0xff;
+		pEntry->m_aPort[1] = (pAddr->port>>8)&0xff;
+	}
+}
 
-			m_aPacketsLegacy[m_NumPacketsLegacy-1].m_Size = sizeof(SERVERBROWSE_LIST_LEGACY) + sizeof(CMastersrvAddrLegacy)*PacketIndexLegacy;
+void UpdatePacketSizes(int Type)
+{
+	int NumSlots = m_aNumSlots[Type];
+	int NumPackets = (NumSlots+MAX_SERVERS_PER_PACKET-1)/MAX_SERVERS_PER_PACKET;
+	int LastEntries = NumSlots-(NumPackets-1)*MAX_SERVERS_PER_PACKET;
 
-			pCurrent++;
+	if(Type == SERVERTYPE_NORMAL)
+	{
+		// the packet before the last one may have just become full
+		for(int i = max(NumPackets-2, 0); i < NumPackets; i++)
+			m_aPackets[i].m_Size = sizeof(SERVERBROWSE_LIST) + sizeof(CMastersrvAddr)*(i == NumPackets-1 ? LastEntries : MAX_SERVERS_PER_PACKET);
+		m_NumPackets = NumPackets;
+	}
+	else
+	{
+		for(int i = max(NumPackets-2, 0); i < NumPackets; i++)
+			m_aPacketsLegacy[i].m_Size = sizeof(SERVERBROWSE_LIST_LEGACY) + sizeof(CMastersrvAddrLegacy)*(i == NumPackets-1 ? LastEntries : MAX_SERVERS_PER_PACKET);
+		m_NumPacketsLegacy = NumPackets;
+	}
+}
+
+// returns true when the whole list has been sent
+bool SendListPackets(CListRequest *pRequest, int MaxPackets)
+{
+	CNetChunk p;
+	p.m_ClientID = -1;
+	p.m_Address = pRequest->m_Address;
+	p.m_Flags = NETSENDFLAG_CONNLESS;
+
+	int NumPackets = pRequest->m_Type == SERVERTYPE_NORMAL ? m_NumPackets : m_NumPacketsLegacy;
+	for(; pRequest->m_NextPacket < NumPackets && MaxPackets > 0; pRequest->m_NextPacket++, MaxPackets--)
+	{
+		if(pRequest->m_Type == SERVERTYPE_NORMAL)
+		{
+			p.m_DataSize = m_aPackets[pRequest->m_NextPacket].m_Size;
+			p.m_pData = &m_aPackets[pRequest->m_NextPacket].m_Data;
 		}
 		else
 		{
-			*pCurrent = m_aServers[m_NumServers-1];
-			m_NumServers--;
-			dbg_msg("mastersrv", "error: server of invalid type, dropping it");
+			p.m_DataSize = m_aPacketsLegacy[pRequest->m_NextPacket].m_Size;
+			p.m_pData = &m_aPacketsLegacy[pRequest->m_NextPacket].m_Data;
 		}
+		m_NetOp.Send(&p);
+	}
+	return pRequest->m_NextPacket >= NumPackets;
+}
+
+void AddListRequest(NETADDR *pAddr, int Type)
+{
+	CListRequest Request;
+	Request.m_Address = *pAddr;
+	Request.m_Type = Type;
+	Request.m_NextPacket = 0;
+
+	// the first burst goes out right away, most lists fit into it
+	if(!m_PurgeWaiting && SendListPackets(&Request, LIST_BURST))
+		return;
+
+	if(m_NumListRequests == MAX_LIST_REQUESTS)
+	{
+		SendListPackets(&Request, MAX_PACKETS);
+		return;
+	}
+	m_aListRequests[m_NumListRequests++] = Request;
+}
+
+void SendLists()
+{
+	for(int i = 0; i < m_NumListRequests; i++)
+	{
+		if(m_PurgeWaiting && !m_aListRequests[i].m_NextPacket)
+			continue;
+		if(SendListPackets(&m_aListRequests[i], LIST_BURST))
+			m_aListRequests[i--] = m_aListRequests[--m_NumListRequests];
 	}
 }
 
+bool ListsInFlight()
+{
+	for(int i = 0; i < m_NumListRequests; i++)
+		if(m_aListRequests[i].m_NextPacket)
+			return true;
+	return false;
+}
+
 void SendOk(NETADDR *pAddr)
 {
 	CNetChunk p;
@@ -207,10 +403,34 @@ void SendCheck(NETADDR *pAddr)
 	m_NetChecker.Send(&p);
 }
 
+int FindCheckserver(const NETADDR *pAddr)
+{
+	for(int i = m_CheckServerIndex.First(CAddrIndex::Hash(pAddr, false)); i != -1; i = m_CheckServerIndex.Next(i))
+	{
+		if(net_addr_comp(&m_aCheckServers[i].m_Address, pAddr) == 0 ||
+			net_addr_comp(&m_aCheckServers[i].m_AltAddress, pAddr) == 0)
+			return i;
+	}
+	return -1;
+}
+
+void RemoveCheckserver(int Entry)
+{
+	m_CheckServerIndex.Remove(CAddrIndex::Hash(&m_aCheckServers[Entry].m_Address, false), Entry);
+	m_CheckServerList.Free(Entry);
+}
+
 void AddCheckserver(NETADDR *pInfo, NETADDR *pAlt, ServerType Type)
 {
+	// a server that is still being checked doesn't need a second check
+	unsigned Hash = CAddrIndex::Hash(pInfo, false);
+	for(int i = m_CheckServerIndex.First(Hash); i != -1; i = m_CheckServerIndex.Next(i))
+		if(net_addr_comp(&m_aCheckServers[i].m_Address, pInfo) == 0)
+			return;
+
 	// add server
-	if(m_NumCheckServers == MAX_SERVERS)
+	int Entry = m_CheckServerList.New();
+	if(Entry == -1)
 	{
 		dbg_msg("mastersrv", "error: mastersrv is full");
 		return;
@@ -221,18 +441,22 @@ void AddCheckserver(NETADDR *pInfo, NETADDR *pAlt, ServerType Type)
 	char aAltAddrStr[NETADDR_MAXSTRSIZE];
 	net_addr_str(pAlt, aAltAddrStr, sizeof(aAltAddrStr));
 	dbg_msg("mastersrv", "checking: %s (%s)", aAddrStr, aAltAddrStr);
-	m_aCheckServers[m_NumCheckServers].m_Address = *pInfo;
-	m_aCheckServers[m_NumCheckServers].m_AltAddress = *pAlt;
-	m_aCheckServers[m_NumCheckServers].m_TryCount = 0;
-	m_aCheckServers[m_NumCheckServers].m_TryTime = 0;
-	m_aCheckServers[m_NumCheckServers].m_Type = Type;
-	m_NumCheckServers++;
+	m_aCheckServers[Entry].m_Address = *pInfo;
+	m_aCheckServers[Entry].m_AltAddress = *pAlt;
+	m_aCheckServers[Entry].m_TryCount = 0;
+	m_aCheckServers[Entry].m_TryTime = 0;
+	m_aCheckServers[Entry].m_Type = Type;
+
+	// it is due right away, so it goes in front
+	m_CheckServerList.PushFront(Entry);
+	m_CheckServerIndex.Add(Hash, Entry);
 }
 
 void AddServer(NETADDR *pInfo, ServerType Type)
 {
 	// see if server already exists in list
-	for(int i = 0; i < m_NumServers; i++)
+	unsigned Hash = CAddrIndex::Hash(pInfo, true);
+	for(int i = m_ServerIndex.First(Hash); i != -1; i = m_ServerIndex.Next(i))
 	{
 		if(net_addr_comp(&m_aServers[i].m_Address, pInfo) == 0)
 		{
@@ -240,12 +464,15 @@ void AddServer(NETADDR *pInfo, ServerType Type)
 			net_addr_str(pInfo, aAddrStr, sizeof(aAddrStr));
 			dbg_msg("mastersrv", "updated: %s", aAddrStr);
 			m_aServers[i].m_Expire = time_get()+time_freq()*EXPIRE_TIME;
+			m_ServerList.Unlink(i);
+			m_ServerList.PushBack(i);
 			return;
 		}
 	}
 
 	// add server
-	if(m_NumServers == MAX_SERVERS)
+	int Entry = m_ServerList.New();
+	if(Entry == -1)
 	{
 		dbg_msg("mastersrv", "error: mastersrv is full");
 		return;
@@ -254,64 +481,86 @@ void AddServer(NETADDR *pInfo, ServerType Type)
 	char aAddrStr[NETADDR_MAXSTRSIZE];
 	net_addr_str(pInfo, aAddrStr, sizeof(aAddrStr));
 	dbg_msg("mastersrv", "added: %s", aAddrStr);
-	m_aServers[m_NumServers].m_Address = *pInfo;
-	m_aServers[m_NumServers].m_Expire = time_get()+time_freq()*EXPIRE_TIME;
-	m_aServers[m_NumServers].m_Type = Type;
+	m_aServers[Entry].m_Address = *pInfo;
+	m_aServers[Entry].m_Expire = time_get()+time_freq()*EXPIRE_TIME;
+	m_aServers[Entry].m_Type = Type;
+	m_aServers[Entry].m_Slot = m_aNumSlots[Type]++;
+	m_ServerList.PushBack(Entry);
+	m_ServerIndex.Add(Hash, Entry);
 	m_NumServers++;
+
+	m_aaSlotServers[Type][m_aServers[Entry].m_Slot] = Entry;
+	WriteSlot(Type, m_aServers[Entry].m_Slot);
+	UpdatePacketSizes(Type);
+}
+
+void RemoveServer(int Entry)
+{
+	m_ServerIndex.Remove(CAddrIndex::Hash(&m_aServers[Entry].m_Address, true), Entry);
+	m_ServerList.Free(Entry);
+	m_NumServers--;
+
+	// the last server of the type takes over the slot
+	int Type = m_aServers[Entry].m_Type;
+	int Slot = m_aServers[Entry].m_Slot;
+	int Last = --m_aNumSlots[Type];
+	if(Slot != Last)
+	{
+		int Moved = m_aaSlotServers[Type][Last];
+		m_aaSlotServers[Type][Slot] = Moved;
+		m_aServers[Moved].m_Slot = Slot;
+		WriteSlot(Type, Slot);
+	}
+	UpdatePacketSizes(Type);
 }
 
 void UpdateServers()
 {
 	int64 Now = time_get();
 	int64 Freq = time_freq();
-	for(int i = 0; i < m_NumCheckServers; i++)
+
+	// the checks are ordered by try time, so only the due ones are looked at
+	int i;
+	while((i = m_CheckServerList.First()) != -1 && Now > m_aCheckServers[i].m_TryTime+Freq)
 	{
-		if(Now > m_aCheckServers[i].m_TryTime+Freq)
+		if(m_aCheckServers[i].m_TryCount == 10)
 		{
-			if(m_aCheckServers[i].m_TryCount == 10)
-			{
-				char aAddrStr[NETADDR_MAXSTRSIZE];
-				net_addr_str(&m_aCheckServers[i].m_Address, aAddrStr, sizeof(aAddrStr));
-				char aAltAddrStr[NETADDR_MAXSTRSIZE];
-				net_addr_str(&m_aCheckServers[i].m_AltAddress, aAltAddrStr, sizeof(aAltAddrStr));
-				dbg_msg("mastersrv", "check failed: %s (%s)", aAddrStr, aAltAddrStr);
-
-				// FAIL!!
-				SendError(&m_aCheckServers[i].m_Address);
-				m_aCheckServers[i] = m_aCheckServers[m_NumCheckServers-1];
-				m_NumCheckServers--;
-				i--;
-			}
+			char aAddrStr[NETADDR_MAXSTRSIZE];
+			net_addr_str(&m_aCheckServers[i].m_Address, aAddrStr, sizeof(aAddrStr));
+			char aAltAddrStr[NETADDR_MAXSTRSIZE];
+			net_addr_str(&m_aCheckServers[i].m_AltAddress, aAltAddrStr, sizeof(aAltAddrStr));
+			dbg_msg("mastersrv", "check failed: %s (%s)", aAddrStr, aAltAddrStr);
+
+			// FAIL!!
+			SendError(&m_aCheckServers[i].m_Address);
+			RemoveCheckserver(i);
+		}
+		else
+		{
+			m_aCheckServers[i].m_TryCount++;
+			m_aCheckServers[i].m_TryTime = Now;
+			if(m_aCheckServers[i].m_TryCount&1)
+				SendCheck(&m_aCheckServers[i].m_Address);
 			else
-			{
-				m_aCheckServers[i].m_TryCount++;
-				m_aCheckServers[i].m_TryTime = Now;
-				if(m_aCheckServers[i].m_TryCount&1)
-					SendCheck(&m_aCheckServers[i].m_Address);
-				else
-					SendCheck(&m_aCheckServers[i].m_AltAddress);
-			}
+				SendCheck(&m_aCheckServers[i].m_AltAddress);
+			m_CheckServerList.Unlink(i);
+			m_CheckServerList.PushBack(i);
 		}
 	}
 }
 
 void PurgeServers()
 {
+	// the servers are ordered by expiry
 	int64 Now = time_get();
-	int i = 0;
-	while(i < m_NumServers)
+	int i;
+	while((i = m_ServerList.First()) != -1 && m_aServers[i].m_Expire < Now)
 	{
-		if(m_aServers[i].m_Expire < Now)
-		{
-			// remove server
-			char aAddrStr[NETADDR_MAXSTRSIZE];
-			net_addr_str(&m_aServers[i].m_Address, aAddrStr, sizeof(aAddrStr));
-			dbg_msg("mastersrv", "expired: %s", aAddrStr);
-			m_aServers[i] = m_aServers[m_NumServers-1];
-			m_NumServers--;
-		}
-		else
-			i++;
+		// remove server
+		char aAddrStr[NETADDR_MAXSTRSIZE];
+		net_addr_str(&m_aServers[i].m_Address, aAddrStr, sizeof(aAddrStr));
+		dbg_msg("mastersrv", "expired: %s", aAddrStr);
+		RemoveServer(i);
 	}
 }
 
@@ -367,7 +616,7 @@ void ReloadBans()
 
 int main(int argc, const char **argv) // ignore_convention
 {
-	int64 LastBuild = 0, LastBanReload = 0;
+	int64 LastPurge = 0, LastBanReload = 0;
 	ServerType Type = SERVERTYPE_INVALID;
 	NETADDR BindAddr;
 
@@ -391,6 +640,12 @@ int main(int argc, const char **argv) // ignore_convention
 		return -1;
 	}
 
+	m_CheckServerList.Init();
+	m_CheckServerIndex.Init();
+	m_ServerList.Init();
+	m_ServerIndex.Init();
+	InitPackets();
+
 	mem_copy(m_CountData.m_Header, SERVERBROWSE_COUNT, sizeof(SERVERBROWSE_COUNT));
 	mem_copy(m_CountDataLegacy.m_Header, SERVERBROWSE_COUNT_LEGACY, sizeof(SERVERBROWSE_COUNT_LEGACY));
 
@@ -482,36 +737,14 @@ int main(int argc, const char **argv) // ignore_convention
 			{
 				// someone requested the list
 				dbg_msg("mastersrv", "requested, responding with %d m_aServers", m_NumServers);
-
-				CNetChunk p;
-				p.m_ClientID = -1;
-				p.m_Address = Packet.m_Address;
-				p.m_Flags = NETSENDFLAG_CONNLESS;
-
-				for(int i = 0; i < m_NumPackets; i++)
-				{
-					p.m_DataSize = m_aPackets[i].m_Size;
-					p.m_pData = &m_aPackets[i].m_Data;
-					m_NetOp.Send(&p);
-				}
+				AddListRequest(&Packet.m_Address, SERVERTYPE_NORMAL);
 			}
 			else if(Packet.m_DataSize == sizeof(SERVERBROWSE_GETLIST_LEGACY) &&
 				mem_comp(Packet.m_pData, SERVERBROWSE_GETLIST_LEGACY, sizeof(SERVERBROWSE_GETLIST_LEGACY)) == 0)
 			{
 				// someone requested the list
 				dbg_msg("mastersrv", "requested, responding with %d m_aServers", m_NumServers);
-
-				CNetChunk p;
-				p.m_ClientID = -1;
-				p.m_Address = Packet.m_Address;
-				p.m_Flags = NETSENDFLAG_CONNLESS;
-
-				for(int i = 0; i < m_NumPacketsLegacy; i++)
-				{
-					p.m_DataSize = m_aPacketsLegacy[i].m_Size;
-					p.m_pData = &m_aPacketsLegacy[i].m_Data;
-					m_NetOp.Send(&p);
-				}
+				AddListRequest(&Packet.m_Address, SERVERTYPE_LEGACY);
 			}
 		}
 
@@ -526,16 +759,11 @@ int main(int argc, const char **argv) // ignore_convention
 			{
 				Type = SERVERTYPE_INVALID;
 				// remove it from checking
-				for(int i = 0; i < m_NumCheckServers; i++)
+				int Check = FindCheckserver(&Packet.m_Address);
+				if(Check != -1)
 				{
-					if(net_addr_comp(&m_aCheckServers[i].m_Address, &Packet.m_Address) == 0 ||
-						net_addr_comp(&m_aCheckServers[i].m_AltAddress, &Packet.m_Address) == 0)
-					{
-						Type = m_aCheckServers[i].m_Type;
-						m_NumCheckServers--;
-						m_aCheckServers[i] = m_aCheckServers[m_NumCheckServers];
-						break;
-					}
+					Type = m_aCheckServers[Check].m_Type;
+					RemoveCheckserver(Check);
 				}
 
 				// drops servers that were not in the CheckServers list
@@ -554,13 +782,20 @@ int main(int argc, const char **argv) // ignore_convention
 			ReloadBans();
 		}
 
-		if(time_get()-LastBuild > time_freq()*5)
+		// checks are spread out as the heartbeats come in instead of going out in bursts
+		UpdateServers();
+		SendLists();
+
+		if(time_get()-LastPurge > time_freq()*5)
 		{
-			LastBuild = time_get();
+			LastPurge = time_get();
+			m_PurgeWaiting = true;
+		}
 
+		if(m_PurgeWaiting && !ListsInFlight())
+		{
 			PurgeServers();
-			UpdateServers();
-			BuildPackets();
+			m_PurgeWaiting = false;
 		}
 
 		// be nice to the CPU
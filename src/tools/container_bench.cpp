@@ -0,0 +1,224 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+#include <base/system.h>
+#include <base/tl/algorithm.h>
+#include <base/tl/array.h>
+#include <base/tl/hash_map.h>
+#include <base/tl/hash_set.h>
+#include <base/tl/small_array.h>
+#include <base/tl/sorted_array.h>
+
+/*
+	container_bench times the containers of base/tl against each other for the
+	ways the engine uses them:
+
+	int keys		hash_map against a sorted_array searched with partition_binary
+					and an array searched linearly, filled and then looked up
+	string keys		hash_set of names against an array compared with str_comp,
+					like the console looks up commands
+	short lists		many small_array<int, 8> against array<int> with a few items
+					each, built, summed and freed
+
+	Times are nanoseconds per operation, the checksums only keep the compiler
+	from dropping the work.
+*/
+
+static int s_Scale = 1;
+
+// keeps the timings of one row together
+class CTimer
+{
+	int64 m_Start;
+public:
+	CTimer() { m_Start = time_get(); }
+	float NsPer(int NumOps) const { return (time_get()-m_Start)*1000000000.0f/time_freq()/max(NumOps, 1); }
+};
+
+struct CIntEntry
+{
+	int m_Key;
+	int m_Value;
+
+	bool operator<(const CIntEntry &Other) const { return m_Key < Other.m_Key; }
+	bool operator==(const CIntEntry &Other) const { return m_Key == Other.m_Key; }
+};
+
+static unsigned s_Random = 1;
+static int Random()
+{
+	s_Random = s_Random*1103515245+12345;
+	return (int)(s_Random>>1);
+}
+
+static void BenchIntKeys(int NumKeys)
+{
+	int *pKeys = (int *)mem_alloc(NumKeys*sizeof(int), sizeof(int));
+	for(int i = 0; i < NumKeys; i++)
+		pKeys[i] = Random();
+	int NumLookups = max(100000*s_Scale, NumKeys);
+	unsigned Checksum = 0;
+
+	float aInsert[3], aLookup[3];
+
+	{
+		CTimer Timer;
+		hash_map<int, int> Map;
+		for(int i = 0; i < NumKeys; i++)
+			Map.set(pKeys[i], i);
+		aInsert[0] = Timer.NsPer(NumKeys);
+
+		CTimer LookupTimer;
+		for(int i = 0; i < NumLookups; i++)
+		{
+			const int *pValue = Map.find(pKeys[i%NumKeys]);
+			Checksum += pValue ? *pValue : 0;
+		}
+		aLookup[0] = LookupTimer.NsPer(NumLookups);
+	}
+
+	{
+		CTimer Timer;
+		sorted_array<CIntEntry> Sorted;
+		for(int i = 0; i < NumKeys; i++)
+		{
+			CIntEntry Entry = { pKeys[i], i };
+			Sorted.add(Entry);
+		}
+		aInsert[1] = Timer.NsPer(NumKeys);
+
+		// find_binary partitions linearly, so partition_binary does the search
+		CTimer LookupTimer;
+		for(int i = 0; i < NumLookups; i++)
+		{
+			CIntEntry Entry = { pKeys[i%NumKeys], 0 };
+			sorted_array<CIntEntry>::range r = partition_binary(Sorted.all(), Entry);
+			Checksum += !r.empty() && r.front() == Entry ? r.front().m_Value : 0;
+		}
+		aLookup[1] = LookupTimer.NsPer(NumLookups);
+	}
+
+	{
+		CTimer Timer;
+		array<CIntEntry> List;
+		for(int i = 0; i < NumKeys; i++)
+		{
+			CIntEntry Entry = { pKeys[i], i };
+			List.add(Entry);
+		}
+		aInsert[2] = Timer.NsPer(NumKeys);
+
+		// linear search gets slow quickly, fewer lookups keep the run short
+		int NumLinear = min(NumLookups, max(100000000/NumKeys, NumKeys));
+		CTimer LookupTimer;
+		for(int i = 0; i < NumLinear; i++)
+		{
+			CIntEntry Entry = { pKeys[i%NumKeys], 0 };
+			array<CIntEntry>::range r = find_linear(List.all(), Entry);
+			Checksum += r.empty() ? 0 : r.front().m_Value;
+		}
+		aLookup[2] = LookupTimer.NsPer(NumLinear);
+	}
+
+	dbg_msg("container_bench", "int keys %6d: insert hash_map %7.1f sorted_array %7.1f array %7.1f | lookup hash_map %7.1f sorted_array %7.1f array %9.1f (%08x)",
+		NumKeys, aInsert[0], aInsert[1], aInsert[2], aLookup[0], aLookup[1], aLookup[2], Checksum);
+	mem_free(pKeys);
+}
+
+static void BenchStringKeys(int NumKeys)
+{
+	char (*paNames)[32] = (char (*)[32])mem_alloc(NumKeys*32, 1);
+	for(int i = 0; i < NumKeys; i++)
+		str_format(paNames[i], 32, "sv_command_%d_%x", i, Random()&0xffff);
+	int NumLookups = max(100000*s_Scale, NumKeys);
+	unsigned Checksum = 0;
+
+	float aLookup[2];
+
+	{
+		hash_set<const char *> Set;
+		for(int i = 0; i < NumKeys; i++)
+			Set.add(paNames[i]);
+
+		CTimer Timer;
+		for(int i = 0; i < NumLookups; i++)
+			Checksum += Set.contains(paNames[(i*7)%NumKeys]);
+		aLookup[0] = Timer.NsPer(NumLookups);
+	}
+
+	{
+		array<const char *> List;
+		for(int i = 0; i < NumKeys; i++)
+			List.add(paNames[i]);
+
+		int NumLinear = min(NumLookups, max(50000000/NumKeys, NumKeys));
+		CTimer Timer;
+		for(int i = 0; i < NumLinear; i++)
+		{
+			const char *pName = paNames[(i*7)%NumKeys];
+			for(int k = 0; k < List.size(); k++)
+				if(str_comp(List[k], pName) == 0)
+				{
+					Checksum++;
+					break;
+				}
+		}
+		aLookup[1] = Timer.NsPer(NumLinear);
+	}
+
+	dbg_msg("container_bench", "string keys %5d: lookup hash_set %7.1f array %9.1f (%08x)", NumKeys, aLookup[0], aLookup[1], Checksum);
+	mem_free(paNames);
+}
+
+template<class LIST>
+static float BenchLists(int NumLists, int ItemsPerList, unsigned *pChecksum)
+{
+	CTimer Timer;
+	for(int Round = 0; Round < 10*s_Scale; Round++)
+	{
+		LIST *pLists = new LIST[NumLists];
+		for(int i = 0; i < NumLists; i++)
+			for(int k = 0; k < ItemsPerList; k++)
+				pLists[i].add(i+k);
+		for(int i = 0; i < NumLists; i++)
+			for(int k = 0; k < pLists[i].size(); k++)
+				*pChecksum += pLists[i][k];
+		delete [] pLists;
+	}
+	return Timer.NsPer(10*s_Scale*NumLists);
+}
+
+static void BenchShortLists(int ItemsPerList)
+{
+	const int NumLists = 10000;
+	unsigned Checksum = 0;
+	float Small = BenchLists<small_array<int, 8> >(NumLists, ItemsPerList, &Checksum);
+	float Dynamic = BenchLists<array<int> >(NumLists, ItemsPerList, &Checksum);
+	dbg_msg("container_bench", "lists of %2d: small_array %7.1f array %7.1f per list (%08x)", ItemsPerList, Small, Dynamic, Checksum);
+}
+
+int main(int argc, const char **argv) // ignore_convention
+{
+	dbg_logger_stdout();
+
+	for(int Arg = 1; Arg < argc; Arg++)
+	{
+		if(str_comp(argv[Arg], "-s") == 0 && Arg+1 < argc)
+			s_Scale = max(str_toint(argv[++Arg]), 1);
+		else
+		{
+			dbg_msg("container_bench", "usage: container_bench [-s <scale>]");
+			return -1;
+		}
+	}
+
+	static const int s_aSizes[] = {8, 64, 512, 4096, 32768};
+	for(unsigned i = 0; i < sizeof(s_aSizes)/sizeof(s_aSizes[0]); i++)
+		BenchIntKeys(s_aSizes[i]);
+	for(unsigned i = 0; i < sizeof(s_aSizes)/sizeof(s_aSizes[0]); i++)
+		BenchStringKeys(s_aSizes[i]);
+	static const int s_aItems[] = {2, 8, 16};
+	for(unsigned i = 0; i < sizeof(s_aItems)/sizeof(s_aItems[0]); i++)
+		BenchShortLists(s_aItems[i]);
+	return 0;
+}
@@ -41,6 +41,32 @@ static int m_ConfigNumpingconfs = sizeof(m_aConfigPings)/sizeof(CPingConfig);
 static int m_ConfigInterval = 10; // seconds between different pingconfigs
 static int m_ConfigLog = 0;
 static int m_ConfigReorder = 0;
+static int m_ConfigStats = 0;
+
+// traffic per direction, 0 is towards the server and 1 towards the client
+struct CTrafficStats
+{
+	int m_Packets;
+	int m_Bytes;
+	int m_Dropped;
+};
+
+static CTrafficStats m_aStats[2];
+static CTrafficStats m_aTotalStats[2];
+
+static void PrintStats(int Seconds)
+{
+	for(int i = 0; i < 2; i++)
+	{
+		m_aTotalStats[i].m_Packets += m_aStats[i].m_Packets;
+		m_aTotalStats[i].m_Bytes += m_aStats[i].m_Bytes;
+		m_aTotalStats[i].m_Dropped += m_aStats[i].m_Dropped;
+	}
+	dbg_msg("crapnet", "%ds to server: %d packets %d bytes %d dropped, to client: %d packets %d bytes %d dropped", Seconds,
+		m_aStats[0].m_Packets, m_aStats[0].m_Bytes, m_aStats[0].m_Dropped,
+		m_aStats[1].m_Packets, m_aStats[1].m_Bytes, m_aStats[1].m_Dropped);
+	mem_zero(m_aStats, sizeof(m_aStats));
+}
 
 void Run(int Port, NETADDR Dest)
 {
@@ -50,9 +76,17 @@ void Run(int Port, NETADDR Dest)
 	char aBuffer[1024*2];
 	int ID = 0;
 	int Delaycounter = 0;
+	int64 StartTime = time_get();
+	int64 LastStats = StartTime;
 
 	while(1)
 	{
+		if(m_ConfigStats && time_get()-LastStats >= time_freq())
+		{
+			LastStats += time_freq();
+			PrintStats((int)((LastStats-StartTime)/time_freq()));
+		}
+
 		static int Lastcfg = 0;
 		int n = ((time_get()/time_freq())/m_ConfigInterval) % m_ConfigNumpingconfs;
 		CPingConfig Ping = m_aConfigPings[n];
@@ -71,12 +105,16 @@ void Run(int Port, NETADDR Dest)
 			if(Bytes <= 0)
 				break;
 
+			int Direction = net_addr_comp(&From, &Dest) == 0 ? 1 : 0;
 			if((rand()%100) < Ping.m_Loss) // drop the packet
 			{
+				m_aStats[Direction].m_Dropped++;
 				if(m_ConfigLog)
 					dbg_msg("crapnet", "dropped packet");
 				continue;
 			}
+			m_aStats[Direction].m_Packets++;
+			m_aStats[Direction].m_Bytes += Bytes;
 
 			// create new packet
 			CPacket *p = (CPacket *)mem_alloc(sizeof(CPacket)+Bytes, 1);
@@ -206,10 +244,61 @@ void Run(int Port, NETADDR Dest)
 	}
 }
 
-int main(int argc, char **argv) // ignore_convention
+int main(int argc, const char **argv) // ignore_convention
 {
 	NETADDR Addr = {NETTYPE_IPV4, {127,0,0,1},8303};
+	int Port = 8302;
 	dbg_logger_stdout();
-	Run(8302, Addr);
+
+	// a fixed link instead of cycling through the ping configs, to measure against
+	CPingConfig Fixed = {0, 0, 0, 0, 0, 0};
+	bool UseFixed = false;
+	for(int i = 1; i < argc; i++) // ignore_convention
+	{
+		if(str_comp(argv[i], "-s") == 0) // ignore_convention
+			m_ConfigStats = 1;
+		else if(str_comp(argv[i], "-v") == 0) // ignore_convention
+			m_ConfigLog = 1;
+		else if(str_comp(argv[i], "-r") == 0) // ignore_convention
+			m_ConfigReorder = 1;
+		else if(i+1 < argc && str_comp(argv[i], "-l") == 0) // ignore_convention
+		{
+			Fixed.m_Loss = str_toint(argv[++i]); // ignore_convention
+			UseFixed = true;
+		}
+		else if(i+1 < argc && str_comp(argv[i], "-p") == 0) // ignore_convention
+		{
+			Fixed.m_Base = str_toint(argv[++i]); // ignore_convention
+			UseFixed = true;
+		}
+		else if(i+1 < argc && str_comp(argv[i], "-f") == 0) // ignore_convention
+		{
+			Fixed.m_Flux = str_toint(argv[++i]); // ignore_convention
+			UseFixed = true;
+		}
+		else if(i+1 < argc && str_comp(argv[i], "-P") == 0) // ignore_convention
+			Port = str_toint(argv[++i]); // ignore_convention
+		else if(i+1 < argc && str_comp(argv[i], "-a") == 0) // ignore_convention
+		{
+			if(net_addr_from_str(&Addr, argv[++i]) != 0) // ignore_convention
+			{
+				dbg_msg("crapnet", "invalid server address '%s'", argv[i]); // ignore_convention
+				return -1;
+			}
+		}
+		else
+		{
+			dbg_msg("crapnet", "usage: crapnet [-s] [-v] [-r] [-l <loss %%>] [-p <ping ms>] [-f <flux ms>] [-P <local port>] [-a <server address>]");
+			return -1;
+		}
+	}
+
+	if(UseFixed)
+	{
+		m_aConfigPings[0] = Fixed;
+		m_ConfigNumpingconfs = 1;
+	}
+
+	Run(Port, Addr);
 	return 0;
 }
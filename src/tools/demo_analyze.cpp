@@ -0,0 +1,558 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+#include <base/system.h>
+#include <base/vmath.h>
+#include <base/tl/array.h>
+
+#include <engine/console.h>
+#include <engine/kernel.h>
+#include <engine/map.h>
+#include <engine/storage.h>
+#include <engine/shared/config.h>
+#include <engine/shared/demo.h>
+#include <engine/shared/jobs.h>
+#include <engine/shared/network.h>
+#include <engine/shared/packer.h>
+#include <engine/shared/protocol.h>
+#include <engine/shared/snapshot.h>
+
+#include <game/collision.h>
+#include <game/gamecore.h>
+#include <game/layers.h>
+#include <game/mapitems.h>
+#include <game/generated/protocol.h>
+
+/*
+	demo_analyze decodes demos without a client and writes what happened in them:
+
+	<name>_events.csv		tick,cid,player,event,index,time,text
+		spawn, start, checkpoint (index = checkpoint), finish, warp (index = distance),
+		death (index = weapon), server_chat and broadcast. Race times are in seconds.
+	<name>_trajectory.csv	tick,cid,x,y,vel_x,vel_y,angle,hook_state,weapon
+		one line per character and snapshot, skipped with -e
+*/
+
+enum
+{
+	WARP_DISTANCE=32*25, // further than that between two snapshots is a teleport or worse
+	TRACE_STEP=8,
+};
+
+// collision data of a map the demos were recorded on, shared read only by all jobs
+struct CMapInfo
+{
+	char m_aName[64];
+	unsigned m_Crc;
+	IKernel *m_pKernel;
+	IEngineMap *m_pEngineMap;
+	CLayers m_Layers;
+	CCollision m_Collision;
+	bool m_Loaded;
+};
+
+struct CPlayerState
+{
+	bool m_Active;
+	int m_LastTick;
+	vec2 m_LastPos;
+	bool m_OnStart;
+	float m_RaceStartTick; // -1 while not racing
+	int m_LastCheckpoint;
+	char m_aName[MAX_NAME_LENGTH];
+};
+
+class CAnalyzeJob : public CDemoPlayer::IListner
+{
+	CSnapshotDelta m_SnapshotDelta;
+	CNetObjHandler m_NetObjHandler;
+	CDemoPlayer *m_pPlayer;
+	IOHANDLE m_EventFile;
+	IOHANDLE m_TrajectoryFile;
+	CPlayerState m_aPlayers[MAX_CLIENTS];
+	int m_LastSnapshotTick;
+
+	void WriteEvent(int Tick, int ClientID, const char *pEvent, int Index, float Time, const char *pText);
+	void TraceRace(int ClientID, vec2 To, int ToTick);
+	void OnCharacter(int Tick, int ClientID, const CNetObj_Character *pChar);
+
+public:
+	CJob m_Job;
+	IStorage *m_pStorage;
+	IConsole *m_pConsole;
+	int m_StorageType;
+	bool m_Trajectories;
+	const CMapInfo *m_pMap;
+	char m_aDemoName[512];
+	char m_aOutName[512];
+
+	// results
+	int m_NumTicks;
+	int m_NumEvents;
+
+	CAnalyzeJob();
+	int Run();
+
+	virtual void OnDemoPlayerSnapshot(void *pData, int Size);
+	virtual void OnDemoPlayerMessage(void *pData, int Size);
+};
+
+static void CsvString(char *pDst, int DstSize, const char *pSrc)
+{
+	// quote the string and double the quotes in it
+	int i = 0;
+	pDst[i++] = '"';
+	for(; *pSrc && i < DstSize-3; pSrc++)
+	{
+		if(*pSrc == '"')
+			pDst[i++] = '"';
+		pDst[i++] = *pSrc == '\n' ? ' ' : *pSrc;
+	}
+	pDst[i++] = '"';
+	pDst[i] = 0;
+}
+
+CAnalyzeJob::CAnalyzeJob()
+{
+	m_pPlayer = 0;
+	m_EventFile = 0;
+	m_TrajectoryFile = 0;
+	m_LastSnapshotTick = -1;
+	m_NumTicks = 0;
+	m_NumEvents = 0;
+	mem_zero(m_aPlayers, sizeof(m_aPlayers));
+
+	for(int i = 0; i < NUM_NETOBJTYPES; i++)
+		m_SnapshotDelta.SetStaticsize(i, m_NetObjHandler.GetObjSize(i));
+}
+
+void CAnalyzeJob::WriteEvent(int Tick, int ClientID, const char *pEvent, int Index, float Time, const char *pText)
+{
+	char aName[MAX_NAME_LENGTH*2+3];
+	char aText[256*2+3];
+	char aIndex[16] = "";
+	char aTime[32] = "";
+	CsvString(aName, sizeof(aName), ClientID >= 0 && ClientID < MAX_CLIENTS ? m_aPlayers[ClientID].m_aName : "");
+	CsvString(aText, sizeof(aText), pText ? pText : "");
+	if(Index >= 0)
+		str_format(aIndex, sizeof(aIndex), "%d", Index);
+	if(Time >= 0.0f)
+		str_format(aTime, sizeof(aTime), "%.3f", Time);
+
+	char aBuf[1024];
+	str_format(aBuf, sizeof(aBuf), "%d,%d,%s,%s,%s,%s,%s\n", Tick, ClientID, aName, pEvent, aIndex, aTime, aText);
+	io_write(m_EventFile, aBuf, str_length(aBuf));
+	m_NumEvents++;
+}
+
+void CAnalyzeJob::TraceRace(int ClientID, vec2 To, int ToTick)
+{
+	CPlayerState *pState = &m_aPlayers[ClientID];
+	const CCollision *pCollision = &m_pMap->m_Collision;
+	vec2 From = pState->m_LastPos;
+	float Distance = distance(From, To);
+
+	// the tiles in between a teleport don't count, only where it ends
+	int Steps = 1;
+	if(Distance > WARP_DISTANCE)
+	{
+		WriteEvent(ToTick, ClientID, "warp", (int)Distance, -1.0f, 0);
+		From = To;
+	}
+	else
+		Steps = max(1, (int)(Distance/TRACE_STEP));
+
+	// snapshots are usually a tick or two apart, walk the way in between to not miss thin tiles
+	for(int s = 1; s <= Steps; s++)
+	{
+		vec2 Pos = mix(From, To, s/(float)Steps);
+		float Tick = pState->m_LastTick + (ToTick-pState->m_LastTick)*(s/(float)Steps);
+		int Index = pCollision->GetIndex((int)Pos.x, (int)Pos.y);
+
+		if(Index == TILE_BEGIN)
+		{
+			// the time starts when leaving the start
+			if(!pState->m_OnStart)
+				WriteEvent((int)Tick, ClientID, "start", -1, -1.0f, 0);
+			pState->m_OnStart = true;
+			pState->m_RaceStartTick = Tick;
+			pState->m_LastCheckpoint = 0;
+			continue;
+		}
+		pState->m_OnStart = false;
+
+		if(pState->m_RaceStartTick < 0)
+			continue;
+
+		float Time = (Tick-pState->m_RaceStartTick)/SERVER_TICK_SPEED;
+		int Checkpoint = pCollision->IsCheckpoint((int)Pos.x, (int)Pos.y);
+		if(Checkpoint && Checkpoint != pState->m_LastCheckpoint)
+		{
+			WriteEvent((int)Tick, ClientID, "checkpoint", Checkpoint, Time, 0);
+			pState->m_LastCheckpoint = Checkpoint;
+		}
+
+		if(Index == TILE_END)
+		{
+			WriteEvent((int)Tick, ClientID, "finish", -1, Time, 0);
+			pState->m_RaceStartTick = -1;
+		}
+	}
+}
+
+void CAnalyzeJob::OnCharacter(int Tick, int ClientID, const CNetObj_Character *pChar)
+{
+	CPlayerState *pState = &m_aPlayers[ClientID];
+	vec2 Pos(pChar->m_X, pChar->m_Y);
+
+	if(m_TrajectoryFile)
+	{
+		char aBuf[256];
+		str_format(aBuf, sizeof(aBuf), "%d,%d,%d,%d,%.2f,%.2f,%d,%d,%d\n", Tick, ClientID, pChar->m_X, pChar->m_Y,
+			pChar->m_VelX/256.0f, pChar->m_VelY/256.0f, pChar->m_Angle, pChar->m_HookState, pChar->m_Weapon);
+		io_write(m_TrajectoryFile, aBuf, str_length(aBuf));
+	}
+
+	if(!pState->m_Active)
+	{
+		pState->m_Active = true;
+		pState->m_OnStart = false;
+		pState->m_RaceStartTick = -1;
+		pState->m_LastCheckpoint = 0;
+		pState->m_LastPos = Pos;
+		pState->m_LastTick = Tick;
+		WriteEvent(Tick, ClientID, "spawn", -1, -1.0f, 0);
+	}
+
+	if(m_pMap)
+		TraceRace(ClientID, Pos, Tick);
+
+	pState->m_LastPos = Pos;
+	pState->m_LastTick = Tick;
+}
+
+void CAnalyzeJob::OnDemoPlayerSnapshot(void *pData, int Size)
+{
+	// the player repeats the last snapshot for ticks without one
+	int Tick = m_pPlayer->Info()->m_Info.m_CurrentTick;
+	if(Tick == m_LastSnapshotTick)
+		return;
+	m_LastSnapshotTick = Tick;
+
+	CSnapshot *pSnap = (CSnapshot *)pData;
+	bool aSeen[MAX_CLIENTS] = {0};
+	for(int i = 0; i < pSnap->NumItems(); i++)
+	{
+		CSnapshotItem *pItem = pSnap->GetItem(i);
+		int ItemSize = pSnap->GetItemSize(i);
+		if(pItem->ID() < 0 || pItem->ID() >= MAX_CLIENTS)
+			continue;
+
+		if(pItem->Type() == NETOBJTYPE_CLIENTINFO && ItemSize >= (int)sizeof(CNetObj_ClientInfo))
+			IntsToStr(&((const CNetObj_ClientInfo *)pItem->Data())->m_Name0, 4, m_aPlayers[pItem->ID()].m_aName);
+		else if(pItem->Type() == NETOBJTYPE_CHARACTER && ItemSize >= (int)sizeof(CNetObj_Character))
+		{
+			OnCharacter(Tick, pItem->ID(), (const CNetObj_Character *)pItem->Data());
+			aSeen[pItem->ID()] = true;
+		}
+	}
+
+	// characters that are gone have to start over
+	for(int i = 0; i < MAX_CLIENTS; i++)
+		if(!aSeen[i])
+			m_aPlayers[i].m_Active = false;
+}
+
+void CAnalyzeJob::OnDemoPlayerMessage(void *pData, int Size)
+{
+	CUnpacker Unpacker;
+	Unpacker.Reset(pData, Size);
+
+	int Msg = Unpacker.GetInt();
+	int Sys = Msg&1;
+	Msg >>= 1;
+	if(Unpacker.Error() || Sys)
+		return;
+
+	void *pRawMsg = m_NetObjHandler.SecureUnpackMsg(Msg, &Unpacker);
+	if(!pRawMsg)
+		return;
+
+	int Tick = m_pPlayer->Info()->m_Info.m_CurrentTick;
+	if(Msg == NETMSGTYPE_SV_CHAT)
+	{
+		// the race results come as chat from the server
+		CNetMsg_Sv_Chat *pMsg = (CNetMsg_Sv_Chat *)pRawMsg;
+		if(pMsg->m_ClientID < 0)
+			WriteEvent(Tick, -1, "server_chat", -1, -1.0f, pMsg->m_pMessage);
+	}
+	else if(Msg == NETMSGTYPE_SV_BROADCAST)
+	{
+		// the running time is broadcasted every second, only keep the rest
+		CNetMsg_Sv_Broadcast *pMsg = (CNetMsg_Sv_Broadcast *)pRawMsg;
+		if(str_comp_num(pMsg->m_pMessage, "Current time:", 13) != 0 || str_find(pMsg->m_pMessage, "Checkpoint"))
+			WriteEvent(Tick, -1, "broadcast", -1, -1.0f, pMsg->m_pMessage);
+	}
+	else if(Msg == NETMSGTYPE_SV_KILLMSG)
+	{
+		CNetMsg_Sv_KillMsg *pMsg = (CNetMsg_Sv_KillMsg *)pRawMsg;
+		if(pMsg->m_Victim >= 0 && pMsg->m_Victim < MAX_CLIENTS)
+		{
+			const char *pKiller = pMsg->m_Killer >= 0 && pMsg->m_Killer < MAX_CLIENTS ? m_aPlayers[pMsg->m_Killer].m_aName : "";
+			WriteEvent(Tick, pMsg->m_Victim, "death", pMsg->m_Weapon, -1.0f, pKiller);
+		}
+	}
+}
+
+int CAnalyzeJob::Run()
+{
+	char aBuf[512+32];
+	str_format(aBuf, sizeof(aBuf), "%s_events.csv", m_aOutName);
+	m_EventFile = m_pStorage->OpenFile(aBuf, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+	if(!m_EventFile)
+		return -1;
+	const char *pHeader = "tick,cid,player,event,index,time,text\n";
+	io_write(m_EventFile, pHeader, str_length(pHeader));
+
+	if(m_Trajectories)
+	{
+		str_format(aBuf, sizeof(aBuf), "%s_trajectory.csv", m_aOutName);
+		m_TrajectoryFile = m_pStorage->OpenFile(aBuf, IOFLAG_WRITE, IStorage::TYPE_SAVE);
+		if(m_TrajectoryFile)
+		{
+			pHeader = "tick,cid,x,y,vel_x,vel_y,angle,hook_state,weapon\n";
+			io_write(m_TrajectoryFile, pHeader, str_length(pHeader));
+		}
+	}
+
+	int Result = -1;
+	m_pPlayer = new CDemoPlayer(&m_SnapshotDelta);
+	m_pPlayer->SetListner(this);
+	if(m_pPlayer->Load(m_pStorage, m_pConsole, m_aDemoName, m_StorageType) == 0)
+	{
+		m_NumTicks = max(0, m_pPlayer->Info()->m_Info.m_LastTick - m_pPlayer->Info()->m_Info.m_FirstTick);
+
+		// decode as fast as possible, the player pauses at the end
+		m_pPlayer->Play();
+		while(m_pPlayer->IsPlaying() && !m_pPlayer->BaseInfo()->m_Paused)
+			m_pPlayer->NextFrame();
+		m_pPlayer->Stop();
+		Result = 0;
+	}
+	delete m_pPlayer;
+	m_pPlayer = 0;
+
+	io_close(m_EventFile);
+	if(m_TrajectoryFile)
+		io_close(m_TrajectoryFile);
+	return Result;
+}
+
+static int AnalyzeJob(void *pUser)
+{
+	return ((CAnalyzeJob *)pUser)->Run();
+}
+
+struct CAnalyzeContext
+{
+	IStorage *m_pStorage;
+	IConsole *m_pConsole;
+	const char *m_pOutDir;
+	bool m_Trajectories;
+	array<CAnalyzeJob *> m_lJobs;
+	array<CMapInfo *> m_lMaps;
+};
+
+static void AddDemo(CAnalyzeContext *pContext, const char *pDemoName, int StorageType)
+{
+	int Length = str_length(pDemoName);
+	if(Length < 5 || str_comp(pDemoName+Length-5, ".demo"))
+		return;
+
+	// the same demo can show up in several storage paths, only the first one counts
+	for(int i = 0; i < pContext->m_lJobs.size(); i++)
+		if(str_comp(pContext->m_lJobs[i]->m_aDemoName, pDemoName) == 0)
+			return;
+
+	// name the output after the demo, without path and extension
+	const char *pBaseName = pDemoName;
+	for(const char *p = pDemoName; *p; p++)
+		if(*p == '/' || *p == '\\')
+			pBaseName = p+1;
+
+	CAnalyzeJob *pJob = new CAnalyzeJob;
+	pJob->m_pStorage = pContext->m_pStorage;
+	pJob->m_pConsole = pContext->m_pConsole;
+	pJob->m_StorageType = StorageType;
+	pJob->m_Trajectories = pContext->m_Trajectories;
+	pJob->m_pMap = 0;
+	str_copy(pJob->m_aDemoName, pDemoName, sizeof(pJob->m_aDemoName));
+	char aBaseName[256];
+	str_copy(aBaseName, pBaseName, min((int)sizeof(aBaseName), str_length(pBaseName)-5+1));
+	str_format(pJob->m_aOutName, sizeof(pJob->m_aOutName), "%s/%s", pContext->m_pOutDir, aBaseName);
+	pContext->m_lJobs.add(pJob);
+}
+
+static int ListdirCallback(const char *pName, int IsDir, int StorageType, void *pUser)
+{
+	const char **ppDir = (const char **)pUser;
+	CAnalyzeContext *pContext = (CAnalyzeContext *)ppDir[1];
+	if(IsDir)
+		return 0;
+
+	char aDemoName[512];
+	str_format(aDemoName, sizeof(aDemoName), "%s/%s", ppDir[0], pName);
+	AddDemo(pContext, aDemoName, StorageType);
+	return 0;
+}
+
+static const CMapInfo *LoadMap(CAnalyzeContext *pContext, const CAnalyzeJob *pJob, const CDemoHeader *pHeader)
+{
+	unsigned Crc = (pHeader->m_aMapCrc[0]<<24) | (pHeader->m_aMapCrc[1]<<16) | (pHeader->m_aMapCrc[2]<<8) | pHeader->m_aMapCrc[3];
+	unsigned MapSize = (pHeader->m_aMapSize[0]<<24) | (pHeader->m_aMapSize[1]<<16) | (pHeader->m_aMapSize[2]<<8) | pHeader->m_aMapSize[3];
+	for(int i = 0; i < pContext->m_lMaps.size(); i++)
+		if(pContext->m_lMaps[i]->m_Crc == Crc && str_comp(pContext->m_lMaps[i]->m_aName, pHeader->m_aMapName) == 0)
+			return pContext->m_lMaps[i]->m_Loaded ? pContext->m_lMaps[i] : 0;
+
+	CMapInfo *pMap = new CMapInfo;
+	str_copy(pMap->m_aName, pHeader->m_aMapName, sizeof(pMap->m_aName));
+	pMap->m_Crc = Crc;
+	pMap->m_Loaded = false;
+	pContext->m_lMaps.add(pMap);
+
+	// store the map the same way the demo player does, so the jobs don't race to do it
+	char aMapFilename[128];
+	str_format(aMapFilename, sizeof(aMapFilename), "downloadedmaps/%s_%08x.map", pMap->m_aName, Crc);
+	IOHANDLE MapFile = pContext->m_pStorage->OpenFile(aMapFilename, IOFLAG_READ, IStorage::TYPE_ALL);
+	if(MapFile)
+		io_close(MapFile);
+	else if(MapSize > 0)
+	{
+		IOHANDLE DemoFile = pContext->m_pStorage->OpenFile(pJob->m_aDemoName, IOFLAG_READ, pJob->m_StorageType);
+		if(DemoFile)
+		{
+			unsigned char *pMapData = (unsigned char *)mem_alloc(MapSize, 1);
+			io_skip(DemoFile, sizeof(CDemoHeader));
+			if(io_read(DemoFile, pMapData, MapSize) == MapSize && (MapFile = pContext->m_pStorage->OpenFile(aMapFilename, IOFLAG_WRITE, IStorage::TYPE_SAVE)))
+			{
+				io_write(MapFile, pMapData, MapSize);
+				io_close(MapFile);
+			}
+			mem_free(pMapData);
+			io_close(DemoFile);
+		}
+	}
+
+	pMap->m_pKernel = IKernel::Create();
+	pMap->m_pEngineMap = CreateEngineMap();
+	pMap->m_pKernel->RegisterInterface(pContext->m_pStorage);
+	pMap->m_pKernel->RegisterInterface(static_cast<IEngineMap*>(pMap->m_pEngineMap)); // register as both
+	pMap->m_pKernel->RegisterInterface(static_cast<IMap*>(pMap->m_pEngineMap));
+
+	if(!pMap->m_pEngineMap->Load(aMapFilename))
+	{
+		// demos without the map in them, use our own if it's the right one
+		str_format(aMapFilename, sizeof(aMapFilename), "maps/%s.map", pMap->m_aName);
+		if(!pMap->m_pEngineMap->Load(aMapFilename))
+			return 0;
+		if(pMap->m_pEngineMap->Crc() != Crc)
+		{
+			pMap->m_pEngineMap->Unload();
+			return 0;
+		}
+	}
+
+	pMap->m_Layers.Init(pMap->m_pKernel);
+	pMap->m_Collision.Init(&pMap->m_Layers);
+	pMap->m_Loaded = true;
+	return pMap;
+}
+
+int main(int argc, const char **argv) // ignore_convention
+{
+	dbg_logger_stdout();
+
+	CAnalyzeContext Context;
+	Context.m_Trajectories = true;
+	int NumThreads = 4;
+	int Arg = 1;
+	for(; Arg < argc && argv[Arg][0] == '-'; Arg++)
+	{
+		if(str_comp(argv[Arg], "-e") == 0)
+			Context.m_Trajectories = false;
+		else if(str_comp(argv[Arg], "-j") == 0 && Arg+1 < argc)
+			NumThreads = max(1, str_toint(argv[++Arg]));
+		else
+			break;
+	}
+
+	IStorage *pStorage = CreateStorage("Teeworlds", argc, argv);
+	if(!pStorage || argc-Arg < 2)
+	{
+		dbg_msg("demo_analyze", "usage: demo_analyze [-e] [-j <threads>] <output directory> <demo or directory> [...]");
+		dbg_msg("demo_analyze", "  -e  only write events, no trajectories");
+		return -1;
+	}
+
+	CNetBase::Init();
+	Context.m_pStorage = pStorage;
+	Context.m_pConsole = CreateConsole(CFGFLAG_SERVER);
+	Context.m_pOutDir = argv[Arg++];
+	if(!pStorage->CreateFolder(Context.m_pOutDir, IStorage::TYPE_SAVE))
+	{
+		dbg_msg("demo_analyze", "failed to create directory '%s'", Context.m_pOutDir);
+		return -1;
+	}
+
+	for(; Arg < argc; Arg++)
+	{
+		int Length = str_length(argv[Arg]);
+		if(Length >= 5 && str_comp(argv[Arg]+Length-5, ".demo") == 0)
+			AddDemo(&Context, argv[Arg], IStorage::TYPE_ALL);
+		else
+		{
+			const char *apDir[2] = { argv[Arg], (const char *)&Context };
+			pStorage->ListDirectory(IStorage::TYPE_ALL, argv[Arg], ListdirCallback, apDir);
+		}
+	}
+
+	// maps are loaded up front, the jobs only read them
+	CDemoPlayer *pInfoPlayer = new CDemoPlayer(0);
+	for(int i = 0; i < Context.m_lJobs.size(); i++)
+	{
+		CDemoHeader Header;
+		if(pInfoPlayer->GetDemoInfo(pStorage, Context.m_lJobs[i]->m_aDemoName, Context.m_lJobs[i]->m_StorageType, &Header))
+			Context.m_lJobs[i]->m_pMap = LoadMap(&Context, Context.m_lJobs[i], &Header);
+	}
+	delete pInfoPlayer;
+
+	int64 StartTime = time_get();
+	CJobPool JobPool;
+	JobPool.Init(NumThreads);
+	for(int i = 0; i < Context.m_lJobs.size(); i++)
+		JobPool.Add(&Context.m_lJobs[i]->m_Job, AnalyzeJob, Context.m_lJobs[i]);
+
+	int NumFailed = 0;
+	int64 NumTicks = 0;
+	int NumEvents = 0;
+	for(int i = 0; i < Context.m_lJobs.size(); i++)
+	{
+		CAnalyzeJob *pJob = Context.m_lJobs[i];
+		pJob->m_Job.Wait();
+		if(pJob->m_Job.Result() != 0)
+		{
+			dbg_msg("demo_analyze", "failed to analyze '%s'", pJob->m_aDemoName);
+			NumFailed++;
+		}
+		NumTicks += pJob->m_NumTicks;
+		NumEvents += pJob->m_NumEvents;
+		delete pJob;
+	}
+
+	// throughput is measured in hours of recorded game per second
+	float Seconds = (time_get()-StartTime)/(float)time_freq();
+	float DemoHours = NumTicks/(float)(SERVER_TICK_SPEED*60*60);
+	dbg_msg("demo_analyze", "analyzed %d of %d demos with %d events, %.2f demo hours in %.2f seconds (%.2f demo hours per second)",
+		Context.m_lJobs.size()-NumFailed, Context.m_lJobs.size(), NumEvents, DemoHours, Seconds, Seconds > 0.0f ? DemoHours/Seconds : 0.0f);
+	return NumFailed ? -1 : 0;
+}
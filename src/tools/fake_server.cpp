@@ -1,12 +1,25 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
 #include <stdlib.h> //rand
+#include <base/math.h>
 #include <base/system.h>
 #include <engine/shared/config.h>
 #include <engine/shared/network.h>
 #include <mastersrv/mastersrv.h>
 
-CNetServer *pNet;
+// every fake server has its own socket, so one process can register thousands of them
+struct CFakeServer
+{
+	NETSOCKET m_Socket;
+	int64 m_NextHeartBeat;
+	bool m_Registered;
+};
+
+CFakeServer *pServers;
+int NumServers = 1;
+int NumRegistered = 0;
+int64 StartTime;
+bool RequestNeeded = false; // fetch the list once all servers are registered
 
 int Progression = 50;
 int GameType = 0;
@@ -27,27 +40,18 @@ int MaxPlayers = 0;
 char aInfoMsg[1024];
 int aInfoMsgSize;
 
-static void SendHeartBeats()
+static void SendHeartBeats(CFakeServer *pServer)
 {
 	static unsigned char aData[sizeof(SERVERBROWSE_HEARTBEAT) + 2];
-	CNetChunk Packet;
 
 	mem_copy(aData, SERVERBROWSE_HEARTBEAT, sizeof(SERVERBROWSE_HEARTBEAT));
 
-	Packet.m_ClientID = -1;
-	Packet.m_Flags = NETSENDFLAG_CONNLESS;
-	Packet.m_DataSize = sizeof(SERVERBROWSE_HEARTBEAT) + 2;
-	Packet.m_pData = &aData;
-
 	/* supply the set port that the master can use if it has problems */
 	aData[sizeof(SERVERBROWSE_HEARTBEAT)] = 0;
 	aData[sizeof(SERVERBROWSE_HEARTBEAT)+1] = 0;
 
 	for(int i = 0; i < NumMasters; i++)
-	{
-		Packet.m_Address = aMasterServers[i];
-		pNet->Send(&Packet);
-	}
+		CNetBase::SendPacketConnless(pServer->m_Socket, &aMasterServers[i], aData, sizeof(aData));
 }
 
 static void WriteStr(const char *pStr)
@@ -86,76 +90,150 @@ static void BuildInfoMsg()
 	}
 }
 
-static void SendServerInfo(NETADDR *pAddr)
+static void SendServerInfo(CFakeServer *pServer, NETADDR *pAddr)
+{
+	CNetBase::SendPacketConnless(pServer->m_Socket, pAddr, aInfoMsg, aInfoMsgSize);
+}
+
+static void SendFWCheckResponse(CFakeServer *pServer, NETADDR *pAddr)
 {
-	CNetChunk p;
-	p.m_ClientID = -1;
-	p.m_Address = *pAddr;
-	p.m_Flags = NETSENDFLAG_CONNLESS;
-	p.m_DataSize = aInfoMsgSize;
-	p.m_pData = aInfoMsg;
-	pNet->Send(&p);
+	CNetBase::SendPacketConnless(pServer->m_Socket, pAddr, SERVERBROWSE_FWRESPONSE, sizeof(SERVERBROWSE_FWRESPONSE));
 }
 
-static void SendFWCheckResponse(NETADDR *pAddr)
+static void ProcessPacket(CFakeServer *pServer, NETADDR *pAddr, const void *pData, int DataSize)
 {
-	CNetChunk p;
-	p.m_ClientID = -1;
-	p.m_Address = *pAddr;
-	p.m_Flags = NETSENDFLAG_CONNLESS;
-	p.m_DataSize = sizeof(SERVERBROWSE_FWRESPONSE);
-	p.m_pData = SERVERBROWSE_FWRESPONSE;
-	pNet->Send(&p);
+	if(DataSize == sizeof(SERVERBROWSE_GETINFO) &&
+		mem_comp(pData, SERVERBROWSE_GETINFO, sizeof(SERVERBROWSE_GETINFO)) == 0)
+	{
+		SendServerInfo(pServer, pAddr);
+	}
+	else if(DataSize == sizeof(SERVERBROWSE_FWCHECK) &&
+		mem_comp(pData, SERVERBROWSE_FWCHECK, sizeof(SERVERBROWSE_FWCHECK)) == 0)
+	{
+		SendFWCheckResponse(pServer, pAddr);
+	}
+	else if(DataSize == sizeof(SERVERBROWSE_FWOK) &&
+		mem_comp(pData, SERVERBROWSE_FWOK, sizeof(SERVERBROWSE_FWOK)) == 0)
+	{
+		if(!pServer->m_Registered)
+		{
+			pServer->m_Registered = true;
+			NumRegistered++;
+			if(NumRegistered == NumServers)
+			{
+				dbg_msg("fake_server", "all %d servers registered after %.2fs", NumServers, (time_get()-StartTime)/(float)time_freq());
+				RequestNeeded = true;
+			}
+		}
+	}
+}
+
+static void RequestList(CFakeServer *pServer)
+{
+	for(int i = 0; i < NumMasters; i++)
+		CNetBase::SendPacketConnless(pServer->m_Socket, &aMasterServers[i], SERVERBROWSE_GETLIST, sizeof(SERVERBROWSE_GETLIST));
+
+	// the list comes in one burst, read it right away so the socket doesn't drop any of it
+	int64 RequestTime = time_get();
+	int64 LastTime = RequestTime;
+	int NumListed = 0, NumPackets = 0;
+	while(net_socket_read_wait(pServer->m_Socket, 500))
+	{
+		unsigned char aBuffer[NET_MAX_PACKETSIZE];
+		CNetPacketConstruct Packet;
+		NETADDR Addr;
+		int Bytes;
+		while((Bytes = net_udp_recv(pServer->m_Socket, &Addr, aBuffer, sizeof(aBuffer))) > 0)
+		{
+			if(CNetBase::UnpackPacket(aBuffer, Bytes, &Packet) != 0 || !(Packet.m_Flags&NET_PACKETFLAG_CONNLESS))
+				continue;
+
+			if(Packet.m_DataSize >= (int)sizeof(SERVERBROWSE_LIST) &&
+				mem_comp(Packet.m_aChunkData, SERVERBROWSE_LIST, sizeof(SERVERBROWSE_LIST)) == 0)
+			{
+				NumListed += (Packet.m_DataSize-sizeof(SERVERBROWSE_LIST))/sizeof(CMastersrvAddr);
+				NumPackets++;
+				LastTime = time_get();
+			}
+			else
+				ProcessPacket(pServer, &Addr, Packet.m_aChunkData, Packet.m_DataSize);
+		}
+	}
+
+	dbg_msg("fake_server", "list: %d servers in %d packets after %.2fms", NumListed, NumPackets, (LastTime-RequestTime)*1000.0f/time_freq());
 }
 
 static int Run()
 {
-	int64 NextHeartBeat = 0;
 	NETADDR BindAddr = {NETTYPE_IPV4, {0},0};
 
-	if(!pNet->Open(BindAddr, 0, 0, 0))
-		return 0;
+	StartTime = time_get();
+	for(int i = 0; i < NumServers; i++)
+	{
+		pServers[i].m_Socket = net_udp_create(BindAddr);
+		if(!pServers[i].m_Socket.type)
+		{
+			dbg_msg("fake_server", "couldn't open socket %d, raise the open file limit", i);
+			return -1;
+		}
+
+		// spread the first heartbeats over a millisecond per server
+		pServers[i].m_NextHeartBeat = StartTime + time_freq()/1000*(rand()%NumServers);
+		pServers[i].m_Registered = false;
+	}
+	dbg_msg("fake_server", "running %d servers", NumServers);
 
+	int64 LastReport = StartTime;
 	while(1)
 	{
-		CNetChunk p;
-		pNet->Update();
-		while(pNet->Recv(&p))
+		unsigned char aBuffer[NET_MAX_PACKETSIZE];
+		CNetPacketConstruct Packet;
+		NETADDR Addr;
+		int64 Now = time_get();
+
+		for(int i = 0; i < NumServers; i++)
 		{
-			if(p.m_ClientID == -1)
+			CFakeServer *pServer = &pServers[i];
+			int Bytes;
+			while((Bytes = net_udp_recv(pServer->m_Socket, &Addr, aBuffer, sizeof(aBuffer))) > 0)
+			{
+				if(CNetBase::UnpackPacket(aBuffer, Bytes, &Packet) == 0 && (Packet.m_Flags&NET_PACKETFLAG_CONNLESS))
+					ProcessPacket(pServer, &Addr, Packet.m_aChunkData, Packet.m_DataSize);
+			}
+
+			/* send heartbeats if needed */
+			if(pServer->m_NextHeartBeat < Now)
 			{
-				if(p.m_DataSize == sizeof(SERVERBROWSE_GETINFO) &&
-					mem_comp(p.m_pData, SERVERBROWSE_GETINFO, sizeof(SERVERBROWSE_GETINFO)) == 0)
-				{
-					SendServerInfo(&p.m_Address);
-				}
-				else if(p.m_DataSize == sizeof(SERVERBROWSE_FWCHECK) &&
-					mem_comp(p.m_pData, SERVERBROWSE_FWCHECK, sizeof(SERVERBROWSE_FWCHECK)) == 0)
-				{
-					SendFWCheckResponse(&p.m_Address);
-				}
+				pServer->m_NextHeartBeat = Now+time_freq()*(15+(rand()%15));
+				SendHeartBeats(pServer);
 			}
 		}
 
-		/* send heartbeats if needed */
-		if(NextHeartBeat < time_get())
+		if(RequestNeeded)
 		{
-			NextHeartBeat = time_get()+time_freq()*(15+(rand()%15));
-			SendHeartBeats();
+			// the first socket has a low number, which select can wait on
+			RequestNeeded = false;
+			RequestList(&pServers[0]);
 		}
 
-		thread_sleep(100);
+		if(NumRegistered < NumServers && Now-LastReport > time_freq()*5)
+		{
+			LastReport = Now;
+			dbg_msg("fake_server", "%d/%d servers registered", NumRegistered, NumServers);
+		}
+
+		thread_sleep(NumServers > 1 ? 10 : 100);
 	}
 }
 
 int main(int argc, char **argv)
 {
-	pNet = new CNetServer;
+	net_init();
+	CNetBase::Init();
 
 	while(argc)
 	{
-		// ?
-		/*if(str_comp(*argv, "-m") == 0)
+		if(str_comp(*argv, "-m") == 0 && NumMasters < 16)
 		{
 			argc--; argv++;
 			net_host_lookup(*argv, &aMasterServers[NumMasters], NETTYPE_IPV4);
@@ -163,7 +241,12 @@ int main(int argc, char **argv)
 			aMasterServers[NumMasters].port = str_toint(*argv);
 			NumMasters++;
 		}
-		else */if(str_comp(*argv, "-p") == 0)
+		else if(str_comp(*argv, "-s") == 0)
+		{
+			argc--; argv++;
+			NumServers = max(str_toint(*argv), 1);
+		}
+		else if(str_comp(*argv, "-p") == 0)
 		{
 			argc--; argv++;
 			PlayerNames[NumPlayers++] = *argv;
@@ -204,10 +287,13 @@ int main(int argc, char **argv)
 		argc--; argv++;
 	}
 
+	dbg_logger_stdout();
+	pServers = new CFakeServer[NumServers];
+
 	BuildInfoMsg();
 	int RunReturn = Run();
 
-	delete pNet;
+	delete [] pServers;
 	return RunReturn;
 }
 
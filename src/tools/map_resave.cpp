@@ -1,26 +1,21 @@
 /* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
 /* If you are missing that file, acquire a complete release at teeworlds.com.                */
 #include <base/system.h>
+#include <base/tl/array.h>
+#include <engine/engine.h>
 #include <engine/shared/datafile.h>
 #include <engine/storage.h>
 
-int main(int argc, const char **argv)
+static int Resave(IStorage *pStorage, const char *pSrcName, int StorageType, const char *pDstName, IEngine *pEngine)
 {
-	IStorage *pStorage = CreateStorage("Teeworlds", argc, argv);
 	int Index, ID = 0, Type = 0, Size;
 	void *pPtr;
-	char aFileName[1024];
 	CDataFileReader DataFile;
 	CDataFileWriter df;
 
-	if(!pStorage || argc != 3)
-		return -1;
-
-	str_format(aFileName, sizeof(aFileName), "maps/%s", argv[2]);
-
-	if(!DataFile.Open(pStorage, argv[1], IStorage::TYPE_ALL))
+	if(!DataFile.Open(pStorage, pSrcName, StorageType))
 		return -1;
-	if(!df.Open(pStorage, aFileName))
+	if(!df.Open(pStorage, pDstName))
 		return -1;
 
 	// add all items
@@ -35,11 +30,117 @@ int main(int argc, const char **argv)
 	for(Index = 0; Index < DataFile.NumData(); Index++)
 	{
 		pPtr = DataFile.GetData(Index);
-		Size = DataFile.GetDataSize(Index);
+		if(!pPtr)
+		{
+			// broken data can't be copied, drop the half written map instead
+			dbg_msg("map_resave", "failed to load data index=%d of '%s'", Index, pSrcName);
+			DataFile.Close();
+			df.Finish();
+			pStorage->RemoveFile(pDstName, IStorage::TYPE_SAVE);
+			return -1;
+		}
+		Size = DataFile.GetUncompressedDataSize(Index);
 		df.AddData(Size, pPtr);
+		DataFile.UnloadData(Index);
 	}
 
 	DataFile.Close();
-	df.Finish();
+	df.Finish(pEngine);
+	return 0;
+}
+
+struct CResaveJob
+{
+	CJob m_Job;
+	IStorage *m_pStorage;
+	int m_StorageType;
+	char m_aSrcName[512];
+	char m_aDstName[512];
+};
+
+struct CResaveDir
+{
+	IStorage *m_pStorage;
+	const char *m_pSrcDir;
+	const char *m_pDstDir;
+	array<CResaveJob *> m_lJobs;
+};
+
+static int ResaveJob(void *pUser)
+{
+	CResaveJob *pJob = (CResaveJob *)pUser;
+	// the files themselves are spread over the pool, so compress each one on its worker
+	int Result = Resave(pJob->m_pStorage, pJob->m_aSrcName, pJob->m_StorageType, pJob->m_aDstName, 0);
+	dbg_msg("map_resave", "%s '%s'", Result == 0 ? "resaved" : "failed to resave", pJob->m_aSrcName);
+	return Result;
+}
+
+static int ListdirCallback(const char *pName, int IsDir, int StorageType, void *pUser)
+{
+	CResaveDir *pDir = (CResaveDir *)pUser;
+	int Length = str_length(pName);
+	if(IsDir || Length < 4 || str_comp(pName+Length-4, ".map"))
+		return 0;
+
+	// the same map can show up in several storage paths, only the first one counts
+	char aSrcName[512];
+	str_format(aSrcName, sizeof(aSrcName), "%s/%s", pDir->m_pSrcDir, pName);
+	for(int i = 0; i < pDir->m_lJobs.size(); i++)
+		if(str_comp(pDir->m_lJobs[i]->m_aSrcName, aSrcName) == 0)
+			return 0;
+
+	CResaveJob *pJob = new CResaveJob;
+	pJob->m_pStorage = pDir->m_pStorage;
+	pJob->m_StorageType = StorageType;
+	str_copy(pJob->m_aSrcName, aSrcName, sizeof(pJob->m_aSrcName));
+	str_format(pJob->m_aDstName, sizeof(pJob->m_aDstName), "%s/%s", pDir->m_pDstDir, pName);
+	pDir->m_lJobs.add(pJob);
 	return 0;
 }
+
+int main(int argc, const char **argv)
+{
+	IStorage *pStorage = CreateStorage("Teeworlds", argc, argv);
+
+	if(!pStorage || (argc != 3 && !(argc == 4 && str_comp(argv[1], "-d") == 0)))
+	{
+		dbg_msg("map_resave", "usage: map_resave <source map> <destination name> | map_resave -d <source directory> <destination directory>");
+		return -1;
+	}
+
+	IEngine *pEngine = CreateEngine("Teeworlds");
+
+	if(argc == 3)
+	{
+		char aFileName[1024];
+		str_format(aFileName, sizeof(aFileName), "maps/%s", argv[2]);
+		return Resave(pStorage, argv[1], IStorage::TYPE_ALL, aFileName, pEngine);
+	}
+
+	// resave a whole directory, one map per job
+	CResaveDir Dir;
+	Dir.m_pStorage = pStorage;
+	Dir.m_pSrcDir = argv[2];
+	Dir.m_pDstDir = argv[3];
+	pStorage->ListDirectory(IStorage::TYPE_ALL, Dir.m_pSrcDir, ListdirCallback, &Dir);
+	if(!pStorage->CreateFolder(Dir.m_pDstDir, IStorage::TYPE_SAVE))
+	{
+		dbg_msg("map_resave", "failed to create directory '%s'", Dir.m_pDstDir);
+		return -1;
+	}
+
+	for(int i = 0; i < Dir.m_lJobs.size(); i++)
+		pEngine->AddJob(&Dir.m_lJobs[i]->m_Job, ResaveJob, Dir.m_lJobs[i]);
+
+	int NumFailed = 0;
+	for(int i = 0; i < Dir.m_lJobs.size(); i++)
+	{
+		Dir.m_lJobs[i]->m_Job.Wait();
+		if(Dir.m_lJobs[i]->m_Job.Result() != 0)
+			NumFailed++;
+		delete Dir.m_lJobs[i];
+	}
+
+	dbg_msg("map_resave", "resaved %d of %d maps", Dir.m_lJobs.size()-NumFailed, Dir.m_lJobs.size());
+	return NumFailed ? -1 : 0;
+}
@@ -6,6 +6,8 @@
 #include <engine/kernel.h>
 #include <engine/map.h>
 #include <engine/storage.h>
+#include <engine/shared/crcindex.h>
+#include <engine/shared/datafile.h>
 
 
 static IOHANDLE s_File = 0;
@@ -24,12 +26,9 @@ int MaplistCallback(const char *pName, int IsDir, int DirType, void *pUser)
 		return 0;
 
 	unsigned MapCrc = s_pEngineMap->Crc();
+	unsigned MapSize = s_pEngineMap->FileSize();
 	s_pEngineMap->Unload();
 
-	IOHANDLE MapFile = s_pStorage->OpenFile(aBuf, IOFLAG_READ, DirType);
-	unsigned MapSize = io_length(MapFile);
-	io_close(MapFile);
-
 	char aMapName[8];
 	str_copy(aMapName, pName, min((int)sizeof(aMapName),l-3));
 
@@ -53,6 +52,11 @@ int main(int argc, const char **argv) // ignore_convention
 	if(RegisterFail)
 		return -1;
 
+	// only maps that changed since the last run get hashed
+	CCrcIndex CrcIndex;
+	CrcIndex.Init(s_pStorage);
+	CDataFileReader::SetCrcIndex(&CrcIndex);
+
 	s_File = s_pStorage->OpenFile("map_version.txt", IOFLAG_WRITE, 1);
 	if(s_File)
 	{
@@ -62,5 +66,7 @@ int main(int argc, const char **argv) // ignore_convention
 		io_close(s_File);
 	}
 
+	CDataFileReader::SetCrcIndex(0);
+	CrcIndex.Save();
 	return 0;
 }
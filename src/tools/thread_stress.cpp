@@ -0,0 +1,397 @@
+/* (c) Magnus Auvinen. See licence.txt in the root of the distribution for more information. */
+/* If you are missing that file, acquire a complete release at teeworlds.com.                */
+#include <base/math.h>
+#include <base/system.h>
+
+/*
+	thread_stress hammers the threading primitives of base from several threads
+	at once and checks that nothing got lost on the way:
+
+	atomics		counters changed with atomic_inc/dec and compare_swap, and a spin
+				lock built on atomic_exchange guarding a plain counter
+	semaphores	items handed from producers to consumers, one signal each
+	condvars	a small bounded queue, waited on from both sides
+	tls			every thread keeps its own pointer and checks it stays its own
+
+	It returns 0 when all checks passed. Run it on every platform the threading
+	code changes for, the counts make races show up as wrong totals.
+*/
+
+enum
+{
+	MAX_THREADS=64,
+	QUEUE_SIZE=16,
+};
+
+static int s_NumThreads = 4;
+static int s_NumIterations = 200000;
+
+static void RunThreads(void (*pfnThread)(void *), void *pUser, int NumThreads)
+{
+	void *apThreads[MAX_THREADS];
+	for(int i = 0; i < NumThreads; i++)
+		apThreads[i] = thread_create(pfnThread, pUser);
+	for(int i = 0; i < NumThreads; i++)
+		thread_wait(apThreads[i]);
+}
+
+static bool Check(const char *pTest, long long Got, long long Expected)
+{
+	if(Got != Expected)
+	{
+		dbg_msg("thread_stress", "%s: FAILED, got %lld instead of %lld", pTest, Got, Expected);
+		return false;
+	}
+	return true;
+}
+
+// atomics
+struct CAtomicTest
+{
+	volatile int m_Inc;
+	volatile int m_Dec;
+	volatile int m_Swapped;
+	volatile int m_SpinLock;
+	int m_Guarded; // only touched while holding the spin lock
+	volatile int m_NextCpu;
+};
+
+static void AtomicThread(void *pUser)
+{
+	CAtomicTest *pTest = (CAtomicTest *)pUser;
+	thread_set_name("stress_atomic");
+
+	// spread the threads over the cpus, so the counters are really contended
+	int Cpu = atomic_inc(&pTest->m_NextCpu)-1;
+	thread_set_affinity(Cpu%cpu_count());
+
+	for(int i = 0; i < s_NumIterations; i++)
+	{
+		atomic_inc(&pTest->m_Inc);
+		atomic_dec(&pTest->m_Dec);
+
+		// a failed swap returns the current value, the next try starts from it
+		int Old = 0, Seen;
+		while((Seen = atomic_compare_swap(&pTest->m_Swapped, Old, Old+2)) != Old)
+			Old = Seen;
+
+		while(atomic_exchange(&pTest->m_SpinLock, 1))
+			thread_yield();
+		pTest->m_Guarded++;
+
+		// the release relies on the full barriers, which ThreadSanitizer doesn't model
+		sync_barrier();
+		atomic_exchange(&pTest->m_SpinLock, 0);
+	}
+}
+
+static bool TestAtomics()
+{
+	CAtomicTest Test;
+	mem_zero(&Test, sizeof(Test));
+	RunThreads(AtomicThread, &Test, s_NumThreads);
+
+	long long Expected = (long long)s_NumThreads*s_NumIterations;
+	bool Passed = Check("atomic_inc", Test.m_Inc, Expected);
+	Passed &= Check("atomic_dec", Test.m_Dec, -Expected);
+	Passed &= Check("atomic_compare_swap", Test.m_Swapped, Expected*2);
+	Passed &= Check("atomic_exchange", Test.m_Guarded, Expected);
+	return Passed;
+}
+
+// semaphores, every produced item is signaled once and every wait takes one
+struct CSemaphoreTest
+{
+	SEMAPHORE m_Items;
+	LOCK m_Lock;
+	int m_aItems[QUEUE_SIZE*MAX_THREADS]; // in the order they were pushed, the end markers come last
+	int m_First;
+	int m_NumItems;
+	volatile int m_NumProducers;
+	long long m_Sum;
+	int m_NumConsumed;
+	volatile int m_NextRole;
+};
+
+static void SemaphorePush(CSemaphoreTest *pTest, int Item)
+{
+	// wait for the consumers when the array is full
+	while(1)
+	{
+		lock_wait(pTest->m_Lock);
+		if(pTest->m_NumItems < QUEUE_SIZE*MAX_THREADS)
+			break;
+		lock_release(pTest->m_Lock);
+		thread_yield();
+	}
+	pTest->m_aItems[(pTest->m_First+pTest->m_NumItems)%(QUEUE_SIZE*MAX_THREADS)] = Item;
+	pTest->m_NumItems++;
+	lock_release(pTest->m_Lock);
+	semaphore_signal(pTest->m_Items);
+}
+
+static void SemaphoreProducer(CSemaphoreTest *pTest)
+{
+	for(int i = 1; i <= s_NumIterations/10; i++)
+		SemaphorePush(pTest, i);
+
+	// the last producer hands every consumer an end marker
+	if(atomic_dec(&pTest->m_NumProducers) == 0)
+	{
+		for(int i = 0; i < s_NumThreads; i++)
+			SemaphorePush(pTest, 0);
+	}
+}
+
+static void SemaphoreConsumer(CSemaphoreTest *pTest)
+{
+	while(1)
+	{
+		semaphore_wait(pTest->m_Items);
+		lock_wait(pTest->m_Lock);
+		dbg_assert(pTest->m_NumItems > 0, "semaphore signaled without an item");
+		int Item = pTest->m_aItems[pTest->m_First];
+		pTest->m_First = (pTest->m_First+1)%(QUEUE_SIZE*MAX_THREADS);
+		pTest->m_NumItems--;
+		if(Item)
+		{
+			pTest->m_Sum += Item;
+			pTest->m_NumConsumed++;
+		}
+		lock_release(pTest->m_Lock);
+		if(!Item)
+			break;
+	}
+}
+
+static void SemaphoreThread(void *pUser)
+{
+	// half of the threads produce, the other half consumes
+	CSemaphoreTest *pTest = (CSemaphoreTest *)pUser;
+	if(atomic_inc(&pTest->m_NextRole)%2)
+	{
+		thread_set_name("stress_sem_prod");
+		SemaphoreProducer(pTest);
+	}
+	else
+	{
+		thread_set_name("stress_sem_cons");
+		SemaphoreConsumer(pTest);
+	}
+}
+
+static bool TestSemaphores()
+{
+	CSemaphoreTest Test;
+	Test.m_Items = semaphore_create();
+	Test.m_Lock = lock_create();
+	Test.m_First = 0;
+	Test.m_NumItems = 0;
+	Test.m_NumProducers = s_NumThreads;
+	Test.m_Sum = 0;
+	Test.m_NumConsumed = 0;
+	Test.m_NextRole = 0;
+
+	// as many producers as consumers
+	RunThreads(SemaphoreThread, &Test, s_NumThreads*2);
+
+	long long PerProducer = s_NumIterations/10;
+	bool Passed = Check("semaphore items", Test.m_NumConsumed, PerProducer*s_NumThreads);
+	Passed &= Check("semaphore sum", Test.m_Sum, PerProducer*(PerProducer+1)/2*s_NumThreads);
+	Passed &= Check("semaphore leftovers", Test.m_NumItems, 0);
+
+	lock_destroy(Test.m_Lock);
+	semaphore_destroy(Test.m_Items);
+	return Passed;
+}
+
+// condition variables, a bounded queue where both sides wait
+struct CCondvarTest
+{
+	LOCK m_Lock;
+	CONDVAR m_NotEmpty;
+	CONDVAR m_NotFull;
+	int m_aQueue[QUEUE_SIZE];
+	int m_First;
+	int m_Size;
+	int m_NumProducers;
+	long long m_Sum;
+	int m_NumConsumed;
+	volatile int m_NextRole;
+};
+
+static void CondvarProducer(CCondvarTest *pTest)
+{
+	for(int i = 1; i <= s_NumIterations/10; i++)
+	{
+		lock_wait(pTest->m_Lock);
+		while(pTest->m_Size == QUEUE_SIZE)
+			condvar_wait(pTest->m_NotFull, pTest->m_Lock);
+		pTest->m_aQueue[(pTest->m_First+pTest->m_Size)%QUEUE_SIZE] = i;
+		pTest->m_Size++;
+		condvar_signal(pTest->m_NotEmpty);
+		lock_release(pTest->m_Lock);
+	}
+
+	// the consumers stop once the queue is empty and no producer is left
+	lock_wait(pTest->m_Lock);
+	if(--pTest->m_NumProducers == 0)
+		condvar_broadcast(pTest->m_NotEmpty);
+	lock_release(pTest->m_Lock);
+}
+
+static void CondvarConsumer(CCondvarTest *pTest)
+{
+	lock_wait(pTest->m_Lock);
+	while(1)
+	{
+		while(pTest->m_Size == 0 && pTest->m_NumProducers > 0)
+			condvar_wait(pTest->m_NotEmpty, pTest->m_Lock);
+		if(pTest->m_Size == 0)
+			break;
+		pTest->m_Sum += pTest->m_aQueue[pTest->m_First];
+		pTest->m_First = (pTest->m_First+1)%QUEUE_SIZE;
+		pTest->m_Size--;
+		pTest->m_NumConsumed++;
+		condvar_signal(pTest->m_NotFull);
+	}
+	lock_release(pTest->m_Lock);
+}
+
+static void CondvarThread(void *pUser)
+{
+	CCondvarTest *pTest = (CCondvarTest *)pUser;
+	if(atomic_inc(&pTest->m_NextRole)%2)
+	{
+		thread_set_name("stress_cv_prod");
+		CondvarProducer(pTest);
+	}
+	else
+	{
+		thread_set_name("stress_cv_cons");
+		CondvarConsumer(pTest);
+	}
+}
+
+static bool TestCondvars()
+{
+	CCondvarTest Test;
+	Test.m_Lock = lock_create();
+	Test.m_NotEmpty = condvar_create();
+	Test.m_NotFull = condvar_create();
+	Test.m_First = 0;
+	Test.m_Size = 0;
+	Test.m_NumProducers = s_NumThreads;
+	Test.m_Sum = 0;
+	Test.m_NumConsumed = 0;
+	Test.m_NextRole = 0;
+
+	RunThreads(CondvarThread, &Test, s_NumThreads*2);
+
+	long long PerProducer = s_NumIterations/10;
+	bool Passed = Check("condvar items", Test.m_NumConsumed, PerProducer*s_NumThreads);
+	Passed &= Check("condvar sum", Test.m_Sum, PerProducer*(PerProducer+1)/2*s_NumThreads);
+
+	condvar_destroy(Test.m_NotFull);
+	condvar_destroy(Test.m_NotEmpty);
+	lock_destroy(Test.m_Lock);
+	return Passed;
+}
+
+// thread local storage, every thread points its slot at its own counter
+struct CTlsTest
+{
+	TLSKEY m_Key;
+	volatile int m_NumWrong;
+	volatile int m_NumUnset;
+};
+
+static void TlsThread(void *pUser)
+{
+	CTlsTest *pTest = (CTlsTest *)pUser;
+	thread_set_name("stress_tls");
+
+	// a new thread starts out with nothing set
+	if(tls_get(pTest->m_Key) != 0)
+		atomic_inc(&pTest->m_NumUnset);
+
+	int Own = 0;
+	tls_set(pTest->m_Key, &Own);
+	for(int i = 0; i < s_NumIterations/10; i++)
+	{
+		int *pOwn = (int *)tls_get(pTest->m_Key);
+		if(pOwn != &Own)
+			atomic_inc(&pTest->m_NumWrong);
+		else
+			(*pOwn)++;
+		if(i%64 == 0)
+			thread_yield();
+	}
+	if(Own != s_NumIterations/10)
+		atomic_inc(&pTest->m_NumWrong);
+}
+
+static bool TestTls()
+{
+	CTlsTest Test;
+	Test.m_Key = tls_create();
+	Test.m_NumWrong = 0;
+	Test.m_NumUnset = 0;
+
+	// the main thread's value must not leak into the others either
+	int Main = 0;
+	tls_set(Test.m_Key, &Main);
+	RunThreads(TlsThread, &Test, s_NumThreads);
+
+	bool Passed = Check("tls foreign values", Test.m_NumWrong, 0);
+	Passed &= Check("tls initial values", Test.m_NumUnset, 0);
+	Passed &= Check("tls main thread", tls_get(Test.m_Key) == &Main, 1);
+
+	tls_destroy(Test.m_Key);
+	return Passed;
+}
+
+int main(int argc, const char **argv) // ignore_convention
+{
+	dbg_logger_stdout();
+
+	s_NumThreads = max(cpu_count(), 2);
+	for(int Arg = 1; Arg < argc; Arg++)
+	{
+		if(str_comp(argv[Arg], "-t") == 0 && Arg+1 < argc)
+			s_NumThreads = str_toint(argv[++Arg]);
+		else if(str_comp(argv[Arg], "-n") == 0 && Arg+1 < argc)
+			s_NumIterations = str_toint(argv[++Arg]);
+		else
+		{
+			dbg_msg("thread_stress", "usage: thread_stress [-t <threads>] [-n <iterations>]");
+			return -1;
+		}
+	}
+	s_NumThreads = clamp(s_NumThreads, 1, MAX_THREADS/2);
+	s_NumIterations = max(s_NumIterations, 10);
+
+	struct
+	{
+		const char *m_pName;
+		bool (*m_pfnTest)();
+	} aTests[] = {
+		{"atomics", TestAtomics},
+		{"semaphores", TestSemaphores},
+		{"condvars", TestCondvars},
+		{"tls", TestTls},
+	};
+
+	dbg_msg("thread_stress", "%d threads, %d iterations, %d cpus", s_NumThreads, s_NumIterations, cpu_count());
+	int NumFailed = 0;
+	for(unsigned i = 0; i < sizeof(aTests)/sizeof(aTests[0]); i++)
+	{
+		int64 StartTime = time_get();
+		bool Passed = aTests[i].m_pfnTest();
+		dbg_msg("thread_stress", "%s: %s in %.2fms", aTests[i].m_pName, Passed ? "passed" : "FAILED",
+			(time_get()-StartTime)*1000.0f/time_freq());
+		if(!Passed)
+			NumFailed++;
+	}
+	return NumFailed ? -1 : 0;
+}